@@ -0,0 +1,260 @@
+/*
+ * aes.cpp: class Aes implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "aes.hh"
+#include <string.h>
+#include <assert.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KRYPTOCD_AES_NI
+#include <cpuid.h>
+#include <wmmintrin.h>
+#endif
+
+using KryptoCD::Aes;
+
+/**
+ * the S-box and the encryption tables, computed once at startup
+ */
+struct AesTables {
+    unsigned char sbox[256];
+
+    /**
+     * te[0][x] is the MixColumns column of the S-box value of x in the
+     * first row, te[1..3] are its rotations for the other rows
+     */
+    unsigned long te[4][256];
+
+    bool aesInstructions;
+
+    /**
+     * multiplication by x in GF(2^8)
+     */
+    static unsigned char xtime(unsigned char a) {
+        return static_cast<unsigned char>((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+    }
+
+    AesTables() {
+        /*
+         * walk through the field with the generator 3, so that p is 3^i
+         * and q is its inverse 3^-i
+         */
+        unsigned char p = 1;
+        unsigned char q = 1;
+        do {
+            p = p ^ xtime(p);
+            q ^= q << 1;
+            q ^= q << 2;
+            q ^= q << 4;
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            unsigned char s = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3)
+                ^ rotl8(q, 4);
+            sbox[p] = s ^ 0x63;
+        } while (p != 1);
+        sbox[0] = 0x63;
+
+        for (int x = 0; x < 256; ++x) {
+            unsigned char s = sbox[x];
+            unsigned char s2 = xtime(s);
+            unsigned long column = (static_cast<unsigned long>(s2) << 24)
+                | (static_cast<unsigned long>(s) << 16)
+                | (static_cast<unsigned long>(s) << 8)
+                | static_cast<unsigned long>(s2 ^ s);
+            for (int row = 0; row < 4; ++row) {
+                te[row][x] = column;
+                column = ((column >> 8) | (column << 24)) & 0xffffffffUL;
+            }
+        }
+
+        aesInstructions = false;
+#ifdef KRYPTOCD_AES_NI
+        unsigned eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            aesInstructions = (ecx & bit_AES) != 0;
+        }
+#endif
+    }
+
+    static unsigned char rotl8(unsigned char x, int r) {
+        return static_cast<unsigned char>((x << r) | (x >> (8 - r)));
+    }
+};
+static const AesTables TABLES;
+
+static inline unsigned long subWord(unsigned long w) {
+    return (static_cast<unsigned long>(TABLES.sbox[(w >> 24) & 0xff]) << 24)
+        | (static_cast<unsigned long>(TABLES.sbox[(w >> 16) & 0xff]) << 16)
+        | (static_cast<unsigned long>(TABLES.sbox[(w >> 8) & 0xff]) << 8)
+        | static_cast<unsigned long>(TABLES.sbox[w & 0xff]);
+}
+
+static inline unsigned long load32(const unsigned char * p) {
+    return (static_cast<unsigned long>(p[0]) << 24)
+        | (static_cast<unsigned long>(p[1]) << 16)
+        | (static_cast<unsigned long>(p[2]) << 8)
+        | static_cast<unsigned long>(p[3]);
+}
+
+static inline void store32(unsigned char * p, unsigned long w) {
+    p[0] = static_cast<unsigned char>(w >> 24);
+    p[1] = static_cast<unsigned char>(w >> 16);
+    p[2] = static_cast<unsigned char>(w >> 8);
+    p[3] = static_cast<unsigned char>(w);
+}
+
+#ifdef KRYPTOCD_AES_NI
+__attribute__((target("aes,sse2")))
+static void encryptBlockNi(const unsigned char * roundKeys, int rounds,
+                           const unsigned char * in, unsigned char * out) {
+    const __m128i * keys = reinterpret_cast<const __m128i *>(roundKeys);
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    block = _mm_xor_si128(block, _mm_loadu_si128(keys));
+    for (int round = 1; round < rounds; ++round) {
+        block = _mm_aesenc_si128(block, _mm_loadu_si128(keys + round));
+    }
+    block = _mm_aesenclast_si128(block, _mm_loadu_si128(keys + rounds));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), block);
+}
+#endif
+
+Aes::Aes(const unsigned char * key, size_t keyLength) {
+    assert((keyLength == 16) || (keyLength == 24) || (keyLength == 32));
+    int keyWords = keyLength / 4;
+    rounds = keyWords + 6;
+
+    int words = 4 * (rounds + 1);
+    unsigned long rcon = 0x01;
+    for (int i = 0; i < words; ++i) {
+        if (i < keyWords) {
+            roundKeys[i] = load32(key + 4 * i);
+            continue;
+        }
+        unsigned long temp = roundKeys[i - 1];
+        if (i % keyWords == 0) {
+            temp = subWord(((temp << 8) | (temp >> 24)) & 0xffffffffUL)
+                ^ (rcon << 24);
+            rcon = AesTables::xtime(static_cast<unsigned char>(rcon));
+        } else if ((keyWords > 6) && (i % keyWords == 4)) {
+            temp = subWord(temp);
+        }
+        roundKeys[i] = roundKeys[i - keyWords] ^ temp;
+    }
+    for (int i = 0; i < words; ++i) {
+        store32(roundKeyBytes + 4 * i, roundKeys[i]);
+    }
+}
+
+Aes::~Aes() {
+    /* the key schedule reveals the key */
+    volatile unsigned char * bytes =
+        reinterpret_cast<volatile unsigned char *>(roundKeys);
+    for (size_t i = 0; i < sizeof(roundKeys); ++i) {
+        bytes[i] = 0;
+    }
+    bytes = roundKeyBytes;
+    for (size_t i = 0; i < sizeof(roundKeyBytes); ++i) {
+        bytes[i] = 0;
+    }
+}
+
+bool Aes::hasAesInstructions(void) {
+    return TABLES.aesInstructions;
+}
+
+void Aes::encryptBlock(const unsigned char in[BLOCK_SIZE],
+                       unsigned char out[BLOCK_SIZE]) const {
+#ifdef KRYPTOCD_AES_NI
+    if (TABLES.aesInstructions) {
+        encryptBlockNi(roundKeyBytes, rounds, in, out);
+        return;
+    }
+#endif
+    const unsigned long (* te)[256] = TABLES.te;
+    const unsigned long * rk = roundKeys;
+    unsigned long s0 = load32(in) ^ rk[0];
+    unsigned long s1 = load32(in + 4) ^ rk[1];
+    unsigned long s2 = load32(in + 8) ^ rk[2];
+    unsigned long s3 = load32(in + 12) ^ rk[3];
+
+    for (int round = 1; round < rounds; ++round) {
+        rk += 4;
+        unsigned long t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff]
+            ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ rk[0];
+        unsigned long t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff]
+            ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ rk[1];
+        unsigned long t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff]
+            ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ rk[2];
+        unsigned long t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff]
+            ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    /* the last round has no MixColumns */
+    rk += 4;
+    const unsigned char * sbox = TABLES.sbox;
+    store32(out, ((static_cast<unsigned long>(sbox[s0 >> 24]) << 24)
+                  | (static_cast<unsigned long>(sbox[(s1 >> 16) & 0xff]) << 16)
+                  | (static_cast<unsigned long>(sbox[(s2 >> 8) & 0xff]) << 8)
+                  | static_cast<unsigned long>(sbox[s3 & 0xff])) ^ rk[0]);
+    store32(out + 4, ((static_cast<unsigned long>(sbox[s1 >> 24]) << 24)
+                  | (static_cast<unsigned long>(sbox[(s2 >> 16) & 0xff]) << 16)
+                  | (static_cast<unsigned long>(sbox[(s3 >> 8) & 0xff]) << 8)
+                  | static_cast<unsigned long>(sbox[s0 & 0xff])) ^ rk[1]);
+    store32(out + 8, ((static_cast<unsigned long>(sbox[s2 >> 24]) << 24)
+                  | (static_cast<unsigned long>(sbox[(s3 >> 16) & 0xff]) << 16)
+                  | (static_cast<unsigned long>(sbox[(s0 >> 8) & 0xff]) << 8)
+                  | static_cast<unsigned long>(sbox[s1 & 0xff])) ^ rk[2]);
+    store32(out + 12, ((static_cast<unsigned long>(sbox[s3 >> 24]) << 24)
+                  | (static_cast<unsigned long>(sbox[(s0 >> 16) & 0xff]) << 16)
+                  | (static_cast<unsigned long>(sbox[(s1 >> 8) & 0xff]) << 8)
+                  | static_cast<unsigned long>(sbox[s2 & 0xff])) ^ rk[3]);
+}
+
+void Aes::cfbEncrypt(unsigned char * data, size_t length) const {
+    unsigned char feedback[BLOCK_SIZE] = {0};
+    for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+        encryptBlock(feedback, feedback);
+        for (size_t i = 0; (i < BLOCK_SIZE) && (done + i < length); ++i) {
+            data[done + i] ^= feedback[i];
+            feedback[i] = data[done + i];
+        }
+    }
+}
+
+void Aes::cfbDecrypt(unsigned char * data, size_t length) const {
+    unsigned char feedback[BLOCK_SIZE] = {0};
+    for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+        encryptBlock(feedback, feedback);
+        for (size_t i = 0; (i < BLOCK_SIZE) && (done + i < length); ++i) {
+            unsigned char c = data[done + i];
+            data[done + i] ^= feedback[i];
+            feedback[i] = c;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * aes.hh: class Aes header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef AES_HH
+#define AES_HH
+
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * Class Aes encrypts 16 byte blocks with the AES block cipher, as
+     * defined in FIPS 197, with 128, 192 or 256 bit keys. Only encryption
+     * is implemented, since OpenPGP uses the cipher in CFB mode, see
+     * PgpEncrypter.
+     * <p>
+     * On x86 processors with the AES instructions, these are used.
+     * Otherwise, the usual lookup tables combine SubBytes, ShiftRows and
+     * MixColumns into four table lookups per column and round.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Aes {
+    public:
+        /**
+         * the length of a block in bytes
+         */
+        static const unsigned BLOCK_SIZE = 16;
+
+        /**
+         * expands the key
+         *
+         * @param key       the key
+         * @param keyLength the length of the key in bytes: 16, 24 or 32
+         */
+        Aes(const unsigned char * key, size_t keyLength);
+
+        /**
+         * clears the expanded key
+         */
+        ~Aes();
+
+        /**
+         * encrypts one block. in and out may be the same.
+         */
+        void encryptBlock(const unsigned char in[BLOCK_SIZE],
+                          unsigned char out[BLOCK_SIZE]) const;
+
+        /**
+         * encrypts a short buffer in place, in plain CFB mode with an IV
+         * of zeros, as OpenPGP encrypts session keys
+         */
+        void cfbEncrypt(unsigned char * data, size_t length) const;
+
+        /**
+         * decrypts what cfbEncrypt() encrypted, in place
+         */
+        void cfbDecrypt(unsigned char * data, size_t length) const;
+
+        /**
+         * @return true if the processor's AES instructions are used
+         */
+        static bool hasAesInstructions(void);
+
+    private:
+        /**
+         * Gcm's vector kernels use the round keys directly
+         */
+        friend class Gcm;
+
+        /**
+         * the number of rounds: 10, 12 or 14
+         */
+        int rounds;
+
+        /**
+         * the round keys as 32 bit words, most significant byte first
+         */
+        unsigned long roundKeys[4 * 15];
+
+        /**
+         * the round keys as bytes, for the AES instructions
+         */
+        unsigned char roundKeyBytes[16 * 15];
+    };
+}
+#endif
@@ -22,43 +22,170 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "archive_creator.hh"
-#include "tar_creator.hh"
-#include "bzip2.hh"
-#include "gpg.hh"
 #include "pipe.hh"
+#include "dedup_filter.hh"
+#include <assert.h>
 
 using KryptoCD::ArchiveCreator;
-using KryptoCD::TarCreator;
-using KryptoCD::Bzip2;
-using KryptoCD::Gpg;
+using KryptoCD::TarWriter;
+using KryptoCD::SegmentedBzip2;
+using KryptoCD::Encrypter;
+using KryptoCD::ChunkIndex;
+using KryptoCD::DedupFilter;
+using KryptoCD::Pipe;
+using KryptoCD::PathStore;
+using KryptoCD::PathSlice;
+using KryptoCD::PathList;
 using std::string;
-using std::list;
+using std::vector;
 
-ArchiveCreator::ArchiveCreator(const string & tarExecutable,
-                               const string & bzip2Executable,
-                               const string & gpgExecutable,
-                               const list<string> & files,
+/**
+ * the block size of bzip2 -1. The chunk stream is compressed in segments
+ * of one block, so a cut archive is known to hold the chunks up to the
+ * last segment start before the cut, see getTarBytes().
+ */
+static const unsigned BZIP2_BLOCK_SIZE = 100 * 1000;
+
+ArchiveCreator::ArchiveCreator(const string & bzip2Executable,
+                               const PathStore & paths,
+                               const PathSlice & files,
+                               int compression,
+                               const string & password,
+                               Encrypter::Format format_,
+                               Sink & sink)
+    : dedupFilter(0),
+      recipeEncrypter(0),
+      format(format_)
+{
+    /* this pipe stays open in this process, for the tar writing thread: */
+    tarPipe = new Pipe;
+    Pipe bzip2ToEncrypter;
+
+    segmentedCompressor = new SegmentedBzip2(bzip2Executable, compression,
+                                             *tarPipe, bzip2ToEncrypter);
+    encrypter       = Encrypter::create(format, password,
+                                        bzip2ToEncrypter, sink);
+    tarWriter       = new TarWriter(paths, files, *tarPipe);
+}
+
+ArchiveCreator::ArchiveCreator(const string & bzip2Executable,
+                               const PathStore & paths,
+                               const PathSlice & files,
                                int compression,
                                const string & password,
-                               Sink & sink) {
-    Pipe tarToBzip2;
-    Pipe Bzip2ToGpg;
-
-    tarCreator      = new TarCreator(tarExecutable, files, tarToBzip2);
-    bzip2Compressor = new Bzip2(bzip2Executable, compression,
-                                tarToBzip2, Bzip2ToGpg);
-    gpgEncrypter    = new Gpg(gpgExecutable, password, Gpg::ENCRYPT,
-                              Bzip2ToGpg, sink);
+                               Encrypter::Format format_,
+                               ChunkIndex & index,
+                               const string & imageId,
+                               Sink & sink,
+                               Sink & recipeSink)
+    : tarPipe(0),
+      format(format_)
+{
+    /* these pipes stay open in this process, for the dedup thread: */
+    Pipe * tarToDedup = new Pipe;
+    Pipe * dedupToBzip2 = new Pipe;
+    Pipe * dedupToRecipeEncrypter = new Pipe;
+    Pipe bzip2ToEncrypter;
+
+    segmentedCompressor = new SegmentedBzip2(bzip2Executable, compression,
+                                             *dedupToBzip2, bzip2ToEncrypter,
+                                             compression * BZIP2_BLOCK_SIZE);
+    encrypter       = Encrypter::create(format, password,
+                                        bzip2ToEncrypter, sink);
+    recipeEncrypter = Encrypter::create(format, password,
+                                        *dedupToRecipeEncrypter, recipeSink);
+    dedupFilter     = new DedupFilter(index, imageId, tarToDedup,
+                                      dedupToBzip2, dedupToRecipeEncrypter);
+    tarWriter       = new TarWriter(paths, files, *tarToDedup);
 }
 
 ArchiveCreator::~ArchiveCreator() {
-    delete tarCreator;
-    delete bzip2Compressor;
-    delete gpgEncrypter;
+    delete segmentedCompressor;
+    /*
+     * the threads stop at the end of their input, or when their readers
+     * are gone. The dedup filter deletes the pipe from the tar writer.
+     */
+    delete encrypter;
+    delete dedupFilter;
+    delete recipeEncrypter;
+    delete tarWriter;
+    delete tarPipe;
 }
 
 void ArchiveCreator::wait(void) {
-    tarCreator->wait();
-    bzip2Compressor->wait();
-    gpgEncrypter->wait();
+    tarWriter->wait();
+    if (dedupFilter != 0) {
+        dedupFilter->join();
+    }
+    segmentedCompressor->wait();
+    encrypter->wait();
+    if (recipeEncrypter != 0) {
+        recipeEncrypter->wait();
+    }
+}
+
+void ArchiveCreator::stop(void) {
+    segmentedCompressor->stop();
+    encrypter->wait();
+    if (dedupFilter != 0) {
+        dedupFilter->join();
+        recipeEncrypter->wait();
+    }
+    tarWriter->wait();
+}
+
+bool ArchiveCreator::tarFailed(void) {
+    return tarWriter->filesFailed();
+}
+
+const vector<TarWriter::Member> & ArchiveCreator::getMembers(void) const {
+    return tarWriter->getMembers();
+}
+
+const PathList & ArchiveCreator::getLeftOut(void) const {
+    return tarWriter->getLeftOut();
+}
+
+const vector<SegmentedBzip2::Segment> &
+ArchiveCreator::getSegments(void) const {
+    static const vector<SegmentedBzip2::Segment> none;
+    if (dedupFilter != 0) {
+        return none;
+    }
+    return segmentedCompressor->getSegments();
+}
+
+long long ArchiveCreator::getTarBytes(long long archiveBytes) const {
+    assert(dedupFilter != 0);
+
+    /* the most compressed bytes whose encryption fits: */
+    long long low = 0;
+    long long high = archiveBytes;
+    while (low < high) {
+        long long middle = low + (high - low + 1) / 2;
+        if (Encrypter::encryptedSize(format, middle) <= archiveBytes) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    /* the segments before the last one that starts there are complete: */
+    const vector<SegmentedBzip2::Segment> & segments =
+        segmentedCompressor->getSegments();
+    long long chunkBytes = 0;
+    for (vector<SegmentedBzip2::Segment>::const_iterator iter =
+             segments.begin();
+         (iter != segments.end()) && (iter->compressedOffset <= low);
+         ++iter) {
+        chunkBytes = iter->plainOffset;
+    }
+    return dedupFilter->getTarBytes(chunkBytes);
+}
+
+bool ArchiveCreator::exitedAbnormally(void) {
+    return tarWriter->exitedAbnormally()
+        || segmentedCompressor->exitedAbnormally()
+        || encrypter->exitedAbnormally()
+        || ((recipeEncrypter != 0) && recipeEncrypter->exitedAbnormally());
 }
@@ -25,20 +25,27 @@
 #ifndef ARCHIVE_CREATOR_HH
 #define ARCHIVE_CREATOR_HH
 
-#include <list>
+#include "path_store.hh"
+#include "tar_writer.hh"
+#include "encrypter.hh"
+#include "segmented_bzip2.hh"
 #include <string>
+#include <vector>
 
 namespace KryptoCD {
-    class TarCreator;
-    class Bzip2;
-    class Gpg;
+    class Pipe;
     class Sink;
+    class ChunkIndex;
+    class DedupFilter;
 
     /**
      * Class ArchiveCreator creates an encrypted compressed tar archive from a
      * list of filenames.
-     * It uses the classes TarCreator, Bzip2, Gpg
-     * The created archive is sent to a Sink.
+     * It uses the classes TarWriter, SegmentedBzip2, Encrypter
+     * The created archive is sent to a Sink. The TarWriter records what
+     * went into the archive, see getMembers() and getLeftOut(), and the
+     * SegmentedBzip2 where the independently compressed segments start,
+     * see getSegments().
      *
      * @author Tobias Peters
      * @version $Revision: 1.2 $ $Date: 2001/05/19 21:53:09 $
@@ -46,41 +53,131 @@ namespace KryptoCD {
     class ArchiveCreator {
     public:
         /**
-         * Create tar, bzip2 and gpg child processes.
+         * Create a TarWriter thread, a SegmentedBzip2 thread, and an
+         * Encrypter thread.
          * The encrypted, compressed tar archive will be sent to the given
          * sink.
          *
-         * @param tarExecutable   A string containing the filesystem location
-         *                        of the GNU tar executable.
          * @param bzip2Executable the location of the bzip2 executable file
-         * @param gpgExecutable   the location of the GNU privacy guard
-         *                        executable file
-         * @param files           A list of absolute filenames that should go
-         *                        into the archive.
+         * @param paths           the store containing the filenames
+         * @param files           the absolute filenames that should go
+         *                        into the archive. Store and list must not
+         *                        change while this object exists.
          * @param compression     the level of compression that bzip2 uses
          *                        when compressing data. Valid compression
          *                        levels are 1,2,...,9.
          * @param password        the password to use for encryption
+         * @param format          the format of the encrypted archive
          * @param sink            the sink where the archive is sent to. This
          *                        constructor will call sink.closeSink() in
          *                        this process.
          */
-        ArchiveCreator(const std::string & tarExecutable,
-                       const std::string & bzip2Executable,
-                       const std::string & gpgExecutable,
-                       const std::list<std::string> & files,
+        ArchiveCreator(const std::string & bzip2Executable,
+                       const PathStore & paths,
+                       const PathSlice & files,
                        int compression,
                        const string & password,
+                       Encrypter::Format format,
                        Sink & sink);
 
+        /**
+         * Create a TarWriter, a SegmentedBzip2, an Encrypter, and a
+         * DedupFilter between the TarWriter and the SegmentedBzip2, so that
+         * only chunks not yet stored in an earlier image are compressed and
+         * encrypted. The chunk stream is compressed in segments of one
+         * bzip2 block, so that getTarBytes() knows closely what a cut
+         * archive holds. The recipe that restore needs to rebuild the tar
+         * stream is encrypted by a second Encrypter.
+         *
+         * @param index       the chunks stored so far. The new chunks are
+         *                    added to it. If the archive is not used in the
+         *                    end, the caller has to call
+         *                    index.forgetImage(imageId).
+         * @param imageId     the id of the image the archive goes to
+         * @param sink        the encrypted chunk stream is sent here, to be
+         *                    stored as DedupFilter::CHUNKS_FILENAME
+         * @param recipeSink  the encrypted recipe is sent here, to be stored
+         *                    as DedupFilter::RECIPE_FILENAME
+         * The other parameters are those of the first constructor.
+         */
+        ArchiveCreator(const std::string & bzip2Executable,
+                       const PathStore & paths,
+                       const PathSlice & files,
+                       int compression,
+                       const string & password,
+                       Encrypter::Format format,
+                       ChunkIndex & index,
+                       const std::string & imageId,
+                       Sink & sink,
+                       Sink & recipeSink);
+
         ~ArchiveCreator();
 
         void wait();
 
+        /**
+         * kills bzip2, if it is still running, and waits for the threads.
+         * Afterwards, getMembers() and getLeftOut() describe the part of
+         * the archive that has been written. If the sinks are pipes, their
+         * readers have to read them to the end, or close them, first.
+         */
+        void stop(void);
+
+        /**
+         * @return true if a file could not be stored, e.g. because it
+         *         could not be read, or it changed while it was read. Only
+         *         meaningful after wait().
+         */
+        bool tarFailed(void);
+
+        /**
+         * @return where the stored files are in the tar stream. Only
+         *         meaningful after wait().
+         */
+        const std::vector<TarWriter::Member> & getMembers(void) const;
+
+        /**
+         * @return the files that could not be stored. Only meaningful
+         *         after wait().
+         */
+        const PathList & getLeftOut(void) const;
+
+        /**
+         * @return where the compressed segments start, see SegmentedBzip2.
+         *         Empty for archives with a DedupFilter, whose compressed
+         *         data is not the tar stream. Only meaningful after wait().
+         */
+        const std::vector<SegmentedBzip2::Segment> & getSegments(void) const;
+
+        /**
+         * for archives with a DedupFilter: how much of the tar stream an
+         * archive cut after some bytes holds
+         *
+         * @param archiveBytes the length of the stored part of the
+         *                     encrypted chunk stream
+         * @return             the length of the beginning of the tar
+         *                     stream that can be rebuilt from the
+         *                     completely stored segments of the chunk
+         *                     stream, and the chunks of earlier images.
+         *                     Only meaningful after wait() or stop().
+         */
+        long long getTarBytes(long long archiveBytes) const;
+
+        /**
+         * @return true if bzip2 exited with an error, or the archive could
+         *         not be written completely, e.g. because the disk is full.
+         *         Only meaningful after wait().
+         */
+        bool exitedAbnormally(void);
+
     private:
-        TarCreator * tarCreator;
-        Bzip2      * bzip2Compressor;
-        Gpg        * gpgEncrypter;
+        TarWriter    * tarWriter;
+        Pipe         * tarPipe;
+        DedupFilter  * dedupFilter;
+        SegmentedBzip2 * segmentedCompressor;
+        Encrypter    * encrypter;
+        Encrypter    * recipeEncrypter;
+        Encrypter::Format format;
     };
 }
 
@@ -25,37 +25,42 @@
 #include "archive_lister.hh"
 #include "tar_lister.hh"
 #include "bzip2.hh"
-#include "gpg.hh"
+#include "decrypter.hh"
 #include "pipe.hh"
 
 using KryptoCD::ArchiveLister;
 using KryptoCD::TarLister;
 using KryptoCD::Bzip2;
-using KryptoCD::Gpg;
+using KryptoCD::Decrypter;
+using KryptoCD::Encrypter;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
 using std::string;
-using std::list;
 
-ArchiveLister::ArchiveLister(const std::string & tarExecutable,
-                             const std::string & bzip2Executable,
-                             const std::string & gpgExecutable,
+ArchiveLister::ArchiveLister(const std::string & bzip2Executable,
                              const string & password,
+                             Encrypter::Format format,
                              Source & source) {
-    Pipe gpgToBzip2;
+    Pipe decrypterToBzip2;
     Pipe bzip2ToTar;
 
-    gpgDecrypter  = new Gpg(gpgExecutable, password, Gpg::DECRYPT,
-                            source, gpgToBzip2);
+    decrypter     = Decrypter::create(format, password,
+                                      source, decrypterToBzip2);
     bzip2Inflator = new Bzip2(bzip2Executable, -1, // -1 == decompress
-                              gpgToBzip2, bzip2ToTar);
-    tarLister     = new TarLister(tarExecutable, bzip2ToTar);
+                              decrypterToBzip2, bzip2ToTar);
+    tarLister     = new TarLister(bzip2ToTar);
 }
 
 ArchiveLister::~ArchiveLister() {
-    delete gpgDecrypter;
+    delete decrypter;
     delete bzip2Inflator;
     delete tarLister;
 }
 
-const list<string> & ArchiveLister::getFileList() const {
+const PathList & ArchiveLister::getFileList() const {
     return tarLister->getFileList();
 }
+
+const PathStore & ArchiveLister::getPathStore() const {
+    return tarLister->getPathStore();
+}
@@ -25,20 +25,23 @@
 #ifndef ARCHIVE_LISTER_HH
 #define ARCHIVE_LISTER_HH
 
-#include <list>
+#include "path_store.hh"
+#include "encrypter.hh"
 #include <string>
 
 namespace KryptoCD {
     class TarLister;
     class Bzip2;
-    class Gpg;
+    class Decrypter;
     class Source;
 
     /**
      * Class ArchiveLister examines what files are contained in an encrypted
      * compressed tar archive.
-     * It makes use of the classes TarLister, Bzip2, Gpg
-     * The archive is read from the given Source.
+     * It makes use of the classes TarLister, Bzip2, Decrypter
+     * The archive is read from the given Source. It has to be one that
+     * ArchiveCreator wrote, since PgpDecrypter does not read everything
+     * that gpg writes.
      *
      * @author Tobias Peters
      * @version $Revision: 1.2 $ $Date: 2001/05/19 21:53:23 $
@@ -48,19 +51,15 @@ namespace KryptoCD {
         /**
          * The archive will be read from the given Source.
          *
-         * @param tarExecutable   A string containing the filesystem location
-         *                        of the GNU tar executable.
          * @param bzip2Executable the location of the bzip2 executable file
-         * @param gpgExecutable   the location of the GNU privacy guard
-         *                        executable file
          * @param password       the password to use for decryption
+         * @param format         the format of the encrypted archive
          * @param source         the source from which to read the
          *                       archive.
          */
-        ArchiveLister(const std::string & tarExecutable,
-                      const std::string & bzip2Executable,
-                      const std::string & gpgExecutable,
+        ArchiveLister(const std::string & bzip2Executable,
                       const string & password,
+                      Encrypter::Format format,
                       Source & source);
 
         ~ArchiveLister();
@@ -74,12 +73,18 @@ namespace KryptoCD {
          *         the last filename in the list will not be contained
          *         completely inside the archive.
          */
-        const std::list<std::string> & getFileList() const;
+        const PathList & getFileList() const;
+
+        /**
+         * @return the store containing the names in getFileList(). Only
+         *         valid after getFileList() has returned.
+         */
+        const PathStore & getPathStore() const;
 
     private:
-        TarLister * tarLister;
-        Bzip2     * bzip2Inflator;
-        Gpg       * gpgDecrypter;
+        TarLister    * tarLister;
+        Bzip2        * bzip2Inflator;
+        Decrypter    * decrypter;
     };
 }
 
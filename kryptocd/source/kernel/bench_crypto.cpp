@@ -0,0 +1,106 @@
+/*
+ * bench_crypto.cpp: benchmark for the kernels of class Gcm
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "gcm.hh"
+#include "chunked_encrypter.hh"
+#include <sys/time.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using KryptoCD::Gcm;
+using KryptoCD::ChunkedEncrypter;
+using std::vector;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * encrypts the buffer again and again, until total bytes are done. With
+ * decrypting set, it is decrypted before each encryption, which gives
+ * back the same ciphertext and tag, since the nonce stays the same.
+ *
+ * @return the time per byte in seconds
+ */
+static double measure(const Gcm & gcm, bool decrypting,
+                      vector<unsigned char> & buffer, double total) {
+    unsigned char nonce[Gcm::NONCE_LENGTH] = {0};
+    unsigned char tag[Gcm::TAG_LENGTH];
+    gcm.encrypt(nonce, 0, 0, &buffer[0], buffer.size(), tag);
+    double done = 0;
+    double start = now();
+    for (; done < total; done += buffer.size()) {
+        if (decrypting && !gcm.decrypt(nonce, 0, 0, &buffer[0],
+                                       buffer.size(), tag)) {
+            cerr << "tag mismatch" << endl;
+            exit(1);
+        }
+        gcm.encrypt(nonce, 0, 0, &buffer[0], buffer.size(), tag);
+    }
+    return (now() - start) / done;
+}
+
+/**
+ * This is a benchmark for the kernels of class Gcm. For each kernel that
+ * this processor supports, it encrypts and decrypts chunks of the size
+ * that ChunkedEncrypter uses, with a 256 bit key, and prints the
+ * throughput of one thread. The optional command line argument is the
+ * number of megabytes to process per measurement, by default 512.
+ */
+int main(int argc, char ** argv) {
+    double total = ((argc > 1) ? atoi(argv[1]) : 512) * 1024.0 * 1024.0;
+    if (total <= 0) {
+        cerr << "usage: bench_crypto [MB]" << endl;
+        return 1;
+    }
+    unsigned char key[32];
+    for (unsigned i = 0; i < sizeof(key); ++i) {
+        key[i] = rand();
+    }
+    vector<unsigned char> buffer(1 << ChunkedEncrypter::CHUNK_SIZE_LOG2);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = rand();
+    }
+
+    cout << "fastest kernel: " << Gcm::getName(Gcm::fastestKernel()) << endl;
+    for (int k = Gcm::PORTABLE; k <= Gcm::VAES; ++k) {
+        Gcm::Kernel kernel = static_cast<Gcm::Kernel>(k);
+        if (!Gcm::isSupported(kernel)) {
+            cout << Gcm::getName(kernel) << ": not supported" << endl;
+            continue;
+        }
+        Gcm gcm(key, sizeof(key), kernel);
+        /* the portable kernel is slow, spare it most of the work */
+        double amount = (kernel == Gcm::PORTABLE) ? total / 16 : total;
+        double encryption = measure(gcm, false, buffer, amount);
+        double decryption = measure(gcm, true, buffer, amount) - encryption;
+        cout << Gcm::getName(kernel) << ": encrypt "
+             << 1e-9 / encryption << " GB/s, decrypt "
+             << 1e-9 / decryption << " GB/s" << endl;
+    }
+    return 0;
+}
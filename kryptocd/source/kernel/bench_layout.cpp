@@ -0,0 +1,202 @@
+/*
+ * bench_layout.cpp: benchmark for class LayoutOrder
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "layout_order.hh"
+#include "metadata_scanner.hh"
+#include "tree_walker.hh"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::LayoutOrder;
+using std::string;
+using std::vector;
+
+static const int PIECE_SIZE = 16 * 1024;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * writes the files round robin, one piece at a time, flushing each round
+ * to disk, so that the blocks of the files interleave. The names are
+ * shuffled, so that neither the name order nor the directory order is the
+ * order of creation.
+ */
+static void createTree(const string & root, int fileCount, int pieces,
+                       vector<string> & names) {
+    mkdir(root.c_str(), 0700);
+    for (int d = 0; d < 16; ++d) {
+        char directory[16];
+        sprintf(directory, "/d%02d", d);
+        mkdir((root + directory).c_str(), 0700);
+    }
+    vector<int> order(fileCount);
+    for (int i = 0; i < fileCount; ++i) {
+        order[i] = i;
+    }
+    srand(1);
+    for (int i = fileCount - 1; i > 0; --i) {
+        int j = rand() % (i + 1);
+        int t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    names.clear();
+    for (int i = 0; i < fileCount; ++i) {
+        char name[32];
+        sprintf(name, "/d%02d/f%06d", order[i] % 16, order[i]);
+        names.push_back(root + name);
+    }
+
+    vector<char> piece(PIECE_SIZE);
+    for (int p = 0; p < pieces; ++p) {
+        for (int i = 0; i < fileCount; ++i) {
+            for (int b = 0; b < PIECE_SIZE; ++b) {
+                piece[b] = char(rand());
+            }
+            int fd = open(names[i].c_str(), O_WRONLY|O_CREAT|O_APPEND, 0600);
+            write(fd, &piece[0], PIECE_SIZE);
+            close(fd);
+        }
+        sync();
+    }
+}
+
+/**
+ * drops the files from the page cache, so they are read from the disk
+ */
+static void dropCache(const PathStore & paths, const PathList & files) {
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        int fd = open(paths.getPath(*iter).c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+/**
+ * reads all files in the order of the list, like tar does
+ *
+ * @return the throughput in MB/s
+ */
+static double readAll(const PathStore & paths, const PathList & files) {
+    dropCache(paths, files);
+    vector<char> buffer(64 * 1024);
+    long long total = 0;
+    double start = now();
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        int fd = open(paths.getPath(*iter).c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        ssize_t length;
+        while ((length = read(fd, &buffer[0], buffer.size())) > 0) {
+            total += length;
+        }
+        close(fd);
+    }
+    return total / (now() - start) / (1024.0 * 1024.0);
+}
+
+/**
+ * This is a benchmark for class LayoutOrder. It expects the name of a
+ * directory that does not exist yet as its first command line argument.
+ * There it creates a fragmented tree of files, by default 500 files of
+ * 256kB each. The optional second and third arguments change the number of
+ * files and their size in kB. The files are then read like tar would read
+ * them, first in the order of the directory tree, then sorted by inode
+ * number, then sorted by their first extents, each time after dropping
+ * them from the page cache. The read throughput of each order is printed.
+ * Finally, the tree is removed again.
+ * <p>
+ * The gain depends on the disk: on a spinning disk the sorted orders read
+ * several times faster, on flash memory there is little difference.
+ */
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        cerr << "usage: bench_layout directory [files [kB]]" << endl;
+        return 1;
+    }
+    string root = argv[1];
+    int fileCount = (argc > 2) ? atoi(argv[2]) : 500;
+    int pieces = ((argc > 3) ? atoi(argv[3]) : 256) * 1024 / PIECE_SIZE;
+    if ((fileCount < 1) || (pieces < 1)) {
+        return 1;
+    }
+
+    vector<string> names;
+    cout << "creating " << fileCount << " files of "
+         << pieces * PIECE_SIZE / 1024 << "kB in " << root << endl;
+    createTree(root, fileCount, pieces, names);
+
+    PathStore paths;
+    PathList files, unreadable;
+    KryptoCD::TreeWalker walker(paths, 4);
+    walker.walk(root, files, unreadable);
+    KryptoCD::MetadataScanner metadata(paths, 16);
+    metadata.scan(files);
+
+    cout << "tree order:   " << readAll(paths, files) << " MB/s" << endl;
+
+    PathList byInode(files);
+    LayoutOrder(paths, metadata, LayoutOrder::INODE, 16).sort(byInode);
+    cout << "inode order:  " << readAll(paths, byInode) << " MB/s" << endl;
+
+    PathList byExtent(files);
+    double start = now();
+    LayoutOrder(paths, metadata, LayoutOrder::EXTENT, 16).sort(byExtent);
+    double sortTime = now() - start;
+    cout << "extent order: " << readAll(paths, byExtent) << " MB/s"
+         << " (sorting took " << sortTime << "s)" << endl;
+
+    for (vector<string>::const_iterator iter = names.begin();
+         iter != names.end();
+         ++iter) {
+        unlink(iter->c_str());
+    }
+    for (int d = 0; d < 16; ++d) {
+        char directory[16];
+        sprintf(directory, "/d%02d", d);
+        rmdir((root + directory).c_str());
+    }
+    rmdir(root.c_str());
+    return 0;
+}
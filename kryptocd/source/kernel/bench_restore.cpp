@@ -0,0 +1,222 @@
+/*
+ * bench_restore.cpp: benchmark for class FileRestorer
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "file_restorer.hh"
+#include "archive_creator.hh"
+#include "image_index.hh"
+#include "decrypter.hh"
+#include "bzip2.hh"
+#include "tar_extractor.hh"
+#include "fsource.hh"
+#include "fsink.hh"
+#include "pipe.hh"
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+
+using KryptoCD::FileRestorer;
+using KryptoCD::ArchiveCreator;
+using KryptoCD::ImageIndex;
+using KryptoCD::TarWriter;
+using KryptoCD::Encrypter;
+using KryptoCD::Decrypter;
+using KryptoCD::Bzip2;
+using KryptoCD::TarExtractor;
+using KryptoCD::FSource;
+using KryptoCD::FSink;
+using KryptoCD::Pipe;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using std::string;
+using std::vector;
+
+static const char PASSWORD[] = "some_password";
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * @return the contents of a file, or an empty string
+ */
+static string contents(const string & filename) {
+    std::ifstream file(filename.c_str());
+    return string(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+}
+
+/**
+ * restores a file the way it was done without an index: the whole
+ * archive is decrypted and decompressed, and a TarExtractor picks the
+ * file out of the tar data
+ *
+ * @return true if the file was restored
+ */
+static bool restoreFromStream(const string & bzip2Executable,
+                              Encrypter::Format format,
+                              const string & archive,
+                              const string & name,
+                              const string & directory) {
+    FSource source(archive);
+    Pipe decrypterToBzip2;
+    Pipe bzip2ToTar;
+    Decrypter * decrypter = Decrypter::create(format, PASSWORD, source,
+                                              decrypterToBzip2);
+    Bzip2 * bzip2Inflator = new Bzip2(bzip2Executable, -1,
+                                      decrypterToBzip2, bzip2ToTar);
+    vector<string> selection(1, name);
+    TarExtractor * tarExtractor =
+        new TarExtractor(bzip2ToTar, directory, 1, &selection);
+    tarExtractor->wait();
+    bzip2Inflator->wait();
+    decrypter->wait();
+    bool success = (tarExtractor->getExtractedCount() == 1)
+        && !tarExtractor->archiveFailed()
+        && !bzip2Inflator->exitedAbnormally()
+        && !decrypter->exitedAbnormally();
+    delete tarExtractor;
+    delete bzip2Inflator;
+    delete decrypter;
+    return success;
+}
+
+/**
+ * This is a benchmark for class FileRestorer. It expects the location of
+ * the bzip2 executable, an empty working directory, and the files to
+ * archive as command line arguments. For each encryption format, it
+ * archives the files like a SINGLE_FILE image does, with an ImageIndex,
+ * and restores the last small file of the archive twice: once from the
+ * whole decrypted and decompressed stream, and once with a FileRestorer.
+ * It prints the latencies, and checks the restored contents.
+ */
+int main(int argc, char ** argv) {
+    if (argc < 4) {
+        cerr << "usage: bench_restore bzip2 directory files..." << endl;
+        return 1;
+    }
+    string bzip2Executable(argv[1]);
+    string work(argv[2]);
+
+    PathStore paths;
+    PathList files;
+    for (int i = 3; i < argc; ++i) {
+        files.push_back(paths.intern(argv[i]));
+    }
+
+    Encrypter::Format formats[] = {Encrypter::CHUNKED, Encrypter::OPENPGP};
+    const char * formatNames[] = {"chunked", "openpgp"};
+    int result = 0;
+    for (int f = 0; f < 2; ++f) {
+        string prefix = work + "/" + formatNames[f];
+        string archive = prefix + ".tar.bz2.gpg";
+        string indexFile = prefix + ".idx";
+
+        vector<ImageIndex::Entry> entries;
+        TarWriter::Member chosen;
+        chosen.dataSize = -1;
+        double start = now();
+        {
+            FSink output(archive, O_WRONLY | O_CREAT | O_EXCL, 0600);
+            ArchiveCreator * ac =
+                new ArchiveCreator(bzip2Executable, paths, files, 6,
+                                   PASSWORD, formats[f], output);
+            ac->wait();
+            if (ac->exitedAbnormally()) {
+                cerr << "could not create " << archive << endl;
+                return 1;
+            }
+            const vector<TarWriter::Member> & members = ac->getMembers();
+            for (size_t i = 0; i < members.size(); ++i) {
+                ImageIndex::Entry entry;
+                entry.file = members[i].file;
+                entry.location = ImageIndex::getLocation(members[i], 0);
+                entries.push_back(entry);
+                if ((members[i].dataSize > 0)
+                    && (members[i].dataSize <= 4096)) {
+                    chosen = members[i];
+                }
+            }
+            if ((chosen.dataSize < 0) && !members.empty()) {
+                chosen = members.back();
+            }
+            ImageIndex::save(indexFile, PASSWORD, paths, entries,
+                             ac->getSegments());
+            cout << formatNames[f] << ": " << members.size()
+                 << " members, " << ac->getSegments().size()
+                 << " segments, created in " << now() - start << " s"
+                 << endl;
+            delete ac;
+        }
+        if (chosen.dataSize < 0) {
+            cerr << "nothing archived" << endl;
+            return 1;
+        }
+
+        string path = paths.getPath(chosen.file);
+        string name = path.substr(path.find_first_not_of('/'));
+        string original = contents(path);
+        cout << "  restoring " << path << " (" << chosen.dataSize
+             << " bytes at offset " << chosen.offset << ")" << endl;
+
+        string streamDirectory = prefix + "_stream";
+        mkdir(streamDirectory.c_str(), 0700);
+        start = now();
+        bool success = restoreFromStream(bzip2Executable, formats[f],
+                                         archive, name, streamDirectory);
+        double streamTime = now() - start;
+        success = success
+            && (contents(streamDirectory + "/" + name) == original);
+        cout << "  whole stream:  " << streamTime << " s"
+             << (success ? "" : ", FAILED") << endl;
+        result |= !success;
+
+        string indexedDirectory = prefix + "_indexed";
+        mkdir(indexedDirectory.c_str(), 0700);
+        start = now();
+        try {
+            ImageIndex index(indexFile, PASSWORD);
+            FileRestorer restorer(bzip2Executable, PASSWORD, formats[f],
+                                  index, path, archive, indexedDirectory);
+            restorer.wait();
+            success = !restorer.restoreFailed();
+        } catch (ImageIndex::Exception) {
+            success = false;
+        } catch (FileRestorer::Exception) {
+            success = false;
+        }
+        double indexedTime = now() - start;
+        success = success
+            && (contents(indexedDirectory + "/" + name) == original);
+        cout << "  with index:    " << indexedTime << " s"
+             << (success ? "" : ", FAILED") << endl;
+        result |= !success;
+    }
+    return result;
+}
@@ -0,0 +1,610 @@
+/*
+ * catalog.cpp: class Catalog implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "catalog.hh"
+#include "varint.hh"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+using KryptoCD::Catalog;
+using KryptoCD::ImageInfo;
+using std::string;
+using std::vector;
+using std::list;
+
+static const string CATALOG_MAGIC("KryptoCD catalog 1\n");
+
+/**
+ * the record count, group count and group table offset at the end
+ */
+static const size_t TRAILER_LENGTH = 3 * 8;
+
+namespace {
+    /**
+     * reads a mapped segment byte by byte, for getNumber(), without
+     * running over its end
+     */
+    class Cursor {
+        const unsigned char * position;
+        const unsigned char * end;
+    public:
+        Cursor(const unsigned char * p, const unsigned char * e)
+            : position(p), end(e) {}
+        int get(void) {
+            return (position < end) ? *position++ : EOF;
+        }
+
+        /**
+         * @return the next length bytes, or 0 if there are not as many
+         */
+        const unsigned char * take(unsigned long long length) {
+            if (static_cast<unsigned long long>(end - position) < length) {
+                return 0;
+            }
+            const unsigned char * bytes = position;
+            position += length;
+            return bytes;
+        }
+
+        const unsigned char * getPosition(void) const {
+            return position;
+        }
+    };
+
+    /**
+     * orders records by name, for stable_sort
+     */
+    struct NameLess {
+        template <class Record>
+        bool operator()(const Record & a, const Record & b) const {
+            return a.name < b.name;
+        }
+    };
+}
+
+static void putBigEndian(string & out, unsigned long long value) {
+    for (int i = 7; i >= 0; --i) {
+        out += char(value >> (8 * i));
+    }
+}
+
+static unsigned long long getBigEndian(const unsigned char * in) {
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * compares names bytewise, like std::string does
+ */
+static int compareNames(const unsigned char * name, size_t length,
+                        const string & other) {
+    size_t common = (length < other.size()) ? length : other.size();
+    int result = memcmp(name, other.data(), common);
+    if (result != 0) {
+        return result;
+    }
+    return (length < other.size()) ? -1 : ((length > other.size()) ? 1 : 0);
+}
+
+/**
+ * the first and last run of a segment file, sorted by first run, the
+ * segments covering more runs first
+ */
+struct SegmentName {
+    unsigned long firstRun;
+    unsigned long lastRun;
+};
+
+static bool segmentNameLess(const SegmentName & a, const SegmentName & b) {
+    return (a.firstRun < b.firstRun)
+        || ((a.firstRun == b.firstRun) && (a.lastRun > b.lastRun));
+}
+
+Catalog::Catalog(const string & directory_)
+    throw(Catalog::Exception)
+    : directory(directory_),
+      nextRun(1)
+{
+    DIR * dp = opendir(directory.c_str());
+    if (dp == 0) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    vector<SegmentName> names;
+    struct dirent * ep;
+    while ((ep = readdir(dp)) != 0) {
+        SegmentName name;
+        int length = 0;
+        if ((sscanf(ep->d_name, "catalog.%lu-%lu%n",
+                    &name.firstRun, &name.lastRun, &length) == 2)
+            && (ep->d_name[length] == '\0')
+            && (name.firstRun <= name.lastRun)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dp);
+    std::sort(names.begin(), names.end(), segmentNameLess);
+
+    try {
+        for (vector<SegmentName>::const_iterator iter = names.begin();
+             iter != names.end();
+             ++iter) {
+            string filename = getFilename(iter->firstRun, iter->lastRun);
+            if (iter->lastRun < nextRun) {
+                /* an input of a merge that was interrupted */
+                unlink(filename.c_str());
+                continue;
+            }
+            segments.push_back(new Segment(filename,
+                                           iter->firstRun, iter->lastRun));
+            nextRun = iter->lastRun + 1;
+        }
+    } catch (...) {
+        for (vector<Segment *>::iterator iter = segments.begin();
+             iter != segments.end();
+             ++iter) {
+            delete *iter;
+        }
+        throw;
+    }
+}
+
+Catalog::~Catalog() {
+    for (vector<Segment *>::iterator iter = segments.begin();
+         iter != segments.end();
+         ++iter) {
+        delete *iter;
+    }
+}
+
+string Catalog::getFilename(unsigned long firstRun,
+                            unsigned long lastRun) const {
+    char name[64];
+    sprintf(name, "/catalog.%lu-%lu", firstRun, lastRun);
+    return directory + name;
+}
+
+unsigned long Catalog::add(const list<ImageInfo> & imageInfos)
+    throw(Catalog::Exception) {
+    unsigned long run = nextRun;
+    vector<Disc> discs;
+    vector<Record> records;
+    for (list<ImageInfo>::const_iterator info = imageInfos.begin();
+         info != imageInfos.end();
+         ++info) {
+        discs.push_back(Disc());
+        discs.back().run = run;
+        discs.back().id = info->imageId;
+
+        bool located = (info->locations.size() == info->files.size());
+        for (size_t i = 0; i < info->files.size(); ++i) {
+            records.push_back(Record());
+            Record & record = records.back();
+            info->paths->appendPath(info->files[i], record.name);
+            record.disc = discs.size() - 1;
+            record.archive = located ? info->locations[i].archive : 0;
+            record.size = located ? info->locations[i].size : 0;
+            record.mtime = located ? info->locations[i].mtime : 0;
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), NameLess());
+
+    string filename = getFilename(run, run);
+    {
+        Segment::Writer writer(filename, discs);
+        for (vector<Record>::const_iterator iter = records.begin();
+             iter != records.end();
+             ++iter) {
+            writer.add(*iter);
+        }
+        writer.finish();
+    }
+    try {
+        segments.push_back(new Segment(filename, run, run));
+    } catch (Exception) {
+        unlink(filename.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    ++nextRun;
+
+    if (segments.size() > MAX_SEGMENTS) {
+        try {
+            merge();
+        } catch (Exception) {
+            /* the segments stay as they are, the next run tries again */
+        }
+    }
+    return run;
+}
+
+void Catalog::merge(void) throw(Catalog::Exception) {
+    vector<Disc> discs;
+    vector<unsigned long> discBase;
+    vector<Segment::Reader *> readers;
+    vector<Record> heads(segments.size());
+    vector<bool> valid(segments.size());
+    unsigned long long total = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        discBase.push_back(discs.size());
+        discs.insert(discs.end(), segments[i]->discs.begin(),
+                      segments[i]->discs.end());
+        readers.push_back(new Segment::Reader(*segments[i], ""));
+        valid[i] = readers[i]->next(heads[i]);
+        total += segments[i]->count;
+    }
+
+    unsigned long firstRun = segments.front()->firstRun;
+    unsigned long lastRun = segments.back()->lastRun;
+    string filename = getFilename(firstRun, lastRun);
+    unsigned long long written = 0;
+    try {
+        Segment::Writer writer(filename, discs);
+        for (;;) {
+            /* the oldest segment first among equal names */
+            size_t smallest = segments.size();
+            for (size_t i = 0; i < segments.size(); ++i) {
+                if (valid[i] && ((smallest == segments.size())
+                                 || (heads[i].name < heads[smallest].name))) {
+                    smallest = i;
+                }
+            }
+            if (smallest == segments.size()) {
+                break;
+            }
+            heads[smallest].disc += discBase[smallest];
+            writer.add(heads[smallest]);
+            ++written;
+            valid[smallest] = readers[smallest]->next(heads[smallest]);
+        }
+        if (written != total) {
+            /* a damaged segment */
+            throw Exception(Exception::BAD_FORMAT);
+        }
+        writer.finish();
+    } catch (...) {
+        for (size_t i = 0; i < readers.size(); ++i) {
+            delete readers[i];
+        }
+        throw;
+    }
+    for (size_t i = 0; i < readers.size(); ++i) {
+        delete readers[i];
+    }
+
+    Segment * merged = new Segment(filename, firstRun, lastRun);
+    for (vector<Segment *>::iterator iter = segments.begin();
+         iter != segments.end();
+         ++iter) {
+        unlink((*iter)->filename.c_str());
+        delete *iter;
+    }
+    segments.assign(1, merged);
+}
+
+void Catalog::find(const string & name, vector<Hit> & hits) const {
+    lookup(name, true, hits);
+}
+
+void Catalog::search(const string & pattern, vector<Hit> & hits) const {
+    lookup(pattern, false, hits);
+}
+
+void Catalog::lookup(const string & pattern, bool exact,
+                     vector<Hit> & hits) const {
+    string prefix = exact ? pattern
+                          : pattern.substr(0, pattern.find_first_of("*?[\\"));
+    Record record;
+    for (vector<Segment *>::const_iterator segment = segments.begin();
+         segment != segments.end();
+         ++segment) {
+        Segment::Reader reader(**segment, prefix);
+        while (reader.next(record)) {
+            if (record.name.compare(0, prefix.length(), prefix) != 0) {
+                if (record.name > prefix) {
+                    break;
+                }
+                continue;
+            }
+            if (exact ? (record.name != pattern)
+                      : (fnmatch(pattern.c_str(), record.name.c_str(), 0)
+                         != 0)) {
+                if (exact) {
+                    break;
+                }
+                continue;
+            }
+            if (record.disc >= (*segment)->discs.size()) {
+                continue;
+            }
+            hits.push_back(Hit());
+            Hit & hit = hits.back();
+            hit.name = record.name;
+            hit.run = (*segment)->discs[record.disc].run;
+            hit.imageId = (*segment)->discs[record.disc].id;
+            hit.archive = record.archive;
+            hit.size = record.size;
+            hit.mtime = record.mtime;
+        }
+    }
+}
+
+unsigned long long Catalog::getCount(void) const {
+    unsigned long long count = 0;
+    for (vector<Segment *>::const_iterator iter = segments.begin();
+         iter != segments.end();
+         ++iter) {
+        count += (*iter)->count;
+    }
+    return count;
+}
+
+Catalog::Segment::Segment(const string & filename_,
+                          unsigned long firstRun_, unsigned long lastRun_)
+    throw(Catalog::Exception)
+    : filename(filename_),
+      firstRun(firstRun_),
+      lastRun(lastRun_),
+      count(0),
+      mapping(0),
+      mappingLength(0),
+      groupCount(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    if (st.st_size < static_cast<off_t>(CATALOG_MAGIC.length()
+                                        + TRAILER_LENGTH)) {
+        close(fd);
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    mappingLength = st.st_size;
+    void * address = mmap(0, mappingLength, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    mapping = static_cast<unsigned char *>(address);
+
+    const unsigned char * trailer = mapping + mappingLength - TRAILER_LENGTH;
+    bool success = (memcmp(mapping, CATALOG_MAGIC.data(),
+                           CATALOG_MAGIC.length()) == 0);
+    Cursor cursor(mapping + CATALOG_MAGIC.length(), trailer);
+    unsigned long long discCount;
+    success = success && getNumber(cursor, discCount);
+    for (unsigned long long i = 0; success && (i < discCount); ++i) {
+        unsigned long long run, length;
+        const unsigned char * id;
+        success = getNumber(cursor, run) && getNumber(cursor, length)
+            && ((id = cursor.take(length)) != 0);
+        if (success) {
+            discs.push_back(Disc());
+            discs.back().run = run;
+            discs.back().id.assign(reinterpret_cast<const char *>(id),
+                                    length);
+        }
+    }
+
+    if (success) {
+        records = cursor.getPosition();
+        count = getBigEndian(trailer);
+        groupCount = getBigEndian(trailer + 8);
+        unsigned long long tableOffset = getBigEndian(trailer + 16);
+        unsigned long long recordBytes = trailer - records;
+        groups = records + tableOffset;
+
+        /* the groups have to be where they can be */
+        success = (tableOffset <= recordBytes)
+            && (groupCount == (count + GROUP_SIZE - 1) / GROUP_SIZE)
+            && ((recordBytes - tableOffset) == 8 * groupCount);
+        for (unsigned long long group = 0;
+             success && (group < groupCount);
+             ++group) {
+            success = getBigEndian(groups + 8 * group) < tableOffset;
+        }
+    }
+    if (!success) {
+        munmap(mapping, mappingLength);
+        throw Exception(Exception::BAD_FORMAT);
+    }
+}
+
+Catalog::Segment::~Segment() {
+    munmap(mapping, mappingLength);
+}
+
+const unsigned char *
+Catalog::Segment::getFirstName(unsigned long long group,
+                               size_t & length) const {
+    Cursor cursor(records + getBigEndian(groups + 8 * group), groups);
+    unsigned long long shared, suffix;
+    if (!getNumber(cursor, shared) || (shared != 0)
+        || !getNumber(cursor, suffix)) {
+        return 0;
+    }
+    length = suffix;
+    return cursor.take(suffix);
+}
+
+Catalog::Segment::Reader::Reader(const Segment & segment_,
+                                 const string & name_)
+    : segment(segment_),
+      position(segment_.records),
+      remaining(segment_.count)
+{
+    if ((segment.groupCount == 0) || name_.empty()) {
+        return;
+    }
+
+    /*
+     * the last group whose first name is before the name: a name may be
+     * stored more than once, and continue from the group before.
+     */
+    unsigned long long low = 0;
+    unsigned long long high = segment.groupCount;
+    while (high - low > 1) {
+        unsigned long long middle = low + (high - low) / 2;
+        size_t length;
+        const unsigned char * first = segment.getFirstName(middle, length);
+        if ((first != 0) && (compareNames(first, length, name_) < 0)) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    position = segment.records + getBigEndian(segment.groups + 8 * low);
+    remaining = segment.count - low * GROUP_SIZE;
+}
+
+bool Catalog::Segment::Reader::next(Record & record) {
+    if (remaining == 0) {
+        return false;
+    }
+    Cursor cursor(position, segment.groups);
+    unsigned long long shared, length, disc, archive, size;
+    long long mtime;
+    const unsigned char * suffix;
+    if (!getNumber(cursor, shared) || (shared > name.size())
+        || !getNumber(cursor, length)
+        || ((suffix = cursor.take(length)) == 0)
+        || !getNumber(cursor, disc)
+        || !getNumber(cursor, archive)
+        || !getNumber(cursor, size)
+        || !getSignedNumber(cursor, mtime)) {
+        remaining = 0;
+        return false;
+    }
+    name.resize(shared);
+    name.append(reinterpret_cast<const char *>(suffix), length);
+    record.name = name;
+    record.disc = disc;
+    record.archive = archive;
+    record.size = size;
+    record.mtime = mtime;
+    position = cursor.getPosition();
+    --remaining;
+    return true;
+}
+
+Catalog::Segment::Writer::Writer(const string & filename_,
+                                 const vector<Disc> & discs)
+    throw(Catalog::Exception)
+    : filename(filename_),
+      temporary(filename_ + ".new"),
+      output(temporary.c_str()),
+      written(0),
+      count(0),
+      recordsStart(0),
+      finished(false)
+{
+    if (!output) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    buffer = CATALOG_MAGIC;
+    putNumber(buffer, discs.size());
+    for (vector<Disc>::const_iterator iter = discs.begin();
+         iter != discs.end();
+         ++iter) {
+        putNumber(buffer, iter->run);
+        putNumber(buffer, iter->id.length());
+        buffer += iter->id;
+    }
+    write(buffer);
+    recordsStart = written;
+}
+
+Catalog::Segment::Writer::~Writer() {
+    if (!finished) {
+        output.close();
+        unlink(temporary.c_str());
+    }
+}
+
+void Catalog::Segment::Writer::write(const string & data)
+    throw(Catalog::Exception) {
+    output.write(data.data(), data.length());
+    if (!output) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    written += data.length();
+}
+
+void Catalog::Segment::Writer::add(const Record & record)
+    throw(Catalog::Exception) {
+    size_t shared = 0;
+    if (count % GROUP_SIZE == 0) {
+        groupOffsets.push_back(written - recordsStart);
+    } else {
+        while ((shared < previous.length())
+               && (shared < record.name.length())
+               && (previous[shared] == record.name[shared])) {
+            ++shared;
+        }
+    }
+    buffer.erase();
+    putNumber(buffer, shared);
+    putNumber(buffer, record.name.length() - shared);
+    buffer.append(record.name, shared, string::npos);
+    putNumber(buffer, record.disc);
+    putNumber(buffer, record.archive);
+    putNumber(buffer, record.size);
+    putSignedNumber(buffer, record.mtime);
+    write(buffer);
+    previous = record.name;
+    ++count;
+}
+
+void Catalog::Segment::Writer::finish(void) throw(Catalog::Exception) {
+    unsigned long long tableOffset = written - recordsStart;
+    buffer.erase();
+    for (vector<unsigned long long>::const_iterator iter =
+             groupOffsets.begin();
+         iter != groupOffsets.end();
+         ++iter) {
+        putBigEndian(buffer, *iter);
+    }
+    putBigEndian(buffer, count);
+    putBigEndian(buffer, groupOffsets.size());
+    putBigEndian(buffer, tableOffset);
+    write(buffer);
+    output.close();
+    if (!output || (rename(temporary.c_str(), filename.c_str()) != 0)) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    finished = true;
+}
@@ -0,0 +1,308 @@
+/*
+ * catalog.hh: class Catalog header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CATALOG_HH
+#define CATALOG_HH
+
+#include "image_info.hh"
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <fstream>
+
+namespace KryptoCD {
+    /**
+     * Class Catalog remembers on which cd of which backup run every file
+     * has been saved, so a file can be found without trying the cds one
+     * at a time. It is kept in a local directory, like the snapshots of
+     * SnapshotDatabase.
+     * <p>
+     * Each run adds the ImageInfos of its cds as a segment, a file
+     * "catalog.first-last" holding the runs first to last. When there are
+     * more than MAX_SEGMENTS segments, they are merged into one, so a
+     * lookup reads few files, and adding a run never rewrites the whole
+     * catalog more than once every MAX_SEGMENTS runs. A segment that is
+     * covered by another one is left over from an interrupted merge and
+     * removed when the catalog is opened.
+     * <p>
+     * A segment is sorted by name, and stored like a Snapshot: each name
+     * as the length of the prefix it shares with the previous one plus
+     * the rest, the numbers as variable length integers. GROUP_SIZE
+     * records make a group, whose first name is stored whole, and a
+     * table at the end of the file gives the offset of each group. The
+     * segments are mapped into memory, and a lookup searches the groups'
+     * first names binarily and decodes one group.
+     * <pre>
+     *   "KryptoCD catalog 1\n"
+     *   number of cds, and for each: run, imageId length, imageId
+     *   records: shared prefix length, suffix length, suffix,
+     *            cd, archive, size, mtime
+     *   group offsets from the start of the records, 8 bytes each
+     *   number of records, number of groups, offset of the group table,
+     *   8 bytes each
+     * </pre>
+     * The numbers of 8 bytes are big-endian.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Catalog {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                UNABLE_TO_OPEN,
+                UNABLE_TO_WRITE,
+                BAD_FORMAT,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * the number of records in a group
+         */
+        static const unsigned GROUP_SIZE = 64;
+
+        /**
+         * the number of segments above which they are merged
+         */
+        static const size_t MAX_SEGMENTS = 8;
+
+        /**
+         * where a file has been saved
+         */
+        struct Hit {
+            std::string   name;
+            unsigned long run;
+            std::string   imageId;
+
+            /**
+             * archive, size and mtime as in ImageIndex::Location. All 0
+             * if the image had no ImageIndex.
+             */
+            unsigned long archive;
+            long long     size;
+            time_t        mtime;
+        };
+
+        /**
+         * opens the catalog
+         *
+         * @param directory the directory containing the segments. It has to
+         *                  exist.
+         * @exception Catalog::Exception
+         *                UNABLE_TO_OPEN or BAD_FORMAT if a segment cannot
+         *                be read
+         */
+        Catalog(const std::string & directory) throw(Exception);
+        ~Catalog();
+
+        /**
+         * adds the cds of a backup run
+         *
+         * @param imageInfos the ImageInfos of the run's cds
+         * @return           the number of the run, counting from 1
+         * @exception Catalog::Exception
+         *                UNABLE_TO_WRITE. The catalog is unchanged then.
+         */
+        unsigned long add(const std::list<ImageInfo> & imageInfos)
+            throw(Exception);
+
+        /**
+         * finds all saved versions of a file, oldest run first
+         *
+         * @param name the absolute name of the file
+         * @param hits the versions are appended to this list
+         */
+        void find(const std::string & name, std::vector<Hit> & hits) const;
+
+        /**
+         * finds the files whose names match a shell pattern, see
+         * fnmatch(3). "*" and "?" match "/" too, so "*part*" is a search
+         * for a substring. The part of the pattern before the first
+         * wildcard is looked up like a name, the rest of each segment
+         * is only read if the pattern starts with a wildcard.
+         *
+         * @param pattern the pattern
+         * @param hits    the matching files are appended to this list,
+         *                sorted by name within each segment, the oldest
+         *                segment first
+         */
+        void search(const std::string & pattern, std::vector<Hit> & hits)
+            const;
+
+        /**
+         * @return the number of saved files in all runs
+         */
+        unsigned long long getCount(void) const;
+
+    private:
+        Catalog(const Catalog &);
+        Catalog & operator=(const Catalog &);
+
+        /**
+         * a cd of a run
+         */
+        struct Disc {
+            unsigned long run;
+            std::string   id;
+        };
+
+        /**
+         * a saved file as stored in a segment
+         */
+        struct Record {
+            std::string   name;
+
+            /**
+             * the index of the cd in the segment's list of cds
+             */
+            unsigned long disc;
+            unsigned long archive;
+            long long     size;
+            time_t        mtime;
+        };
+
+        /**
+         * one mapped segment file
+         */
+        class Segment {
+        public:
+            /**
+             * maps and checks a segment file
+             */
+            Segment(const std::string & filename,
+                    unsigned long firstRun, unsigned long lastRun)
+                throw(Exception);
+            ~Segment();
+
+            /**
+             * writes a segment file under a temporary name, and renames
+             * it when finished. The records are not kept in memory, so
+             * segments of any size can be merged.
+             */
+            class Writer {
+            public:
+                Writer(const std::string & filename,
+                       const std::vector<Disc> & discs)
+                    throw(Exception);
+
+                /**
+                 * removes the unfinished file
+                 */
+                ~Writer();
+
+                /**
+                 * @param record a record not sorted before the previous one
+                 */
+                void add(const Record & record) throw(Exception);
+
+                void finish(void) throw(Exception);
+            private:
+                void write(const std::string & data) throw(Exception);
+
+                std::string filename;
+                std::string temporary;
+                std::ofstream output;
+                unsigned long long written;
+                std::vector<unsigned long long> groupOffsets;
+                unsigned long long count;
+                unsigned long long recordsStart;
+                std::string previous;
+                std::string buffer;
+                bool finished;
+            };
+
+            /**
+             * reads the records of a segment in order
+             */
+            class Reader {
+            public:
+                /**
+                 * starts at the group that may contain a name, or at the
+                 * beginning if the name is empty
+                 */
+                Reader(const Segment & segment, const std::string & name);
+
+                /**
+                 * @return false at the end, or if the segment is damaged
+                 */
+                bool next(Record & record);
+            private:
+                const Segment & segment;
+                const unsigned char * position;
+                unsigned long long remaining;
+                std::string name;
+            };
+            friend class Reader;
+
+            std::string filename;
+            unsigned long firstRun;
+            unsigned long lastRun;
+            std::vector<Disc> discs;
+            unsigned long long count;
+
+        private:
+            Segment(const Segment &);
+            Segment & operator=(const Segment &);
+
+            /**
+             * @return the first name of a group, or 0 if it is damaged
+             */
+            const unsigned char * getFirstName(unsigned long long group,
+                                               size_t & length) const;
+
+            unsigned char * mapping;
+            size_t mappingLength;
+            unsigned long long groupCount;
+            const unsigned char * records;
+            const unsigned char * groups;
+        };
+        friend class Segment;
+
+        /**
+         * appends the records of all segments from "pattern"'s literal
+         * prefix on that match it, or that equal it if "exact"
+         */
+        void lookup(const std::string & pattern, bool exact,
+                    std::vector<Hit> & hits) const;
+
+        /**
+         * merges all segments into one
+         */
+        void merge(void) throw(Exception);
+
+        /**
+         * @return the name of the segment file of some runs
+         */
+        std::string getFilename(unsigned long firstRun,
+                                unsigned long lastRun) const;
+
+        std::string directory;
+        std::vector<Segment *> segments;
+        unsigned long nextRun;
+    };
+}
+#endif
@@ -115,6 +115,11 @@ namespace KryptoCD {
          */
         int sendSignal(int);
 
+        /**
+         * @return the process id of the child process
+         */
+        pid_t getPid(void) const {return pid;}
+
         /**
          * waitpid sets an integer with information about the child's exit
          * status. This integer is retrieved here. See the waitpid(2) manpage
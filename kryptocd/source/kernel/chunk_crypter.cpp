@@ -0,0 +1,221 @@
+/*
+ * chunk_crypter.cpp: class ChunkCrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "chunk_crypter.hh"
+#include "gcm.hh"
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::ChunkCrypter;
+using KryptoCD::Gcm;
+using std::vector;
+
+/**
+ * the length of the additional authenticated data: index and header
+ */
+static const size_t AAD_LENGTH = 8 + ChunkCrypter::HEADER_LENGTH;
+
+/**
+ * the nonce of a chunk: 4 zero bytes, and the index
+ */
+static void makeNonce(unsigned long long index,
+                      unsigned char nonce[Gcm::NONCE_LENGTH]) {
+    memset(nonce, 0, 4);
+    for (int i = Gcm::NONCE_LENGTH - 1; i >= 4; --i) {
+        nonce[i] = index;
+        index >>= 8;
+    }
+}
+
+static void makeAad(const ChunkCrypter::Chunk & chunk,
+                    unsigned char aad[AAD_LENGTH]) {
+    unsigned long long index = chunk.index;
+    for (int i = 7; i >= 0; --i) {
+        aad[i] = index;
+        index >>= 8;
+    }
+    ChunkCrypter::writeHeader(chunk, aad + 8);
+}
+
+ChunkCrypter::ChunkCrypter(const Gcm & gcm_, bool decrypting_, int threads_)
+    : gcm(gcm_),
+      decrypting(decrypting_),
+      threads(threads_),
+      stopping(false),
+      mutex(new pthread_mutex_t),
+      changed(new pthread_cond_t)
+{
+    assert(threads > 0);
+    pthread_mutex_init(mutex, 0);
+    pthread_cond_init(changed, 0);
+    for (int i = 0; i < threads + 2; ++i) {
+        chunks.push_back(new Chunk);
+        freeChunks.push_back(chunks.back());
+    }
+}
+
+ChunkCrypter::~ChunkCrypter() {
+    pthread_mutex_lock(mutex);
+    stopping = true;
+    pthread_cond_broadcast(changed);
+    pthread_mutex_unlock(mutex);
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+    for (vector<Chunk *>::iterator iter = chunks.begin();
+         iter != chunks.end();
+         ++iter) {
+        delete *iter;
+    }
+    int destroyVal = pthread_cond_destroy(changed);
+    assert (destroyVal == 0);
+    delete changed;
+    destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+}
+
+ChunkCrypter::Chunk * ChunkCrypter::getFree(void) {
+    if (freeChunks.empty()) {
+        return 0;
+    }
+    Chunk * chunk = freeChunks.back();
+    freeChunks.pop_back();
+    chunk->data.clear();
+    return chunk;
+}
+
+void ChunkCrypter::submit(Chunk * chunk) {
+    chunk->finished = false;
+    submitted.push_back(chunk);
+
+    pthread_mutex_lock(mutex);
+    queued.push_back(chunk);
+    pthread_cond_signal(changed);
+    pthread_mutex_unlock(mutex);
+
+    /* one more worker, as long as there are fewer than chunks to do */
+    if ((workers.size() < size_t(threads))
+        && (workers.size() < submitted.size())) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+}
+
+ChunkCrypter::Chunk * ChunkCrypter::getDone(void) {
+    if (submitted.empty()) {
+        return 0;
+    }
+    Chunk * chunk = submitted.front();
+    submitted.pop_front();
+
+    pthread_mutex_lock(mutex);
+    while (!chunk->finished) {
+        pthread_cond_wait(changed, mutex);
+    }
+    pthread_mutex_unlock(mutex);
+    return chunk;
+}
+
+void ChunkCrypter::release(Chunk * chunk) {
+    freeChunks.push_back(chunk);
+}
+
+void * ChunkCrypter::Worker::run(void) {
+    crypter.work();
+    return this;
+}
+
+void ChunkCrypter::work(void) {
+    for (;;) {
+        pthread_mutex_lock(mutex);
+        while (queued.empty() && !stopping) {
+            pthread_cond_wait(changed, mutex);
+        }
+        if (queued.empty()) {
+            pthread_mutex_unlock(mutex);
+            break;
+        }
+        Chunk * chunk = queued.front();
+        queued.pop_front();
+        pthread_mutex_unlock(mutex);
+
+        if (decrypting) {
+            decrypt(gcm, *chunk);
+        } else {
+            encrypt(gcm, *chunk);
+        }
+
+        pthread_mutex_lock(mutex);
+        chunk->finished = true;
+        pthread_cond_broadcast(changed);
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+void ChunkCrypter::writeHeader(const Chunk & chunk,
+                               unsigned char header[HEADER_LENGTH]) {
+    size_t length = chunk.data.size();
+    header[0] = chunk.kind;
+    header[1] = length >> 24;
+    header[2] = length >> 16;
+    header[3] = length >> 8;
+    header[4] = length;
+}
+
+void ChunkCrypter::encrypt(const Gcm & gcm, Chunk & chunk) {
+    unsigned char nonce[Gcm::NONCE_LENGTH];
+    unsigned char aad[AAD_LENGTH];
+    makeNonce(chunk.index, nonce);
+    makeAad(chunk, aad);
+    gcm.encrypt(nonce, aad, sizeof(aad),
+                chunk.data.empty() ? 0 : &chunk.data[0], chunk.data.size(),
+                chunk.tag);
+}
+
+void ChunkCrypter::decrypt(const Gcm & gcm, Chunk & chunk) {
+    unsigned char nonce[Gcm::NONCE_LENGTH];
+    unsigned char aad[AAD_LENGTH];
+    makeNonce(chunk.index, nonce);
+    makeAad(chunk, aad);
+    chunk.authentic =
+        gcm.decrypt(nonce, aad, sizeof(aad),
+                    chunk.data.empty() ? 0 : &chunk.data[0],
+                    chunk.data.size(), chunk.tag);
+}
+
+int ChunkCrypter::defaultThreads(void) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processors < 1) {
+        return 1;
+    }
+    return (processors > 8) ? 8 : int(processors);
+}
@@ -0,0 +1,201 @@
+/*
+ * chunk_crypter.hh: class ChunkCrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CHUNK_CRYPTER_HH
+#define CHUNK_CRYPTER_HH
+
+#include "thread.hh"
+#include <vector>
+#include <deque>
+#include <stddef.h>
+
+namespace KryptoCD {
+    class Gcm;
+
+    /**
+     * Class ChunkCrypter encrypts or decrypts the chunks of the chunked
+     * archive format on a pool of worker threads, see ChunkedEncrypter.
+     * <p>
+     * Every chunk is stored as a record: a kind byte, the length of the
+     * payload as 4 bytes, most significant first, the payload encrypted
+     * with AES-GCM, and the GCM tag. The nonce is the chunk's index in
+     * the stream, and the additional authenticated data is the index
+     * followed by kind and length, so chunks cannot be reordered, or be
+     * moved from one place of the stream to another, unnoticed.
+     * <p>
+     * The caller takes a free chunk with getFree(), fills it, and hands
+     * it to the workers with submit(). getDone() returns the chunks in
+     * the order of submission, once they are done, and release() makes
+     * them free again. Only one thread may call these methods.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ChunkCrypter {
+    public:
+        /**
+         * the kinds of records
+         */
+        enum Kind {
+            DATA = 0,
+            END  = 1,
+        };
+
+        /**
+         * the length of a record's header
+         */
+        static const size_t HEADER_LENGTH = 5;
+
+        struct Chunk {
+            unsigned long long index;
+            unsigned char kind;
+
+            /**
+             * the payload, plain or encrypted. Its size is the payload's
+             * length.
+             */
+            std::vector<unsigned char> data;
+            unsigned char tag[16];
+
+            /**
+             * after decryption: false if the tag did not match
+             */
+            bool authentic;
+
+            /**
+             * set by the worker that has encrypted or decrypted the chunk
+             */
+            bool finished;
+        };
+
+        /**
+         * @param gcm        the cipher, with the key of the stream
+         * @param decrypting true to check and decrypt the chunks, false to
+         *                   encrypt them
+         * @param threads    the largest number of worker threads. They are
+         *                   started when there is work for them.
+         */
+        ChunkCrypter(const Gcm & gcm, bool decrypting, int threads);
+
+        /**
+         * waits for the chunks being worked on, and stops the workers
+         */
+        ~ChunkCrypter();
+
+        /**
+         * @return a free chunk with an empty payload, or 0 if all chunks
+         *         are submitted or done
+         */
+        Chunk * getFree(void);
+
+        /**
+         * hands a chunk to the workers
+         */
+        void submit(Chunk * chunk);
+
+        /**
+         * waits until the chunk submitted first is done
+         *
+         * @return the chunk, or 0 if no chunk has been submitted
+         */
+        Chunk * getDone(void);
+
+        /**
+         * makes a chunk returned by getDone() free
+         */
+        void release(Chunk * chunk);
+
+        /**
+         * writes the header of a chunk's record
+         */
+        static void writeHeader(const Chunk & chunk,
+                                unsigned char header[HEADER_LENGTH]);
+
+        /**
+         * encrypts a chunk on the calling thread
+         */
+        static void encrypt(const Gcm & gcm, Chunk & chunk);
+
+        /**
+         * checks and decrypts a chunk on the calling thread, and sets
+         * chunk.authentic
+         */
+        static void decrypt(const Gcm & gcm, Chunk & chunk);
+
+        /**
+         * @return the number of processors, at least 1 and at most 8
+         */
+        static int defaultThreads(void);
+
+    private:
+        /**
+         * the work of one thread: encrypt or decrypt submitted chunks
+         * until stopped
+         */
+        void work(void);
+
+        /**
+         * a thread calling work()
+         */
+        class Worker : public Thread {
+            ChunkCrypter & crypter;
+        public:
+            Worker(ChunkCrypter & c) : crypter(c) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        const Gcm & gcm;
+        bool decrypting;
+        int threads;
+        std::vector<Worker *> workers;
+
+        /**
+         * all chunks: threads + 2, so the caller can fill and write one
+         * each while every worker is busy
+         */
+        std::vector<Chunk *> chunks;
+        std::vector<Chunk *> freeChunks;
+
+        /**
+         * the submitted chunks not yet taken by a worker, and all chunks
+         * not yet returned by getDone(), in the order of submission
+         */
+        std::deque<Chunk *> queued;
+        std::deque<Chunk *> submitted;
+        bool stopping;
+
+        /**
+         * protects queued, stopping and the chunks' finished flags.
+         * "changed" is signalled when a chunk is queued or finished, and
+         * when the workers have to stop.
+         */
+        pthread_mutex_t * mutex;
+        pthread_cond_t  * changed;
+    };
+}
+#endif
@@ -0,0 +1,339 @@
+/*
+ * chunk_index.cpp: class ChunkIndex implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "chunk_index.hh"
+#include "xxh64.hh"
+#include "varint.hh"
+#include <fstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+
+using KryptoCD::ChunkIndex;
+using KryptoCD::Fingerprint;
+using KryptoCD::Xxh64;
+using std::string;
+using std::vector;
+using std::map;
+
+/**
+ * the first line of every chunk index file
+ */
+static const string CHUNK_INDEX_MAGIC("KryptoCD chunk index 1\n");
+
+/**
+ * the initial number of hash slots, must be a power of two
+ */
+static const size_t INITIAL_SLOTS = 1024;
+
+/**
+ * the seed of the second hash of a fingerprint
+ */
+static const unsigned long long SECOND_SEED = 0x9e3779b97f4a7c15ULL;
+
+Fingerprint Fingerprint::of(const char * data, size_t length) {
+    Fingerprint fingerprint;
+    fingerprint.high = Xxh64::hash(data, length, SECOND_SEED);
+    fingerprint.low = Xxh64::hash(data, length);
+    return fingerprint;
+}
+
+/**
+ * appends a 64 bit number in little endian byte order
+ */
+static void putFixed(string & out, unsigned long long n) {
+    for (int i = 0; i < 8; ++i) {
+        out += char(n & 0xff);
+        n >>= 8;
+    }
+}
+
+/**
+ * reads a number written by putFixed
+ */
+static bool getFixed(std::istream & in, unsigned long long & n) {
+    unsigned char bytes[8];
+    in.read(reinterpret_cast<char *>(bytes), 8);
+    if (!in) {
+        return false;
+    }
+    n = 0;
+    for (int i = 7; i >= 0; --i) {
+        n = (n << 8) | bytes[i];
+    }
+    return true;
+}
+
+ChunkIndex::ChunkIndex()
+    : loadedImageCount(0),
+      slots(INITIAL_SLOTS, 0),
+      forgottenCount(0),
+      mutex(new pthread_mutex_t)
+{
+    pthread_mutex_init(mutex, 0);
+}
+
+ChunkIndex::~ChunkIndex() {
+    int destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+}
+
+size_t ChunkIndex::findSlot(const Fingerprint & fingerprint) const {
+    size_t slot = fingerprint.low & (slots.size() - 1);
+    while (slots[slot] != 0) {
+        const Fingerprint & other = entries[slots[slot] - 1].fingerprint;
+        if ((other.low == fingerprint.low)
+            && (other.high == fingerprint.high)) {
+            break;
+        }
+        slot = (slot + 1) & (slots.size() - 1);
+    }
+    return slot;
+}
+
+void ChunkIndex::grow(void) {
+    slots.assign(slots.size() * 2, 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        slots[findSlot(entries[i].fingerprint)] = i + 1;
+    }
+}
+
+void ChunkIndex::addEntry(const Entry & entry) {
+    assert(entry.location.image < imageEntries.size());
+    imageEntries[entry.location.image].push_back(entries.size());
+    entries.push_back(entry);
+    if (3 * entries.size() > 2 * slots.size()) {
+        grow();
+    } else {
+        slots[findSlot(entry.fingerprint)] = entries.size();
+    }
+}
+
+unsigned ChunkIndex::getImageNumber(const string & imageId) {
+    pthread_mutex_lock(mutex);
+    unsigned image;
+    map<string, unsigned>::const_iterator found = imageNumbers.find(imageId);
+    if (found != imageNumbers.end()) {
+        image = found->second;
+        assert((image >= loadedImageCount) || imageEntries[image].empty());
+    } else {
+        image = imageIds.size();
+        imageIds.push_back(imageId);
+        imageNumbers[imageId] = image;
+        imageEntries.push_back(vector<unsigned>());
+    }
+    pthread_mutex_unlock(mutex);
+    return image;
+}
+
+bool ChunkIndex::isStored(const string & imageId) const {
+    pthread_mutex_lock(mutex);
+    map<string, unsigned>::const_iterator found = imageNumbers.find(imageId);
+    bool stored = (found != imageNumbers.end())
+        && (found->second < loadedImageCount)
+        && !imageEntries[found->second].empty();
+    pthread_mutex_unlock(mutex);
+    return stored;
+}
+
+string ChunkIndex::getImageId(unsigned image) const {
+    pthread_mutex_lock(mutex);
+    assert(image < imageIds.size());
+    string imageId = imageIds[image];
+    pthread_mutex_unlock(mutex);
+    return imageId;
+}
+
+bool ChunkIndex::findOrAdd(const Fingerprint & fingerprint,
+                           const Location & location,
+                           Location & existing) {
+    bool found = false;
+
+    pthread_mutex_lock(mutex);
+    size_t slot = findSlot(fingerprint);
+    if (slots[slot] == 0) {
+        Entry entry;
+        entry.fingerprint = fingerprint;
+        entry.location = location;
+        entry.forgotten = false;
+        addEntry(entry);
+    } else {
+        Entry & entry = entries[slots[slot] - 1];
+        if (entry.forgotten) {
+            /* the image containing it was discarded, store it anew */
+            assert(location.image < imageEntries.size());
+            imageEntries[location.image].push_back(slots[slot] - 1);
+            entry.location = location;
+            entry.forgotten = false;
+            --forgottenCount;
+        } else {
+            existing = entry.location;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(mutex);
+    return found;
+}
+
+void ChunkIndex::forgetImage(const string & imageId) {
+    pthread_mutex_lock(mutex);
+    map<string, unsigned>::const_iterator found = imageNumbers.find(imageId);
+    if (found != imageNumbers.end()) {
+        vector<unsigned> & stored = imageEntries[found->second];
+        for (vector<unsigned>::const_iterator iter = stored.begin();
+             iter != stored.end();
+             ++iter) {
+            assert(!entries[*iter].forgotten);
+            entries[*iter].forgotten = true;
+            ++forgottenCount;
+        }
+        vector<unsigned>().swap(stored);
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+size_t ChunkIndex::size(void) const {
+    pthread_mutex_lock(mutex);
+    size_t count = entries.size() - forgottenCount;
+    pthread_mutex_unlock(mutex);
+    return count;
+}
+
+void ChunkIndex::save(const string & filename) const
+    throw(ChunkIndex::Exception) {
+    string temporary = filename + ".new";
+    std::ofstream output(temporary.c_str());
+    if (!output) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+
+    pthread_mutex_lock(mutex);
+    string buffer = CHUNK_INDEX_MAGIC;
+    putNumber(buffer, imageIds.size());
+    for (vector<string>::const_iterator iter = imageIds.begin();
+         iter != imageIds.end();
+         ++iter) {
+        putNumber(buffer, iter->length());
+        buffer += *iter;
+    }
+    putNumber(buffer, entries.size() - forgottenCount);
+    output.write(buffer.data(), buffer.length());
+
+    for (vector<Entry>::const_iterator iter = entries.begin();
+         iter != entries.end();
+         ++iter) {
+        if (iter->forgotten) {
+            continue;
+        }
+        buffer.erase();
+        putFixed(buffer, iter->fingerprint.high);
+        putFixed(buffer, iter->fingerprint.low);
+        putNumber(buffer, iter->location.image);
+        putNumber(buffer, iter->location.offset);
+        putNumber(buffer, iter->location.length);
+        output.write(buffer.data(), buffer.length());
+    }
+    pthread_mutex_unlock(mutex);
+
+    output.flush();
+    if (!output) {
+        output.close();
+        unlink(temporary.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    output.close();
+    if (rename(temporary.c_str(), filename.c_str()) != 0) {
+        unlink(temporary.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+}
+
+void ChunkIndex::load(const string & filename) throw(ChunkIndex::Exception) {
+    std::ifstream input(filename.c_str());
+    if (!input) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    string magic(CHUNK_INDEX_MAGIC.length(), '\0');
+    input.read(&magic[0], magic.length());
+    if (!input || (magic != CHUNK_INDEX_MAGIC)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+
+    /* read everything before changing anything: */
+    vector<string> newImageIds;
+    vector<Entry> newEntries;
+    unsigned long long count, length;
+    if (!getNumber(input, count)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    for (; count > 0; --count) {
+        if (!getNumber(input, length)) {
+            throw Exception(Exception::BAD_FORMAT);
+        }
+        newImageIds.push_back(string(length, '\0'));
+        if (length > 0) {
+            input.read(&newImageIds.back()[0], length);
+        }
+    }
+    if (!input || !getNumber(input, count)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    for (; count > 0; --count) {
+        Entry entry;
+        unsigned long long image, offset;
+        if (!getFixed(input, entry.fingerprint.high)
+            || !getFixed(input, entry.fingerprint.low)
+            || !getNumber(input, image)
+            || !getNumber(input, offset)
+            || !getNumber(input, length)
+            || (image >= newImageIds.size())) {
+            throw Exception(Exception::BAD_FORMAT);
+        }
+        entry.location.image = image;
+        entry.location.offset = offset;
+        entry.location.length = length;
+        entry.forgotten = false;
+        newEntries.push_back(entry);
+    }
+
+    pthread_mutex_lock(mutex);
+    imageIds.swap(newImageIds);
+    imageNumbers.clear();
+    for (unsigned image = 0; image < imageIds.size(); ++image) {
+        imageNumbers[imageIds[image]] = image;
+    }
+    loadedImageCount = imageIds.size();
+    imageEntries.assign(imageIds.size(), vector<unsigned>());
+    entries.clear();
+    forgottenCount = 0;
+    slots.assign(INITIAL_SLOTS, 0);
+    for (vector<Entry>::const_iterator iter = newEntries.begin();
+         iter != newEntries.end();
+         ++iter) {
+        addEntry(*iter);
+    }
+    pthread_mutex_unlock(mutex);
+}
@@ -0,0 +1,220 @@
+/*
+ * chunk_index.hh: class ChunkIndex header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CHUNK_INDEX_HH
+#define CHUNK_INDEX_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+
+namespace KryptoCD {
+    /**
+     * the fingerprint of a chunk of data: two XXH64 hashes with different
+     * seeds
+     */
+    struct Fingerprint {
+        unsigned long long high;
+        unsigned long long low;
+
+        /**
+         * computes the fingerprint of a chunk
+         */
+        static Fingerprint of(const char * data, size_t length);
+    };
+
+    /**
+     * Class ChunkIndex remembers all chunks that have been written to
+     * deduplicated archives, see DedupFilter: for each fingerprint, the
+     * image that contains the chunk, and its position in that image's
+     * uncompressed chunk stream. It is kept across backups in a file, so a
+     * chunk that has been burned once is never burned again.
+     * <p>
+     * All methods may be called by several threads at the same time, so
+     * several images can be deduplicated in parallel against one index.
+     * <p>
+     * Images are known by their ids. The id of an image whose chunks were
+     * loaded from the file is taken, see isStored(): new chunks stored
+     * under it would be confused with the chunks on the earlier cd.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ChunkIndex {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                UNABLE_TO_OPEN,
+                UNABLE_TO_WRITE,
+                BAD_FORMAT,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * where a chunk is stored
+         */
+        struct Location {
+            /**
+             * the image, see getImageNumber()
+             */
+            unsigned image;
+
+            /**
+             * the offset in the uncompressed chunk stream of the image
+             */
+            unsigned long long offset;
+
+            unsigned length;
+        };
+
+        /**
+         * creates an empty index
+         */
+        ChunkIndex();
+
+        ~ChunkIndex();
+
+        /**
+         * replaces the contents of the index with those of a file written
+         * by save()
+         *
+         * @exception ChunkIndex::Exception UNABLE_TO_OPEN or BAD_FORMAT
+         */
+        void load(const std::string & filename) throw(Exception);
+
+        /**
+         * saves the index to a file. The file is written under a temporary
+         * name and then renamed.
+         *
+         * @exception ChunkIndex::Exception UNABLE_TO_OPEN or UNABLE_TO_WRITE
+         */
+        void save(const std::string & filename) const throw(Exception);
+
+        /**
+         * @param imageId the id of an image, which must not be stored
+         *                already, see isStored()
+         * @return        a small number standing for this image, the same
+         *                for every call with the same id
+         */
+        unsigned getImageNumber(const std::string & imageId);
+
+        /**
+         * @return true if the index was loaded with chunks that are stored
+         *         in the image with this id. That image is on the cds of an
+         *         earlier backup, and its id must not be used again.
+         */
+        bool isStored(const std::string & imageId) const;
+
+        /**
+         * @return the id of the image with this number
+         */
+        std::string getImageId(unsigned image) const;
+
+        /**
+         * looks a chunk up, and adds it if it is not yet known
+         *
+         * @param fingerprint the fingerprint of the chunk
+         * @param location    where the chunk will be stored if it is new
+         * @param existing    receives the location of the chunk if it is
+         *                    already known
+         * @return            true if the chunk was known, false if it has
+         *                    been added
+         */
+        bool findOrAdd(const Fingerprint & fingerprint,
+                       const Location & location,
+                       Location & existing);
+
+        /**
+         * forgets all chunks stored in an image, because the image has been
+         * discarded. They will be stored again when they are next seen.
+         */
+        void forgetImage(const std::string & imageId);
+
+        /**
+         * @return the number of known chunks
+         */
+        size_t size(void) const;
+
+    private:
+        struct Entry {
+            Fingerprint fingerprint;
+            Location    location;
+
+            /**
+             * set by forgetImage()
+             */
+            bool        forgotten;
+        };
+
+        /**
+         * finds the slot of a fingerprint, or the free slot where it
+         * belongs. Called with the mutex held.
+         */
+        size_t findSlot(const Fingerprint & fingerprint) const;
+
+        /**
+         * adds an entry. Called with the mutex held.
+         */
+        void addEntry(const Entry & entry);
+
+        /**
+         * doubles the number of slots. Called with the mutex held.
+         */
+        void grow(void);
+
+        std::vector<std::string> imageIds;
+        std::map<std::string, unsigned> imageNumbers;
+
+        /**
+         * the ids up to this number were loaded from a file
+         */
+        unsigned loadedImageCount;
+
+        std::vector<Entry> entries;
+
+        /**
+         * for each image number, the indexes in "entries" of the chunks
+         * stored in that image, so forgetImage() need not search them
+         */
+        std::vector<std::vector<unsigned> > imageEntries;
+
+        /**
+         * an open addressing hash table: the index in "entries" plus one,
+         * or 0 for a free slot. The fingerprints are hashes already, so the
+         * low bits of the fingerprint select the slot.
+         */
+        std::vector<unsigned> slots;
+        size_t forgottenCount;
+
+        /**
+         * protects all of the above
+         */
+        pthread_mutex_t * mutex;
+    };
+}
+#endif
@@ -0,0 +1,307 @@
+/*
+ * chunked_decrypter.cpp: class ChunkedDecrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "chunked_decrypter.hh"
+#include "chunked_encrypter.hh"
+#include "gcm.hh"
+#include "key_cache.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::ChunkedDecrypter;
+using KryptoCD::ChunkedEncrypter;
+using KryptoCD::ChunkCrypter;
+using KryptoCD::Gcm;
+using KryptoCD::KeyCache;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using std::string;
+
+/**
+ * the range of chunk sizes that are accepted, as binary logarithms
+ */
+static const unsigned MIN_CHUNK_SIZE_LOG2 = 12;
+static const unsigned MAX_CHUNK_SIZE_LOG2 = 26;
+
+ChunkedDecrypter::ChunkedDecrypter(const string & password_,
+                                   Source & source,
+                                   Sink & sink,
+                                   int threads_,
+                                   long long plainStart,
+                                   long long plainEnd)
+    : Decrypter(plainStart, plainEnd),
+      password(password_),
+      threads(threads_),
+      written(0)
+{
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    sinkFd = dup(sink.getSinkFd());
+    sink.closeSink();
+
+    int success = start();
+    assert(success == 0);
+}
+
+ChunkedDecrypter::~ChunkedDecrypter() {
+    join();
+    KeyCache::wipe(&password[0], password.size());
+}
+
+void * ChunkedDecrypter::run(void) {
+    /*
+     * if the reader of the plain data has exited, write() has to fail
+     * with EPIPE instead of the whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    unsigned char key[KeyCache::KEY_LENGTH];
+    size_t chunkSize;
+    if (!readHeader(key, chunkSize)) {
+        failed = true;
+        close(sourceFd);
+        close(sinkFd);
+        return this;
+    }
+    Gcm gcm(key, sizeof(key));
+    KeyCache::wipe(key, sizeof(key));
+
+    /* the chunks that hold the range */
+    unsigned long long index = rangeStart / chunkSize;
+    unsigned long long last = ~0ULL;
+    if (rangeEnd >= 0) {
+        last = (rangeEnd > rangeStart) ? (rangeEnd - 1) / chunkSize : 0;
+    }
+    if ((index > 0) && !skipRecords(index, chunkSize)) {
+        failed = true;
+        close(sourceFd);
+        close(sinkFd);
+        return this;
+    }
+    written = index * chunkSize;
+
+    /*
+     * the chunks before a broken record are written, as long as they
+     * are authentic, since an archive cut to the size of a cd has to be
+     * listed up to the cut
+     */
+    bool success = true;
+    bool writing = true;
+    bool rangeDone = false;
+    ChunkCrypter::Chunk end;
+    end.kind = ChunkCrypter::DATA;
+    {
+        ChunkCrypter crypter(gcm, true, threads);
+        while (writing) {
+            if (index > last) {
+                rangeDone = true;
+                break;
+            }
+            ChunkCrypter::Chunk * chunk = crypter.getFree();
+            if (chunk == 0) {
+                /* all chunks are busy: write the oldest one */
+                chunk = crypter.getDone();
+                writing = writeChunk(*chunk);
+                crypter.release(chunk);
+                continue;
+            }
+            success = readRecord(*chunk, chunkSize);
+            if (success && (chunk->kind == ChunkCrypter::DATA)) {
+                chunk->index = index++;
+                crypter.submit(chunk);
+                continue;
+            }
+            if (success) {
+                end.kind = chunk->kind;
+                end.data.swap(chunk->data);
+                memcpy(end.tag, chunk->tag, sizeof(end.tag));
+            }
+            crypter.release(chunk);
+            break;
+        }
+
+        /* write the rest, until a chunk cannot be written */
+        for (ChunkCrypter::Chunk * chunk = crypter.getDone();
+             chunk != 0;
+             chunk = crypter.getDone()) {
+            writing = writing && writeChunk(*chunk);
+            crypter.release(chunk);
+        }
+    }
+
+    /*
+     * the END record tells whether chunks are missing at the end. A range
+     * that ends before is complete when all its chunks are authentic.
+     */
+    success = success && writing && (rangeDone
+        || ((end.kind == ChunkCrypter::END)
+            && (end.data.size() == ChunkedEncrypter::END_LENGTH)));
+    if (success && !rangeDone) {
+        end.index = index;
+        ChunkCrypter::decrypt(gcm, end);
+        unsigned long long count = 0;
+        unsigned long long total = 0;
+        for (int i = 0; i < 8; ++i) {
+            count = (count << 8) | end.data[i];
+            total = (total << 8) | end.data[8 + i];
+        }
+        unsigned char extra;
+        success = end.authentic && (count == index) && (total == written)
+            && !readInput(&extra, 1);
+    }
+    if (!success) {
+        failed = true;
+    }
+    close(sourceFd);
+    close(sinkFd);
+    return this;
+}
+
+bool ChunkedDecrypter::readHeader(unsigned char * key, size_t & chunkSize) {
+    unsigned char header[ChunkedEncrypter::HEADER_LENGTH];
+    if (!readInput(header, sizeof(header))
+        || (memcmp(header, ChunkedEncrypter::MAGIC,
+                   sizeof(ChunkedEncrypter::MAGIC)) != 0)
+        || (header[8] != ChunkedEncrypter::VERSION)
+        || (header[9] < MIN_CHUNK_SIZE_LOG2)
+        || (header[9] > MAX_CHUNK_SIZE_LOG2)) {
+        return false;
+    }
+    chunkSize = size_t(1) << header[9];
+    unsigned char count = header[10];
+    const unsigned char * salt = header + 11;
+    const unsigned char * keyNonce = header
+        + ChunkedEncrypter::AUTHENTICATED_HEADER_LENGTH - Gcm::NONCE_LENGTH;
+    memcpy(key, header + ChunkedEncrypter::AUTHENTICATED_HEADER_LENGTH,
+           KeyCache::KEY_LENGTH);
+
+    unsigned char passphraseKey[KeyCache::KEY_LENGTH];
+    try {
+        const KeyCache & cache = KeyCache::get(password);
+        if ((count == KeyCache::S2K_COUNT)
+            && (memcmp(salt, cache.getSalt(), KeyCache::SALT_LENGTH) == 0)) {
+            memcpy(passphraseKey, cache.getKey(), sizeof(passphraseKey));
+        } else {
+            KeyCache::deriveKey(password, salt, count,
+                                passphraseKey, sizeof(passphraseKey));
+        }
+    } catch (KeyCache::Exception &) {
+        return false;
+    }
+    bool success = Gcm(passphraseKey, sizeof(passphraseKey))
+        .decrypt(keyNonce, header,
+                 ChunkedEncrypter::AUTHENTICATED_HEADER_LENGTH,
+                 key, KeyCache::KEY_LENGTH,
+                 header + ChunkedEncrypter::AUTHENTICATED_HEADER_LENGTH
+                 + KeyCache::KEY_LENGTH);
+    KeyCache::wipe(passphraseKey, sizeof(passphraseKey));
+    return success;
+}
+
+bool ChunkedDecrypter::readRecord(ChunkCrypter::Chunk & chunk,
+                                  size_t chunkSize) {
+    unsigned char header[ChunkCrypter::HEADER_LENGTH];
+    if (!readInput(header, sizeof(header))) {
+        return false;
+    }
+    size_t length = (size_t(header[1]) << 24) | (header[2] << 16)
+        | (header[3] << 8) | header[4];
+    if (((header[0] != ChunkCrypter::DATA)
+         && (header[0] != ChunkCrypter::END))
+        || (length > chunkSize)) {
+        return false;
+    }
+    chunk.kind = header[0];
+    chunk.data.resize(length);
+    return (length == 0 || readInput(&chunk.data[0], length))
+        && readInput(chunk.tag, sizeof(chunk.tag));
+}
+
+bool ChunkedDecrypter::skipRecords(unsigned long long count,
+                                   size_t chunkSize) {
+    off_t recordLength = ChunkCrypter::HEADER_LENGTH + chunkSize
+        + Gcm::TAG_LENGTH;
+    if (lseek(sourceFd, off_t(count) * recordLength, SEEK_CUR) >= 0) {
+        return true;
+    }
+
+    /* not a file: the records are only checked to be data records */
+    ChunkCrypter::Chunk chunk;
+    for (unsigned long long i = 0; i < count; ++i) {
+        if (!readRecord(chunk, chunkSize)
+            || (chunk.kind != ChunkCrypter::DATA)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkedDecrypter::writeChunk(const ChunkCrypter::Chunk & chunk) {
+    if (!chunk.authentic) {
+        return false;
+    }
+    size_t skip;
+    size_t length = clip(written, chunk.data.size(), skip);
+    const unsigned char * data = (length == 0) ? 0 : &chunk.data[skip];
+    while (length > 0) {
+        ssize_t count = write(sinkFd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        length -= count;
+    }
+    written += chunk.data.size();
+    return true;
+}
+
+bool ChunkedDecrypter::readInput(unsigned char * data, size_t length) {
+    while (length > 0) {
+        ssize_t count = read(sourceFd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (count == 0) {
+            return false;
+        }
+        data += count;
+        length -= count;
+    }
+    return true;
+}
@@ -0,0 +1,130 @@
+/*
+ * chunked_decrypter.hh: class ChunkedDecrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CHUNKED_DECRYPTER_HH
+#define CHUNKED_DECRYPTER_HH
+
+#include "decrypter.hh"
+#include "chunk_crypter.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class ChunkedDecrypter decrypts what ChunkedEncrypter encrypted.
+     * The chunks are checked and decrypted by a ChunkCrypter's worker
+     * threads, and only chunks whose tags match are written, in order.
+     * If the key in the header was encrypted with the key in the
+     * passphrase's KeyCache, the S2K function does not run again.
+     * <p>
+     * For a range of the plain data, only the chunks that hold it are
+     * read and decrypted. If the input is a file, the chunks before them
+     * are skipped by seeking, since every chunk's position follows from
+     * its index, otherwise they are read without being decrypted.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ChunkedDecrypter : public Decrypter {
+    public:
+        /**
+         * starts the decrypting thread. Like a ChildFilter, the object
+         * takes over the file descriptors of source and sink, and closes
+         * them in the caller's view.
+         *
+         * @param password the passphrase
+         * @param source   the encrypted data are read from here
+         * @param sink     the plain data are written here
+         * @param threads  the largest number of threads decrypting chunks
+         * @param start    the offset of the first plain byte to write
+         * @param end      the offset after the last plain byte to write,
+         *                 or -1 for the end of the stream
+         */
+        ChunkedDecrypter(const std::string & password,
+                         Source & source,
+                         Sink & sink,
+                         int threads = ChunkCrypter::defaultThreads(),
+                         long long start = 0,
+                         long long end = -1);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~ChunkedDecrypter();
+
+    protected:
+        /**
+         * reads the records, and writes the decrypted chunks
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * reads the header, and decrypts the stream's key
+         *
+         * @param key       receives the key, KeyCache::KEY_LENGTH bytes
+         * @param chunkSize receives the largest payload of a data record
+         * @return false if the header is broken, or the passphrase wrong
+         */
+        bool readHeader(unsigned char * key, size_t & chunkSize);
+
+        /**
+         * reads the next record
+         *
+         * @return false at the end of the input, or if the record is
+         *         broken
+         */
+        bool readRecord(ChunkCrypter::Chunk & chunk, size_t chunkSize);
+
+        /**
+         * skips the records of the chunks before the range
+         *
+         * @return false if the input ends before
+         */
+        bool skipRecords(unsigned long long count, size_t chunkSize);
+
+        /**
+         * writes the part of a decrypted chunk that is in the range, if
+         * the chunk is authentic
+         */
+        bool writeChunk(const ChunkCrypter::Chunk & chunk);
+
+        /**
+         * reads exactly length bytes from the input file descriptor
+         */
+        bool readInput(unsigned char * data, size_t length);
+
+        std::string password;
+        int sourceFd;
+        int sinkFd;
+        int threads;
+
+        /**
+         * the number of plain bytes decrypted, or skipped before the range
+         */
+        unsigned long long written;
+    };
+}
+#endif
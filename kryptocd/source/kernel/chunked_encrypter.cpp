@@ -0,0 +1,231 @@
+/*
+ * chunked_encrypter.cpp: class ChunkedEncrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "chunked_encrypter.hh"
+#include "gcm.hh"
+#include "key_cache.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::ChunkedEncrypter;
+using KryptoCD::ChunkCrypter;
+using KryptoCD::Gcm;
+using KryptoCD::KeyCache;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using std::string;
+
+const char ChunkedEncrypter::MAGIC[8] = {'K','C','D','C','H','U','N','K'};
+
+/**
+ * the size of the pieces a chunk is read in
+ */
+static const size_t READ_SIZE = 64 * 1024;
+
+/**
+ * writes to a file descriptor
+ */
+static bool writeAll(int fd, const unsigned char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+ChunkedEncrypter::ChunkedEncrypter(const string & password_,
+                                   Source & source,
+                                   Sink & sink,
+                                   int threads_)
+    : password(password_),
+      threads(threads_)
+{
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    sinkFd = dup(sink.getSinkFd());
+    sink.closeSink();
+
+    int success = start();
+    assert(success == 0);
+}
+
+ChunkedEncrypter::~ChunkedEncrypter() {
+    join();
+    KeyCache::wipe(&password[0], password.size());
+}
+
+long long ChunkedEncrypter::encryptedSize(long long plainSize) {
+    long long records = (plainSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    return HEADER_LENGTH
+        + records * (ChunkCrypter::HEADER_LENGTH + Gcm::TAG_LENGTH)
+        + plainSize
+        + (ChunkCrypter::HEADER_LENGTH + END_LENGTH + Gcm::TAG_LENGTH);
+}
+
+bool ChunkedEncrypter::writeRecord(int fd, const ChunkCrypter::Chunk & chunk) {
+    unsigned char header[ChunkCrypter::HEADER_LENGTH];
+    ChunkCrypter::writeHeader(chunk, header);
+    return writeAll(fd, header, sizeof(header))
+        && (chunk.data.empty()
+            || writeAll(fd, &chunk.data[0], chunk.data.size()))
+        && writeAll(fd, chunk.tag, sizeof(chunk.tag));
+}
+
+void * ChunkedEncrypter::run(void) {
+    /*
+     * if the reader of the encrypted data has exited, write() has to fail
+     * with EPIPE instead of the whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    const KeyCache * cache = 0;
+    try {
+        cache = &KeyCache::get(password);
+    } catch (KeyCache::Exception &) {
+        failed = true;
+    }
+
+    unsigned char header[HEADER_LENGTH];
+    unsigned char * keyNonce = header + AUTHENTICATED_HEADER_LENGTH
+        - Gcm::NONCE_LENGTH;
+    unsigned char * key = header + AUTHENTICATED_HEADER_LENGTH;
+    if ((cache == 0)
+        || !KeyCache::readRandom(keyNonce, Gcm::NONCE_LENGTH)
+        || !KeyCache::readRandom(key, KeyCache::KEY_LENGTH)) {
+        failed = true;
+        close(sourceFd);
+        close(sinkFd);
+        return this;
+    }
+
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    header[8] = VERSION;
+    header[9] = CHUNK_SIZE_LOG2;
+    header[10] = KeyCache::S2K_COUNT;
+    memcpy(header + 11, cache->getSalt(), KeyCache::SALT_LENGTH);
+    Gcm gcm(key, KeyCache::KEY_LENGTH);
+    Gcm(cache->getKey(), KeyCache::KEY_LENGTH)
+        .encrypt(keyNonce, header, AUTHENTICATED_HEADER_LENGTH,
+                 key, KeyCache::KEY_LENGTH,
+                 key + KeyCache::KEY_LENGTH);
+
+    bool success = writeAll(sinkFd, header, sizeof(header));
+    unsigned long long index = 0;
+    unsigned long long total = 0;
+    {
+        ChunkCrypter crypter(gcm, false, threads);
+        bool more = true;
+        while (success && more) {
+            ChunkCrypter::Chunk * chunk = crypter.getFree();
+            if (chunk == 0) {
+                /* all chunks are busy: write the oldest one */
+                chunk = crypter.getDone();
+                success = writeRecord(sinkFd, *chunk);
+                crypter.release(chunk);
+                continue;
+            }
+            more = readChunk(*chunk);
+            if (chunk->data.empty()) {
+                crypter.release(chunk);
+            } else {
+                chunk->index = index++;
+                chunk->kind = ChunkCrypter::DATA;
+                total += chunk->data.size();
+                crypter.submit(chunk);
+            }
+        }
+
+        /* write the rest, or wait for it if the output failed */
+        for (ChunkCrypter::Chunk * chunk = crypter.getDone();
+             chunk != 0;
+             chunk = crypter.getDone()) {
+            success = success && writeRecord(sinkFd, *chunk);
+            crypter.release(chunk);
+        }
+    }
+
+    if (success && !failed) {
+        ChunkCrypter::Chunk end;
+        end.index = index;
+        end.kind = ChunkCrypter::END;
+        end.data.resize(END_LENGTH);
+        for (int i = 7; i >= 0; --i) {
+            end.data[i] = index;
+            end.data[8 + i] = total;
+            index >>= 8;
+            total >>= 8;
+        }
+        ChunkCrypter::encrypt(gcm, end);
+        success = writeRecord(sinkFd, end);
+    }
+    if (!success) {
+        failed = true;
+    }
+    close(sourceFd);
+    close(sinkFd);
+    return this;
+}
+
+bool ChunkedEncrypter::readChunk(ChunkCrypter::Chunk & chunk) {
+    /* reserving does not touch the memory of a short last chunk */
+    chunk.data.reserve(CHUNK_SIZE);
+    while (chunk.data.size() < CHUNK_SIZE) {
+        size_t filled = chunk.data.size();
+        size_t count = CHUNK_SIZE - filled;
+        if (count > READ_SIZE) {
+            count = READ_SIZE;
+        }
+        chunk.data.resize(filled + count);
+        ssize_t got = read(sourceFd, &chunk.data[filled], count);
+        if (got < 0) {
+            chunk.data.resize(filled);
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        chunk.data.resize(filled + got);
+        if (got == 0) {
+            return false;
+        }
+    }
+    return true;
+}
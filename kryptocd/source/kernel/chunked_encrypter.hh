@@ -0,0 +1,141 @@
+/*
+ * chunked_encrypter.hh: class ChunkedEncrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CHUNKED_ENCRYPTER_HH
+#define CHUNKED_ENCRYPTER_HH
+
+#include "encrypter.hh"
+#include "chunk_crypter.hh"
+#include <string>
+
+namespace KryptoCD {
+    /**
+     * Class ChunkedEncrypter encrypts a stream in the CHUNKED format,
+     * see Encrypter::Format. An OpenPGP stream is one long CFB chain, so
+     * it is encrypted and decrypted on one processor, and reading any
+     * byte means decrypting everything before it. This format splits the
+     * stream into chunks of CHUNK_SIZE bytes, which are encrypted
+     * independently with AES-256-GCM by a ChunkCrypter's worker threads.
+     * <p>
+     * The stream starts with a header of HEADER_LENGTH bytes:
+     * <ul><li>MAGIC, the version, and the binary logarithm of the chunk
+     * size, 1 byte each but MAGIC
+     * <li>the coded S2K count and the salt of the passphrase's KeyCache
+     * <li>a random nonce, and a random key for this stream, encrypted
+     * with the cached key in GCM, authenticating all header bytes before
+     * it, and its tag
+     * </ul>
+     * Then follow the records of the data chunks, see ChunkCrypter, and
+     * an END record whose payload is the number of data chunks and the
+     * number of plain bytes, 8 bytes each, so a stream that is cut after
+     * a record is recognized. All data records but the last one hold a
+     * full chunk, so the position of every chunk in the stream follows
+     * from its index, and no separate chunk table is needed.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ChunkedEncrypter : public Encrypter {
+    public:
+        static const char MAGIC[8];
+        static const unsigned char VERSION = 1;
+
+        /**
+         * the binary logarithm of the chunk size, and the chunk size
+         */
+        static const unsigned CHUNK_SIZE_LOG2 = 22;
+        static const size_t CHUNK_SIZE = size_t(1) << CHUNK_SIZE_LOG2;
+
+        /**
+         * the header: magic, version, chunk size, S2K count, salt, key
+         * nonce, encrypted key, key tag
+         */
+        static const size_t HEADER_LENGTH = 8 + 1 + 1 + 1 + 8 + 12 + 32 + 16;
+
+        /**
+         * the length of the header bytes that the key's tag authenticates
+         */
+        static const size_t AUTHENTICATED_HEADER_LENGTH = 8 + 1 + 1 + 1 + 8 + 12;
+
+        /**
+         * the length of an END record's payload
+         */
+        static const size_t END_LENGTH = 16;
+
+        /**
+         * starts the encrypting thread. Like a ChildFilter, the object
+         * takes over the file descriptors of source and sink, and closes
+         * them in the caller's view.
+         *
+         * @param password the passphrase
+         * @param source   the plain data are read from here
+         * @param sink     the encrypted data are written here
+         * @param threads  the largest number of threads encrypting chunks
+         */
+        ChunkedEncrypter(const std::string & password,
+                         Source & source,
+                         Sink & sink,
+                         int threads = ChunkCrypter::defaultThreads());
+
+        /**
+         * waits for the thread
+         */
+        virtual ~ChunkedEncrypter();
+
+        /**
+         * @return the number of bytes written for plainSize plain bytes,
+         *         see Encrypter::encryptedSize()
+         */
+        static long long encryptedSize(long long plainSize);
+
+        /**
+         * writes a chunk's record
+         *
+         * @return false if fd could not be written
+         */
+        static bool writeRecord(int fd, const ChunkCrypter::Chunk & chunk);
+
+    protected:
+        /**
+         * reads the stream into chunks, and writes the encrypted records
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * fills a chunk from the input, up to CHUNK_SIZE bytes
+         *
+         * @return false at the end of the input, or if it could not be
+         *         read. failed is set in the second case.
+         */
+        bool readChunk(ChunkCrypter::Chunk & chunk);
+
+        std::string password;
+        int sourceFd;
+        int sinkFd;
+        int threads;
+    };
+}
+#endif
@@ -0,0 +1,208 @@
+/*
+ * content_hasher.cpp: class ContentHasher implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "content_hasher.hh"
+#include "xxh64.hh"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+using KryptoCD::ContentHasher;
+using KryptoCD::FileMetadata;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using KryptoCD::Xxh64;
+using std::string;
+using std::vector;
+
+/**
+ * the size of the buffer each thread reads files into
+ */
+static const size_t READ_BUFFER_SIZE = 256 * 1024;
+
+ContentHasher::ContentHasher(const PathStore & paths_,
+                             const MetadataScanner & metadata_,
+                             const HashIndex & index_,
+                             int threads_)
+    : paths(paths_),
+      metadata(metadata_),
+      index(index_),
+      threads(threads_),
+      nextPending(0),
+      mutex(new pthread_mutex_t),
+      hashed(new pthread_cond_t)
+{
+    assert(threads > 0);
+    pthread_mutex_init(mutex, 0);
+    pthread_cond_init(hashed, 0);
+}
+
+ContentHasher::~ContentHasher() {
+    finish();
+    int destroyVal = pthread_cond_destroy(hashed);
+    assert (destroyVal == 0);
+    delete hashed;
+    destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+}
+
+bool ContentHasher::hashFile(const char * name, unsigned long long & hash,
+                             vector<char> & buffer) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (buffer.empty()) {
+        buffer.resize(READ_BUFFER_SIZE);
+    }
+
+    Xxh64 hasher;
+    ssize_t count;
+    while ((count = read(fd, &buffer[0], buffer.size())) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        hasher.update(&buffer[0], count);
+    }
+    close(fd);
+
+    hash = hasher.digest();
+    if (hash == 0) {
+        hash = 1;
+    }
+    return true;
+}
+
+void ContentHasher::start(const PathList & files) {
+    assert(workers.empty());
+    if (slotOf.size() < paths.size()) {
+        slotOf.resize(paths.size(), 0);
+    }
+
+    /* look everything up in the index first, queue the rest: */
+    pending.clear();
+    nextPending = 0;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        if (slotOf[*iter] != 0) {
+            continue;
+        }
+        hashes.push_back(0);
+        states.push_back(NO_HASH);
+        slotOf[*iter] = hashes.size();
+
+        const FileMetadata * st = metadata.get(*iter);
+        if ((st == 0) || !S_ISREG(st->mode)) {
+            continue;
+        }
+        if (index.lookup(*st, hashes.back())) {
+            states.back() = HASHED;
+        } else {
+            states.back() = PENDING;
+            pending.push_back(*iter);
+        }
+    }
+
+    size_t threadCount = pending.size();
+    if (threadCount > size_t(threads)) {
+        threadCount = threads;
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+}
+
+void * ContentHasher::Worker::run(void) {
+    hasher.work();
+    return this;
+}
+
+void ContentHasher::work(void) {
+    string name;
+    vector<char> buffer;
+
+    for (;;) {
+        pthread_mutex_lock(mutex);
+        if (nextPending == pending.size()) {
+            pthread_mutex_unlock(mutex);
+            break;
+        }
+        PathId file = pending[nextPending++];
+        pthread_mutex_unlock(mutex);
+
+        unsigned slot = slotOf[file] - 1;
+        name.erase();
+        paths.appendPath(file, name);
+        bool success = hashFile(name.c_str(), hashes[slot], buffer);
+
+        pthread_mutex_lock(mutex);
+        states[slot] = success ? HASHED : NO_HASH;
+        pthread_cond_broadcast(hashed);
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+bool ContentHasher::get(PathId file, unsigned long long & hash) {
+    if ((file >= slotOf.size()) || (slotOf[file] == 0)) {
+        return false;
+    }
+    unsigned slot = slotOf[file] - 1;
+
+    pthread_mutex_lock(mutex);
+    while (states[slot] == PENDING) {
+        pthread_cond_wait(hashed, mutex);
+    }
+    bool success = (states[slot] == HASHED);
+    pthread_mutex_unlock(mutex);
+
+    if (success) {
+        hash = hashes[slot];
+    }
+    return success;
+}
+
+void ContentHasher::finish(void) {
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+    workers.clear();
+}
+
+size_t ContentHasher::getHashedCount(void) const {
+    return pending.size();
+}
@@ -0,0 +1,163 @@
+/*
+ * content_hasher.hh: class ContentHasher header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef CONTENT_HASHER_HH
+#define CONTENT_HASHER_HH
+
+#include "path_store.hh"
+#include "metadata_scanner.hh"
+#include "hash_index.hh"
+#include "thread.hh"
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class ContentHasher fingerprints the contents of regular files with
+     * XXH64, for change detection that does not depend on mtime alone.
+     * Files whose device, inode, mtime and size are found in a HashIndex
+     * are not read again, so normally only new and modified files cost
+     * anything.
+     * <p>
+     * start() returns immediately, the files are hashed by worker threads
+     * in the background, in the order of the list. get() waits only for
+     * the file it is asked about. The caller can therefore go on with the
+     * backup, and by the time it needs a hash, it is usually there.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ContentHasher {
+    public:
+        /**
+         * @param paths    the store containing the file names
+         * @param metadata a scanner that has scanned the files
+         * @param index    hashes known from earlier backups, sorted
+         * @param threads  the number of threads reading files
+         */
+        ContentHasher(const PathStore & paths,
+                      const MetadataScanner & metadata,
+                      const HashIndex & index,
+                      int threads);
+
+        /**
+         * waits for the worker threads
+         */
+        ~ContentHasher();
+
+        /**
+         * starts hashing the regular files in a list. Must not be called
+         * again before finish().
+         */
+        void start(const PathList & files);
+
+        /**
+         * gets the hash of a file, waiting until it has been computed
+         *
+         * @param file a file from the list passed to start()
+         * @param hash receives the hash, never 0
+         * @return     false if the file is not a regular file, could not be
+         *             read, or was not passed to start()
+         */
+        bool get(PathId file, unsigned long long & hash);
+
+        /**
+         * waits until all files have been hashed
+         */
+        void finish(void);
+
+        /**
+         * @return the number of files that were actually read, not found
+         *         in the index
+         */
+        size_t getHashedCount(void) const;
+
+        /**
+         * hashes a single file on the calling thread
+         *
+         * @param name   the name of the file
+         * @param hash   receives the hash. A hash of 0 is changed to 1, so
+         *               that 0 can mean "unknown".
+         * @param buffer a buffer for reading, resized if empty
+         * @return       true if the file could be read
+         */
+        static bool hashFile(const char * name, unsigned long long & hash,
+                             std::vector<char> & buffer);
+
+    private:
+        enum State {
+            PENDING,
+            HASHED,
+            NO_HASH,
+        };
+
+        /**
+         * the work of one thread: hash pending files until there are none
+         * left
+         */
+        void work(void);
+
+        /**
+         * a thread calling work()
+         */
+        class Worker : public Thread {
+            ContentHasher & hasher;
+        public:
+            Worker(ContentHasher & h) : hasher(h) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        const PathStore & paths;
+        const MetadataScanner & metadata;
+        const HashIndex & index;
+        int threads;
+        std::vector<Worker *> workers;
+
+        /**
+         * slotOf[id] is the index in "hashes" and "states" of the file
+         * with PathId id, plus one. 0 for files not passed to start().
+         */
+        std::vector<unsigned> slotOf;
+        std::vector<unsigned long long> hashes;
+        std::vector<char> states;
+
+        /**
+         * the files that have to be read, in the order of the list, and
+         * the index of the next one to be taken by a worker
+         */
+        std::vector<PathId> pending;
+        size_t nextPending;
+
+        /**
+         * protects nextPending and "states". "hashed" is signalled
+         * whenever a file is done.
+         */
+        pthread_mutex_t * mutex;
+        pthread_cond_t  * hashed;
+    };
+}
+#endif
@@ -0,0 +1,89 @@
+/*
+ * decrypter.cpp: class Decrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "decrypter.hh"
+#include "pgp_decrypter.hh"
+#include "chunked_decrypter.hh"
+#include <assert.h>
+
+using KryptoCD::Decrypter;
+using KryptoCD::Encrypter;
+using KryptoCD::PgpDecrypter;
+using KryptoCD::ChunkedDecrypter;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using std::string;
+
+Decrypter * Decrypter::create(Encrypter::Format format,
+                              const string & password,
+                              Source & source,
+                              Sink & sink,
+                              long long start,
+                              long long end) {
+    if (format == Encrypter::CHUNKED) {
+        return new ChunkedDecrypter(password, source, sink,
+                                    ChunkCrypter::defaultThreads(),
+                                    start, end);
+    }
+    assert(format == Encrypter::OPENPGP);
+    return new PgpDecrypter(password, source, sink, start, end);
+}
+
+Decrypter::Decrypter(long long start, long long end)
+    : failed(false),
+      rangeStart(start),
+      rangeEnd(end)
+{
+}
+
+Decrypter::~Decrypter() {
+}
+
+void Decrypter::wait(void) {
+    join();
+}
+
+bool Decrypter::exitedAbnormally(void) const {
+    return failed;
+}
+
+size_t Decrypter::clip(unsigned long long offset, size_t length,
+                       size_t & skip) const {
+    unsigned long long pieceEnd = offset + length;
+    unsigned long long first = rangeStart;
+    unsigned long long last = (rangeEnd < 0) ? pieceEnd : rangeEnd;
+    if (first < offset) {
+        first = offset;
+    }
+    if (last > pieceEnd) {
+        last = pieceEnd;
+    }
+    skip = 0;
+    if (first >= last) {
+        return 0;
+    }
+    skip = first - offset;
+    return last - first;
+}
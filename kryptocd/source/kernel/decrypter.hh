@@ -0,0 +1,115 @@
+/*
+ * decrypter.hh: class Decrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef DECRYPTER_HH
+#define DECRYPTER_HH
+
+#include "encrypter.hh"
+#include <string>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+
+    /**
+     * Class Decrypter is the base class of the threads that decrypt what
+     * an Encrypter encrypted. They read the encrypted data from a Source
+     * and write the plain data to a Sink, taking over the file
+     * descriptors of both like an Encrypter.
+     * <p>
+     * A Decrypter can be asked for a range of the plain data only. It
+     * then writes nothing else, and closes the Sink at the end of the
+     * range. How much of the rest it has to decrypt depends on the
+     * format.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Decrypter : public Thread {
+    public:
+        /**
+         * starts a decrypting thread for a format
+         *
+         * @param format   the format of the encrypted stream, see
+         *                 Encrypter::Format
+         * @param password the passphrase
+         * @param source   the encrypted data are read from here
+         * @param sink     the plain data are written here
+         * @param start    the offset of the first plain byte to write
+         * @param end      the offset after the last plain byte to write,
+         *                 or -1 for the end of the stream
+         * @return         the thread, to be deleted by the caller
+         */
+        static Decrypter * create(Encrypter::Format format,
+                                  const std::string & password,
+                                  Source & source,
+                                  Sink & sink,
+                                  long long start = 0,
+                                  long long end = -1);
+
+        virtual ~Decrypter();
+
+        /**
+         * waits until all data has been decrypted, or decryption failed
+         */
+        void wait(void);
+
+        /**
+         * @return true if the input was not a stream of the format, the
+         *         passphrase was wrong, the data has been modified, or the
+         *         output could not be written. Only meaningful after
+         *         wait().
+         */
+        bool exitedAbnormally(void) const;
+
+    protected:
+        Decrypter(long long start, long long end);
+
+        /**
+         * finds the part of a piece of plain data that is in the range
+         *
+         * @param offset the offset of the piece in the plain data
+         * @param length the length of the piece
+         * @param skip   receives the number of the piece's bytes before
+         *               the range
+         * @return       the number of the piece's bytes in the range, after
+         *               the skipped ones
+         */
+        size_t clip(unsigned long long offset, size_t length,
+                    size_t & skip) const;
+
+        /**
+         * set by the thread if decryption failed
+         */
+        bool failed;
+
+        /**
+         * the range of plain data to write, see create()
+         */
+        long long rangeStart;
+        long long rangeEnd;
+    };
+}
+#endif
@@ -0,0 +1,291 @@
+/*
+ * dedup_filter.cpp: class DedupFilter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "dedup_filter.hh"
+#include "varint.hh"
+#include "pipe.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::DedupFilter;
+using KryptoCD::ChunkIndex;
+using KryptoCD::Fingerprint;
+using KryptoCD::Pipe;
+using std::string;
+using std::vector;
+
+const string DedupFilter::CHUNKS_FILENAME("/kryptocd_chunks.bz2.gpg");
+const string DedupFilter::RECIPE_FILENAME("/kryptocd_recipe.gpg");
+
+const string DedupFilter::RECIPE_MAGIC("KryptoCD recipe 1\n");
+const unsigned DedupFilter::MIN_CHUNK_SIZE;
+const unsigned DedupFilter::MAX_CHUNK_SIZE;
+
+/**
+ * the average chunk size. Below the average size, a cut needs more zero
+ * bits in the gear hash than above it ("normalized chunking"), which keeps
+ * most chunks close to the average.
+ */
+static const size_t AVERAGE_CHUNK_SIZE = 8 * 1024;
+static const unsigned long long MASK_SMALL = 0x7fffULL << 49;
+static const unsigned long long MASK_LARGE = 0x7ffULL << 53;
+
+/**
+ * the size of the buffer the tar stream is read into, a multiple of the
+ * maximum chunk size
+ */
+static const size_t INPUT_BUFFER_SIZE = 16 * DedupFilter::MAX_CHUNK_SIZE;
+
+/**
+ * the recipe is written in pieces of about this size
+ */
+static const size_t RECIPE_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * one random number for each byte value. They are generated by a fixed
+ * generator (splitmix64), so the cuts, and thereby the deduplication
+ * across backups, never depend on the build.
+ */
+class GearTable {
+public:
+    unsigned long long gear[256];
+    GearTable() {
+        unsigned long long state = 0;
+        for (int i = 0; i < 256; ++i) {
+            state += 0x9e3779b97f4a7c15ULL;
+            unsigned long long z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            gear[i] = z ^ (z >> 31);
+        }
+    }
+};
+static const GearTable GEAR_TABLE;
+
+/**
+ * writes a whole buffer to a file descriptor
+ *
+ * @return false if writing failed
+ */
+static bool writeAll(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+DedupFilter::DedupFilter(ChunkIndex & index_, const string & imageId,
+                         Pipe * input_, Pipe * chunks_, Pipe * recipe_)
+    : index(index_),
+      image(index_.getImageNumber(imageId)),
+      input(input_),
+      chunks(chunks_),
+      recipe(recipe_),
+      recipeImageCount(0),
+      totalBytes(0),
+      newBytes(0),
+      cutBytes(0)
+{
+    int success = start();
+    assert(success == 0);
+}
+
+DedupFilter::~DedupFilter() {
+    join();
+    delete input;
+    delete chunks;
+    delete recipe;
+}
+
+long long DedupFilter::getTotalBytes(void) const {
+    return totalBytes;
+}
+
+long long DedupFilter::getNewBytes(void) const {
+    return newBytes;
+}
+
+long long DedupFilter::getTarBytes(long long chunkBytes) const {
+    /* find the first new chunk that does not end within chunkBytes: */
+    size_t low = 0;
+    size_t high = newChunks.size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (newChunks[middle].end <= chunkBytes) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    /* the known chunks before it are on earlier cds */
+    return (low < newChunks.size()) ? newChunks[low].tarOffset : cutBytes;
+}
+
+size_t DedupFilter::findBoundary(const char * data, size_t length) {
+    if (length <= MIN_CHUNK_SIZE) {
+        return length;
+    }
+    size_t normal = (length < AVERAGE_CHUNK_SIZE) ? length : AVERAGE_CHUNK_SIZE;
+    size_t end = (length < MAX_CHUNK_SIZE) ? length : MAX_CHUNK_SIZE;
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(data);
+    unsigned long long hash = 0;
+    size_t i = MIN_CHUNK_SIZE;
+
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + GEAR_TABLE.gear[bytes[i]];
+        if ((hash & MASK_SMALL) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + GEAR_TABLE.gear[bytes[i]];
+        if ((hash & MASK_LARGE) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+void DedupFilter::addToRecipe(const ChunkIndex::Location & location) {
+    if (recipeImages.size() <= location.image) {
+        recipeImages.resize(location.image + 1, 0);
+    }
+    if (recipeImages[location.image] == 0) {
+        string imageId = index.getImageId(location.image);
+        putNumber(recipeBuffer, RECIPE_IMAGE);
+        putNumber(recipeBuffer, imageId.length());
+        recipeBuffer += imageId;
+        recipeImages[location.image] = ++recipeImageCount;
+    }
+    putNumber(recipeBuffer, RECIPE_CHUNK);
+    putNumber(recipeBuffer, recipeImages[location.image] - 1);
+    putNumber(recipeBuffer, location.offset);
+    putNumber(recipeBuffer, location.length);
+}
+
+bool DedupFilter::flushRecipe(void) {
+    bool success = writeAll(recipe->getSinkFd(),
+                            recipeBuffer.data(), recipeBuffer.length());
+    recipeBuffer.erase();
+    return success;
+}
+
+void * DedupFilter::run(void) {
+    vector<char> buffer(INPUT_BUFFER_SIZE);
+    size_t filled = 0;
+    bool endOfStream = false;
+    bool success = true;
+
+    /*
+     * if bzip2 or gpg are killed, write() has to fail with EPIPE instead of
+     * the whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    recipeBuffer = RECIPE_MAGIC;
+    while (success && (!endOfStream || (filled > 0))) {
+        /* keep at least one maximum chunk in the buffer, if possible: */
+        while (!endOfStream && (filled < buffer.size())) {
+            ssize_t count = read(input->getSourceFd(),
+                                 &buffer[filled], buffer.size() - filled);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                success = false;
+                break;
+            }
+            if (count == 0) {
+                endOfStream = true;
+            }
+            filled += count;
+            totalBytes += count;
+        }
+        if (!success) {
+            break;
+        }
+
+        /* cut all complete chunks: */
+        size_t position = 0;
+        while ((filled - position >= MAX_CHUNK_SIZE)
+               || (endOfStream && (position < filled))) {
+            size_t length = findBoundary(&buffer[position], filled - position);
+            ChunkIndex::Location location, existing;
+            location.image = image;
+            location.offset = newBytes;
+            location.length = length;
+            if (index.findOrAdd(Fingerprint::of(&buffer[position], length),
+                                location, existing)) {
+                location = existing;
+            } else {
+                if (!writeAll(chunks->getSinkFd(),
+                              &buffer[position], length)) {
+                    success = false;
+                    break;
+                }
+                newBytes += length;
+                NewChunk newChunk;
+                newChunk.tarOffset = cutBytes;
+                newChunk.end = newBytes;
+                newChunks.push_back(newChunk);
+            }
+            addToRecipe(location);
+            if ((recipeBuffer.length() >= RECIPE_BUFFER_SIZE)
+                && !flushRecipe()) {
+                success = false;
+                break;
+            }
+            position += length;
+            cutBytes += length;
+        }
+        memmove(&buffer[0], &buffer[position], filled - position);
+        filled -= position;
+    }
+    if (success) {
+        putNumber(recipeBuffer, RECIPE_END);
+        putNumber(recipeBuffer, totalBytes);
+        flushRecipe();
+    }
+
+    /* EOF for bzip2 and gpg, and a broken pipe for tar if we failed: */
+    input->closeSource();
+    chunks->closeSink();
+    recipe->closeSink();
+    return this;
+}
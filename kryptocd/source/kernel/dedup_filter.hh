@@ -0,0 +1,209 @@
+/*
+ * dedup_filter.hh: class DedupFilter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef DEDUP_FILTER_HH
+#define DEDUP_FILTER_HH
+
+#include "chunk_index.hh"
+#include "thread.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    class Pipe;
+
+    /**
+     * Class DedupFilter removes data from a tar stream that has already
+     * been stored in an earlier image. It sits between tar and bzip2, see
+     * ArchiveCreator.
+     * <p>
+     * The stream is cut into chunks of 2 to 64 kB, 8 kB on average, with
+     * the FastCDC algorithm: a rolling "gear" hash over the last bytes
+     * decides where a chunk ends, so the cuts depend on the contents only,
+     * and an insertion into a file shifts the following cuts along instead
+     * of changing all following chunks. Each chunk is looked up in a
+     * ChunkIndex. New chunks go to the chunk stream, which is compressed,
+     * encrypted and stored as CHUNKS_FILENAME. For every chunk, new or
+     * not, the recipe gets an entry saying where it is stored. The recipe
+     * is encrypted and stored as RECIPE_FILENAME. A DedupReplayer rebuilds
+     * the tar stream from the recipe and the chunk streams.
+     * <p>
+     * The recipe format is a sequence of variable length integers: after
+     * the line "KryptoCD recipe 1\n", each entry is either RECIPE_IMAGE,
+     * the length of an image id and the id, which gives the id the next
+     * image number, or RECIPE_CHUNK, the image number, the offset in that
+     * image's chunk stream and the length of a chunk. The last entry is
+     * RECIPE_END and the length of the tar stream, so that a truncated
+     * recipe is detected.
+     * <p>
+     * The work is done by a thread that is started by the constructor.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class DedupFilter : public Thread {
+    public:
+        /**
+         * the names of the files on a cd that contain a deduplicated
+         * archive, instead of /kryptocd_archive.tar.bz2.gpg
+         */
+        static const std::string CHUNKS_FILENAME;
+        static const std::string RECIPE_FILENAME;
+
+        /**
+         * the first line of every recipe
+         */
+        static const std::string RECIPE_MAGIC;
+
+        /**
+         * the types of recipe entries
+         */
+        enum RecipeEntry {
+            RECIPE_IMAGE,
+            RECIPE_CHUNK,
+            RECIPE_END,
+        };
+
+        /**
+         * the smallest chunk size, except for the last chunk of a stream
+         */
+        static const unsigned MIN_CHUNK_SIZE = 2 * 1024;
+
+        /**
+         * the largest chunk size
+         */
+        static const unsigned MAX_CHUNK_SIZE = 64 * 1024;
+
+        /**
+         * starts the filter thread
+         *
+         * @param index   the chunks stored so far. New chunks are added.
+         * @param imageId the id of the image the chunk stream goes to
+         * @param input   the tar stream is read from this pipe
+         * @param chunks  the new chunks are written to this pipe
+         * @param recipe  the recipe is written to this pipe
+         *                The pipes are deleted by this object. Their other
+         *                ends should have been passed to child processes
+         *                already.
+         */
+        DedupFilter(ChunkIndex & index, const std::string & imageId,
+                    Pipe * input, Pipe * chunks, Pipe * recipe);
+
+        /**
+         * waits for the thread, and deletes the pipes
+         */
+        virtual ~DedupFilter();
+
+        /**
+         * @return the number of bytes read from the tar stream, valid after
+         *         the thread has finished
+         */
+        long long getTotalBytes(void) const;
+
+        /**
+         * @return the number of bytes written to the chunk stream, valid
+         *         after the thread has finished
+         */
+        long long getNewBytes(void) const;
+
+        /**
+         * @param chunkBytes the length of a beginning of the chunk stream,
+         *                   as much as was stored when the stream was cut
+         * @return           the length of the beginning of the tar stream
+         *                   that can be rebuilt from it and the chunks of
+         *                   earlier images. Valid after the thread has
+         *                   finished.
+         */
+        long long getTarBytes(long long chunkBytes) const;
+
+        /**
+         * finds the end of the first chunk in a buffer
+         *
+         * @param data   the buffer
+         * @param length the number of bytes in the buffer. If it is less
+         *               than the maximum chunk size, the buffer has to
+         *               contain the end of the stream.
+         * @return       the length of the first chunk
+         */
+        static size_t findBoundary(const char * data, size_t length);
+
+    protected:
+        /**
+         * reads the tar stream and writes the chunks and the recipe
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * writes the recipe buffer to the recipe pipe
+         *
+         * @return false if the pipe has been closed by the reader
+         */
+        bool flushRecipe(void);
+
+        /**
+         * adds an entry for a chunk to the recipe buffer, preceeded by the
+         * image id if it is the first chunk from that image
+         */
+        void addToRecipe(const ChunkIndex::Location & location);
+
+        ChunkIndex & index;
+        unsigned image;
+        Pipe * input;
+        Pipe * chunks;
+        Pipe * recipe;
+        std::string recipeBuffer;
+
+        /**
+         * the recipe's number for each image number of the index, plus
+         * one, or 0 for images not yet mentioned in the recipe
+         */
+        std::vector<unsigned> recipeImages;
+        unsigned recipeImageCount;
+
+        /**
+         * where a new chunk begins in the tar stream, and where it ends in
+         * the chunk stream
+         */
+        struct NewChunk {
+            long long tarOffset;
+            long long end;
+        };
+
+        /**
+         * the new chunks, in stream order, for getTarBytes()
+         */
+        std::vector<NewChunk> newChunks;
+
+        long long totalBytes;
+        long long newBytes;
+
+        /**
+         * the number of tar bytes cut into chunks
+         */
+        long long cutBytes;
+    };
+}
+#endif
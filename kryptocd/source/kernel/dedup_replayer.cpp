@@ -0,0 +1,175 @@
+/*
+ * dedup_replayer.cpp: class DedupReplayer implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "dedup_replayer.hh"
+#include "dedup_filter.hh"
+#include "varint.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+using KryptoCD::DedupReplayer;
+using KryptoCD::DedupFilter;
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+    /**
+     * reads a file descriptor byte by byte, through a buffer
+     */
+    class BufferedInput {
+        int fd;
+        vector<char> buffer;
+        size_t position;
+        size_t filled;
+    public:
+        BufferedInput(int f) : fd(f), buffer(64 * 1024), position(0),
+                               filled(0) {}
+        int get(void) {
+            if (position == filled) {
+                ssize_t count;
+                do {
+                    count = read(fd, &buffer[0], buffer.size());
+                } while ((count < 0) && (errno == EINTR));
+                if (count <= 0) {
+                    return EOF;
+                }
+                position = 0;
+                filled = count;
+            }
+            return static_cast<unsigned char>(buffer[position++]);
+        }
+    };
+}
+
+DedupReplayer::DedupReplayer(const map<string, string> & chunkFiles_)
+    : chunkFiles(chunkFiles_)
+{}
+
+DedupReplayer::~DedupReplayer() {
+    for (map<string, int>::iterator iter = openFiles.begin();
+         iter != openFiles.end();
+         ++iter) {
+        close(iter->second);
+    }
+}
+
+int DedupReplayer::openChunks(const string & imageId)
+    throw(DedupReplayer::Exception) {
+    map<string, int>::iterator open = openFiles.find(imageId);
+    if (open != openFiles.end()) {
+        return open->second;
+    }
+    map<string, string>::const_iterator name = chunkFiles.find(imageId);
+    if (name == chunkFiles.end()) {
+        throw Exception(Exception::MISSING_IMAGE, imageId);
+    }
+    int fd = ::open(name->second.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception(Exception::MISSING_IMAGE, imageId);
+    }
+    openFiles[imageId] = fd;
+    return fd;
+}
+
+void DedupReplayer::replay(Source & recipe, Sink & output)
+    throw(DedupReplayer::Exception) {
+    BufferedInput input(recipe.getSourceFd());
+
+    for (size_t i = 0; i < DedupFilter::RECIPE_MAGIC.length(); ++i) {
+        if (input.get()
+            != static_cast<unsigned char>(DedupFilter::RECIPE_MAGIC[i])) {
+            throw Exception(Exception::BAD_RECIPE);
+        }
+    }
+
+    vector<int> images;
+    unsigned long long written = 0;
+    vector<char> chunk(DedupFilter::MAX_CHUNK_SIZE);
+    unsigned long long type;
+    while (getNumber(input, type)) {
+        if (type == DedupFilter::RECIPE_IMAGE) {
+            unsigned long long length;
+            if (!getNumber(input, length)) {
+                throw Exception(Exception::BAD_RECIPE);
+            }
+            string imageId;
+            for (; length > 0; --length) {
+                int c = input.get();
+                if (c == EOF) {
+                    throw Exception(Exception::BAD_RECIPE);
+                }
+                imageId += char(c);
+            }
+            images.push_back(openChunks(imageId));
+            continue;
+        }
+        if (type == DedupFilter::RECIPE_END) {
+            unsigned long long total;
+            if (!getNumber(input, total) || (total != written)) {
+                throw Exception(Exception::BAD_RECIPE);
+            }
+            return;
+        }
+
+        unsigned long long image, offset, length;
+        if ((type != DedupFilter::RECIPE_CHUNK)
+            || !getNumber(input, image) || !getNumber(input, offset)
+            || !getNumber(input, length)
+            || (image >= images.size())
+            || (length > DedupFilter::MAX_CHUNK_SIZE)) {
+            throw Exception(Exception::BAD_RECIPE);
+        }
+        size_t done = 0;
+        while (done < length) {
+            ssize_t count = pread(images[image], &chunk[done],
+                                  length - done, offset + done);
+            if ((count < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (count <= 0) {
+                throw Exception(Exception::UNABLE_TO_READ_CHUNK);
+            }
+            done += count;
+        }
+        for (done = 0; done < length;) {
+            ssize_t count = write(output.getSinkFd(), &chunk[done],
+                                  length - done);
+            if ((count < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (count < 0) {
+                throw Exception(Exception::UNABLE_TO_WRITE);
+            }
+            done += count;
+        }
+        written += length;
+    }
+    /* the recipe ended without RECIPE_END */
+    throw Exception(Exception::BAD_RECIPE);
+}
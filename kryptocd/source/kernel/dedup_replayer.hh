@@ -0,0 +1,108 @@
+/*
+ * dedup_replayer.hh: class DedupReplayer header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef DEDUP_REPLAYER_HH
+#define DEDUP_REPLAYER_HH
+
+#include <string>
+#include <map>
+#include <vector>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+
+    /**
+     * Class DedupReplayer rebuilds the tar stream of a deduplicated archive
+     * from its recipe and the chunk streams of all images the recipe
+     * refers to, see DedupFilter.
+     * <p>
+     * The chunk streams have to be decrypted and decompressed into plain
+     * files first, because the chunks are read from them in any order.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class DedupReplayer {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                BAD_RECIPE,
+                MISSING_IMAGE,
+                UNABLE_TO_READ_CHUNK,
+                UNABLE_TO_WRITE,
+            } reason;
+
+            /**
+             * the image id, for MISSING_IMAGE
+             */
+            std::string imageId;
+
+            Exception(Reason r, const std::string & i = "")
+                : reason(r), imageId(i) {}
+        };
+
+        /**
+         * @param chunkFiles the names of the plain chunk stream files, by
+         *                   image id
+         */
+        DedupReplayer(const std::map<std::string, std::string> & chunkFiles);
+
+        /**
+         * closes the chunk files
+         */
+        ~DedupReplayer();
+
+        /**
+         * reads a recipe and writes the tar stream
+         *
+         * @param recipe the decrypted recipe
+         * @param output the tar stream is written here
+         * @exception DedupReplayer::Exception
+         *               BAD_RECIPE, MISSING_IMAGE with the id of an image
+         *               whose chunk stream is needed but was not given,
+         *               UNABLE_TO_READ_CHUNK if a chunk stream is too short,
+         *               UNABLE_TO_WRITE
+         */
+        void replay(Source & recipe, Sink & output) throw(Exception);
+
+    private:
+        /**
+         * opens the chunk stream of an image
+         *
+         * @return a file descriptor
+         */
+        int openChunks(const std::string & imageId) throw(Exception);
+
+        std::map<std::string, std::string> chunkFiles;
+
+        /**
+         * the chunk streams opened so far, by image id
+         */
+        std::map<std::string, int> openFiles;
+    };
+}
+#endif
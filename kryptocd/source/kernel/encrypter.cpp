@@ -0,0 +1,71 @@
+/*
+ * encrypter.cpp: class Encrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "encrypter.hh"
+#include "pgp_encrypter.hh"
+#include "chunked_encrypter.hh"
+#include <assert.h>
+
+using KryptoCD::Encrypter;
+using KryptoCD::PgpEncrypter;
+using KryptoCD::ChunkedEncrypter;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using std::string;
+
+Encrypter * Encrypter::create(Format format,
+                              const string & password,
+                              Source & source,
+                              Sink & sink) {
+    if (format == CHUNKED) {
+        return new ChunkedEncrypter(password, source, sink);
+    }
+    assert(format == OPENPGP);
+    return new PgpEncrypter(password, source, sink);
+}
+
+long long Encrypter::encryptedSize(Format format, long long plainSize) {
+    if (format == CHUNKED) {
+        return ChunkedEncrypter::encryptedSize(plainSize);
+    }
+    assert(format == OPENPGP);
+    return PgpEncrypter::encryptedSize(plainSize);
+}
+
+Encrypter::Encrypter()
+    : failed(false)
+{
+}
+
+Encrypter::~Encrypter() {
+}
+
+void Encrypter::wait(void) {
+    join();
+}
+
+bool Encrypter::exitedAbnormally(void) const {
+    return failed;
+}
@@ -0,0 +1,106 @@
+/*
+ * encrypter.hh: class Encrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef ENCRYPTER_HH
+#define ENCRYPTER_HH
+
+#include "thread.hh"
+#include <string>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+
+    /**
+     * Class Encrypter is the base class of the threads that encrypt a
+     * stream with a passphrase. They read the plain data from a Source
+     * and write the encrypted data to a Sink. Like a ChildFilter, they
+     * take over the file descriptors of source and sink, and close them
+     * in the caller's view.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Encrypter : public Thread {
+    public:
+        /**
+         * the formats of encrypted streams:
+         * OPENPGP is what "gpg --symmetric" writes and "gpg --decrypt"
+         * reads, see PgpEncrypter. CHUNKED consists of independently
+         * encrypted chunks, which are encrypted and decrypted in
+         * parallel, see ChunkedEncrypter. It can only be read by
+         * KryptoCD.
+         */
+        enum Format {OPENPGP, CHUNKED};
+
+        /**
+         * starts an encrypting thread for a format
+         *
+         * @param format   the format of the encrypted stream
+         * @param password the passphrase
+         * @param source   the plain data are read from here
+         * @param sink     the encrypted data are written here
+         * @return         the thread, to be deleted by the caller
+         */
+        static Encrypter * create(Format format,
+                                  const std::string & password,
+                                  Source & source,
+                                  Sink & sink);
+
+        /**
+         * computes the exact size of an encrypted stream from the size of
+         * the plain data, so that an archive can be planned to fill a cd
+         * to the byte
+         *
+         * @param format    the format of the encrypted stream
+         * @param plainSize the number of plain bytes
+         * @return          the number of bytes the encrypter writes
+         */
+        static long long encryptedSize(Format format, long long plainSize);
+
+        virtual ~Encrypter();
+
+        /**
+         * waits until all data has been encrypted, or encryption failed
+         */
+        void wait(void);
+
+        /**
+         * @return true if the input could not be read, or the output could
+         *         not be written, e.g. because the disk is full. Only
+         *         meaningful after wait().
+         */
+        bool exitedAbnormally(void) const;
+
+    protected:
+        Encrypter();
+
+        /**
+         * set by the thread if encryption failed
+         */
+        bool failed;
+    };
+}
+#endif
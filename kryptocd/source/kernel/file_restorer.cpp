@@ -0,0 +1,127 @@
+/*
+ * file_restorer.cpp: class FileRestorer implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "file_restorer.hh"
+#include "image_index.hh"
+#include "decrypter.hh"
+#include "bzip2.hh"
+#include "tar_extractor.hh"
+#include "fsource.hh"
+#include "io_pump.hh"
+#include "pipe.hh"
+
+using KryptoCD::FileRestorer;
+using KryptoCD::ImageIndex;
+using KryptoCD::SegmentedBzip2;
+using KryptoCD::Decrypter;
+using KryptoCD::Encrypter;
+using KryptoCD::Bzip2;
+using KryptoCD::TarExtractor;
+using KryptoCD::FSource;
+using KryptoCD::IoPump;
+using KryptoCD::Pipe;
+using std::string;
+using std::vector;
+
+FileRestorer::FileRestorer(const string & bzip2Executable,
+                           const string & password,
+                           Encrypter::Format format,
+                           const ImageIndex & index,
+                           const string & path,
+                           const string & archive,
+                           const string & directory)
+    throw(Exception)
+{
+    ImageIndex::Location location;
+    if (!index.find(path, location)) {
+        throw Exception(Exception::NOT_ON_IMAGE);
+    }
+
+    /*
+     * the segments holding the member. Without them, the compressed data
+     * are read from their beginning, and the whole tar data before the
+     * member is skipped.
+     */
+    SegmentedBzip2::Segment first = {0, 0};
+    long long compressedEnd = -1;
+    if (location.archive == 0) {
+        long long plainEnd = (location.length > 0)
+            ? location.offset + location.length : -1;
+        if (!index.findSegments(location.offset, plainEnd,
+                                first, compressedEnd)) {
+            first.plainOffset = 0;
+            first.compressedOffset = 0;
+            compressedEnd = -1;
+        }
+    }
+
+    FSource * source;
+    try {
+        source = new FSource(archive);
+    } catch (FSource::Exception) {
+        throw Exception(Exception::UNABLE_TO_READ);
+    }
+    Pipe decrypterToBzip2;
+    Pipe bzip2ToTar;
+
+    decrypter     = Decrypter::create(format, password, *source,
+                                      decrypterToBzip2,
+                                      first.compressedOffset, compressedEnd);
+    delete source;
+    bzip2Inflator = new Bzip2(bzip2Executable, -1, // -1 == decompress
+                              decrypterToBzip2, bzip2ToTar);
+
+    /* the members before the file, in its first segment: */
+    IoPump(bzip2ToTar).pump(location.offset - first.plainOffset);
+
+    /* the TarWriter stored the name relative to the root */
+    string::size_type start = path.find_first_not_of('/');
+    vector<string> selection(1, (start == string::npos) ? string(".")
+                                                        : path.substr(start));
+    tarExtractor  = new TarExtractor(bzip2ToTar, directory, 1, &selection);
+}
+
+FileRestorer::~FileRestorer() {
+    delete tarExtractor;
+    delete bzip2Inflator;
+    delete decrypter;
+}
+
+void FileRestorer::wait(void) {
+    tarExtractor->wait();
+    bzip2Inflator->wait();
+    decrypter->wait();
+}
+
+bool FileRestorer::restoreFailed(void) {
+    /*
+     * the tar data usually end inside a member after the file, so the
+     * archive is expected to appear truncated
+     */
+    return (tarExtractor->getExtractedCount() == 0)
+        || !tarExtractor->getFailedFiles().empty()
+        || bzip2Inflator->exitedAbnormally()
+        || decrypter->exitedAbnormally();
+}
@@ -0,0 +1,120 @@
+/*
+ * file_restorer.hh: class FileRestorer header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef FILE_RESTORER_HH
+#define FILE_RESTORER_HH
+
+#include "encrypter.hh"
+#include <string>
+
+namespace KryptoCD {
+    class ImageIndex;
+    class Decrypter;
+    class Bzip2;
+    class TarExtractor;
+
+    /**
+     * Class FileRestorer restores one file from an archive of an image,
+     * without decrypting and decompressing all of the archive before it.
+     * The ImageIndex tells where the file's tar member is in the tar
+     * data, and, for archives that a SegmentedBzip2 compressed, which of
+     * the independent bzip2 streams contain it. Only the compressed bytes
+     * of these segments are decrypted and decompressed, the tar data
+     * before the member is skipped, and a TarExtractor restores the
+     * member.
+     * <p>
+     * How much the decryption saves depends on the format: a ChunkedDecrypter
+     * seeks to the chunks of the segments, a PgpDecrypter has to decrypt
+     * the stream from its beginning, and checks the modification detection
+     * code at its end, but passes on only the segments. Without segments,
+     * the archive is decompressed up to the member.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class FileRestorer {
+    public:
+        class Exception {
+        public:
+            enum Reason {
+                NOT_ON_IMAGE,
+                UNABLE_TO_READ,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * starts restoring a file
+         *
+         * @param bzip2Executable the location of the bzip2 executable file
+         * @param password        the passphrase
+         * @param format          the format of the encrypted archive
+         * @param index           the index of the image
+         * @param path            the name of the file, as it was stored
+         * @param archive         the file name of the archive that the
+         *                        index names for the file
+         * @param directory       the file is restored below this directory
+         * @exception FileRestorer::Exception
+         *                        NOT_ON_IMAGE if the index does not know
+         *                        the file, UNABLE_TO_READ if the archive
+         *                        cannot be opened
+         */
+        FileRestorer(const std::string & bzip2Executable,
+                     const std::string & password,
+                     Encrypter::Format format,
+                     const ImageIndex & index,
+                     const std::string & path,
+                     const std::string & archive,
+                     const std::string & directory)
+            throw(Exception);
+
+        ~FileRestorer();
+
+        /**
+         * waits until the file has been restored, and the decrypted data
+         * has been checked
+         */
+        void wait(void);
+
+        /**
+         * @return true if the file could not be restored, or the archive
+         *         is damaged before the end of the file's member. Only
+         *         meaningful after wait().
+         */
+        bool restoreFailed(void);
+
+    private:
+        /**
+         * not to be copied
+         */
+        FileRestorer(const FileRestorer &);
+        FileRestorer & operator=(const FileRestorer &);
+
+        Decrypter * decrypter;
+        Bzip2 * bzip2Inflator;
+        TarExtractor * tarExtractor;
+    };
+}
+#endif
@@ -0,0 +1,680 @@
+/*
+ * gcm.cpp: class Gcm implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "gcm.hh"
+#include "key_cache.hh"
+#include <string.h>
+#include <assert.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KRYPTOCD_GCM_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#if __GNUC__ >= 8
+#define KRYPTOCD_GCM_VAES
+#endif
+#endif
+
+using KryptoCD::Gcm;
+using KryptoCD::Aes;
+using KryptoCD::KeyCache;
+
+/**
+ * the reduction of the 4 bits shifted out of the state, by the GCM
+ * polynomial
+ */
+static const unsigned long long REDUCTION[16] = {
+    0x0000ULL, 0x1c20ULL, 0x3840ULL, 0x2460ULL,
+    0x7080ULL, 0x6ca0ULL, 0x48c0ULL, 0x54e0ULL,
+    0xe100ULL, 0xfd20ULL, 0xd940ULL, 0xc560ULL,
+    0x9180ULL, 0x8da0ULL, 0xa9c0ULL, 0xb5e0ULL,
+};
+
+static unsigned long long getBigEndian(const unsigned char * bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static void putBigEndian(unsigned long long value, unsigned char * bytes) {
+    for (int i = 7; i >= 0; --i) {
+        bytes[i] = value;
+        value >>= 8;
+    }
+}
+
+/**
+ * encrypt() hashes the ciphertext in pieces of this size right after
+ * encrypting them, while they are still in the cache. A multiple of the
+ * block size.
+ */
+static const size_t PIECE_SIZE = 16 * 1024;
+
+#ifdef KRYPTOCD_GCM_NI
+#define NI_TARGET __attribute__((target("aes,pclmul,ssse3,sse4.1")))
+
+/**
+ * reverses the bytes of a block. Then the 32 bit counter of a counter
+ * block is the lowest lane, and a block of GHASH is the 128 bit number
+ * whose bits the vector kernels multiply.
+ */
+NI_TARGET
+static inline __m128i reverseBytes(__m128i block) {
+    return _mm_shuffle_epi8(block, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                                8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/**
+ * adds the carry-less product of a and b to the three parts of an
+ * unreduced 256 bit sum
+ */
+NI_TARGET
+static inline void multiplyAdd(__m128i a, __m128i b, __m128i & low,
+                               __m128i & middle, __m128i & high) {
+    low = _mm_xor_si128(low, _mm_clmulepi64_si128(a, b, 0x00));
+    middle = _mm_xor_si128(middle,
+                           _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01),
+                                         _mm_clmulepi64_si128(a, b, 0x10)));
+    high = _mm_xor_si128(high, _mm_clmulepi64_si128(a, b, 0x11));
+}
+
+/**
+ * reduces a 256 bit product modulo the GCM polynomial. Since the bits of
+ * GHASH are reflected, the product is shifted left by one bit first.
+ * This is the method of Gueron and Kounavis, in Intel's white paper on
+ * carry-less multiplication.
+ */
+NI_TARGET
+static inline __m128i reduce(__m128i low, __m128i middle, __m128i high) {
+    low = _mm_xor_si128(low, _mm_slli_si128(middle, 8));
+    high = _mm_xor_si128(high, _mm_srli_si128(middle, 8));
+
+    __m128i lowCarry = _mm_srli_epi32(low, 31);
+    __m128i highCarry = _mm_srli_epi32(high, 31);
+    low = _mm_slli_epi32(low, 1);
+    high = _mm_slli_epi32(high, 1);
+    high = _mm_or_si128(high, _mm_srli_si128(lowCarry, 12));
+    high = _mm_or_si128(high, _mm_slli_si128(highCarry, 4));
+    low = _mm_or_si128(low, _mm_slli_si128(lowCarry, 4));
+
+    __m128i first = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(low, 31),
+                                                _mm_slli_epi32(low, 30)),
+                                  _mm_slli_epi32(low, 25));
+    low = _mm_xor_si128(low, _mm_slli_si128(first, 12));
+    __m128i second = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(low, 1),
+                                                 _mm_srli_epi32(low, 2)),
+                                   _mm_srli_epi32(low, 7));
+    second = _mm_xor_si128(second, _mm_srli_si128(first, 4));
+    return _mm_xor_si128(high, _mm_xor_si128(low, second));
+}
+
+/**
+ * computes the powers H^1 to H^16 of the hash key
+ */
+NI_TARGET
+static void computePowersNi(unsigned long long high, unsigned long long low,
+                            unsigned long long powers[16][2]) {
+    __m128i key = _mm_set_epi64x(high, low);
+    __m128i power = key;
+    for (int i = 0; i < 16; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(powers[i]), power);
+        __m128i productLow = _mm_setzero_si128();
+        __m128i productMiddle = _mm_setzero_si128();
+        __m128i productHigh = _mm_setzero_si128();
+        multiplyAdd(power, key, productLow, productMiddle, productHigh);
+        power = reduce(productLow, productMiddle, productHigh);
+    }
+}
+
+/**
+ * hashes whole blocks, 4 at a time: the state is added to the first of
+ * them, and they are multiplied by H^4 to H^1, so that one reduction
+ * suffices
+ */
+NI_TARGET
+static void hashNi(const unsigned long long powers[16][2],
+                   unsigned long long & high, unsigned long long & low,
+                   const unsigned char * data, size_t blocks) {
+    const __m128i * power = reinterpret_cast<const __m128i *>(powers);
+    const __m128i * in = reinterpret_cast<const __m128i *>(data);
+    __m128i state = _mm_set_epi64x(high, low);
+    __m128i h1 = _mm_loadu_si128(power);
+    if (blocks >= 4) {
+        __m128i h2 = _mm_loadu_si128(power + 1);
+        __m128i h3 = _mm_loadu_si128(power + 2);
+        __m128i h4 = _mm_loadu_si128(power + 3);
+        for (; blocks >= 4; blocks -= 4, in += 4) {
+            __m128i productLow = _mm_setzero_si128();
+            __m128i productMiddle = _mm_setzero_si128();
+            __m128i productHigh = _mm_setzero_si128();
+            multiplyAdd(_mm_xor_si128(reverseBytes(_mm_loadu_si128(in)),
+                                      state),
+                        h4, productLow, productMiddle, productHigh);
+            multiplyAdd(reverseBytes(_mm_loadu_si128(in + 1)), h3,
+                        productLow, productMiddle, productHigh);
+            multiplyAdd(reverseBytes(_mm_loadu_si128(in + 2)), h2,
+                        productLow, productMiddle, productHigh);
+            multiplyAdd(reverseBytes(_mm_loadu_si128(in + 3)), h1,
+                        productLow, productMiddle, productHigh);
+            state = reduce(productLow, productMiddle, productHigh);
+        }
+    }
+    for (; blocks > 0; --blocks, ++in) {
+        __m128i productLow = _mm_setzero_si128();
+        __m128i productMiddle = _mm_setzero_si128();
+        __m128i productHigh = _mm_setzero_si128();
+        multiplyAdd(_mm_xor_si128(reverseBytes(_mm_loadu_si128(in)), state),
+                    h1, productLow, productMiddle, productHigh);
+        state = reduce(productLow, productMiddle, productHigh);
+    }
+    unsigned long long halves[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(halves), state);
+    low = halves[0];
+    high = halves[1];
+}
+
+/**
+ * encrypts 8 counter blocks at a time, so that the AES instructions of
+ * different blocks overlap in the pipeline
+ */
+NI_TARGET
+static void counterModeNi(const unsigned char * roundKeys, int rounds,
+                          const unsigned char * nonce, unsigned long block,
+                          unsigned char * data, size_t length) {
+    const __m128i * keys = reinterpret_cast<const __m128i *>(roundKeys);
+    unsigned char first[16];
+    memcpy(first, nonce, Gcm::NONCE_LENGTH);
+    first[12] = block >> 24;
+    first[13] = block >> 16;
+    first[14] = block >> 8;
+    first[15] = block;
+    __m128i counter =
+        reverseBytes(_mm_loadu_si128(reinterpret_cast<__m128i *>(first)));
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+
+    for (; length >= 8 * 16; length -= 8 * 16, data += 8 * 16) {
+        __m128i * io = reinterpret_cast<__m128i *>(data);
+        __m128i key = _mm_loadu_si128(keys);
+        __m128i b0 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b1 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b2 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b3 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b4 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b5 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b6 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        __m128i b7 = _mm_xor_si128(reverseBytes(counter), key);
+        counter = _mm_add_epi32(counter, one);
+        for (int round = 1; round < rounds; ++round) {
+            key = _mm_loadu_si128(keys + round);
+            b0 = _mm_aesenc_si128(b0, key);
+            b1 = _mm_aesenc_si128(b1, key);
+            b2 = _mm_aesenc_si128(b2, key);
+            b3 = _mm_aesenc_si128(b3, key);
+            b4 = _mm_aesenc_si128(b4, key);
+            b5 = _mm_aesenc_si128(b5, key);
+            b6 = _mm_aesenc_si128(b6, key);
+            b7 = _mm_aesenc_si128(b7, key);
+        }
+        key = _mm_loadu_si128(keys + rounds);
+        _mm_storeu_si128(io, _mm_xor_si128(_mm_aesenclast_si128(b0, key),
+                                           _mm_loadu_si128(io)));
+        _mm_storeu_si128(io + 1, _mm_xor_si128(_mm_aesenclast_si128(b1, key),
+                                               _mm_loadu_si128(io + 1)));
+        _mm_storeu_si128(io + 2, _mm_xor_si128(_mm_aesenclast_si128(b2, key),
+                                               _mm_loadu_si128(io + 2)));
+        _mm_storeu_si128(io + 3, _mm_xor_si128(_mm_aesenclast_si128(b3, key),
+                                               _mm_loadu_si128(io + 3)));
+        _mm_storeu_si128(io + 4, _mm_xor_si128(_mm_aesenclast_si128(b4, key),
+                                               _mm_loadu_si128(io + 4)));
+        _mm_storeu_si128(io + 5, _mm_xor_si128(_mm_aesenclast_si128(b5, key),
+                                               _mm_loadu_si128(io + 5)));
+        _mm_storeu_si128(io + 6, _mm_xor_si128(_mm_aesenclast_si128(b6, key),
+                                               _mm_loadu_si128(io + 6)));
+        _mm_storeu_si128(io + 7, _mm_xor_si128(_mm_aesenclast_si128(b7, key),
+                                               _mm_loadu_si128(io + 7)));
+    }
+
+    while (length > 0) {
+        __m128i b = _mm_xor_si128(reverseBytes(counter),
+                                  _mm_loadu_si128(keys));
+        counter = _mm_add_epi32(counter, one);
+        for (int round = 1; round < rounds; ++round) {
+            b = _mm_aesenc_si128(b, _mm_loadu_si128(keys + round));
+        }
+        b = _mm_aesenclast_si128(b, _mm_loadu_si128(keys + rounds));
+        unsigned char keyStream[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(keyStream), b);
+        size_t count = (length < 16) ? length : 16;
+        for (size_t i = 0; i < count; ++i) {
+            data[i] ^= keyStream[i];
+        }
+        KeyCache::wipe(keyStream, sizeof(keyStream));
+        data += count;
+        length -= count;
+    }
+}
+#endif
+
+#ifdef KRYPTOCD_GCM_VAES
+#define VAES_TARGET __attribute__((target( \
+    "aes,pclmul,ssse3,sse4.1,avx2,avx512f,avx512bw,vaes,vpclmulqdq")))
+
+/**
+ * reverses the bytes of each of the four blocks
+ */
+VAES_TARGET
+static inline __m512i reverseBytes4(__m512i blocks) {
+    return _mm512_shuffle_epi8(blocks, _mm512_broadcast_i32x4(
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                     8, 9, 10, 11, 12, 13, 14, 15)));
+}
+
+/**
+ * @return the sum of the four 128 bit lanes
+ */
+VAES_TARGET
+static inline __m128i sumLanes(__m512i x) {
+    return _mm_xor_si128(_mm_xor_si128(_mm512_extracti32x4_epi32(x, 0),
+                                       _mm512_extracti32x4_epi32(x, 1)),
+                         _mm_xor_si128(_mm512_extracti32x4_epi32(x, 2),
+                                       _mm512_extracti32x4_epi32(x, 3)));
+}
+
+/**
+ * hashes whole blocks, 16 at a time in four registers of four blocks.
+ * They are multiplied by H^16 to H^1, and reduced once. The rest is left
+ * to hashNi().
+ */
+VAES_TARGET
+static void hashVaes(const unsigned long long powers[16][2],
+                     unsigned long long & high, unsigned long long & low,
+                     const unsigned char * data, size_t blocks) {
+    if (blocks >= 16) {
+        const __m128i * power = reinterpret_cast<const __m128i *>(powers);
+        __m512i keys[4];
+        for (int j = 0; j < 4; ++j) {
+            /* lane k of register j multiplies block 4j+k by H^(16-4j-k) */
+            __m512i key = _mm512_castsi128_si512(
+                _mm_loadu_si128(power + 15 - 4 * j));
+            key = _mm512_inserti32x4(key, _mm_loadu_si128(power + 14 - 4 * j),
+                                     1);
+            key = _mm512_inserti32x4(key, _mm_loadu_si128(power + 13 - 4 * j),
+                                     2);
+            keys[j] = _mm512_inserti32x4(key,
+                                         _mm_loadu_si128(power + 12 - 4 * j),
+                                         3);
+        }
+        __m128i state = _mm_set_epi64x(high, low);
+        for (; blocks >= 16; blocks -= 16, data += 16 * 16) {
+            __m512i productLow = _mm512_setzero_si512();
+            __m512i productMiddle = _mm512_setzero_si512();
+            __m512i productHigh = _mm512_setzero_si512();
+            for (int j = 0; j < 4; ++j) {
+                __m512i x = reverseBytes4(_mm512_loadu_si512(data + 64 * j));
+                if (j == 0) {
+                    x = _mm512_xor_si512(
+                        x, _mm512_inserti32x4(_mm512_setzero_si512(),
+                                              state, 0));
+                }
+                productLow = _mm512_xor_si512(
+                    productLow, _mm512_clmulepi64_epi128(x, keys[j], 0x00));
+                productMiddle = _mm512_xor_si512(
+                    productMiddle,
+                    _mm512_xor_si512(
+                        _mm512_clmulepi64_epi128(x, keys[j], 0x01),
+                        _mm512_clmulepi64_epi128(x, keys[j], 0x10)));
+                productHigh = _mm512_xor_si512(
+                    productHigh, _mm512_clmulepi64_epi128(x, keys[j], 0x11));
+            }
+            state = reduce(sumLanes(productLow), sumLanes(productMiddle),
+                           sumLanes(productHigh));
+        }
+        unsigned long long halves[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(halves), state);
+        low = halves[0];
+        high = halves[1];
+    }
+    hashNi(powers, high, low, data, blocks);
+}
+
+/**
+ * encrypts 16 counter blocks at a time, in four registers of four
+ * blocks. The rest is left to counterModeNi().
+ */
+VAES_TARGET
+static void counterModeVaes(const unsigned char * roundKeys, int rounds,
+                            const unsigned char * nonce, unsigned long block,
+                            unsigned char * data, size_t length) {
+    if (length >= 16 * 16) {
+        const __m128i * keyBlocks =
+            reinterpret_cast<const __m128i *>(roundKeys);
+        __m512i keys[15];
+        for (int round = 0; round <= rounds; ++round) {
+            keys[round] =
+                _mm512_broadcast_i32x4(_mm_loadu_si128(keyBlocks + round));
+        }
+        unsigned char first[16];
+        memcpy(first, nonce, Gcm::NONCE_LENGTH);
+        first[12] = block >> 24;
+        first[13] = block >> 16;
+        first[14] = block >> 8;
+        first[15] = block;
+        __m512i counter = _mm512_add_epi32(
+            reverseBytes4(_mm512_broadcast_i32x4(
+                _mm_loadu_si128(reinterpret_cast<__m128i *>(first)))),
+            _mm512_set_epi32(0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0));
+        const __m512i four =
+            _mm512_broadcast_i32x4(_mm_set_epi32(0, 0, 0, 4));
+
+        for (; length >= 16 * 16; length -= 16 * 16, data += 16 * 16) {
+            __m512i b[4];
+            for (int j = 0; j < 4; ++j) {
+                b[j] = _mm512_xor_si512(reverseBytes4(counter), keys[0]);
+                counter = _mm512_add_epi32(counter, four);
+            }
+            for (int round = 1; round < rounds; ++round) {
+                for (int j = 0; j < 4; ++j) {
+                    b[j] = _mm512_aesenc_epi128(b[j], keys[round]);
+                }
+            }
+            for (int j = 0; j < 4; ++j) {
+                b[j] = _mm512_aesenclast_epi128(b[j], keys[rounds]);
+                _mm512_storeu_si512(
+                    data + 64 * j,
+                    _mm512_xor_si512(b[j], _mm512_loadu_si512(data + 64 * j)));
+            }
+            block += 16;
+        }
+    }
+    counterModeNi(roundKeys, rounds, nonce, block, data, length);
+}
+#endif
+
+static Gcm::Kernel detectKernel(void) {
+    Gcm::Kernel kernel = Gcm::PORTABLE;
+#ifdef KRYPTOCD_GCM_NI
+    unsigned eax, ebx, ecx, edx;
+    const unsigned ni = bit_AES | bit_PCLMUL | bit_SSSE3 | bit_SSE4_1;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || ((ecx & ni) != ni)) {
+        return kernel;
+    }
+    kernel = Gcm::AES_NI;
+#ifdef KRYPTOCD_GCM_VAES
+    /* the operating system must save the AVX-512 registers */
+    if ((ecx & bit_OSXSAVE) == 0) {
+        return kernel;
+    }
+    unsigned xcr0, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+    if ((xcr0 & 0xe6) != 0xe6) {
+        return kernel;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+        && (ebx & bit_AVX512F) && (ebx & bit_AVX512BW)
+        && (ecx & bit_VAES) && (ecx & bit_VPCLMULQDQ)) {
+        kernel = Gcm::VAES;
+    }
+#endif
+#endif
+    return kernel;
+}
+static const Gcm::Kernel FASTEST = detectKernel();
+
+Gcm::Kernel Gcm::fastestKernel(void) {
+    return FASTEST;
+}
+
+bool Gcm::isSupported(Kernel kernel) {
+    return kernel <= FASTEST;
+}
+
+const char * Gcm::getName(Kernel kernel) {
+    switch (kernel) {
+    case AES_NI:
+        return "AES-NI+PCLMULQDQ";
+    case VAES:
+        return "VAES+VPCLMULQDQ (AVX-512)";
+    default:
+        return "portable";
+    }
+}
+
+Gcm::Gcm(const unsigned char * key, size_t keyLength, Kernel kernel)
+    : aes(key, keyLength),
+      kernel(kernel)
+{
+    assert(isSupported(kernel));
+    unsigned char hashKey[Aes::BLOCK_SIZE] = {0};
+    aes.encryptBlock(hashKey, hashKey);
+    unsigned long long high = getBigEndian(hashKey);
+    unsigned long long low = getBigEndian(hashKey + 8);
+    KeyCache::wipe(hashKey, sizeof(hashKey));
+
+    /*
+     * the bits are reflected: index 8 is the hash key itself, 4, 2 and 1
+     * are the key times x, x^2 and x^3
+     */
+    tableHigh[0] = tableLow[0] = 0;
+    tableHigh[8] = high;
+    tableLow[8] = low;
+    for (int i = 4; i > 0; i >>= 1) {
+        unsigned long long carry = (low & 1) ? 0xe1000000ULL << 32 : 0;
+        low = (high << 63) | (low >> 1);
+        high = (high >> 1) ^ carry;
+        tableHigh[i] = high;
+        tableLow[i] = low;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; ++j) {
+            tableHigh[i + j] = tableHigh[i] ^ tableHigh[j];
+            tableLow[i + j] = tableLow[i] ^ tableLow[j];
+        }
+    }
+
+    memset(powers, 0, sizeof(powers));
+#ifdef KRYPTOCD_GCM_NI
+    if (kernel != PORTABLE) {
+        computePowersNi(tableHigh[8], tableLow[8], powers);
+    }
+#endif
+}
+
+Gcm::~Gcm() {
+    KeyCache::wipe(tableHigh, sizeof(tableHigh));
+    KeyCache::wipe(tableLow, sizeof(tableLow));
+    KeyCache::wipe(powers, sizeof(powers));
+}
+
+void Gcm::multiply(Hash & state) const {
+    unsigned char x[Aes::BLOCK_SIZE];
+    putBigEndian(state.high, x);
+    putBigEndian(state.low, x + 8);
+
+    unsigned long long high = tableHigh[x[15] & 0xf];
+    unsigned long long low = tableLow[x[15] & 0xf];
+    for (int i = 15; i >= 0; --i) {
+        unsigned nibbles[2] = {unsigned(x[i] & 0xf), unsigned(x[i] >> 4)};
+        for (int n = (i == 15) ? 1 : 0; n < 2; ++n) {
+            unsigned shiftedOut = low & 0xf;
+            low = (high << 60) | (low >> 4);
+            high = (high >> 4) ^ (REDUCTION[shiftedOut] << 48);
+            high ^= tableHigh[nibbles[n]];
+            low ^= tableLow[nibbles[n]];
+        }
+    }
+    state.high = high;
+    state.low = low;
+}
+
+void Gcm::hash(Hash & state, const unsigned char * data, size_t length) const {
+#ifdef KRYPTOCD_GCM_NI
+    if (kernel != PORTABLE) {
+        size_t blocks = length / Aes::BLOCK_SIZE;
+#ifdef KRYPTOCD_GCM_VAES
+        if (kernel == VAES) {
+            hashVaes(powers, state.high, state.low, data, blocks);
+        } else
+#endif
+        {
+            hashNi(powers, state.high, state.low, data, blocks);
+        }
+        size_t rest = length % Aes::BLOCK_SIZE;
+        if (rest > 0) {
+            unsigned char block[Aes::BLOCK_SIZE] = {0};
+            memcpy(block, data + blocks * Aes::BLOCK_SIZE, rest);
+            hashNi(powers, state.high, state.low, block, 1);
+        }
+        return;
+    }
+#endif
+    hashPortable(state, data, length);
+}
+
+void Gcm::hashPortable(Hash & state,
+                       const unsigned char * data, size_t length) const {
+    while (length > 0) {
+        unsigned char block[Aes::BLOCK_SIZE] = {0};
+        size_t count = (length < Aes::BLOCK_SIZE) ? length : Aes::BLOCK_SIZE;
+        memcpy(block, data, count);
+        state.high ^= getBigEndian(block);
+        state.low ^= getBigEndian(block + 8);
+        multiply(state);
+        data += count;
+        length -= count;
+    }
+}
+
+void Gcm::counterMode(const unsigned char nonce[NONCE_LENGTH],
+                      unsigned long block,
+                      unsigned char * data, size_t length) const {
+#ifdef KRYPTOCD_GCM_VAES
+    if (kernel == VAES) {
+        counterModeVaes(aes.roundKeyBytes, aes.rounds, nonce, block,
+                        data, length);
+        return;
+    }
+#endif
+#ifdef KRYPTOCD_GCM_NI
+    if (kernel == AES_NI) {
+        counterModeNi(aes.roundKeyBytes, aes.rounds, nonce, block,
+                      data, length);
+        return;
+    }
+#endif
+    unsigned char counter[Aes::BLOCK_SIZE];
+    unsigned char keyStream[Aes::BLOCK_SIZE];
+    memcpy(counter, nonce, NONCE_LENGTH);
+    while (length > 0) {
+        counter[12] = block >> 24;
+        counter[13] = block >> 16;
+        counter[14] = block >> 8;
+        counter[15] = block;
+        aes.encryptBlock(counter, keyStream);
+        size_t count = (length < Aes::BLOCK_SIZE) ? length : Aes::BLOCK_SIZE;
+        for (size_t i = 0; i < count; ++i) {
+            data[i] ^= keyStream[i];
+        }
+        ++block;
+        data += count;
+        length -= count;
+    }
+    KeyCache::wipe(keyStream, sizeof(keyStream));
+}
+
+void Gcm::finishTag(const unsigned char nonce[NONCE_LENGTH],
+                    Hash & state, size_t aadLength, size_t length,
+                    unsigned char tag[TAG_LENGTH]) const {
+    /* the lengths in bits are the last block */
+    unsigned char lengths[Aes::BLOCK_SIZE];
+    putBigEndian((unsigned long long)aadLength * 8, lengths);
+    putBigEndian((unsigned long long)length * 8, lengths + 8);
+    hash(state, lengths, sizeof(lengths));
+
+    /* the tag is the hash, encrypted with counter 1 */
+    unsigned char counter[Aes::BLOCK_SIZE] = {0};
+    memcpy(counter, nonce, NONCE_LENGTH);
+    counter[15] = 1;
+    aes.encryptBlock(counter, tag);
+    unsigned char hashed[Aes::BLOCK_SIZE];
+    putBigEndian(state.high, hashed);
+    putBigEndian(state.low, hashed + 8);
+    for (unsigned i = 0; i < TAG_LENGTH; ++i) {
+        tag[i] ^= hashed[i];
+    }
+}
+
+void Gcm::computeTag(const unsigned char nonce[NONCE_LENGTH],
+                     const unsigned char * aad, size_t aadLength,
+                     const unsigned char * data, size_t length,
+                     unsigned char tag[TAG_LENGTH]) const {
+    Hash state = {0, 0};
+    hash(state, aad, aadLength);
+    hash(state, data, length);
+    finishTag(nonce, state, aadLength, length, tag);
+}
+
+void Gcm::encrypt(const unsigned char nonce[NONCE_LENGTH],
+                  const unsigned char * aad, size_t aadLength,
+                  unsigned char * data, size_t length,
+                  unsigned char tag[TAG_LENGTH]) const {
+    Hash state = {0, 0};
+    hash(state, aad, aadLength);
+    unsigned long block = 2;
+    for (size_t done = 0; done < length; done += PIECE_SIZE) {
+        size_t count =
+            (length - done < PIECE_SIZE) ? length - done : PIECE_SIZE;
+        counterMode(nonce, block, data + done, count);
+        hash(state, data + done, count);
+        block += count / Aes::BLOCK_SIZE;
+    }
+    finishTag(nonce, state, aadLength, length, tag);
+}
+
+bool Gcm::decrypt(const unsigned char nonce[NONCE_LENGTH],
+                  const unsigned char * aad, size_t aadLength,
+                  unsigned char * data, size_t length,
+                  const unsigned char tag[TAG_LENGTH]) const {
+    unsigned char expected[TAG_LENGTH];
+    computeTag(nonce, aad, aadLength, data, length, expected);
+
+    /* compare in constant time */
+    unsigned char difference = 0;
+    for (unsigned i = 0; i < TAG_LENGTH; ++i) {
+        difference |= expected[i] ^ tag[i];
+    }
+    if (difference != 0) {
+        return false;
+    }
+    counterMode(nonce, 2, data, length);
+    return true;
+}
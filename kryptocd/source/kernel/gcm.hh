@@ -0,0 +1,189 @@
+/*
+ * gcm.hh: class Gcm header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef GCM_HH
+#define GCM_HH
+
+#include "aes.hh"
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * Class Gcm encrypts and authenticates with AES in Galois/Counter
+     * Mode, as defined in NIST SP 800-38D, with 96 bit nonces and 128 bit
+     * tags. The data is encrypted in counter mode, and the tag is a
+     * GHASH of the additional data and the ciphertext.
+     * <p>
+     * Which kernel does this is chosen at run time, from what the
+     * processor offers: with VAES and VPCLMULQDQ on AVX-512, 16 blocks
+     * are encrypted and hashed per step in four 512 bit registers; with
+     * AES-NI and PCLMULQDQ, 8 blocks are encrypted and 4 hashed per
+     * step, with one reduction for the 4 products. The portable kernel
+     * uses Aes::encryptBlock() and the 4 bit tables of Shoup's method.
+     * All kernels give the same results.
+     * <p>
+     * The methods are const, so one object can be used by several
+     * threads at once, as long as no nonce is used twice with the same
+     * key.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Gcm {
+    public:
+        static const unsigned NONCE_LENGTH = 12;
+        static const unsigned TAG_LENGTH = 16;
+
+        /**
+         * the implementations, slowest first
+         */
+        enum Kernel {PORTABLE, AES_NI, VAES};
+
+        /**
+         * @return the fastest kernel this processor supports
+         */
+        static Kernel fastestKernel(void);
+
+        /**
+         * @return true if this processor supports the kernel
+         */
+        static bool isSupported(Kernel kernel);
+
+        /**
+         * @return the name of the kernel, for messages
+         */
+        static const char * getName(Kernel kernel);
+
+        /**
+         * expands the key, and computes the GHASH tables
+         *
+         * @param key       the AES key
+         * @param keyLength the length of the key in bytes: 16, 24 or 32
+         * @param kernel    the implementation to use. It must be supported.
+         */
+        Gcm(const unsigned char * key, size_t keyLength,
+            Kernel kernel = fastestKernel());
+
+        /**
+         * @return the kernel this object uses
+         */
+        Kernel getKernel(void) const {return kernel;}
+
+        /**
+         * clears the tables
+         */
+        ~Gcm();
+
+        /**
+         * encrypts data in place, and computes its tag
+         *
+         * @param aad    additional data that is authenticated, but not
+         *               encrypted
+         */
+        void encrypt(const unsigned char nonce[NONCE_LENGTH],
+                     const unsigned char * aad, size_t aadLength,
+                     unsigned char * data, size_t length,
+                     unsigned char tag[TAG_LENGTH]) const;
+
+        /**
+         * checks the tag, and decrypts data in place if it matches
+         *
+         * @return false if the tag does not match. The data is unchanged
+         *         then.
+         */
+        bool decrypt(const unsigned char nonce[NONCE_LENGTH],
+                     const unsigned char * aad, size_t aadLength,
+                     unsigned char * data, size_t length,
+                     const unsigned char tag[TAG_LENGTH]) const;
+
+    private:
+        /**
+         * the GHASH state: the 128 bit value, most significant half first
+         */
+        struct Hash {
+            unsigned long long high;
+            unsigned long long low;
+        };
+
+        /**
+         * hashes data, padded with zeros to whole blocks
+         */
+        void hash(Hash & state,
+                  const unsigned char * data, size_t length) const;
+
+        /**
+         * hashes data with the portable kernel
+         */
+        void hashPortable(Hash & state,
+                          const unsigned char * data, size_t length) const;
+
+        /**
+         * multiplies the state with the hash key
+         */
+        void multiply(Hash & state) const;
+
+        /**
+         * encrypts or decrypts in counter mode
+         *
+         * @param block the counter of the first block of data
+         */
+        void counterMode(const unsigned char nonce[NONCE_LENGTH],
+                         unsigned long block,
+                         unsigned char * data, size_t length) const;
+
+        /**
+         * computes the tag from the hash of additional data and
+         * ciphertext, and their lengths
+         */
+        void finishTag(const unsigned char nonce[NONCE_LENGTH],
+                       Hash & state, size_t aadLength, size_t length,
+                       unsigned char tag[TAG_LENGTH]) const;
+
+        /**
+         * computes the tag of additional data and ciphertext
+         */
+        void computeTag(const unsigned char nonce[NONCE_LENGTH],
+                        const unsigned char * aad, size_t aadLength,
+                        const unsigned char * data, size_t length,
+                        unsigned char tag[TAG_LENGTH]) const;
+
+        Aes aes;
+
+        Kernel kernel;
+
+        /**
+         * the multiples of the hash key by all 4 bit values
+         */
+        unsigned long long tableHigh[16];
+        unsigned long long tableLow[16];
+
+        /**
+         * for the vector kernels: the powers H^1 to H^16 of the hash key,
+         * as low and high halves
+         */
+        unsigned long long powers[16][2];
+    };
+}
+#endif
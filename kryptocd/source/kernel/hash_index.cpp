@@ -0,0 +1,87 @@
+/*
+ * hash_index.cpp: class HashIndex implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "hash_index.hh"
+#include <algorithm>
+#include <assert.h>
+
+using KryptoCD::HashIndex;
+using KryptoCD::FileMetadata;
+
+HashIndex::HashIndex()
+    : sorted(true)
+{}
+
+bool HashIndex::lessKey(const Entry & a, const Entry & b) {
+    if (a.device != b.device) {
+        return a.device < b.device;
+    }
+    if (a.inode != b.inode) {
+        return a.inode < b.inode;
+    }
+    if (a.mtime != b.mtime) {
+        return a.mtime < b.mtime;
+    }
+    return a.size < b.size;
+}
+
+void HashIndex::insert(const FileMetadata & metadata,
+                       unsigned long long hash) {
+    assert(hash != 0);
+    Entry entry;
+    entry.device = metadata.device;
+    entry.inode = metadata.inode;
+    entry.mtime = metadata.mtime;
+    entry.size = metadata.size;
+    entry.hash = hash;
+    entries.push_back(entry);
+    sorted = false;
+}
+
+void HashIndex::sort(void) {
+    std::sort(entries.begin(), entries.end(), lessKey);
+    sorted = true;
+}
+
+bool HashIndex::lookup(const FileMetadata & metadata,
+                       unsigned long long & hash) const {
+    assert(sorted);
+    Entry key;
+    key.device = metadata.device;
+    key.inode = metadata.inode;
+    key.mtime = metadata.mtime;
+    key.size = metadata.size;
+    std::vector<Entry>::const_iterator found =
+        std::lower_bound(entries.begin(), entries.end(), key, lessKey);
+    if ((found == entries.end()) || lessKey(key, *found)) {
+        return false;
+    }
+    hash = found->hash;
+    return true;
+}
+
+size_t HashIndex::size(void) const {
+    return entries.size();
+}
@@ -0,0 +1,94 @@
+/*
+ * hash_index.hh: class HashIndex header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef HASH_INDEX_HH
+#define HASH_INDEX_HH
+
+#include "metadata_scanner.hh"
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class HashIndex remembers the content hashes of files, keyed by
+     * device, inode, mtime and size. As long as none of these has changed,
+     * the contents are assumed to be unchanged too, and the file does not
+     * have to be read again. The hashes come from the saved snapshots, see
+     * SnapshotDatabase::loadHashIndex().
+     * <p>
+     * All entries have to be inserted, and sort() called, before the first
+     * lookup. After that, any number of threads may call lookup().
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class HashIndex {
+    public:
+        HashIndex();
+
+        /**
+         * remembers the hash of a file
+         *
+         * @param metadata the state of the file when it was hashed
+         * @param hash     its content hash, not 0
+         */
+        void insert(const FileMetadata & metadata, unsigned long long hash);
+
+        /**
+         * prepares the index for lookups
+         */
+        void sort(void);
+
+        /**
+         * @param metadata the current state of a file
+         * @param hash     receives the hash, if one is known
+         * @return         true if a hash for this state of the file is known
+         */
+        bool lookup(const FileMetadata & metadata,
+                    unsigned long long & hash) const;
+
+        /**
+         * @return the number of hashes in the index
+         */
+        size_t size(void) const;
+
+    private:
+        struct Entry {
+            unsigned long long device;
+            long long          inode;
+            long long          mtime;
+            long long          size;
+            unsigned long long hash;
+        };
+
+        /**
+         * orders entries by device, inode, mtime and size
+         */
+        static bool lessKey(const Entry & a, const Entry & b);
+
+        std::vector<Entry> entries;
+        bool sorted;
+    };
+}
+#endif
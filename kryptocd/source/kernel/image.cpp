@@ -23,6 +23,8 @@
  */
 
 #include "image_single_file.hh"
+#include "image_indexed_files.hh"
+#include "chunk_index.hh"
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -34,79 +36,114 @@
 #include <dirent.h>
 
 using KryptoCD::Image;
+using KryptoCD::Encrypter;
 using KryptoCD::ImageSingleFile;
+using KryptoCD::ImageIndexedFiles;
 using KryptoCD::Diskspace;
 using KryptoCD::Childprocess;
 using KryptoCD::IoPump;
 using KryptoCD::Pipe;
+using KryptoCD::ChunkIndex;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using KryptoCD::PathList;
 using std::string;
 using std::list;
 
 Image * Image::create(const string & imageId_,
                       const string & password_,
                       int compression_,
-                      list<string> & files_,
-                      list<string> & rejectedBigFiles_,
-                      list<string> & rejectedForbiddenFiles_,
-                      list<string> & rejectedBadNamedFiles_,
+                      const PathStore & paths_,
+                      const MetadataScanner & metadata_,
+                      PathList & files_,
+                      PathList & rejectedBigFiles_,
+                      PathList & rejectedForbiddenFiles_,
+                      PathList & rejectedBadNamedFiles_,
                       list<ImageInfo> & imageInfos,
                       Diskspace & diskspace_,
                       int cdCapacity_,
                       Image::Method method,
-                      const string & tarExecutable_,
+                      Encrypter::Format format,
                       const string & bzip2Executable_,
-                      const string & gpgExecutable_,
-                      const string & mkisofsExecutable_)
+                      const string & mkisofsExecutable_,
+                      ChunkIndex * chunkIndex)
     throw(Image::Exception, IoPump::Exception,
           Pipe::Exception, Childprocess::Exception) {
+    if ((chunkIndex != 0) && chunkIndex->isStored(imageId_)) {
+        /* an earlier backup has this id, its chunks are on cd already */
+        throw Exception(Exception::BAD_IMAGE_ID);
+    }
+    if (method == INDEXED_FILES) {
+        assert(chunkIndex == 0);
+        return new ImageIndexedFiles(imageId_, password_, compression_,
+                                     paths_, metadata_, files_,
+                                     rejectedBigFiles_, rejectedForbiddenFiles_,
+                                     rejectedBadNamedFiles_, imageInfos,
+                                     diskspace_, cdCapacity_, format,
+                                     bzip2Executable_, mkisofsExecutable_);
+    }
     assert(method == SINGLE_FILE);
-    return new ImageSingleFile(imageId_, password_, compression_, files_,
+    return new ImageSingleFile(imageId_, password_, compression_,
+                               paths_, metadata_, files_,
                                rejectedBigFiles_, rejectedForbiddenFiles_,
                                rejectedBadNamedFiles_, imageInfos, diskspace_,
-                               cdCapacity_, tarExecutable_, bzip2Executable_,
-                               gpgExecutable_, mkisofsExecutable_);
+                               cdCapacity_, format, bzip2Executable_,
+                               mkisofsExecutable_, chunkIndex);
 }
     
 Image::Image(const string & imageId_,
              const string & password_,
              int compression_,
-             list<string> & files_,
-             list<string> & rejectedBigFiles_,
-             list<string> & rejectedForbiddenFiles_,
-             list<string> & rejectedBadNamedFiles_,
+             const PathStore & paths_,
+             const MetadataScanner & metadata_,
+             PathList & files_,
+             PathList & rejectedBigFiles_,
+             PathList & rejectedForbiddenFiles_,
+             PathList & rejectedBadNamedFiles_,
              list<ImageInfo> & imageInfos,
              Diskspace & diskspace_,
              int cdCapacity_,
-             const string & tarExecutable_,
+             Encrypter::Format format_,
              const string & bzip2Executable_,
-             const string & gpgExecutable_,
-             const string & mkisofsExecutable_)
+             const string & mkisofsExecutable_,
+             bool adopt)
     throw(Image::Exception)
     : imageId(imageId_),
       password(password_),
       compression(compression_),
+      paths(paths_),
+      metadata(metadata_),
       files(files_),
       rejectedBigFiles(rejectedBigFiles_),
       rejectedForbiddenFiles(rejectedForbiddenFiles_),
       rejectedBadNamedFiles(rejectedBadNamedFiles_),
       diskspace(diskspace_),
       cdCapacity(cdCapacity_),
-      tarExecutable(tarExecutable_),
+      format(format_),
       bzip2Executable(bzip2Executable_),
-      gpgExecutable(gpgExecutable_),
       mkisofsExecutable(mkisofsExecutable_),
       allocatedMegabytes(0),
       imageMaxMegabytes(int(float(cdCapacity * CD_BLOCKSIZE)
                             / float(MEGABYTE)) + 1),   // rounding up
       imageMaxCdBlocks(cdCapacity),
       imageReady(false),
-      baseDirectory(diskspace_.getDirectory() + "/" + imageId_)
+      baseDirectory(diskspace_.getDirectory() + "/" + imageId_),
+      dataKept(false)
 {
-    checkParameters();
+    if (adopt) {
+        /* the files of a finished image are already there */
+        struct stat st;
+        if ((stat(baseDirectory.c_str(), &st) != 0) || !S_ISDIR(st.st_mode)) {
+            throw Exception(Exception::UNABLE_TO_CREATE_SUBDIRECTORY);
+        }
+    } else {
+        checkParameters();
 
-    /* Create the directory where all files for this image are stored: */
-    if (mkdir(baseDirectory.c_str(), 0700) != 0) {
-        throw Exception(Exception::UNABLE_TO_CREATE_SUBDIRECTORY);
+        /* Create the directory where all files for this image are stored: */
+        if (mkdir(baseDirectory.c_str(), 0700) != 0) {
+            throw Exception(Exception::UNABLE_TO_CREATE_SUBDIRECTORY);
+        }
     }
 
     /*
@@ -121,6 +158,24 @@ Image::Image(const string & imageId_,
                                / float(CD_BLOCKSIZE)); // rounding down
     }
 
+    if (adopt) {
+        /*
+         * The data of an adopted image is all there already, so its space
+         * is taken in full, waiting for other images to release theirs if
+         * necessary. Otherwise, concurrent images would be given space
+         * that is not free.
+         */
+        int neededMegabytes = getDirectoryMegabytes(baseDirectory);
+        if (neededMegabytes > imageMaxMegabytes) {
+            neededMegabytes = imageMaxMegabytes;
+        }
+        while (allocatedMegabytes < neededMegabytes) {
+            allocatedMegabytes +=
+                diskspace.allocate(neededMegabytes - allocatedMegabytes);
+        }
+        return;
+    }
+
     /*
      * Reserve the needed harddisk space. It is possible that we do not receive
      * all required space at once. Part of the space may be occupied by previous
@@ -134,25 +189,48 @@ Image::Image(const string & imageId_,
 void Image::rejectFirstFile(void) {
     if ((imageReady == false) &&  !files.empty()) {
         rejectedBigFiles.push_back(files.front());
-        files.pop_front();
+        files.erase(files.begin());
     }
 }
 
-Image::~Image() {
+int Image::getDirectoryMegabytes(const string & directory) {
+    long long bytes = 0;
+    DIR *dp = opendir(directory.c_str());
+    if (dp != NULL) {
+        struct dirent *ep;
+        struct stat st;
+        while ((ep = readdir(dp)) != 0) {
+            if ((stat((directory + "/" + ep->d_name).c_str(), &st) == 0)
+                && S_ISREG(st.st_mode)) {
+                bytes += st.st_size;
+            }
+        }
+        closedir(dp);
+    }
+    return int((bytes + MEGABYTE - 1) / MEGABYTE);
+}
+
+void Image::removeDirectory(const string & directory) {
     DIR *dp;
     struct dirent *ep;
      
-    dp = opendir (baseDirectory.c_str());
+    dp = opendir (directory.c_str());
     if (dp != NULL) {
         while ((ep = readdir(dp))!= 0) {
             if ((strcmp(ep->d_name, ".") != 0)
                 && (strcmp(ep->d_name, "..") != 0)) {
-                  unlink((baseDirectory + "/" + ep->d_name).c_str());
+                  unlink((directory + "/" + ep->d_name).c_str());
             }
         }
         closedir (dp);
     }
-    rmdir(baseDirectory.c_str());
+    rmdir(directory.c_str());
+}
+
+Image::~Image() {
+    if (!dataKept) {
+        removeDirectory(baseDirectory);
+    }
     diskspace.release(allocatedMegabytes);
 }
 
@@ -193,39 +271,50 @@ void Image::checkParameters(void) const throw (Image::Exception) {
     assert(files.empty() == false);
 
     /*
-     * lists of iterators pointing to entries in "files" that have to be moved
-     * to rejectedForbiddenFiles or rejectedBadNamedFiles:
+     * The valid filenames are collected in "kept", the invalid ones in
+     * "forbidden" and "badNamed". "files" is only changed after all names
+     * have been checked, so that it stays intact if we throw.
      */
-    list<list<string>::iterator> forbiddenFileIterators;
-    list<list<string>::iterator> badNamedFileIterators;
-    
-    
-    for (list<string>::iterator iter = files.begin();
+    PathList kept;
+    PathList forbidden;
+    PathList badNamed;
+    kept.reserve(files.size());
+    string name;
+
+    for (PathList::const_iterator iter = files.begin();
          iter != files.end();
          ++iter) {
-        assert(!iter->empty());
+        name.erase();
+        paths.appendPath(*iter, name);
+
+        assert(!name.empty());
 
         /* absolute filenames required  */
-        assert((*iter)[0] == '/');
+        assert(name[0] == '/');
 
         /* more than one '/' in sequence forbidden */
-        assert(iter->find("//") == string::npos);
+        assert(name.find("//") == string::npos);
         
-        if ((iter->empty()) || ((*iter)[0] != '/')
-            || (iter->find("//") != string::npos)) {
-                throw Exception(*iter);
+        if ((name.empty()) || (name[0] != '/')
+            || (name.find("//") != string::npos)) {
+                throw Exception(name);
         }
 
         /* check if file exists */
-        struct stat st;
-        if (stat(iter->c_str(), & st) != 0) {
+        const FileMetadata * st = metadata.get(*iter);
+        FileMetadata unscanned;
+        if (st == 0) {
+            MetadataScanner::statFile(name.c_str(), unscanned);
+            st = &unscanned;
+        }
+        if (st->mode == 0) {
             /*
              * We cannot stat this file. The file may have been deleted since
              * it was included in the files list. Don't crash the whole backup
              * because of that! Just remove that file from the files list, and
              * add it to the rejectedForbiddenFiles list.
              */
-            forbiddenFileIterators.push_back(iter);
+            forbidden.push_back(*iter);
             continue;                                    // Skip further checks
         }
 
@@ -233,44 +322,37 @@ void Image::checkParameters(void) const throw (Image::Exception) {
          * check if directories and only directories have a '/' as their last
          * character
          */
-        if ((*iter)[iter->length()-1] == '/') {
+        if (name[name.length()-1] == '/') {
             /* last character is '/' */
-            if ((st.st_mode & S_IFDIR) == 0) {
-                badNamedFileIterators.push_back(iter);
+            if (!S_ISDIR(st->mode)) {
+                badNamed.push_back(*iter);
                 continue;                                // Skip further checks
             }
         } else {
             /* last character is not '/' */
-            if ((st.st_mode & S_IFDIR) != 0) {
-                badNamedFileIterators.push_back(iter);
+            if (S_ISDIR(st->mode)) {
+                badNamed.push_back(*iter);
                 continue;                                // Skip further checks
             }
         }
 
         /* check if tar can live with all characters in the filename */
-        if (iter->find_first_of(FORBIDDEN_FOR_TAR,
-                                0,
-                                sizeof(FORBIDDEN_FOR_TAR))
+        if (name.find_first_of(FORBIDDEN_FOR_TAR,
+                               0,
+                               sizeof(FORBIDDEN_FOR_TAR))
             != string::npos) {
-                badNamedFileIterators.push_back(iter);
+                badNamed.push_back(*iter);
                 continue;                                // Skip further checks
         }
+        kept.push_back(*iter);
     }
 
     /* remove the invalid filenames from "files": */
-    list<list<string>::iterator>::iterator iter;
-    for (iter = forbiddenFileIterators.begin();
-         iter != forbiddenFileIterators.end();
-         ++iter) {
-        rejectedForbiddenFiles.push_back(**iter);
-        files.erase(*iter);
-    }
-    for (iter = badNamedFileIterators.begin();
-         iter != badNamedFileIterators.end();
-         ++iter) {
-        rejectedBadNamedFiles.push_back(**iter);
-        files.erase(*iter);
-    }
+    rejectedForbiddenFiles.insert(rejectedForbiddenFiles.end(),
+                                  forbidden.begin(), forbidden.end());
+    rejectedBadNamedFiles.insert(rejectedBadNamedFiles.end(),
+                                 badNamed.begin(), badNamed.end());
+    files.swap(kept);
     if (files.empty()) {
         throw Exception(Exception::ARCHIVE_WOULD_BE_EMPTY);
     }
@@ -279,9 +361,8 @@ void Image::checkParameters(void) const throw (Image::Exception) {
 
     /* FIXME: Cleaner check for the executable filenames needed */
     struct stat st;
-    const string * executables [] = {&tarExecutable, &bzip2Executable  ,
-                                         &gpgExecutable, &mkisofsExecutable};
-    for (int i = 0; i < 4; ++i) {
+    const string * executables [] = {&bzip2Executable, &mkisofsExecutable};
+    for (int i = 0; i < 2; ++i) {
         if (stat(executables[i]->c_str(), & st) != 0) {
             assert(0);
         }
@@ -29,12 +29,17 @@
 #include <iostream>
 #include "diskspace.hh"
 #include "image_info.hh"
+#include "path_store.hh"
+#include "metadata_scanner.hh"
 #include "io_pump.hh"
 #include "pipe.hh"
 #include "childprocess.hh"
+#include "encrypter.hh"
 
 namespace KryptoCD {
+    class ArchiveCreator;
     class ArchiveLister;
+    class ChunkIndex;
 
     /**
      * the number of bytes per megabyte
@@ -79,8 +84,8 @@ namespace KryptoCD {
         };
 
         /**
-         * a type for choosing the archive method. Currently, only
-         * SINGLE_FILE is implemented
+         * a type for choosing the archive method, see
+         * doc/Backup_method.txt
          */
         enum Method {SINGLE_FILE, INDEXED_FILES};
 
@@ -103,6 +108,11 @@ namespace KryptoCD {
          *                   our users.
          * @param compression the compression rate used for the bzip2
          *                   compression. *Must* be between 1 and 9.
+         * @param paths      the store containing all file names. It must
+         *                   not change while the image exists, and it has
+         *                   to outlive the ImageInfo objects.
+         * @param metadata   the results of stat()ing the files. Files that
+         *                   have not been scanned are stat()ed again.
          * @param files      a list of files still needing to be archived.
          *                   Filenames must be absolute (starting with "/").
          *                   Directory names must end with exactly one "/".
@@ -131,14 +141,15 @@ namespace KryptoCD {
          *                   line containing "ATIP start of lead out:". A
          *                   block on cd has space for 2048 bytes.
          * @param method     one of the supported archive methods: either
-         *                   Image::SINGLE_TAR_FILE or Image::INDEX_FILE.
-         *                   Currently, only Image::SINGLE_TAR_FILE is
-         *                   implemented
-         * @param tarExecutable     the location of the GNU tar executable file
+         *                   Image::SINGLE_FILE or Image::INDEXED_FILES.
+         * @param format     the format of the encrypted archives. Index
+         *                   and pack table files are always OpenPGP, so
+         *                   gpg can tell which cd holds a file.
          * @param bzip2Executable   the location of the bzip2 executable file
-         * @param gpgExecutable     the location of the GNU privacy guard
-         *                          executable file
          * @param mkisofsExecutable the location of the mkisofs executable file
+         * @param chunkIndex if not 0, the archive is deduplicated against
+         *                   the chunks in this index, see DedupFilter and
+         *                   ImageSingleFile. Only for Image::SINGLE_FILE.
          * @exception Image::Exception
          *                          data member "reason" contains the reason
          *                          for this Exception:
@@ -175,7 +186,9 @@ namespace KryptoCD {
          *                          filenames
          *                          <li>
          *                          Image::Exception::BAD_IMAGE_ID is set when
-         *                          the imageId contains '/' or '\0'
+         *                          the imageId contains '/' or '\0', or when
+         *                          the chunkIndex stores chunks in an image
+         *                          with this id already
          *                          <li>
          *                          Image::Exception::BAD_PASSWORD is set when
          *                          the password contains a newline character
@@ -200,18 +213,20 @@ namespace KryptoCD {
         static Image* create(const std::string & imageId,
                              const std::string & password,
                              int compression,
-                             std::list<std::string> & files,
-                             std::list<std::string> & rejectedBigFiles,
-                             std::list<std::string> & rejectedForbiddenFiles,
-                             std::list<std::string> & rejectedBadNamedFiles,
+                             const PathStore & paths,
+                             const MetadataScanner & metadata,
+                             PathList & files,
+                             PathList & rejectedBigFiles,
+                             PathList & rejectedForbiddenFiles,
+                             PathList & rejectedBadNamedFiles,
                              std::list<ImageInfo> & imageInfos,
                              Diskspace & diskspace,
                              int cdCapacity,
                              Method method,
-                             const std::string & tarExecutable,
+                             Encrypter::Format format,
                              const std::string & bzip2Executable,
-                             const std::string & gpgExecutable,
-                             const std::string & mkisofsExecutable)
+                             const std::string & mkisofsExecutable,
+                             ChunkIndex * chunkIndex = 0)
             throw(Image::Exception, IoPump::Exception,
                   Pipe::Exception, Childprocess::Exception);
 
@@ -233,6 +248,11 @@ namespace KryptoCD {
          *                   our users.
          * @param compression the compression rate used for the bzip2
          *                   compression. *Must* be between 1 and 9.
+         * @param paths      the store containing all file names. It must
+         *                   not change while the image exists, and it has
+         *                   to outlive the ImageInfo objects.
+         * @param metadata   the results of stat()ing the files. Files that
+         *                   have not been scanned are stat()ed again.
          * @param files      a list of files still needing to be archived.
          *                   Filenames must be absolute (starting with "/").
          *                   Directory names must end with exactly one "/".
@@ -260,11 +280,13 @@ namespace KryptoCD {
          *                   is the number reported by cdrecord -atip in the
          *                   line containing "ATIP start of lead out:". A
          *                   block on cd has space for 2048 bytes.
-         * @param tarExecutable     the location of the GNU tar executable file
+         * @param format     the format of the encrypted archives
          * @param bzip2Executable   the location of the bzip2 executable file
-         * @param gpgExecutable     the location of the GNU privacy guard
-         *                          executable file
          * @param mkisofsExecutable the location of the mkisofs executable file
+         * @param adopt      if true, the subdirectory already exists and
+         *                   contains the data of a finished image, e.g. of a
+         *                   backup that is resumed. It is used as it is,
+         *                   and the files are not checked again.
          * @exception Image::Exception
          *                          data member "reason" contains the reason
          *                          for this Exception:
@@ -272,7 +294,8 @@ namespace KryptoCD {
          *                          Image::Exception::UNABLE_TO_CREATE_SUBDIRECTORY
          *                          means the subdirectory where the
          *                          image data should be stored cannot be
-         *                          created.
+         *                          created, or does not exist when adopting
+         *                          it.
          *                          <li>
          *                          Image::Exception::ARCHIVE_WOULD_BE_EMPTY
          *                          means none of the files given in
@@ -314,17 +337,19 @@ namespace KryptoCD {
         Image(const std::string & imageId,
               const std::string & password,
               int compression,
-              std::list<std::string> & files,
-              std::list<std::string> & rejectedBigFiles,
-              std::list<std::string> & rejectedForbiddenFiles,
-              std::list<std::string> & rejectedBadNamedFiles,
+              const PathStore & paths,
+              const MetadataScanner & metadata,
+              PathList & files,
+              PathList & rejectedBigFiles,
+              PathList & rejectedForbiddenFiles,
+              PathList & rejectedBadNamedFiles,
               std::list<ImageInfo> & imageInfos,
               Diskspace & diskspace,
               int cdCapacity,
-              const std::string & tarExecutable,
+              Encrypter::Format format,
               const std::string & bzip2Executable,
-              const std::string & gpgExecutable,
-              const std::string & mkisofsExecutable)
+              const std::string & mkisofsExecutable,
+              bool adopt = false)
             throw(Image::Exception);
 
     public:
@@ -347,7 +372,31 @@ namespace KryptoCD {
         virtual void sendImageData(Sink & sink) const = 0;
 
         /**
-         * destructor frees the used disk space
+         * @return the image id, as passed to the constructor
+         */
+        const std::string & getImageId(void) const {return imageId;}
+
+        /**
+         * makes the destructor leave the data of this image on the
+         * harddisk, so that an interrupted backup can use it when it is
+         * resumed. See class Journal.
+         */
+        void keepData(void) {dataKept = true;}
+
+        /**
+         * removes a directory and the files in it
+         */
+        static void removeDirectory(const std::string & directory);
+
+        /**
+         * @return the size of the files in a directory, in megabytes,
+         *         rounded up
+         */
+        static int getDirectoryMegabytes(const std::string & directory);
+
+        /**
+         * destructor frees the used disk space, and deletes the data of
+         * this image unless keepData() has been called
          */
         virtual ~Image();
 
@@ -434,6 +483,16 @@ namespace KryptoCD {
          */
         int compression;
 
+        /**
+         * the store containing the names of all files in the lists below
+         */
+        const PathStore & paths;
+
+        /**
+         * what stat() told us about the files
+         */
+        const MetadataScanner & metadata;
+
         /**
          * A reference to the list of files that still need to be archived on
          * a cd. The files that are stored on this cd will be removed from
@@ -441,25 +500,25 @@ namespace KryptoCD {
          * after compression, and we will also remove the files from this list
          * for which we do not have the permission to read them.
          */
-        std::list<std::string> & files;
+        PathList & files;
 
         /**
          * A reference to the list of files that are too big to fit on a cd
          * even after compression. We will only append files to this list.
          */
-        std::list<std::string> & rejectedBigFiles;
+        PathList & rejectedBigFiles;
 
         /**
          * A reference to the list of files that we do not have the permission
          * to read. We will only append files to this list.
          */
-        std::list<std::string> & rejectedForbiddenFiles;
+        PathList & rejectedForbiddenFiles;
 
         /**
          * A reference to the list of files that cannot be dumped because of
          * their names.
          */
-        std::list<std::string> & rejectedBadNamedFiles;
+        PathList & rejectedBadNamedFiles;
 
         /**
          * A reference to the harddisk space managing object
@@ -472,20 +531,15 @@ namespace KryptoCD {
         int cdCapacity;
 
         /**
-         * the location of the GNU tar executable file
+         * the format of the encrypted archives
          */
-        std::string tarExecutable;
+        Encrypter::Format format;
 
         /**
          * the location of the bzip2 executable file
          */
         std::string bzip2Executable;
 
-        /**
-         * the location of the GNU privacy guard executable file
-         */
-        std::string gpgExecutable;
-
         /**
          * the location of the mkisofs executable file
          */
@@ -528,6 +582,11 @@ namespace KryptoCD {
          * (diskspace.getDirectory() + "/" + imageId)
          */
         std::string baseDirectory;
+
+        /**
+         * set by keepData()
+         */
+        bool dataKept;
     };
 }
 #endif
@@ -0,0 +1,446 @@
+/*
+ * image_index.cpp: class ImageIndex implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_index.hh"
+#include "gcm.hh"
+#include "key_cache.hh"
+#include "varint.hh"
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+using KryptoCD::ImageIndex;
+using KryptoCD::TarWriter;
+using KryptoCD::SegmentedBzip2;
+using KryptoCD::PathStore;
+using KryptoCD::Gcm;
+using KryptoCD::KeyCache;
+using std::string;
+using std::vector;
+using std::pair;
+
+const char ImageIndex::MAGIC[8] = {'K','C','D','I','N','D','E','X'};
+
+namespace {
+    /**
+     * reads the mapped index byte by byte, for getNumber(), without
+     * running over its end
+     */
+    class Cursor {
+        const unsigned char * position;
+        const unsigned char * end;
+    public:
+        Cursor(const unsigned char * p, const unsigned char * e)
+            : position(p), end(e) {}
+        int get(void) {
+            return (position < end) ? *position++ : EOF;
+        }
+
+        /**
+         * @return the next length bytes, or 0 if there are not as many
+         */
+        const unsigned char * take(unsigned long long length) {
+            if (static_cast<unsigned long long>(end - position) < length) {
+                return 0;
+            }
+            const unsigned char * bytes = position;
+            position += length;
+            return bytes;
+        }
+    };
+}
+
+static void putBigEndian(string & out, unsigned long long value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out += char(value >> (8 * i));
+    }
+}
+
+static unsigned long long getBigEndian(const unsigned char * in, int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * compares names bytewise, like std::string does
+ */
+static int compareNames(const unsigned char * name, size_t length,
+                        const string & other) {
+    size_t common = (length < other.size()) ? length : other.size();
+    int result = memcmp(name, other.data(), common);
+    if (result != 0) {
+        return result;
+    }
+    return (length < other.size()) ? -1 : ((length > other.size()) ? 1 : 0);
+}
+
+/**
+ * writes to a file descriptor
+ */
+static bool writeAll(int fd, const unsigned char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+ImageIndex::Location ImageIndex::getLocation(const TarWriter::Member & member,
+                                             unsigned long archive) {
+    Location location;
+    location.archive = archive;
+    location.offset = member.offset;
+    location.length = member.size;
+    location.size = member.dataSize;
+    location.mtime = member.mtime;
+    location.hash = member.hash;
+    return location;
+}
+
+void ImageIndex::save(const string & filename,
+                      const string & password,
+                      const PathStore & paths,
+                      const vector<Entry> & entries,
+                      const vector<SegmentedBzip2::Segment> & segments)
+    throw(ImageIndex::Exception) {
+    vector<pair<string, size_t> > sorted;
+    sorted.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        sorted.push_back(pair<string, size_t>(paths.getPath(entries[i].file),
+                                              i));
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    unsigned long groupCount = (sorted.size() + GROUP_SIZE - 1) / GROUP_SIZE;
+    string index;
+    putBigEndian(index, sorted.size(), 4);
+    putBigEndian(index, groupCount, 4);
+    putBigEndian(index, segments.size(), 4);
+    size_t groupTable = index.size();
+    index.append(4 * groupCount, '\0');
+    for (size_t i = 0; i < segments.size(); ++i) {
+        putBigEndian(index, segments[i].plainOffset, 8);
+        putBigEndian(index, segments[i].compressedOffset, 8);
+    }
+    size_t entriesStart = index.size();
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const string & name = sorted[i].first;
+        size_t shared = 0;
+        if (i % GROUP_SIZE == 0) {
+            string offset;
+            putBigEndian(offset, index.size() - entriesStart, 4);
+            index.replace(groupTable + 4 * (i / GROUP_SIZE), 4, offset);
+        } else {
+            const string & previous = sorted[i - 1].first;
+            while ((shared < name.size()) && (shared < previous.size())
+                   && (name[shared] == previous[shared])) {
+                ++shared;
+            }
+        }
+        const Location & location = entries[sorted[i].second].location;
+        putNumber(index, shared);
+        putNumber(index, name.size() - shared);
+        index.append(name, shared, string::npos);
+        putNumber(index, location.archive);
+        putNumber(index, location.offset);
+        putNumber(index, location.length);
+        putNumber(index, location.size);
+        putSignedNumber(index, location.mtime);
+        putBigEndian(index, location.hash, 8);
+    }
+
+    vector<unsigned char> file(HEADER_LENGTH + index.size()
+                               + Gcm::TAG_LENGTH);
+    unsigned char * nonce = &file[HEADER_LENGTH - Gcm::NONCE_LENGTH];
+    unsigned char * body = &file[HEADER_LENGTH];
+    memcpy(body, index.data(), index.size());
+    KeyCache::wipe(&index[0], index.size());
+    try {
+        const KeyCache & cache = KeyCache::get(password);
+        if (!KeyCache::readRandom(nonce, Gcm::NONCE_LENGTH)) {
+            throw Exception(Exception::UNABLE_TO_WRITE);
+        }
+        memcpy(&file[0], MAGIC, sizeof(MAGIC));
+        file[8] = VERSION;
+        file[9] = KeyCache::S2K_COUNT;
+        memcpy(&file[10], cache.getSalt(), KeyCache::SALT_LENGTH);
+        Gcm(cache.getKey(), KeyCache::KEY_LENGTH)
+            .encrypt(nonce, &file[0], HEADER_LENGTH, body,
+                     file.size() - HEADER_LENGTH - Gcm::TAG_LENGTH,
+                     &file[file.size() - Gcm::TAG_LENGTH]);
+    } catch (KeyCache::Exception &) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+
+    int fd = open(filename.c_str(), O_WRONLY|O_CREAT|O_EXCL, 0600);
+    if (fd < 0) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    bool success = writeAll(fd, &file[0], file.size());
+    if ((close(fd) != 0) || !success) {
+        unlink(filename.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+}
+
+ImageIndex::ImageIndex(const string & filename, const string & password)
+    throw(ImageIndex::Exception)
+    : mapping(0),
+      mappingLength(0),
+      version(0),
+      count(0),
+      groupCount(0),
+      segmentCount(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception(Exception::UNABLE_TO_READ);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw Exception(Exception::UNABLE_TO_READ);
+    }
+    if (st.st_size < static_cast<off_t>(HEADER_LENGTH + 8 + Gcm::TAG_LENGTH)) {
+        close(fd);
+        throw Exception(Exception::NOT_AN_INDEX);
+    }
+    mappingLength = st.st_size;
+
+    /* a private mapping can be decrypted in place */
+    void * address = mmap(0, mappingLength, PROT_READ|PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        throw Exception(Exception::UNABLE_TO_READ);
+    }
+    mapping = static_cast<unsigned char *>(address);
+
+    Exception::Reason failure = Exception::NOT_AN_INDEX;
+    version = mapping[8];
+    bool success = (memcmp(mapping, MAGIC, sizeof(MAGIC)) == 0)
+        && (version >= 1) && (version <= VERSION);
+    if (success) {
+        unsigned char count = mapping[9];
+        const unsigned char * salt = mapping + 10;
+        unsigned char key[KeyCache::KEY_LENGTH];
+        try {
+            const KeyCache & cache = KeyCache::get(password);
+            if ((count == KeyCache::S2K_COUNT)
+                && (memcmp(salt, cache.getSalt(), KeyCache::SALT_LENGTH)
+                    == 0)) {
+                memcpy(key, cache.getKey(), sizeof(key));
+            } else {
+                KeyCache::deriveKey(password, salt, count, key, sizeof(key));
+            }
+            success = Gcm(key, sizeof(key))
+                .decrypt(mapping + HEADER_LENGTH - Gcm::NONCE_LENGTH,
+                         mapping, HEADER_LENGTH,
+                         mapping + HEADER_LENGTH,
+                         mappingLength - HEADER_LENGTH - Gcm::TAG_LENGTH,
+                         mapping + mappingLength - Gcm::TAG_LENGTH);
+        } catch (KeyCache::Exception &) {
+            success = false;
+        }
+        KeyCache::wipe(key, sizeof(key));
+        failure = Exception::NOT_AUTHENTIC;
+    }
+
+    if (success) {
+        mprotect(mapping, mappingLength, PROT_READ);
+        const unsigned char * index = mapping + HEADER_LENGTH;
+        end = mapping + mappingLength - Gcm::TAG_LENGTH;
+        this->count = getBigEndian(index, 4);
+        groupCount = getBigEndian(index + 4, 4);
+        groups = index + 8;
+        if (version >= 2) {
+            segmentCount = getBigEndian(index + 8, 4);
+            groups += 4;
+        }
+        segments = groups + 4 * groupCount;
+        entries = segments + SEGMENT_LENGTH * segmentCount;
+
+        /* the groups and segments have to be where they can be */
+        failure = Exception::NOT_AN_INDEX;
+        success = (groupCount == (this->count + GROUP_SIZE - 1) / GROUP_SIZE)
+            && (groupCount <= static_cast<unsigned long>(end - groups) / 4)
+            && (segmentCount
+                <= static_cast<unsigned long>(end - segments)
+                / SEGMENT_LENGTH);
+        for (unsigned long group = 0; success && (group < groupCount);
+             ++group) {
+            success = getBigEndian(groups + 4 * group, 4)
+                < static_cast<unsigned long long>(end - entries);
+        }
+    }
+    if (!success) {
+        munmap(mapping, mappingLength);
+        throw Exception(failure);
+    }
+}
+
+ImageIndex::~ImageIndex() {
+    munmap(mapping, mappingLength);
+}
+
+size_t ImageIndex::getCount(void) const {
+    return count;
+}
+
+const unsigned char * ImageIndex::getFirstName(unsigned group,
+                                               size_t & length) const {
+    Cursor cursor(entries + getBigEndian(groups + 4 * group, 4), end);
+    unsigned long long shared, suffix;
+    if (!getNumber(cursor, shared) || (shared != 0)
+        || !getNumber(cursor, suffix)) {
+        return 0;
+    }
+    length = suffix;
+    return cursor.take(suffix);
+}
+
+bool ImageIndex::find(const string & path, Location & location) const {
+    if (groupCount == 0) {
+        return false;
+    }
+
+    /* the last group whose first name is not after the path */
+    unsigned long low = 0;
+    unsigned long high = groupCount;
+    while (high - low > 1) {
+        unsigned long middle = (low + high) / 2;
+        size_t length;
+        const unsigned char * name = getFirstName(middle, length);
+        if (name == 0) {
+            return false;
+        }
+        if (compareNames(name, length, path) <= 0) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    Cursor cursor(entries + getBigEndian(groups + 4 * low, 4), end);
+    string name;
+    unsigned long last = (low + 1) * GROUP_SIZE;
+    if (last > count) {
+        last = count;
+    }
+    for (unsigned long entry = low * GROUP_SIZE; entry < last; ++entry) {
+        unsigned long long shared, length, archive, offset, size;
+        unsigned long long memberLength = 0;
+        long long mtime;
+        const unsigned char * suffix;
+        const unsigned char * hash;
+        if (!getNumber(cursor, shared) || (shared > name.size())
+            || !getNumber(cursor, length)
+            || ((suffix = cursor.take(length)) == 0)
+            || !getNumber(cursor, archive)
+            || !getNumber(cursor, offset)
+            || ((version >= 2) && !getNumber(cursor, memberLength))
+            || !getNumber(cursor, size)
+            || !getSignedNumber(cursor, mtime)
+            || ((hash = cursor.take(8)) == 0)) {
+            return false;
+        }
+        name.resize(shared);
+        name.append(reinterpret_cast<const char *>(suffix), length);
+        int order = name.compare(path);
+        if (order == 0) {
+            location.archive = archive;
+            location.offset = offset;
+            location.length = memberLength;
+            location.size = size;
+            location.mtime = mtime;
+            location.hash = getBigEndian(hash, 8);
+            return true;
+        }
+        if (order > 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+SegmentedBzip2::Segment ImageIndex::getSegment(unsigned long segment) const {
+    SegmentedBzip2::Segment result;
+    result.plainOffset = getBigEndian(segments + SEGMENT_LENGTH * segment, 8);
+    result.compressedOffset =
+        getBigEndian(segments + SEGMENT_LENGTH * segment + 8, 8);
+    return result;
+}
+
+bool ImageIndex::findSegments(long long plainStart, long long plainEnd,
+                              SegmentedBzip2::Segment & first,
+                              long long & compressedEnd) const {
+    if (segmentCount == 0) {
+        return false;
+    }
+
+    /* the last segment that does not start after plainStart */
+    unsigned long low = 0;
+    unsigned long high = segmentCount;
+    while (high - low > 1) {
+        unsigned long middle = (low + high) / 2;
+        if (getSegment(middle).plainOffset <= plainStart) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    first = getSegment(low);
+
+    /* the first segment that starts at or after plainEnd */
+    compressedEnd = -1;
+    if (plainEnd >= 0) {
+        high = segmentCount;
+        while (high - low > 1) {
+            unsigned long middle = (low + high) / 2;
+            if (getSegment(middle).plainOffset < plainEnd) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        if (high < segmentCount) {
+            compressedEnd = getSegment(high).compressedOffset;
+        }
+    }
+    return true;
+}
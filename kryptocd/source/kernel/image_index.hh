@@ -0,0 +1,267 @@
+/*
+ * image_index.hh: class ImageIndex header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef IMAGE_INDEX_HH
+#define IMAGE_INDEX_HH
+
+#include "path_store.hh"
+#include "tar_writer.hh"
+#include "segmented_bzip2.hh"
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class ImageIndex writes and reads the binary index of an image. It
+     * tells for every file on the image in which archive it is, where its
+     * member starts in the tar data, and its size, modification time and
+     * Xxh64 hash, without decrypting and parsing the list of names.
+     * <p>
+     * The file starts with a header of HEADER_LENGTH bytes: MAGIC, the
+     * version, the coded S2K count and the salt of the passphrase's
+     * KeyCache, and a random nonce. The rest is the index, encrypted with
+     * AES-256-GCM under the cached key, authenticating the header, and the
+     * tag.
+     * <p>
+     * The index is laid out to be used where it lies, without parsing:
+     * the number of entries, of groups and of segments, 4 bytes each,
+     * then the offset of each group from the start of the entries, 4
+     * bytes each, then the segments of archive 0 as written by
+     * SegmentedBzip2, plain and compressed offset in 8 bytes each, then
+     * the entries sorted by name. Numbers are big-endian, except in the
+     * entries. A group is GROUP_SIZE entries. Each entry stores the length
+     * of the prefix it shares with the name before it and the rest of its
+     * name, so a group's first name is stored whole. Then follow archive,
+     * offset, length, size and time as variable length integers, see
+     * varint.hh, and the hash in 8 bytes. A lookup searches the groups'
+     * first names binarily, and decodes one group.
+     * <p>
+     * Version 1 had neither segments nor lengths. It is still read.
+     * <p>
+     * The reader maps the file into memory privately, decrypts it in
+     * place, and makes it read only.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ImageIndex {
+    public:
+        class Exception {
+        public:
+            enum Reason {
+                UNABLE_TO_WRITE,
+                UNABLE_TO_READ,
+                NOT_AN_INDEX,
+                NOT_AUTHENTIC,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        static const char MAGIC[8];
+        static const unsigned char VERSION = 2;
+
+        /**
+         * the header: magic, version, S2K count, salt, nonce
+         */
+        static const size_t HEADER_LENGTH = 8 + 1 + 1 + 8 + 12;
+
+        /**
+         * the number of entries in a group
+         */
+        static const unsigned GROUP_SIZE = 16;
+
+        /**
+         * an upper bound for the bytes an entry takes besides its name:
+         * two lengths, archive, offset, member length, size and time of up
+         * to 10 bytes each, the hash, and its share of the group table.
+         * The index file adds less than a cd block to the entries and
+         * segments.
+         */
+        static const size_t MAX_ENTRY_OVERHEAD = 7 * 10 + 8 + 4;
+
+        /**
+         * the bytes a segment takes
+         */
+        static const size_t SEGMENT_LENGTH = 8 + 8;
+
+        /**
+         * where a file is stored on the image
+         */
+        struct Location {
+            /**
+             * the archive: 0 for archive.tar.bz2.gpg of a SINGLE_FILE
+             * image and for directories.tar.bz2.gpg of an INDEXED_FILES
+             * image, else the index number in the archive's name
+             */
+            unsigned long archive;
+
+            /**
+             * the offset of the file's tar member in the archive's
+             * uncompressed tar data
+             */
+            long long offset;
+
+            /**
+             * the number of bytes of the tar member, headers and padding
+             * included, or 0 if the index does not tell
+             */
+            long long length;
+
+            /**
+             * the number of data bytes stored
+             */
+            long long size;
+
+            time_t mtime;
+
+            /**
+             * the Xxh64 hash of the stored data
+             */
+            unsigned long long hash;
+        };
+
+        struct Entry {
+            PathId file;
+            Location location;
+        };
+
+        /**
+         * @return the location of a member that a TarWriter has written
+         *         into an archive
+         */
+        static Location getLocation(const TarWriter::Member & member,
+                                    unsigned long archive);
+
+        /**
+         * writes an index file
+         *
+         * @param filename the file to create. It must not exist.
+         * @param password the passphrase
+         * @param paths    the store containing the names of the files
+         * @param entries  the files, in any order
+         * @param segments the segments of archive 0, or none if it was
+         *                 not compressed by a SegmentedBzip2
+         * @exception ImageIndex::Exception
+         *                 if the file could not be written
+         */
+        static void save(const std::string & filename,
+                         const std::string & password,
+                         const PathStore & paths,
+                         const std::vector<Entry> & entries,
+                         const std::vector<SegmentedBzip2::Segment> &
+                         segments)
+            throw(Exception);
+
+        /**
+         * maps an index file into memory, and decrypts it
+         *
+         * @param filename the index file
+         * @param password the passphrase
+         * @exception ImageIndex::Exception
+         *                 if the file cannot be read, is not an index, or
+         *                 the passphrase is wrong or the file damaged
+         */
+        ImageIndex(const std::string & filename,
+                   const std::string & password)
+            throw(Exception);
+
+        /**
+         * unmaps the index
+         */
+        ~ImageIndex();
+
+        /**
+         * @return the number of files in the index
+         */
+        size_t getCount(void) const;
+
+        /**
+         * looks a file up
+         *
+         * @param path     the name of the file, as it was stored
+         * @param location where it is stored is returned here
+         * @return         false if the file is not on the image
+         */
+        bool find(const std::string & path, Location & location) const;
+
+        /**
+         * finds the part of archive 0's compressed data that has to be
+         * decompressed to get a part of its tar data
+         *
+         * @param plainStart the offset of the first tar byte needed
+         * @param plainEnd   the offset after the last tar byte needed, or
+         *                   -1 for the end of the tar data
+         * @param first      receives the segment containing plainStart
+         * @param compressedEnd
+         *                   receives the offset of the compressed data
+         *                   after the last segment needed, or -1 if the
+         *                   last segment of the archive is needed
+         * @return           false if the index has no segments, so that
+         *                   all of the compressed data before plainEnd
+         *                   has to be decompressed
+         */
+        bool findSegments(long long plainStart, long long plainEnd,
+                          SegmentedBzip2::Segment & first,
+                          long long & compressedEnd) const;
+
+    private:
+        /**
+         * not to be copied
+         */
+        ImageIndex(const ImageIndex &);
+        ImageIndex & operator=(const ImageIndex &);
+
+        /**
+         * @return the name of a group's first entry, and its length
+         */
+        const unsigned char * getFirstName(unsigned group,
+                                           size_t & length) const;
+
+        /**
+         * @return a segment from the table
+         */
+        SegmentedBzip2::Segment getSegment(unsigned long segment) const;
+
+        /**
+         * the mapped file
+         */
+        unsigned char * mapping;
+        size_t mappingLength;
+
+        unsigned char version;
+        unsigned long count;
+        unsigned long groupCount;
+        unsigned long segmentCount;
+
+        /**
+         * the group offsets, the segments, and the entries
+         */
+        const unsigned char * groups;
+        const unsigned char * segments;
+        const unsigned char * entries;
+        const unsigned char * end;
+    };
+}
+#endif
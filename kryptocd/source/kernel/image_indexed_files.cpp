@@ -0,0 +1,652 @@
+/*
+ * image_indexed_files.cpp: class ImageIndexedFiles implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "image_indexed_files.hh"
+#include "archive_creator.hh"
+#include "fsink.hh"
+#include "pgp_encrypter.hh"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <fstream>
+#include <algorithm>
+#include <map>
+
+using KryptoCD::Image;
+using KryptoCD::Encrypter;
+using KryptoCD::ImageIndexedFiles;
+using KryptoCD::ArchiveCreator;
+using KryptoCD::TarWriter;
+using KryptoCD::ImageIndex;
+using KryptoCD::FSink;
+using KryptoCD::PgpEncrypter;
+using KryptoCD::Diskspace;
+using KryptoCD::Childprocess;
+using KryptoCD::IoPump;
+using KryptoCD::Pipe;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using KryptoCD::PathList;
+using KryptoCD::PathSlice;
+using KryptoCD::PathId;
+using std::string;
+using std::list;
+using std::vector;
+using std::pair;
+using std::ofstream;
+
+const string ImageIndexedFiles::DIRECTORIES_FILENAME("/directories.tar.bz2.gpg");
+const string ImageIndexedFiles::PACK_TABLE_FILENAME("/packs.gpg");
+const long long ImageIndexedFiles::PACK_FILE_MAX_SIZE = 64 * 1024;
+const long long ImageIndexedFiles::PACK_MAX_BYTES = 1024 * 1024;
+
+/**
+ * The space a compressed archive needs at most besides its files: a tar
+ * header and the padding to the end of the tar file, and the 600 bytes
+ * that bzip2 adds to incompressible data besides expanding it by up to
+ * 1%. The growth by encryption is added exactly, see
+ * Encrypter::encryptedSize(), and the iso9660 directory record.
+ */
+static const long long ARCHIVE_OVERHEAD = 512 + 10240 + 600;
+static const long long DIRECTORY_RECORD_BYTES = 256;
+
+/**
+ * the space of a directory in the directory archive: one tar header
+ */
+static const long long DIRECTORY_BYTES = 512;
+
+/**
+ * the space of a file in a tar archive: the header, and the data padded
+ * to tar blocks
+ */
+static long long tarBytes(long long fileSize) {
+    return 512 + ((fileSize + 511) / 512) * 512;
+}
+
+/**
+ * space kept free for the directory archive's own overhead
+ */
+static const long long DIRECTORY_ARCHIVE_RESERVE = ARCHIVE_OVERHEAD + 10240;
+
+static long long roundUpToCdBlocks(long long bytes) {
+    return ((bytes + KryptoCD::CD_BLOCKSIZE - 1) / KryptoCD::CD_BLOCKSIZE)
+        * KryptoCD::CD_BLOCKSIZE;
+}
+
+static long long maximumArchiveBytes(Encrypter::Format format,
+                                     long long fileSize) {
+    long long compressed = fileSize + fileSize / 100 + ARCHIVE_OVERHEAD;
+    return roundUpToCdBlocks(Encrypter::encryptedSize(format, compressed))
+        + DIRECTORY_RECORD_BYTES;
+}
+
+ImageIndexedFiles::ImageIndexedFiles(const string & imageId_,
+                                     const string & password_,
+                                     int compression_,
+                                     const PathStore & paths_,
+                                     const MetadataScanner & metadata_,
+                                     PathList & files_,
+                                     PathList & rejectedBigFiles_,
+                                     PathList & rejectedForbiddenFiles_,
+                                     PathList & rejectedBadNamedFiles_,
+                                     list<ImageInfo> & imageInfos,
+                                     Diskspace & diskspace_,
+                                     int cdCapacity_,
+                                     Encrypter::Format format_,
+                                     const string & bzip2Executable_,
+                                     const string & mkisofsExecutable_)
+    throw(Image::Exception, IoPump::Exception,
+          Pipe::Exception, Childprocess::Exception)
+    : Image(imageId_, password_, compression_, paths_, metadata_, files_,
+            rejectedBigFiles_, rejectedForbiddenFiles_, rejectedBadNamedFiles_,
+            imageInfos, diskspace_, cdCapacity_, format_,
+            bzip2Executable_, mkisofsExecutable_),
+      started(0),
+      nextJob(0),
+      running(0),
+      committedBytes(0),
+      maxBytes(0),
+      finished(false),
+      failed(false),
+      mutex(new pthread_mutex_t),
+      queued(new pthread_cond_t),
+      done(new pthread_cond_t)
+{
+    pthread_mutex_init(mutex, 0);
+    pthread_cond_init(queued, 0);
+    pthread_cond_init(done, 0);
+
+    /*
+     * estimate the blocks needed for the index files, like ImageSingleFile
+     */
+    long long estimatedIndexFileSize = 0;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        estimatedIndexFileSize += 2 * paths.getLength(*iter) + 1
+            + ImageIndex::MAX_ENTRY_OVERHEAD;
+    }
+    int estimatedIndexFileBlocks =
+        (estimatedIndexFileSize / CD_BLOCKSIZE) + 2;
+    maxBytes =
+        static_cast<long long>(imageMaxCdBlocks - CD_BLOCKS_FOR_ISO_STRUCTURE
+                               - estimatedIndexFileBlocks) * CD_BLOCKSIZE
+        - Encrypter::encryptedSize(format, DIRECTORY_ARCHIVE_RESERVE);
+    if (maxBytes < CD_BLOCKSIZE) {
+        throw Image::Exception(Image::Exception::CD_CAPACITY_TOO_SMALL);
+    }
+
+    /* the Image destructor removes the files created so far */
+    PathList stored;
+    vector<ImageIndex::Location> locations;
+    vector<pair<size_t, size_t> > packs;
+    do {
+        archiveFiles();
+        if (failed) {
+            /* probably a full disk */
+            IoPump::Exception e;
+            e.notWritableFileDescriptor = -1;
+            throw e;
+        }
+        if (imageReady == false) {
+            rejectFirstFile();
+            if (files.empty()) {
+                /* we cannot create a cd: all files too big to fit */
+                throw Exception(Exception::ARCHIVE_WOULD_BE_EMPTY);
+            }
+            continue;
+        }
+
+        /*
+         * The stored files keep their order, the unreadable ones are moved
+         * to rejectedForbiddenFiles. Each archive is renamed to the line
+         * number of its first file in the index file. Packs only contain
+         * stored files, a pack with an unreadable file has been split.
+         */
+        unsigned long archive = 0;
+        for (size_t position = 0; position < started; ++position) {
+            if (jobs[position].state == UNREADABLE) {
+                rejectedForbiddenFiles.push_back(files[position]);
+                continue;
+            }
+            assert(jobs[position].state == STORED);
+            stored.push_back(files[position]);
+            if (jobs[position].count > 0) {
+                archive = stored.size();
+                char lineNumber[32];
+                sprintf(lineNumber, "/%lu",
+                        static_cast<unsigned long>(stored.size()));
+                rename(getJobFilename(position).c_str(),
+                       (baseDirectory + lineNumber).c_str());
+            }
+            if (jobs[position].count > 1) {
+                packs.push_back(pair<size_t, size_t>(stored.size(),
+                                                     jobs[position].count));
+            }
+            /* a directory's location is known with the directories archive */
+            locations.push_back(ImageIndex::getLocation(jobs[position].member,
+                                                        archive));
+        }
+        files.erase(files.begin(), files.begin() + started);
+        if (stored.empty()) {
+            /* all files we tried were unreadable */
+            imageReady = false;
+            if (files.empty()) {
+                throw Exception(Exception::ARCHIVE_WOULD_BE_EMPTY);
+            }
+        }
+    } while (imageReady == false);
+    files.insert(files.begin(), stored.begin(), stored.end());
+
+    vector<TarWriter::Member> directoryMembers;
+    archiveDirectories(directoryMembers);
+    std::map<PathId, size_t> directoryMember;
+    for (size_t i = 0; i < directoryMembers.size(); ++i) {
+        directoryMember[directoryMembers[i].file] = i;
+    }
+    for (size_t line = 0; line < stored.size(); ++line) {
+        std::map<PathId, size_t>::const_iterator iter =
+            directoryMember.find(stored[line]);
+        if (paths.isDirectory(stored[line])
+            && (iter != directoryMember.end())) {
+            locations[line] =
+                ImageIndex::getLocation(directoryMembers[iter->second], 0);
+        }
+    }
+    if (!packs.empty()) {
+        savePackTable(packs);
+    }
+
+    imageInfos.push_back(ImageInfo(imageId, paths,
+                                   PathSlice(files, 0, stored.size())));
+    imageInfos.back().locations.swap(locations);
+
+    // remove the stored files from the list:
+    files.erase(files.begin(), files.begin() + stored.size());
+    try {
+        imageInfos.back().saveToFile(baseDirectory, password);
+    } catch (...) {
+        imageInfos.pop_back();
+        throw Exception(Exception::UNABLE_TO_CREATE_INFO);
+    }
+}
+
+ImageIndexedFiles::~ImageIndexedFiles() {
+    int destroyVal = pthread_cond_destroy(done);
+    assert(destroyVal == 0);
+    delete done;
+    destroyVal = pthread_cond_destroy(queued);
+    assert(destroyVal == 0);
+    delete queued;
+    destroyVal = pthread_mutex_destroy(mutex);
+    assert(destroyVal == 0);
+    delete mutex;
+}
+
+string ImageIndexedFiles::getJobFilename(size_t position) const {
+    char name[32];
+    sprintf(name, "/job%lu", static_cast<unsigned long>(position));
+    return baseDirectory + name;
+}
+
+void ImageIndexedFiles::archiveFiles(void) {
+    Job notStarted;
+    notStarted.state = NOT_STARTED;
+    notStarted.bytes = 0;
+    notStarted.first = 0;
+    notStarted.count = 0;
+    notStarted.member = TarWriter::Member();
+    jobs.assign(files.size(), notStarted);
+    onImage.assign(paths.size(), false);
+    started = 0;
+    nextJob = 0;
+    running = 0;
+    committedBytes = 0;
+    finished = false;
+    failed = false;
+
+    /*
+     * Most of the time goes to bzip2, so use all processors, and then some
+     * to make up for the time tar and gpg spend waiting for the disk.
+     */
+    long threadCount = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+    if (threadCount < 2) {
+        threadCount = 2;
+    }
+    if (size_t(threadCount) > files.size()) {
+        threadCount = files.size();
+    }
+    vector<Worker *> workers;
+    for (long i = 0; i < threadCount; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+
+    pthread_mutex_lock(mutex);
+    while ((started < files.size()) && !failed) {
+        size_t count = startFiles(started, started == 0);
+        if (count == 0) {
+            if (running == 0) {
+                /* even the finished archives leave no room for this file */
+                break;
+            }
+            /* the running archives may turn out smaller than reserved */
+            pthread_cond_wait(done, mutex);
+        } else {
+            /*
+             * Get the harddisk space for the reservation before the workers
+             * see the file. The reservation is an upper bound, so the
+             * archives cannot grow beyond the allocated space.
+             */
+            long long neededMegabytes =
+                (committedBytes + MEGABYTE - 1) / MEGABYTE;
+            if (neededMegabytes > imageMaxMegabytes) {
+                neededMegabytes = imageMaxMegabytes;
+            }
+            while (allocatedMegabytes < neededMegabytes) {
+                pthread_mutex_unlock(mutex);
+                allocatedMegabytes +=
+                    diskspace.allocate(neededMegabytes - allocatedMegabytes);
+                pthread_mutex_lock(mutex);
+            }
+            started += count;
+            pthread_cond_broadcast(queued);
+        }
+    }
+    while (running > 0) {
+        pthread_cond_wait(done, mutex);
+    }
+    finished = true;
+    pthread_cond_broadcast(queued);
+    pthread_mutex_unlock(mutex);
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+
+    /*
+     * A file forced onto the empty cd, or files that grew since they were
+     * stat()ed, may have made the archives too big. Drop archives from the
+     * end until they fit.
+     */
+    while ((committedBytes > maxBytes) && (started > 0)) {
+        size_t first = jobs[started - 1].first;
+        unlink(getJobFilename(first).c_str());
+        while (started > first) {
+            --started;
+            committedBytes -= jobs[started].bytes;
+            jobs[started].state = NOT_STARTED;
+        }
+    }
+    imageReady = (started > 0);
+}
+
+void ImageIndexedFiles::findNewDirectories(PathId file,
+                                           vector<PathId> & newDirectories)
+    const {
+    if (paths.isDirectory(file) && !onImage[file]) {
+        newDirectories.push_back(file);
+    }
+    for (PathId parent = paths.getParent(file);
+         (parent != KryptoCD::NO_PATH) && !onImage[parent];
+         parent = paths.getParent(parent)) {
+        const FileMetadata * parentMetadata = metadata.get(parent);
+        if ((parentMetadata != 0) && S_ISDIR(parentMetadata->mode)
+            && (std::find(newDirectories.begin(), newDirectories.end(),
+                          parent) == newDirectories.end())) {
+            newDirectories.push_back(parent);
+        }
+    }
+}
+
+size_t ImageIndexedFiles::startFiles(size_t position, bool force) {
+    /* the directories these files need that are not yet on this cd: */
+    vector<PathId> newDirectories;
+    findNewDirectories(files[position], newDirectories);
+
+    if (paths.isDirectory(files[position])) {
+        long long bytes = DIRECTORY_BYTES * newDirectories.size();
+        if (!force && (committedBytes + bytes > maxBytes)) {
+            return 0;
+        }
+        committedBytes += bytes;
+        jobs[position].state = STORED;
+        jobs[position].first = position;
+    } else {
+        /*
+         * A small file takes the following small files of the list with it
+         * into a pack, up to a directory or a large file.
+         */
+        size_t count = 0;
+        long long packBytes = 0;
+        do {
+            PathId file = files[position + count];
+            const FileMetadata * st = metadata.get(file);
+            FileMetadata unscanned;
+            if (st == 0) {
+                string name = paths.getPath(file);
+                MetadataScanner::statFile(name.c_str(), unscanned);
+                st = &unscanned;
+            }
+            if ((count > 0)
+                && ((st->size >= PACK_FILE_MAX_SIZE)
+                    || (packBytes + tarBytes(st->size) > PACK_MAX_BYTES))) {
+                break;
+            }
+            if (count > 0) {
+                findNewDirectories(file, newDirectories);
+            }
+            packBytes += tarBytes(st->size);
+            ++count;
+            if (st->size >= PACK_FILE_MAX_SIZE) {
+                break;
+            }
+        } while ((position + count < files.size())
+                 && !paths.isDirectory(files[position + count]));
+
+        long long bytes = maximumArchiveBytes(format, packBytes);
+        long long directoryBytes = DIRECTORY_BYTES * newDirectories.size();
+        if (!force && (committedBytes + bytes + directoryBytes > maxBytes)) {
+            return 0;
+        }
+        committedBytes += bytes + directoryBytes;
+        for (size_t i = 0; i < count; ++i) {
+            jobs[position + i].state = WAITING;
+            jobs[position + i].first = position;
+        }
+        jobs[position].bytes = bytes;
+        jobs[position].count = count;
+        ++running;
+    }
+
+    for (vector<PathId>::const_iterator iter = newDirectories.begin();
+         iter != newDirectories.end();
+         ++iter) {
+        onImage[*iter] = true;
+    }
+    return jobs[position].count > 0 ? jobs[position].count : 1;
+}
+
+void * ImageIndexedFiles::Worker::run(void) {
+    image.work();
+    return this;
+}
+
+void ImageIndexedFiles::work(void) {
+    vector<JobState> states;
+    vector<long long> archiveBytes;
+    vector<TarWriter::Member> members;
+
+    pthread_mutex_lock(mutex);
+    for (;;) {
+        while ((nextJob < started)
+               && ((jobs[nextJob].state != WAITING)
+                   || (jobs[nextJob].first != nextJob))) {
+            ++nextJob;
+        }
+        if (nextJob < started) {
+            size_t position = nextJob++;
+            size_t count = jobs[position].count;
+            for (size_t i = 0; i < count; ++i) {
+                jobs[position + i].state = RUNNING;
+            }
+            pthread_mutex_unlock(mutex);
+
+            bool split = archiveJob(position, count, states, archiveBytes,
+                                    members);
+
+            pthread_mutex_lock(mutex);
+            committedBytes -= jobs[position].bytes;
+            for (size_t i = 0; i < count; ++i) {
+                Job & job = jobs[position + i];
+                job.state = states[i];
+                job.bytes = 0;
+                if (split) {
+                    job.first = position + i;
+                    job.count = 1;
+                }
+                if ((states[i] == STORED) && (i < members.size())) {
+                    job.member = members[i];
+                }
+                if ((states[i] == STORED) && (job.count > 0)) {
+                    job.bytes = roundUpToCdBlocks(archiveBytes[i])
+                        + DIRECTORY_RECORD_BYTES;
+                }
+                committedBytes += job.bytes;
+                if (states[i] == FAILED) {
+                    failed = true;
+                }
+            }
+            --running;
+            pthread_cond_broadcast(done);
+        } else if (finished) {
+            break;
+        } else {
+            pthread_cond_wait(queued, mutex);
+        }
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+bool ImageIndexedFiles::archiveJob(size_t position, size_t count,
+                                   vector<JobState> & states,
+                                   vector<long long> & bytes,
+                                   vector<TarWriter::Member> & members) {
+    states.assign(count, STORED);
+    bytes.assign(count, 0);
+    members.clear();
+    JobState state = createArchive(position, count, bytes[0], members);
+    if ((state != UNREADABLE) || (count == 1)) {
+        states.assign(count, state);
+        return false;
+    }
+
+    /*
+     * tar could not read one of the files of the pack. Rather than find
+     * out which, store each file on its own, so the unreadable ones are
+     * left out.
+     */
+    vector<TarWriter::Member> fileMembers;
+    members.assign(count, TarWriter::Member());
+    for (size_t i = 0; i < count; ++i) {
+        states[i] = createArchive(position + i, 1, bytes[i], fileMembers);
+        if ((states[i] == STORED) && !fileMembers.empty()) {
+            members[i] = fileMembers[0];
+        }
+    }
+    return true;
+}
+
+ImageIndexedFiles::JobState
+ImageIndexedFiles::createArchive(size_t position, size_t count,
+                                 long long & bytes,
+                                 vector<TarWriter::Member> & members) {
+    string filename = getJobFilename(position);
+    try {
+        FSink output(filename, O_WRONLY|O_CREAT|O_EXCL, 0600);
+        ArchiveCreator archiveCreator(bzip2Executable, paths,
+                                      PathSlice(files, position, count),
+                                      compression, password, format,
+                                      output);
+        archiveCreator.wait();
+        if (archiveCreator.exitedAbnormally()) {
+            unlink(filename.c_str());
+            return FAILED;
+        }
+        if (archiveCreator.tarFailed()) {
+            /* a file could not be read, or has vanished */
+            unlink(filename.c_str());
+            return UNREADABLE;
+        }
+        members = archiveCreator.getMembers();
+    } catch (...) {
+        unlink(filename.c_str());
+        return FAILED;
+    }
+
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return FAILED;
+    }
+    bytes = st.st_size;
+    return STORED;
+}
+
+void ImageIndexedFiles::savePackTable(const vector<pair<size_t, size_t> >
+                                      & packs) const
+    throw(Image::Exception) {
+    string filename = baseDirectory + PACK_TABLE_FILENAME;
+    try {
+        FSink output(filename, O_WRONLY|O_CREAT|O_EXCL, 0600);
+        try {
+            Pipe contentsPipe;
+            PgpEncrypter encrypter(password, contentsPipe, output);
+            {
+                ofstream of(contentsPipe.getSinkFd());
+
+                for (vector<pair<size_t, size_t> >::const_iterator iter =
+                         packs.begin();
+                     iter != packs.end();
+                     ++iter) {
+                    of << iter->first << ' ' << iter->second << '\n';
+                }
+                of << flush;
+                if (of.bad()) {
+                    /* Disk full? */
+                    throw Exception(Exception::UNABLE_TO_CREATE_INFO);
+                }
+            }
+            contentsPipe.closeSink();
+            encrypter.wait();
+            if (encrypter.exitedAbnormally()) {
+                /* Disk full? */
+                throw Exception(Exception::UNABLE_TO_CREATE_INFO);
+            }
+        } catch(...) {
+            unlink(filename.c_str());
+            throw Exception(Exception::UNABLE_TO_CREATE_INFO);
+        }
+    } catch(FSink::Exception) {
+        throw Exception(Exception::UNABLE_TO_CREATE_INFO);
+    }
+}
+
+void ImageIndexedFiles::archiveDirectories(vector<TarWriter::Member> &
+                                           members)
+    throw(IoPump::Exception, Pipe::Exception, Childprocess::Exception) {
+    /*
+     * A parent directory is interned before its children, so in PathId
+     * order tar restores each directory before its contents.
+     */
+    PathList directories;
+    for (PathId id = 0; id < onImage.size(); ++id) {
+        if (onImage[id]) {
+            directories.push_back(id);
+        }
+    }
+    if (directories.empty()) {
+        return;
+    }
+    FSink output(baseDirectory + DIRECTORIES_FILENAME,
+                 O_WRONLY|O_CREAT|O_EXCL, 0600);
+    ArchiveCreator archiveCreator(bzip2Executable, paths,
+                                  PathSlice(directories),
+                                  compression, password, format, output);
+    archiveCreator.wait();
+    if (archiveCreator.exitedAbnormally()) {
+        IoPump::Exception e;
+        e.notWritableFileDescriptor = -1;
+        throw e;
+    }
+    members = archiveCreator.getMembers();
+}
@@ -0,0 +1,337 @@
+/*
+ * image_indexed_files.hh: class ImageIndexedFiles header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef IMAGE_INDEXED_FILES_HH
+#define IMAGE_INDEXED_FILES_HH
+
+#include "image.hh"
+#include "thread.hh"
+#include "tar_writer.hh"
+#include <vector>
+#include <utility>
+#include <pthread.h>
+
+namespace KryptoCD {
+    /**
+     * Class ImageIndexedFiles implements the index file method of
+     * doc/Backup_method.txt: each file goes into a compressed, encrypted tar
+     * archive of its own, named by its index number, so a single file can
+     * be restored without decrypting anything else, and a bad block on the
+     * cd destroys only the file it belongs to.
+     * <p>
+     * The index numbers are the line numbers in the encrypted file list
+     * that ImageInfo::saveToFile() writes: the file on line n is stored in
+     * the archive named n. Directories have no archive of their own. All
+     * directories of the files on this cd, including the parent directories
+     * that went onto earlier cds, are stored together in
+     * DIRECTORIES_FILENAME, so each cd can be restored on its own with all
+     * permissions.
+     * <p>
+     * Files smaller than PACK_FILE_MAX_SIZE would cost a tar, bzip2 and gpg
+     * process each, and a cd block. Consecutive small files of the list
+     * are therefore packed into one archive of up to PACK_MAX_BYTES of tar
+     * data, named by the line number of its first file. PACK_TABLE_FILENAME
+     * lists the packs, one line "first count" each, so restore knows that
+     * lines first to first + count - 1 are stored in the archive named
+     * first. Within the pack, the files are stored in the order of the
+     * file list.
+     * <p>
+     * The per file archives are created by a pool of worker threads, each
+     * running its own tar, bzip2 and gpg processes. Files are started in
+     * the order of the list as long as the space they might need, at worst,
+     * still fits on the cd. The space actually used is accounted for as
+     * soon as an archive is finished, so the cd is filled up to the end
+     * with the first files of the list that fit.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ImageIndexedFiles : public Image {
+    public:
+        /**
+         * the name of the archive containing the directories
+         */
+        static const std::string DIRECTORIES_FILENAME;
+
+        /**
+         * the name of the encrypted table of the packs
+         */
+        static const std::string PACK_TABLE_FILENAME;
+
+        /**
+         * regular files smaller than this go into packs
+         */
+        static const long long PACK_FILE_MAX_SIZE;
+
+        /**
+         * the maximum size of the tar data in a pack
+         */
+        static const long long PACK_MAX_BYTES;
+
+        /**
+         * creates the archives. The parameters and exceptions are those of
+         * Image::create(), see there. Additionally, IoPump::Exception is
+         * thrown when bzip2 or gpg fail to write an archive, which is
+         * probably due to a full disk.
+         */
+        ImageIndexedFiles(const std::string & imageId,
+                          const std::string & password,
+                          int compression,
+                          const PathStore & paths,
+                          const MetadataScanner & metadata,
+                          PathList & files,
+                          PathList & rejectedBigFiles,
+                          PathList & rejectedForbiddenFiles,
+                          PathList & rejectedBadNamedFiles,
+                          std::list<ImageInfo> & imageInfos,
+                          Diskspace & diskspace,
+                          int cdCapacity,
+                          Encrypter::Format format,
+                          const std::string & bzip2Executable,
+                          const std::string & mkisofsExecutable)
+            throw(Image::Exception, IoPump::Exception,
+                  Pipe::Exception, Childprocess::Exception);
+
+        /**
+         * returns the number of blocks that this image would occupy on a cd.
+         * Uses mkisofs -print-size
+         *
+         * @return the size of the iso9660-image in cd blocks
+         */
+        virtual int getImageBlocks(void) const {return 0;};
+
+        /**
+         * creates an iso9660 image if the cd data on the fly and sends this
+         * image to the given sink
+         *
+         * @param sink            the sink where the image data is
+         *                        sent to. Should be a pipe to a cdrecord
+         *                        process
+         */
+        virtual void sendImageData(Sink & sink) const {};
+
+        virtual ~ImageIndexedFiles();
+
+    private:
+        /**
+         * the state of one file of the list
+         */
+        enum JobState {
+            NOT_STARTED,
+            WAITING,
+            RUNNING,
+            STORED,
+            UNREADABLE,
+            FAILED,
+        };
+
+        struct Job {
+            JobState state;
+
+            /**
+             * the cd space reserved for the archive starting at this file
+             * while it is created, its actual cd space afterwards. 0 for
+             * the other files of a pack and for directories.
+             */
+            long long bytes;
+
+            /**
+             * the position of the file whose job creates the archive
+             * containing this file. Equal to the own position for
+             * standalone files, pack heads and directories.
+             */
+            size_t first;
+
+            /**
+             * the number of files in the archive starting at this file,
+             * 0 if none starts here
+             */
+            size_t count;
+
+            /**
+             * the file's tar member in its archive, once STORED
+             */
+            TarWriter::Member member;
+        };
+
+        /**
+         * a thread creating per file archives
+         */
+        class Worker : public Thread {
+            ImageIndexedFiles & image;
+        public:
+            Worker(ImageIndexedFiles & i) : image(i) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        /**
+         * creates the archives of as many files from the beginning of the
+         * list as fit on the cd, and sets "started" to their number.
+         * Sets imageReady if at least one file fits.
+         */
+        void archiveFiles(void);
+
+        /**
+         * the work of one thread: create the archives of started files
+         * until archiveFiles() is finished
+         */
+        void work(void);
+
+        /**
+         * creates the archive of some consecutive files under the
+         * temporary name of the first one
+         *
+         * @param position the position of the first file in "files"
+         * @param count    the number of files
+         * @param bytes    receives the size of the archive
+         * @param members  receives the tar members of the files
+         * @return         STORED, UNREADABLE if tar could not read one of
+         *                 the files, or FAILED
+         */
+        JobState createArchive(size_t position, size_t count,
+                               long long & bytes,
+                               std::vector<TarWriter::Member> & members);
+
+        /**
+         * creates the archive of a pack, or, if one of its files is
+         * unreadable, standalone archives of its files. Called by work()
+         * without the mutex held.
+         *
+         * @param states receives the new state of each file of the pack
+         * @param bytes  receives the size of each archive, indexed like
+         *               states
+         * @param members receives the tar member of each stored file,
+         *               indexed like states
+         * @return       true if the pack had to be split
+         */
+        bool archiveJob(size_t position, size_t count,
+                        std::vector<JobState> & states,
+                        std::vector<long long> & bytes,
+                        std::vector<TarWriter::Member> & members);
+
+        /**
+         * reserves the cd space for a file, or for a pack of small files
+         * starting with it, and for their parent directories that are not
+         * yet on this cd, if it fits, and marks them WAITING, or STORED for
+         * a directory. Called by archiveFiles() with the mutex held.
+         *
+         * @param force start the file even if it might not fit
+         * @return      the number of files started, 0 if the file might not
+         *              fit on the cd
+         */
+        size_t startFiles(size_t position, bool force);
+
+        /**
+         * adds the parent directories of a file that are not yet on this cd
+         * to newDirectories
+         */
+        void findNewDirectories(PathId file,
+                                std::vector<PathId> & newDirectories) const;
+
+        /**
+         * writes PACK_TABLE_FILENAME
+         *
+         * @param packs pairs of the first line number and the file count
+         *              of each pack
+         */
+        void savePackTable(const std::vector<std::pair<size_t, size_t> >
+                           & packs) const
+            throw(Image::Exception);
+
+        /**
+         * @return the temporary name of the archive of a file
+         */
+        std::string getJobFilename(size_t position) const;
+
+        /**
+         * creates DIRECTORIES_FILENAME
+         *
+         * @param members receives the tar members of the directories
+         */
+        void archiveDirectories(std::vector<TarWriter::Member> & members)
+            throw(IoPump::Exception, Pipe::Exception, Childprocess::Exception);
+
+        /**
+         * one entry for each file in "files"
+         */
+        std::vector<Job> jobs;
+
+        /**
+         * the number of files from the beginning of "files" that have been
+         * started
+         */
+        size_t started;
+
+        /**
+         * the position in "files" of the next file a worker should take
+         */
+        size_t nextJob;
+
+        /**
+         * the number of started files whose archives are not finished
+         */
+        int running;
+
+        /**
+         * the cd space of the finished archives, plus the space reserved
+         * for the running ones, plus the space for the directories
+         */
+        long long committedBytes;
+
+        /**
+         * the cd space available for archives
+         */
+        long long maxBytes;
+
+        /**
+         * onImage[id] is true for the directories that go into
+         * DIRECTORIES_FILENAME
+         */
+        std::vector<bool> onImage;
+
+        /**
+         * set when the workers should exit
+         */
+        bool finished;
+
+        /**
+         * set by a worker when an archive could not be written
+         */
+        bool failed;
+
+        /**
+         * protects all of the above. "queued" is signalled when files have
+         * been started or the workers should exit, "done" when an archive
+         * is finished.
+         */
+        pthread_mutex_t * mutex;
+        pthread_cond_t  * queued;
+        pthread_cond_t  * done;
+    };
+}
+#endif
@@ -23,7 +23,7 @@
  */
 
 #include "image_info.hh"
-#include "gpg.hh"
+#include "pgp_encrypter.hh"
 #include "fsink.hh"
 #include "pipe.hh"
 #include <fstream>
@@ -33,18 +33,23 @@
 #include <unistd.h>
 
 using KryptoCD::ImageInfo;
-using KryptoCD::Gpg;
+using KryptoCD::PgpEncrypter;
+using KryptoCD::PathStore;
+using KryptoCD::PathSlice;
+using KryptoCD::PathList;
+using KryptoCD::ImageIndex;
 using std::string;
-using std::list;
+using std::vector;
 
 ImageInfo::ImageInfo(const std::string & imageId_,
-                     const std::list<std::string> & files_)
+                     const PathStore & paths_,
+                     const PathSlice & files_)
     : imageId(imageId_),
-      files(files_)
+      paths(&paths_),
+      files(files_.begin(), files_.end())
 {}
 
-void ImageInfo::saveToFile(const string & gpgExecutable,
-                           const string & directory,
+void ImageInfo::saveToFile(const string & directory,
                            const string & password)
     throw(ImageInfo::Exception)
 {
@@ -54,15 +59,17 @@ void ImageInfo::saveToFile(const string & gpgExecutable,
                       0600);
         try {
             Pipe contentsPipe;
-            Gpg gpgEncrypter(gpgExecutable, password, Gpg::ENCRYPT,
-                             contentsPipe, output);
+            PgpEncrypter encrypter(password, contentsPipe, output);
             {
                 ofstream of(contentsPipe.getSinkFd());
+                string name;
 
-                for (list<string>::const_iterator iter = files.begin();
+                for (PathList::const_iterator iter = files.begin();
                      iter != files.end();
                      ++iter) {
-                    of << *iter << endl;
+                    name.erase();
+                    paths->appendPath(*iter, name);
+                    of << name << '\n';
                 }
                 of << flush;
                 if (of.bad()) {
@@ -71,8 +78,8 @@ void ImageInfo::saveToFile(const string & gpgExecutable,
                 }
             }
             contentsPipe.closeSink();
-            gpgEncrypter.wait();
-            if (gpgEncrypter.exitedAbnormally()) {
+            encrypter.wait();
+            if (encrypter.exitedAbnormally()) {
                 /* Disk full? */
                 throw Exception();
             }
@@ -88,4 +95,20 @@ void ImageInfo::saveToFile(const string & gpgExecutable,
         /* The open system call failed */
         throw Exception();
     }
+
+    if (locations.empty() || (locations.size() != files.size())) {
+        return;
+    }
+    vector<ImageIndex::Entry> entries(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        entries[i].file = files[i];
+        entries[i].location = locations[i];
+    }
+    try {
+        ImageIndex::save(directory + "/" + imageId + ".idx", password,
+                         *paths, entries, segments);
+    } catch (ImageIndex::Exception) {
+        unlink((directory + "/" + imageId + ".gpg").c_str());
+        throw Exception();
+    }
 }
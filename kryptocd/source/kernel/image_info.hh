@@ -25,8 +25,10 @@
 #ifndef IMAGE_INFO_HH
 #define IMAGE_INFO_HH
 
-#include <list>
+#include "path_store.hh"
+#include "image_index.hh"
 #include <string>
+#include <vector>
 
 namespace KryptoCD {
     /**
@@ -44,26 +46,43 @@ namespace KryptoCD {
          *
          * @param imageId  the imageId of this cd, as passed to the constructor
          *                 of class Image
+         * @param paths    the store containing the file names. It has to
+         *                 live at least as long as this object.
          * @param files    the names of the fales that actually went into this
          *                 archive
          */
         ImageInfo(const std::string & imageId,
-                  const std::list<std::string> & files);
+                  const PathStore & paths,
+                  const PathSlice & files);
 
         /**
          * saves the current image info to an encrypted file. Filename is equal
-         * to imageId plus suffix ".gpg"
+         * to imageId plus suffix ".gpg". If the locations are known, the
+         * binary ImageIndex is saved next to it, with suffix ".idx".
          *
          * @param directory  the directory where the file is stored
-         * @param password   the password for symmetric gpg encryption
+         * @param password   the password for the symmetric OpenPGP
+         *                   encryption, see PgpEncrypter
          */
-        void saveToFile(const string & gpgExecutable,
-                        const string & directory,
+        void saveToFile(const string & directory,
                         const string & password)
             throw(Exception);
 
         std::string imageId;
-        std::list<std::string> files;
+        const PathStore * paths;
+        PathList files;
+
+        /**
+         * where the files are stored in the image, in the order of files.
+         * Empty if the image does not know.
+         */
+        std::vector<ImageIndex::Location> locations;
+
+        /**
+         * the segments of the image's archive 0, saved in the ImageIndex.
+         * Empty if it was not compressed by a SegmentedBzip2.
+         */
+        std::vector<SegmentedBzip2::Segment> segments;
     };
 }
 #endif
@@ -0,0 +1,201 @@
+/*
+ * image_planner.cpp: class ImagePlanner implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_planner.hh"
+#include "image.hh"
+#include "metadata_scanner.hh"
+#include <algorithm>
+#include <sys/stat.h>
+#include <assert.h>
+
+using KryptoCD::ImagePlanner;
+using KryptoCD::Encrypter;
+using KryptoCD::ImageIndex;
+using KryptoCD::Diskspace;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using std::vector;
+
+namespace {
+    /**
+     * orders indices into the entry vector by decreasing predicted size
+     */
+    template <class Entry>
+    class BiggerFirst {
+        const vector<Entry> & entries;
+    public:
+        BiggerFirst(const vector<Entry> & e) : entries(e) {}
+        bool operator()(size_t a, size_t b) const {
+            return entries[a].predictedBytes > entries[b].predictedBytes;
+        }
+    };
+}
+
+ImagePlanner::ImagePlanner(const PathStore & paths_,
+                           int cdCapacity, Encrypter::Format format_,
+                           const Diskspace & diskspace)
+    : paths(paths_),
+      imageMaxCdBlocks(cdCapacity),
+      format(format_)
+{
+    assert(cdCapacity > 0);
+
+    /* the same constraint that the Image constructor applies: */
+    if ((static_cast<long long>(diskspace.getUsableMegabytes()) * MEGABYTE)
+        < (static_cast<long long>(cdCapacity) * CD_BLOCKSIZE)) {
+        imageMaxCdBlocks = int(float(diskspace.getUsableMegabytes()
+                                     * MEGABYTE)
+                               / float(CD_BLOCKSIZE)); // rounding down
+    }
+}
+
+long long ImagePlanner::predictCompressedSize(size_t nameLength,
+                                              long long fileSize,
+                                              double compressionRatio) {
+    long long tarBytes = TAR_BLOCKSIZE;                      // the header
+
+    if (nameLength > size_t(TAR_NAME_FIELD_SIZE)) {
+        /* TarWriter may split the name into the ustar prefix and name
+           fields, but it is not known here if the name has a suitable
+           slash. Otherwise, the name goes into a pax extended header:
+           one header block plus the record "<length> path=<name>\n",
+           padded to full blocks. 16 bytes cover the record's framing. */
+        tarBytes += TAR_BLOCKSIZE
+            + ((nameLength + 16 + TAR_BLOCKSIZE - 1) / TAR_BLOCKSIZE)
+            * TAR_BLOCKSIZE;
+    }
+    if (fileSize > 0) {
+        tarBytes += ((fileSize + TAR_BLOCKSIZE - 1) / TAR_BLOCKSIZE)
+            * TAR_BLOCKSIZE;
+    }
+    return static_cast<long long>(tarBytes * compressionRatio) + 1;
+}
+
+void ImagePlanner::addFile(PathId file, long long predictedBytes) {
+    assert(predictedBytes >= 0);
+
+    Entry entry;
+    entry.file = file;
+    entry.nameBytes = 2 * paths.getLength(file) + 1
+        + ImageIndex::MAX_ENTRY_OVERHEAD;
+    entry.predictedBytes = predictedBytes;
+    entries.push_back(entry);
+}
+
+void ImagePlanner::addFiles(const PathList & files,
+                            const MetadataScanner & metadata,
+                            double compressionRatio) {
+    entries.reserve(entries.size() + files.size());
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        const FileMetadata * st = metadata.get(*iter);
+        long long size = ((st != 0) && S_ISREG(st->mode)) ? st->size : 0;
+        addFile(*iter, predictCompressedSize(paths.getLength(*iter), size,
+                                             compressionRatio));
+    }
+}
+
+bool ImagePlanner::fits(long long predictedBytes, long long nameBytes) const {
+    /* see the ImageSingleFile constructor: */
+    long long indexFileBlocks = (nameBytes / CD_BLOCKSIZE) + 2;
+    long long archiveFileMaxSize =
+        (imageMaxCdBlocks - CD_BLOCKS_FOR_ISO_STRUCTURE - indexFileBlocks)
+        * static_cast<long long>(CD_BLOCKSIZE);
+    long long predictedArchiveSize =
+        Encrypter::encryptedSize(format, predictedBytes + TAR_RECORDSIZE);
+
+    return predictedArchiveSize < archiveFileMaxSize;
+}
+
+void ImagePlanner::plan(void) {
+    vector<size_t> order;
+    vector<vector<size_t> > members;
+
+    discs.clear();
+    order.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), BiggerFirst<Entry>(entries));
+
+    /* first fit decreasing: */
+    for (vector<size_t>::const_iterator iter = order.begin();
+         iter != order.end();
+         ++iter) {
+        const Entry & entry = entries[*iter];
+        long long nameBytes = entry.nameBytes;
+        size_t disc;
+
+        for (disc = 0; disc < discs.size(); ++disc) {
+            if (fits(discs[disc].predictedBytes + entry.predictedBytes,
+                     discs[disc].nameBytes + nameBytes)) {
+                break;
+            }
+        }
+        if (disc == discs.size()) {
+            /*
+             * Open a new cd. The file gets it even if it does not fit
+             * according to our prediction: only Image::create() can tell for
+             * sure, and will reject it if it really is too big.
+             */
+            Disc newDisc;
+            newDisc.predictedBytes = 0;
+            newDisc.nameBytes = 0;
+            discs.push_back(newDisc);
+            members.push_back(vector<size_t>());
+        }
+        discs[disc].predictedBytes += entry.predictedBytes;
+        discs[disc].nameBytes += nameBytes;
+        members[disc].push_back(*iter);
+    }
+
+    /* restore the original relative order on each cd: */
+    for (size_t disc = 0; disc < discs.size(); ++disc) {
+        std::sort(members[disc].begin(), members[disc].end());
+        discs[disc].files.reserve(members[disc].size());
+        for (vector<size_t>::const_iterator iter = members[disc].begin();
+             iter != members[disc].end();
+             ++iter) {
+            discs[disc].files.push_back(entries[*iter].file);
+        }
+    }
+}
+
+int ImagePlanner::getDiscCount(void) const {
+    return discs.size();
+}
+
+const PathList & ImagePlanner::getDiscFiles(int disc) const {
+    assert((disc >= 0) && (size_t(disc) < discs.size()));
+    return discs[disc].files;
+}
+
+long long ImagePlanner::getDiscPredictedBytes(int disc) const {
+    assert((disc >= 0) && (size_t(disc) < discs.size()));
+    return discs[disc].predictedBytes;
+}
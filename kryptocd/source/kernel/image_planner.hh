@@ -0,0 +1,221 @@
+/*
+ * image_planner.hh: class ImagePlanner header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef IMAGE_PLANNER_HH
+#define IMAGE_PLANNER_HH
+
+#include "path_store.hh"
+#include "encrypter.hh"
+#include <vector>
+
+namespace KryptoCD {
+    class Diskspace;
+    class MetadataScanner;
+
+    /**
+     * the size of a tar header block, and the granularity of file data
+     * inside a tar archive
+     */
+    const int TAR_BLOCKSIZE (512);
+
+    /**
+     * GNU tar pads the archive to a multiple of this record size
+     */
+    const int TAR_RECORDSIZE (10240);
+
+    /**
+     * Names longer than this may need a pax extended header member
+     */
+    const int TAR_NAME_FIELD_SIZE (100);
+
+    /**
+     * Class ImagePlanner distributes a complete backup over as few cds as
+     * possible before any archive is created.
+     * <p>
+     * Image::create() fills a cd with the files from the front of its file
+     * list, in the order given, until the next file does not fit any more.
+     * A big file near the end of a cd can thus waste hundreds of megabytes.
+     * The planner instead looks at all files at once and runs the
+     * first-fit-decreasing bin packing heuristic on their predicted
+     * compressed sizes: the biggest files are placed first, each into the
+     * first cd that still has room for it. Inside each cd, files keep their
+     * original relative order, so directories still preceed their contents.
+     * The growth by encryption is not estimated, but computed exactly by
+     * Encrypter::encryptedSize(), so no safety margin is kept.
+     * <p>
+     * The result is only a prediction. Hand the file list of each planned cd
+     * to Image::create() in turn; files that Image::create() leaves in its
+     * list because they did not fit after all should simply be carried over
+     * to the list of the next cd.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ImagePlanner {
+    public:
+        /**
+         * Constructor
+         *
+         * @param paths      the store containing the names of all files that
+         *                   will be added
+         * @param cdCapacity the number of usable blocks on the target cds,
+         *                   as passed to Image::create()
+         * @param format     the encryption format, as passed to
+         *                   Image::create()
+         * @param diskspace  the harddisk space manager that will be passed to
+         *                   Image::create(). Its usable size may constrain
+         *                   the usable size of a cd.
+         */
+        ImagePlanner(const PathStore & paths,
+                     int cdCapacity, Encrypter::Format format,
+                     const Diskspace & diskspace);
+
+        /**
+         * predicts the number of bytes that a file adds to the compressed
+         * archive: the tar header(s) plus the file data padded to full tar
+         * blocks, multiplied with the expected compression ratio.
+         *
+         * @param nameLength       the length of the name of the file, as it
+         *                         will be passed to tar
+         * @param fileSize         the current size of the file in bytes
+         * @param compressionRatio the expected ratio compressed/uncompressed.
+         *                         1.0 is a safe guess for data that does not
+         *                         compress at all.
+         * @return                 the predicted compressed size in bytes
+         */
+        static long long predictCompressedSize(size_t nameLength,
+                                               long long fileSize,
+                                               double compressionRatio);
+
+        /**
+         * add a file to the backup. Filenames must obey the rules for the
+         * "files" list of Image::create().
+         *
+         * @param file           the name of the file
+         * @param predictedBytes the predicted size of this file inside the
+         *                       compressed archive, e.g. as computed by
+         *                       predictCompressedSize()
+         */
+        void addFile(PathId file, long long predictedBytes);
+
+        /**
+         * adds all files of a list, with their sizes predicted by
+         * predictCompressedSize() from the sizes that a MetadataScanner
+         * found. Files that could not be stat()ed are added with size 0;
+         * Image::create() will reject them.
+         *
+         * @param files            the names of the files
+         * @param metadata         a scanner that has scanned the files
+         * @param compressionRatio see predictCompressedSize()
+         */
+        void addFiles(const PathList & files,
+                      const MetadataScanner & metadata,
+                      double compressionRatio);
+
+        /**
+         * distributes all added files over cds. May be called again after
+         * more files have been added.
+         */
+        void plan(void);
+
+        /**
+         * @return the number of cds needed for all added files. Only valid
+         *         after plan() has been called.
+         */
+        int getDiscCount(void) const;
+
+        /**
+         * @param disc the number of the cd, counting from 0
+         * @return     the files that should go on this cd, in their original
+         *             relative order. Only valid after plan() has been
+         *             called.
+         */
+        const PathList & getDiscFiles(int disc) const;
+
+        /**
+         * @param disc the number of the cd, counting from 0
+         * @return     the predicted size of the archive on this cd, in bytes
+         */
+        long long getDiscPredictedBytes(int disc) const;
+
+    private:
+        /**
+         * checks if a file still fits onto a partially filled cd. Mimics
+         * the archive size limit that ImageSingleFile computes.
+         *
+         * @param predictedBytes the predicted archive bytes already on the cd
+         *                       plus those of the new file
+         * @param nameBytes      the bytes needed in the index files for the
+         *                       names of all files on the cd, including the
+         *                       new file
+         * @return               true if the new file fits
+         */
+        bool fits(long long predictedBytes, long long nameBytes) const;
+
+        /**
+         * a file to distribute
+         */
+        struct Entry {
+            PathId    file;
+            unsigned  nameBytes;
+            long long predictedBytes;
+        };
+
+        /**
+         * what we know about a cd while filling it
+         */
+        struct Disc {
+            long long predictedBytes;
+            long long nameBytes;
+            PathList  files;
+        };
+
+        /**
+         * the store containing the names of the files
+         */
+        const PathStore & paths;
+
+        /**
+         * all files added with addFile(), in their original order
+         */
+        std::vector<Entry> entries;
+
+        /**
+         * the result of plan()
+         */
+        std::vector<Disc> discs;
+
+        /**
+         * the number of cd blocks an image may occupy, see
+         * Image::imageMaxCdBlocks
+         */
+        int imageMaxCdBlocks;
+
+        /**
+         * the encryption format of the archives
+         */
+        Encrypter::Format format;
+    };
+}
+#endif
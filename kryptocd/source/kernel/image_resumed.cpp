@@ -0,0 +1,64 @@
+/*
+ * image_resumed.cpp: class ImageResumed implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "image_resumed.hh"
+
+using KryptoCD::Image;
+using KryptoCD::Encrypter;
+using KryptoCD::ImageResumed;
+using KryptoCD::ImageInfo;
+using KryptoCD::Diskspace;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::PathList;
+using KryptoCD::PathSlice;
+using std::string;
+using std::list;
+
+ImageResumed::ImageResumed(const string & imageId_,
+                           const string & password_,
+                           int compression_,
+                           const PathStore & paths_,
+                           const MetadataScanner & metadata_,
+                           PathList & files_,
+                           PathList & rejectedBigFiles_,
+                           PathList & rejectedForbiddenFiles_,
+                           PathList & rejectedBadNamedFiles_,
+                           list<ImageInfo> & imageInfos,
+                           Diskspace & diskspace_,
+                           int cdCapacity_,
+                           Encrypter::Format format_,
+                           const string & bzip2Executable_,
+                           const string & mkisofsExecutable_)
+    throw(Image::Exception)
+    : Image(imageId_, password_, compression_, paths_, metadata_, files_,
+            rejectedBigFiles_, rejectedForbiddenFiles_, rejectedBadNamedFiles_,
+            imageInfos, diskspace_, cdCapacity_, format_,
+            bzip2Executable_, mkisofsExecutable_, true)
+{
+    imageInfos.push_back(ImageInfo(imageId, paths, PathSlice(files)));
+    files.clear();
+    imageReady = true;
+}
@@ -0,0 +1,90 @@
+/*
+ * image_resumed.hh: class ImageResumed header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef IMAGE_RESUMED_HH
+#define IMAGE_RESUMED_HH
+
+#include "image.hh"
+
+namespace KryptoCD {
+    /**
+     * Class ImageResumed takes over the data of an image that an earlier,
+     * interrupted run of the same backup has finished. The data is used as
+     * it is found in the image's directory. ImageScheduler creates these
+     * objects from its Journal after checking that the directory is intact.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ImageResumed : public Image {
+    public:
+        /**
+         * adopts the directory of a finished image. The parameters are
+         * those of Image::create(), except that "files" has to contain
+         * exactly the files stored in the image. They are all moved to the
+         * image's ImageInfo, which is appended to imageInfos. Nothing is
+         * rejected.
+         *
+         * @exception Image::Exception
+         *                   UNABLE_TO_CREATE_SUBDIRECTORY if the directory
+         *                   does not exist
+         */
+        ImageResumed(const std::string & imageId,
+                     const std::string & password,
+                     int compression,
+                     const PathStore & paths,
+                     const MetadataScanner & metadata,
+                     PathList & files,
+                     PathList & rejectedBigFiles,
+                     PathList & rejectedForbiddenFiles,
+                     PathList & rejectedBadNamedFiles,
+                     std::list<ImageInfo> & imageInfos,
+                     Diskspace & diskspace,
+                     int cdCapacity,
+                     Encrypter::Format format,
+                     const std::string & bzip2Executable,
+                     const std::string & mkisofsExecutable)
+            throw(Image::Exception);
+
+        /**
+         * returns the number of blocks that this image would occupy on a cd.
+         * Uses mkisofs -print-size
+         *
+         * @return the size of the iso9660-image in cd blocks
+         */
+        virtual int getImageBlocks(void) const {return 0;};
+
+        /**
+         * creates an iso9660 image if the cd data on the fly and sends this
+         * image to the given sink
+         *
+         * @param sink            the sink where the image data is
+         *                        sent to. Should be a pipe to a cdrecord
+         *                        process
+         */
+        virtual void sendImageData(Sink & sink) const {};
+    };
+}
+#endif
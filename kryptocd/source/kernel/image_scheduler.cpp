@@ -0,0 +1,409 @@
+/*
+ * image_scheduler.cpp: class ImageScheduler implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "image_scheduler.hh"
+#include "image_planner.hh"
+#include "image_resumed.hh"
+#include "journal.hh"
+#include "layout_order.hh"
+#include "chunk_index.hh"
+#include <assert.h>
+
+using KryptoCD::ImageScheduler;
+using KryptoCD::Encrypter;
+using KryptoCD::ImagePlanner;
+using KryptoCD::ImageResumed;
+using KryptoCD::Journal;
+using KryptoCD::LayoutOrder;
+using KryptoCD::ChunkIndex;
+using KryptoCD::Image;
+using KryptoCD::ImageInfo;
+using KryptoCD::Diskspace;
+using KryptoCD::IoPump;
+using KryptoCD::Pipe;
+using KryptoCD::Childprocess;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::PathList;
+using KryptoCD::PathSlice;
+using std::string;
+using std::list;
+using std::vector;
+
+/**
+ * return a string representation of an unsigned integer:
+ */
+static string unsignedToString(unsigned i) {
+    string s;
+
+    if (i == 0) {
+        return "0";
+    }
+    while (i > 0) {
+        s.insert(s.begin(), char('0' + i % 10));
+        i /= 10;
+    }
+    return s;
+}
+
+ImageScheduler::Job::Job(const PathList & f)
+    : files(f),
+      image(0),
+      finished(false),
+      failure(NONE),
+      imageException(0),
+      journaled(false)
+{}
+
+ImageScheduler::Job::~Job() {
+    delete image;
+    delete imageException;
+}
+
+ImageScheduler::ImageScheduler(const PathStore & paths_,
+                               const MetadataScanner & metadata_,
+                               const ImagePlanner & planner,
+                               const string & imageIdPrefix_,
+                               const string & password_,
+                               int compression_,
+                               Diskspace & diskspace_,
+                               int cdCapacity_,
+                               Image::Method method_,
+                               Encrypter::Format format_,
+                               const string & bzip2Executable_,
+                               const string & mkisofsExecutable_,
+                               int threads,
+                               Journal * journal_,
+                               const LayoutOrder * layoutOrder_,
+                               ChunkIndex * chunkIndex_)
+    : paths(paths_),
+      metadata(metadata_),
+      imageIdPrefix(imageIdPrefix_),
+      password(password_),
+      compression(compression_),
+      diskspace(diskspace_),
+      cdCapacity(cdCapacity_),
+      method(method_),
+      format(format_),
+      bzip2Executable(bzip2Executable_),
+      mkisofsExecutable(mkisofsExecutable_),
+      journal(journal_),
+      layoutOrder(layoutOrder_),
+      chunkIndex(chunkIndex_),
+      nextJob(0),
+      nextToHandOut(0),
+      running(0),
+      cancelled(false),
+      mutex(new pthread_mutex_t),
+      condition(new pthread_cond_t)
+{
+    assert(threads > 0);
+    pthread_mutex_init(mutex, 0);
+    pthread_cond_init(condition, 0);
+
+    if ((journal != 0) && journal->hasPlan()) {
+        /* a resumed backup: keep to the plan it started with */
+        const vector<PathList> & plan = journal->getPlan();
+        for (size_t disc = 0; disc < plan.size(); ++disc) {
+            jobs.push_back(new Job(plan[disc]));
+        }
+    } else {
+        vector<PathList> plan;
+        for (int disc = 0; disc < planner.getDiscCount(); ++disc) {
+            plan.push_back(planner.getDiscFiles(disc));
+            jobs.push_back(new Job(plan.back()));
+        }
+        if (journal != 0) {
+            journal->recordPlan(plan);
+        }
+    }
+
+    /* the harddisk space each image will allocate, see Image::Image() */
+    int imageMaxMegabytes = int(float(cdCapacity * CD_BLOCKSIZE)
+                                / float(MEGABYTE)) + 1;
+    if (imageMaxMegabytes > diskspace.getUsableMegabytes()) {
+        imageMaxMegabytes = diskspace.getUsableMegabytes();
+    }
+    maxInFlight = diskspace.getUsableMegabytes() / imageMaxMegabytes;
+    if (maxInFlight < 1) {
+        maxInFlight = 1;
+    }
+    if (threads > maxInFlight) {
+        threads = maxInFlight;
+    }
+    if (chunkIndex != 0) {
+        /* the next image must know the chunks of the previous one */
+        threads = 1;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+}
+
+ImageScheduler::~ImageScheduler() {
+    pthread_mutex_lock(mutex);
+    cancelled = true;
+    pthread_cond_broadcast(condition);
+    pthread_mutex_unlock(mutex);
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+    for (vector<Job *>::iterator iter = jobs.begin();
+         iter != jobs.end();
+         ++iter) {
+        if (((*iter)->image != 0) && (*iter)->journaled) {
+            /* the backup may be resumed with this image */
+            (*iter)->image->keepData();
+        } else if (((*iter)->image != 0) && (chunkIndex != 0)) {
+            chunkIndex->forgetImage((*iter)->image->getImageId());
+        }
+        delete *iter;
+    }
+
+    int destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+    destroyVal = pthread_cond_destroy(condition);
+    assert (destroyVal == 0);
+    delete condition;
+}
+
+void * ImageScheduler::Worker::run(void) {
+    scheduler.work();
+    return this;
+}
+
+bool ImageScheduler::jobAvailable(void) const {
+    return (nextJob < jobs.size())
+        && (nextJob < nextToHandOut + maxInFlight);
+}
+
+bool ImageScheduler::allJobsDone(void) const {
+    return (nextJob == jobs.size()) && (running == 0) && carryOver.empty();
+}
+
+void ImageScheduler::work(void) {
+    pthread_mutex_lock(mutex);
+    for (;;) {
+        while (!cancelled && !jobAvailable() && !allJobsDone()) {
+            pthread_cond_wait(condition, mutex);
+        }
+        if (cancelled || !jobAvailable()) {
+            break;
+        }
+        size_t jobIndex = nextJob++;
+        Job & job = *jobs[jobIndex];
+        ++running;
+        pthread_mutex_unlock(mutex);
+
+        /* build the image without holding the mutex */
+        buildImage(job, jobIndex);
+
+        pthread_mutex_lock(mutex);
+        job.finished = true;
+        --running;
+        if (job.failure == Job::NONE) {
+            carryOver.insert(carryOver.end(),
+                             job.files.begin(), job.files.end());
+            PathList().swap(job.files);
+        }
+        if ((nextJob == jobs.size()) && (running == 0) && !carryOver.empty()) {
+            /*
+             * All planned cds are done, but some files did not fit. They go
+             * onto an additional cd. Its leftovers, if any, will again go
+             * onto the next one.
+             */
+            jobs.push_back(new Job(PathList()));
+            jobs.back()->files.swap(carryOver);
+        }
+        pthread_cond_broadcast(condition);
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+void ImageScheduler::buildImage(Job & job, size_t jobIndex) {
+    string imageId = imageIdPrefix + unsignedToString(jobIndex + 1);
+    string directory = diskspace.getDirectory() + "/" + imageId;
+    unsigned long long inputHash = 0;
+
+    if (layoutOrder != 0) {
+        layoutOrder->sort(job.files);
+    }
+
+    if (journal != 0) {
+        inputHash = Journal::hashFiles(paths, job.files);
+        Journal::ImageRecord record;
+        if (journal->findImage(imageId, record)
+            && (record.inputHash == inputHash)
+            && (record.burned
+                || Journal::verifyDirectory(directory, record.spoolFiles))) {
+            /* finished by an earlier run */
+            job.rejectedBigFiles.swap(record.rejectedBigFiles);
+            job.rejectedForbiddenFiles.swap(record.rejectedForbiddenFiles);
+            job.rejectedBadNamedFiles.swap(record.rejectedBadNamedFiles);
+            job.journaled = true;
+            if (record.burned) {
+                job.imageInfos.push_back(ImageInfo(imageId, paths,
+                                                   PathSlice(record
+                                                             .storedFiles)));
+            } else {
+                try {
+                    job.image = new ImageResumed(imageId, password,
+                                                 compression, paths,
+                                                 metadata, record.storedFiles,
+                                                 job.rejectedBigFiles,
+                                                 job.rejectedForbiddenFiles,
+                                                 job.rejectedBadNamedFiles,
+                                                 job.imageInfos, diskspace,
+                                                 cdCapacity, format,
+                                                 bzip2Executable,
+                                                 mkisofsExecutable);
+                } catch (Image::Exception & e) {
+                    job.failure = Job::IMAGE;
+                    job.imageException = new Image::Exception(e);
+                }
+            }
+            job.files.swap(record.leftOverFiles);
+            return;
+        }
+
+        /* whatever an interrupted run left of this image is useless */
+        Image::removeDirectory(directory);
+    }
+
+    try {
+        job.image = Image::create(imageId,
+                                  password, compression,
+                                  paths, metadata, job.files,
+                                  job.rejectedBigFiles,
+                                  job.rejectedForbiddenFiles,
+                                  job.rejectedBadNamedFiles,
+                                  job.imageInfos, diskspace, cdCapacity,
+                                  method, format, bzip2Executable,
+                                  mkisofsExecutable, chunkIndex);
+    } catch (Image::Exception & e) {
+        if (e.reason != Image::Exception::ARCHIVE_WOULD_BE_EMPTY) {
+            job.failure = Job::IMAGE;
+            job.imageException = new Image::Exception(e);
+        }
+        /* else: all files of this cd were rejected, no image */
+    } catch (IoPump::Exception & e) {
+        job.failure = Job::IO_PUMP;
+        job.ioPumpException = e;
+    } catch (Pipe::Exception &) {
+        job.failure = Job::PIPE;
+    } catch (Childprocess::Exception &) {
+        job.failure = Job::CHILDPROCESS;
+    }
+
+    if ((journal != 0) && (job.image != 0)) {
+        Journal::ImageRecord record;
+        record.inputHash = inputHash;
+        record.storedFiles = job.imageInfos.back().files;
+        record.rejectedBigFiles = job.rejectedBigFiles;
+        record.rejectedForbiddenFiles = job.rejectedForbiddenFiles;
+        record.rejectedBadNamedFiles = job.rejectedBadNamedFiles;
+        record.leftOverFiles = job.files;
+        /*
+         * Reading the files back verifies them. If they cannot be read or
+         * recorded, a resumed backup simply builds this image again.
+         */
+        if (Journal::listDirectory(directory, record.spoolFiles)) {
+            try {
+                journal->recordImage(imageId, record);
+                job.journaled = true;
+            } catch (Journal::Exception &) {
+            }
+        }
+    }
+}
+
+Image * ImageScheduler::nextImage(PathList & rejectedBigFiles,
+                                  PathList & rejectedForbiddenFiles,
+                                  PathList & rejectedBadNamedFiles,
+                                  list<ImageInfo> & imageInfos)
+    throw(Image::Exception, IoPump::Exception,
+          Pipe::Exception, Childprocess::Exception) {
+    for (;;) {
+        pthread_mutex_lock(mutex);
+        while (((nextToHandOut < jobs.size())
+                && !jobs[nextToHandOut]->finished)
+               || ((nextToHandOut == jobs.size()) && !allJobsDone())) {
+            pthread_cond_wait(condition, mutex);
+        }
+        if (nextToHandOut == jobs.size()) {
+            pthread_mutex_unlock(mutex);
+            return 0;
+        }
+        Job & job = *jobs[nextToHandOut++];
+
+        /* a slot for building another image has become free: */
+        pthread_cond_broadcast(condition);
+        pthread_mutex_unlock(mutex);
+
+        rejectedBigFiles.insert(rejectedBigFiles.end(),
+                                job.rejectedBigFiles.begin(),
+                                job.rejectedBigFiles.end());
+        rejectedForbiddenFiles.insert(rejectedForbiddenFiles.end(),
+                                      job.rejectedForbiddenFiles.begin(),
+                                      job.rejectedForbiddenFiles.end());
+        rejectedBadNamedFiles.insert(rejectedBadNamedFiles.end(),
+                                     job.rejectedBadNamedFiles.begin(),
+                                     job.rejectedBadNamedFiles.end());
+        imageInfos.splice(imageInfos.end(), job.imageInfos);
+
+        switch (job.failure) {
+        case Job::IMAGE:
+            throw Image::Exception(*job.imageException);
+        case Job::IO_PUMP:
+            throw job.ioPumpException;
+        case Job::PIPE:
+            throw Pipe::Exception();
+        case Job::CHILDPROCESS:
+            throw Childprocess::Exception();
+        case Job::NONE:
+            break;
+        }
+        if (job.image != 0) {
+            Image * image = job.image;
+            job.image = 0;
+            return image;
+        }
+        /* all files of this cd were rejected, go on with the next one */
+    }
+}
+
+void ImageScheduler::imageBurned(const Image & image)
+    throw(Journal::Exception) {
+    if (journal != 0) {
+        journal->recordBurned(image.getImageId());
+    }
+}
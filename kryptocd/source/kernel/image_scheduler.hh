@@ -0,0 +1,289 @@
+/*
+ * image_scheduler.hh: class ImageScheduler header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef IMAGE_SCHEDULER_HH
+#define IMAGE_SCHEDULER_HH
+
+#include "image.hh"
+#include "journal.hh"
+#include "thread.hh"
+#include <vector>
+
+namespace KryptoCD {
+    class ImagePlanner;
+    class LayoutOrder;
+    class ChunkIndex;
+
+    /**
+     * Class ImageScheduler builds the images of a planned backup on several
+     * threads at once. Each image gets its own tar, bzip2 and gpg processes,
+     * so on a multiprocessor machine several images are compressed and
+     * encrypted in parallel.
+     * <p>
+     * The images are handed out in cd order by nextImage(). The harddisk
+     * space is coordinated through the Diskspace object: at most as many
+     * images are built or waiting to be handed out as fit into the usable
+     * harddisk space at once. Images that have been handed out occupy their
+     * harddisk space until they are deleted, so delete each image as soon as
+     * it has been burned.
+     * <p>
+     * Files that do not fit on their planned cd after all are collected and
+     * go onto additional cds after the planned ones.
+     * <p>
+     * With a Journal, an interrupted backup can be resumed: the plan and
+     * every finished image are recorded, and an image that the journal
+     * knows, built from the same files, is not built again. If it has been
+     * burned, it is skipped, else its directory is checked against the
+     * journal and adopted as an ImageResumed. Images not handed out when
+     * the scheduler is destroyed keep their data on the harddisk. Whoever
+     * burns the images reports each burned one with imageBurned(), before
+     * deleting it.
+     * <p>
+     * With a ChunkIndex, the archives are deduplicated, see ImageSingleFile.
+     * An image may then refer to chunks of the images before it, so the
+     * images are built one at a time, in cd order, and the chunks of images
+     * that are deleted without being handed out or journaled are removed
+     * from the index again. Loading and saving the index, and removing the
+     * chunks of images that fail to burn, is up to the caller.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class ImageScheduler {
+    public:
+        /**
+         * starts the worker threads. The parameters are passed on to
+         * Image::create(), see there.
+         *
+         * @param paths         the store containing the names of all files
+         *                      in the plan
+         * @param metadata      the results of stat()ing the files
+         * @param planner       the plan of the backup. Cd number n (counting
+         *                      from 1) gets the files that the planner
+         *                      assigned to its disc n-1, and the image id
+         *                      imageIdPrefix + n.
+         * @param imageIdPrefix the image ids are this prefix plus the number
+         *                      of the cd. With a chunkIndex loaded from a
+         *                      file, it must differ from the prefixes of
+         *                      the earlier backups, see
+         *                      ChunkIndex::isStored().
+         * @param threads       the maximum number of images built at the
+         *                      same time. Should be about the number of
+         *                      processors.
+         * @param journal       if not 0, an opened journal. If it contains
+         *                      a plan, that plan is used instead of the
+         *                      planner's, else the planner's plan is
+         *                      recorded.
+         * @param layoutOrder   if not 0, the files of each cd are sorted by
+         *                      their positions on disk before they are
+         *                      archived
+         * @param chunkIndex    if not 0, the archives are deduplicated
+         *                      against the chunks in this index. Only for
+         *                      Image::SINGLE_FILE.
+         * @exception Journal::Exception
+         *                      if the plan cannot be recorded
+         */
+        ImageScheduler(const PathStore & paths,
+                       const MetadataScanner & metadata,
+                       const ImagePlanner & planner,
+                       const std::string & imageIdPrefix,
+                       const std::string & password,
+                       int compression,
+                       Diskspace & diskspace,
+                       int cdCapacity,
+                       Image::Method method,
+                       Encrypter::Format format,
+                       const std::string & bzip2Executable,
+                       const std::string & mkisofsExecutable,
+                       int threads,
+                       Journal * journal = 0,
+                       const LayoutOrder * layoutOrder = 0,
+                       ChunkIndex * chunkIndex = 0);
+
+        /**
+         * stops handing out work to the worker threads, waits for them to
+         * finish, and deletes all images not yet handed out.
+         */
+        ~ImageScheduler();
+
+        /**
+         * waits until the next image in cd order is ready and hands it over
+         * to the caller. Cds that ended up empty, because all their files
+         * were rejected, are skipped.
+         *
+         * @param rejectedBigFiles, rejectedForbiddenFiles,
+         *        rejectedBadNamedFiles, imageInfos
+         *                      the files rejected while building this image,
+         *                      and its ImageInfo, are appended to these lists,
+         *                      just as Image::create() would do.
+         * @return              the next image, to be deleted by the caller,
+         *                      or 0 if all images have been handed out.
+         * @exception           whatever Image::create() threw while building
+         *                      this image
+         */
+        Image * nextImage(PathList & rejectedBigFiles,
+                          PathList & rejectedForbiddenFiles,
+                          PathList & rejectedBadNamedFiles,
+                          std::list<ImageInfo> & imageInfos)
+            throw(Image::Exception, IoPump::Exception,
+                  Pipe::Exception, Childprocess::Exception);
+
+        /**
+         * records in the journal, if there is one, that an image handed
+         * out by nextImage() has been burned, so that a resumed backup
+         * skips it
+         *
+         * @exception Journal::Exception
+         *                      if the journal cannot be written
+         */
+        void imageBurned(const Image & image) throw(Journal::Exception);
+
+    private:
+        /**
+         * the work of one worker thread: builds images until there are no
+         * more to build
+         */
+        void work(void);
+
+        /**
+         * a worker thread
+         */
+        class Worker : public Thread {
+            ImageScheduler & scheduler;
+        public:
+            Worker(ImageScheduler & s) : scheduler(s) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        /**
+         * everything about one cd
+         */
+        struct Job {
+            enum Failure {NONE, IMAGE, IO_PUMP, PIPE, CHILDPROCESS};
+
+            PathList             files;
+            PathList             rejectedBigFiles;
+            PathList             rejectedForbiddenFiles;
+            PathList             rejectedBadNamedFiles;
+            std::list<ImageInfo> imageInfos;
+            Image *              image;
+            bool                 finished;
+            Failure              failure;
+            Image::Exception *   imageException;
+            IoPump::Exception    ioPumpException;
+
+            /**
+             * the image is recorded in the journal
+             */
+            bool                 journaled;
+
+            Job(const PathList & f);
+            ~Job();
+        };
+
+        /**
+         * builds the image of a job, or takes it from the journal. Called
+         * without holding the mutex.
+         */
+        void buildImage(Job & job, size_t jobIndex);
+
+        /**
+         * may a worker start building the next cd now? Only called while
+         * holding the mutex.
+         */
+        bool jobAvailable(void) const;
+
+        /**
+         * is there nothing more to build? Only called while holding the mutex.
+         */
+        bool allJobsDone(void) const;
+
+        const PathStore & paths;
+        const MetadataScanner & metadata;
+        std::string imageIdPrefix;
+        std::string password;
+        int         compression;
+        Diskspace & diskspace;
+        int         cdCapacity;
+        Image::Method method;
+        Encrypter::Format format;
+        std::string bzip2Executable;
+        std::string mkisofsExecutable;
+        Journal *   journal;
+        const LayoutOrder * layoutOrder;
+        ChunkIndex * chunkIndex;
+
+        /**
+         * all cds, in cd order. Jobs for additional cds are appended when
+         * files did not fit on their planned cd.
+         */
+        std::vector<Job *> jobs;
+
+        /**
+         * files left over by finished jobs, waiting for an additional cd
+         */
+        PathList carryOver;
+
+        /**
+         * the index in "jobs" of the next cd to build
+         */
+        size_t nextJob;
+
+        /**
+         * the index in "jobs" of the next cd to hand out
+         */
+        size_t nextToHandOut;
+
+        /**
+         * the number of images currently being built
+         */
+        int running;
+
+        /**
+         * the number of images that fit into the usable harddisk space at
+         * the same time. Never more images than this are being built or
+         * waiting to be handed out, or the builders could block each other
+         * inside Diskspace::allocate().
+         */
+        int maxInFlight;
+
+        /**
+         * set by the destructor: do not start any more jobs
+         */
+        bool cancelled;
+
+        std::vector<Worker *> workers;
+
+        /**
+         * protects all the data above, and signals the completion of jobs
+         * and the handing out of images
+         */
+        pthread_mutex_t * mutex;
+        pthread_cond_t  * condition;
+    };
+}
+#endif
@@ -25,6 +25,8 @@
 #include "image_single_file.hh"
 #include "archive_creator.hh"
 #include "archive_lister.hh"
+#include "chunk_index.hh"
+#include "dedup_filter.hh"
 #include "io_pump.hh"
 #include "pipe.hh"
 #include "fsink.hh"
@@ -37,49 +39,91 @@
 
 static const string ARCHIVE_FILENAME("/kryptocd_archive.tar.bz2.gpg");
 
+/**
+ * an upper limit for the size of a recipe entry, see DedupFilter
+ */
+static const int RECIPE_ENTRY_SIZE = 16;
+
 using KryptoCD::Image;
+using KryptoCD::Encrypter;
 using KryptoCD::ImageSingleFile;
 using KryptoCD::ArchiveCreator;
 using KryptoCD::ArchiveLister;
+using KryptoCD::ChunkIndex;
+using KryptoCD::DedupFilter;
+using KryptoCD::TarWriter;
+using KryptoCD::ImageIndex;
 using KryptoCD::Diskspace;
 using KryptoCD::Childprocess;
 using KryptoCD::IoPump;
 using KryptoCD::Pipe;
+using KryptoCD::PathStore;
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using KryptoCD::SegmentedBzip2;
+using KryptoCD::PathList;
+using KryptoCD::PathSlice;
+using KryptoCD::PathId;
 using std::string;
 using std::list;
+using std::vector;
 
 ImageSingleFile::ImageSingleFile(const string & imageId_,
                                  const string & password_,
                                  int compression_,
-                                 list<string> & files_,
-                                 list<string> & rejectedBigFiles_,
-                                 list<string> & rejectedForbiddenFiles_,
-                                 list<string> & rejectedBadNamedFiles_,
+                                 const PathStore & paths_,
+                                 const MetadataScanner & metadata_,
+                                 PathList & files_,
+                                 PathList & rejectedBigFiles_,
+                                 PathList & rejectedForbiddenFiles_,
+                                 PathList & rejectedBadNamedFiles_,
                                  list<ImageInfo> & imageInfos,
                                  Diskspace & diskspace_,
                                  int cdCapacity_,
-                                 const string & tarExecutable_,
+                                 Encrypter::Format format_,
                                  const string & bzip2Executable_,
-                                 const string & gpgExecutable_,
-                                 const string & mkisofsExecutable_)
+                                 const string & mkisofsExecutable_,
+                                 ChunkIndex * chunkIndex_)
     throw(Image::Exception, IoPump::Exception,
           Pipe::Exception, Childprocess::Exception)
-    : Image(imageId_, password_, compression_, files_, rejectedBigFiles_,
-            rejectedForbiddenFiles_, rejectedBadNamedFiles_, imageInfos,
-            diskspace_, cdCapacity_, tarExecutable_, bzip2Executable_,
-            gpgExecutable_, mkisofsExecutable_),
-      estimatedIndexFileSize(0)
+    : Image(imageId_, password_, compression_, paths_, metadata_, files_,
+            rejectedBigFiles_, rejectedForbiddenFiles_, rejectedBadNamedFiles_, imageInfos,
+            diskspace_, cdCapacity_, format_, bzip2Executable_,
+            mkisofsExecutable_),
+      thisTimeFileCount(0),
+      estimatedIndexFileSize(0),
+      chunkIndex(chunkIndex_)
 {
     /*
-     * estimate the blocks needed for an index file: simply sum all filenames'
-     * lengths up
+     * estimate the blocks needed for the index files: simply sum all
+     * filenames' lengths up, once for the list of names, and once with
+     * the rest of the entry for the ImageIndex. The ImageIndex also
+     * holds a segment for every SegmentedBzip2::SEGMENT_SIZE bytes of
+     * tar data, less than a pax header, a ustar header and a block of
+     * padding besides the data of each file.
      */
-    for (list<string>::const_iterator iter = files.begin();
+    long long tarBytes = 0;
+    for (PathList::const_iterator iter = files.begin();
          iter != files.end();
          ++iter) {
-        estimatedIndexFileSize += iter->length() + 1;
+        estimatedIndexFileSize += 2 * paths.getLength(*iter) + 1
+            + ImageIndex::MAX_ENTRY_OVERHEAD;
+        const FileMetadata * st = metadata.get(*iter);
+        tarBytes += 4 * 512 + 2 * paths.getLength(*iter)
+            + ((st != 0) ? st->size : 0);
     }
-    estimatedIndexFileBlocks = (estimatedIndexFileSize / CD_BLOCKSIZE) + 1;
+    estimatedIndexFileSize += ImageIndex::SEGMENT_LENGTH
+        * (tarBytes / SegmentedBzip2::SEGMENT_SIZE + 1);
+    if (chunkIndex != 0) {
+        /*
+         * A deduplicated archive has a recipe, with an entry for every
+         * chunk of the tar stream, and one naming each image it refers
+         * to, which the chunks' minimum size leaves room for.
+         */
+        estimatedIndexFileSize += RECIPE_ENTRY_SIZE
+            * (tarBytes / DedupFilter::MIN_CHUNK_SIZE + 1);
+    }
+    estimatedIndexFileBlocks = (estimatedIndexFileSize / CD_BLOCKSIZE) + 2;
     
     /*
      * Calculate the maximum size permitted for the archive file:
@@ -96,6 +140,9 @@ ImageSingleFile::ImageSingleFile(const string & imageId_,
         try {
             assembleImageData();
         } catch (...) {
+            if (chunkIndex != 0) {
+                chunkIndex->forgetImage(imageId);
+            }
             rmdir(baseDirectory.c_str());
             throw;
         }
@@ -108,11 +155,29 @@ ImageSingleFile::ImageSingleFile(const string & imageId_,
             }
         }
     } while (imageReady == false);
-    imageInfos.push_back(ImageInfo(imageId, thisTimeFileList));
+    imageInfos.push_back(ImageInfo(imageId, paths,
+                                   PathSlice(files, 0, thisTimeFileCount)));
+
+    /* the members are in the order of the files that were stored */
+    vector<ImageIndex::Location> & locations = imageInfos.back().locations;
+    for (size_t member = 0;
+         (member < storedMembers.size())
+             && (locations.size() < thisTimeFileCount);
+         ++member) {
+        if (storedMembers[member].file == files[locations.size()]) {
+            locations.push_back(ImageIndex::getLocation(storedMembers[member],
+                                                        0));
+        }
+    }
+    storedMembers.clear();
+    imageInfos.back().segments.swap(storedSegments);
+
+    // remove the stored files from the list:
+    files.erase(files.begin(), files.begin() + thisTimeFileCount);
     try {
-        imageInfos.back().saveToFile(gpgExecutable, baseDirectory, password);
+        imageInfos.back().saveToFile(baseDirectory, password);
     } catch (...) {
-        unlink((baseDirectory + ARCHIVE_FILENAME).c_str());
+        discardArchive();
         rmdir(baseDirectory.c_str());
         imageInfos.pop_back();
         throw Exception(Exception::UNABLE_TO_CREATE_INFO);
@@ -123,7 +188,7 @@ void ImageSingleFile::assembleImageData(void)
     throw (Image::Exception, IoPump::Exception,
            Pipe::Exception, Childprocess::Exception) {
     timesFilesetReduced = 0;
-    thisTimeFileList = files;
+    thisTimeFileCount = files.size();
     do {
         // create the archive, check if it fits on the cd, and if not, deduce
         // what files would fit.
@@ -132,43 +197,53 @@ void ImageSingleFile::assembleImageData(void)
          * would fit into a limited size archive:
          */
         createTestArchiveAndExamineResult();    // All Exceptions thrown here
-    } while ((imageReady == false) && !thisTimeFileList.empty());
-    if (imageReady) {
-        // remove the stored files from the list:
-        list<string>::iterator filesIterator = files.begin();
-        list<string>::const_iterator thisTimeFileListIterator =
-            thisTimeFileList.begin();
-
-        for (; thisTimeFileListIterator != thisTimeFileList.end();
-             ++filesIterator, ++thisTimeFileListIterator) {
-            assert(*filesIterator == *thisTimeFileListIterator);
-        }
-        files.erase(files.begin(), filesIterator);
-    }
+    } while ((imageReady == false) && (thisTimeFileCount > 0));
 }
 
 void ImageSingleFile::createTestArchiveAndExamineResult(void)
     throw (Image::Exception, IoPump::Exception,
            Pipe::Exception, Childprocess::Exception) {
     Pipe archiveCreatorSucker;           // could throw Pipe::Exception
-    ArchiveCreator * archiveCreator =    // could throw Childprocess::Exception
-        new ArchiveCreator(tarExecutable, bzip2Executable, gpgExecutable,
-                           thisTimeFileList, compression, password,
-                           archiveCreatorSucker);
-    /*
-     * prepare to list the contents of the compressed, encrypted, and then
-     * cutted to the permitted size archive:
-     */
-    Pipe archiveListerFeeder;            // could throw Pipe::Exception        
-    ArchiveLister * archiveLister =      // could throw Childprocess::Exception
-        new ArchiveLister(tarExecutable, bzip2Executable, gpgExecutable,
-                          password,
-                          archiveListerFeeder);
+    ArchiveCreator * archiveCreator;
+    Pipe archiveListerFeeder;            // could throw Pipe::Exception
+    ArchiveLister * archiveLister = 0;
+    string outputFile;
+
+    if (chunkIndex == 0) {
+        archiveCreator =                 // could throw Childprocess::Exception
+            new ArchiveCreator(bzip2Executable,
+                               paths, PathSlice(files, 0, thisTimeFileCount),
+                               compression, password, format,
+                               archiveCreatorSucker);
+        /*
+         * prepare to list the contents of the compressed, encrypted, and
+         * then cutted to the permitted size archive:
+         */
+        archiveLister =                  // could throw Childprocess::Exception
+            new ArchiveLister(bzip2Executable, password, format,
+                              archiveListerFeeder);
+        outputFile = baseDirectory + ARCHIVE_FILENAME;
+    } else {
+        /*
+         * the chunk stream cannot be listed. The tar writer tells where
+         * the files are in the tar stream, and the archive creator how
+         * much of it a cut archive holds. The recipe is written to its
+         * file directly.
+         */
+        FSink recipe(baseDirectory + DedupFilter::RECIPE_FILENAME,
+                     O_WRONLY|O_CREAT|O_EXCL, 0600);
+        archiveCreator =                 // could throw Childprocess::Exception
+            new ArchiveCreator(bzip2Executable,
+                               paths, PathSlice(files, 0, thisTimeFileCount),
+                               compression, password, format,
+                               *chunkIndex, imageId,
+                               archiveCreatorSucker, recipe);
+        outputFile = baseDirectory + DedupFilter::CHUNKS_FILENAME;
+    }
 
     /*
      * create the output file:
      */
-    string outputFile = baseDirectory + ARCHIVE_FILENAME;
     long long archiveFileSize = 0;
     FSink output(outputFile, O_WRONLY|O_CREAT|O_EXCL, 0600); //XXX
 
@@ -179,7 +254,9 @@ void ImageSingleFile::createTestArchiveAndExamineResult(void)
      */
     IoPump archivePump(archiveCreatorSucker);
 
-    archivePump.addSink(archiveListerFeeder);
+    if (archiveLister != 0) {
+        archivePump.addSink(archiveListerFeeder);
+    }
     archivePump.addSink(output);
 
     bool pumpingFinished = false;
@@ -193,20 +270,35 @@ void ImageSingleFile::createTestArchiveAndExamineResult(void)
             cerr << "Not enough harddisk space for image "
                  << "(lesser than permitted)" << endl;
             output.closeSink();
-            unlink(outputFile.c_str());
+            if (archiveLister != 0) {
+                archiveListerFeeder.closeSink();
+            }
+            /* no chunks may be added after they have been forgotten */
+            archiveCreatorSucker.closeSource();
+            archiveCreator->stop();
+            delete archiveCreator;
+            delete archiveLister;
+            discardArchive();
             throw;
         }
     }
     // close the file descriptors to which the archive was sent:
     output.closeSink();
-    archiveListerFeeder.closeSink();
+    if (archiveLister != 0) {
+        archiveListerFeeder.closeSink();
+    }
 
     // kill the archive creating processes
+    archiveCreatorSucker.closeSource();
+    archiveCreator->stop();
+    checkArchive(*archiveCreator, archiveLister, archiveFileSize);
+    if (archiveFileSize < archiveFileMaxSize) {
+        storedMembers = archiveCreator->getMembers();
+        storedSegments = archiveCreator->getSegments();
+    }
     delete archiveCreator;
     archiveCreator = 0;
 
-    thisTimeFileList = checkArchive(archiveLister);
-
     delete archiveLister;
     archiveLister = 0;
 
@@ -217,12 +309,12 @@ void ImageSingleFile::createTestArchiveAndExamineResult(void)
         /* All files together do not fit on cd. */
 
             /* Delete the incomplete archive: */
-        unlink(outputFile.c_str());
+        discardArchive();
 
         /* Reduce the number of files for the next archive */
         reduceFileset();
 
-        if (thisTimeFileList.empty()) {
+        if (thisTimeFileCount == 0) {
             /* the first file in the list is too large to fit on a cd */
             return; // reject that file
         }
@@ -271,78 +363,78 @@ bool ImageSingleFile::pumpArchive(IoPump & archivePump,
     return pumpingFinished;
 }
 
-list<string> ImageSingleFile::checkArchive(ArchiveLister * archiveLister)
-        throw (Image::Exception) {
-    list<string> dumpedFilesList;
-
-    for (list<string>::const_iterator iter =
-             archiveLister->getFileList().begin();
-         iter != archiveLister->getFileList().end();
-         ++iter) {
-        dumpedFilesList.push_back("/" + *iter);
+void ImageSingleFile::checkArchive(const ArchiveCreator & archiveCreator,
+                                   ArchiveLister * archiveLister,
+                                   long long archiveFileSize) {
+    const vector<TarWriter::Member> & members = archiveCreator.getMembers();
+    size_t dumpedCount = 0;
+    if (archiveLister != 0) {
+        dumpedCount = archiveLister->getFileList().size();
+    } else if (archiveFileSize < archiveFileMaxSize) {
+        dumpedCount = members.size();
+    } else {
+        /*
+         * Many of the members that the tar writer has written were still
+         * on their way to the cd when the archive was cut. Only those in
+         * the part of the tar stream that the stored chunks hold made it,
+         * plus the one that was cut, as in a listing.
+         */
+        long long tarBytes = archiveCreator.getTarBytes(archiveFileSize);
+        while ((dumpedCount < members.size())
+               && (members[dumpedCount].offset + members[dumpedCount].size
+                   <= tarBytes)) {
+            ++dumpedCount;
+        }
+        if ((dumpedCount < members.size())
+            && (members[dumpedCount].offset < tarBytes)) {
+            ++dumpedCount;
+        }
     }
-    assert(dumpedFilesList.size() <= thisTimeFileList.size());
+    assert(dumpedCount <= members.size());
 
     /*
      * Maybe not all files have been dumped. Maybe some have been left out
-     * because of their permissions. Search for filenames that
-     * have been left out:
+     * because of their permissions. The members are in the order we
+     * passed the files, so all requested files between the previous
+     * dumped member and this one have been left out.
      */
-    list<list<string>::iterator> forbiddenFileIterators;
-    list<string>::const_iterator dumpedIterator;
-    list<string>::const_iterator thisTimeIterator;
-    list<string>::iterator filesIterator;
-
-    for ((dumpedIterator = dumpedFilesList.begin()),
-             (thisTimeIterator = thisTimeFileList.begin()),
-             (filesIterator = files.begin());
-         dumpedIterator != dumpedFilesList.end();
-         ++dumpedIterator, ++thisTimeIterator, ++filesIterator) {
-        assert(*thisTimeIterator == *filesIterator);       //redundancy
-        while (*thisTimeIterator != *dumpedIterator) {
-            // Either a file was left out, or tar did something ugly
-            // with its name.
-            if (find(filesIterator, files.end(), *dumpedIterator)
-                == files.end()) {
-                    /*
-                     * the filename appearing at dumpedIterator was not
-                     * in the "files" list. However, we checked for bad
-                     * filenames before creating the archive. We must have
-                     * wrong information about what characters are allowed
-                     * in a filename and what are not.
-                     */
-                throw Exception(*filesIterator + " //->// "
-                                + *dumpedIterator);
-            } else {
-                /*
-                 * A file was left out due to permissions or mere
-                 * nonexistance.
-                 */
-                forbiddenFileIterators.push_back(filesIterator);
-                ++thisTimeIterator;
-                ++filesIterator;
-                assert(thisTimeIterator != thisTimeFileList.end());
-                assert(*thisTimeIterator == *filesIterator);
-            }
+    vector<bool> leftOut(thisTimeFileCount, false);
+    size_t position = 0;
+    for (size_t dumped = 0; dumped < dumpedCount; ++dumped) {
+        while (files[position] != members[dumped].file) {
+            /*
+             * A file was left out due to permissions or mere
+             * nonexistance.
+             */
+            leftOut[position++] = true;
         }
+        ++position;
     }
-    
+
     /* archiveFileSize is not in scope here, so we cannot perform this check:
      *
-     * //assert(((dumpedFilesList.size() + forbiddenFileIterators.size())
-     * //        == thisTimeFileList.size())
+     * //assert(((dumpedCount + number of left out files)
+     * //        == thisTimeFileCount)
      * //       || (archiveFileSize == archiveFileMaxSize));
      */
 
-    /* remove the forbidden files from the "files" list: */
-    for (list<list<string>::iterator>::iterator iter =
-             forbiddenFileIterators.begin();
-         iter != forbiddenFileIterators.end();
-         ++iter) {
-        rejectedForbiddenFiles.push_back(**iter);
-        files.erase(*iter);
+    /*
+     * Move the forbidden files from the "files" list to the
+     * "rejectedForbiddenFiles" list, and reduce thisTimeFileCount to the
+     * files that have actually been dumped.
+     */
+    size_t dumpedPositions = position;
+    size_t kept = 0;
+
+    for (position = 0; position < dumpedPositions; ++position) {
+        if (leftOut[position]) {
+            rejectedForbiddenFiles.push_back(files[position]);
+        } else {
+            files[kept++] = files[position];
+        }
     }
-    return dumpedFilesList;
+    files.erase(files.begin() + kept, files.begin() + dumpedPositions);
+    thisTimeFileCount = kept;
 }
 
 void ImageSingleFile::reduceFileset() {
@@ -352,9 +444,9 @@ void ImageSingleFile::reduceFileset() {
          * what files would have fitted onto this cd and try again
          * with these files only.
          */
-        if (!thisTimeFileList.empty()) {
+        if (thisTimeFileCount > 0) {
             /* the last file in the list was incompletely stored */
-            thisTimeFileList.pop_back();
+            --thisTimeFileCount;
         }
     } else {
         /*
@@ -365,10 +457,16 @@ void ImageSingleFile::reduceFileset() {
          * Radically reduce the number of files to store in the archive!
          * Delete the second half of filenames.
          */
-        list<string>::iterator iter = thisTimeFileList.begin();
-        for (size_t i = 0; i < (thisTimeFileList.size() / 2); ++i){
-            ++iter;
-        }
-        thisTimeFileList.erase(iter, thisTimeFileList.end());
+        thisTimeFileCount /= 2;
+    }
+}
+
+void ImageSingleFile::discardArchive() {
+    if (chunkIndex == 0) {
+        unlink((baseDirectory + ARCHIVE_FILENAME).c_str());
+    } else {
+        unlink((baseDirectory + DedupFilter::CHUNKS_FILENAME).c_str());
+        unlink((baseDirectory + DedupFilter::RECIPE_FILENAME).c_str());
+        chunkIndex->forgetImage(imageId);
     }
 }
@@ -33,6 +33,13 @@ namespace KryptoCD {
      * All files are collected in a single tar file, which is then compressed
      * and encrypted. Together with this file, we create an encrypted index
      * file that contains the names of all files in the tar file.
+     * <p>
+     * With a ChunkIndex, the tar stream is deduplicated on its way to
+     * bzip2, see DedupFilter: the image then holds the new chunks as
+     * DedupFilter::CHUNKS_FILENAME and the recipe as
+     * DedupFilter::RECIPE_FILENAME instead of the archive file. The chunks
+     * of trial archives that are discarded because they do not fit on the
+     * cd are removed from the index again.
      *
      * @author  Tobias Peters
      * @version $Revision: 1.2 $ $Date: 2001/05/20 19:41:57 $
@@ -56,6 +63,11 @@ namespace KryptoCD {
          *                   our users.
          * @param compression the compression rate used for the bzip2
          *                   compression. *Must* be between 1 and 9.
+         * @param paths      the store containing all file names. It must
+         *                   not change while the image exists, and it has
+         *                   to outlive the ImageInfo objects.
+         * @param metadata   the results of stat()ing the files. Files that
+         *                   have not been scanned are stat()ed again.
          * @param files      a list of files still needing to be archived.
          *                   Filenames must be absolute (starting with "/").
          *                   Directory names must end with exactly one "/".
@@ -83,11 +95,13 @@ namespace KryptoCD {
          *                   is the number reported by cdrecord -atip in the
          *                   line containing "ATIP start of lead out:". A
          *                   block on cd has space for 2048 bytes.
-         * @param tarExecutable     the location of the GNU tar executable file
          * @param bzip2Executable   the location of the bzip2 executable file
-         * @param gpgExecutable     the location of the GNU privacy guard
-         *                          executable file
          * @param mkisofsExecutable the location of the mkisofs executable file
+         * @param chunkIndex        if not 0, deduplicate the archive against
+         *                          the chunks in this index, and add its
+         *                          new chunks. The chunk stream cannot be
+         *                          listed, so the number of files that fit
+         *                          is taken from the tar writer.
          * @exception Image::Exception
          *                          data member "reason" contains the reason
          *                          for this Exception:
@@ -144,17 +158,19 @@ namespace KryptoCD {
         ImageSingleFile(const std::string & imageId,
                         const std::string & password,
                         int compression,
-                        std::list<std::string> & files,
-                        std::list<std::string> & rejectedBigFiles,
-                        std::list<std::string> & rejectedForbiddenFiles,
-                        std::list<std::string> & rejectedBadNamedFiles,
+                        const PathStore & paths,
+                        const MetadataScanner & metadata,
+                        PathList & files,
+                        PathList & rejectedBigFiles,
+                        PathList & rejectedForbiddenFiles,
+                        PathList & rejectedBadNamedFiles,
                         std::list<ImageInfo> & imageInfos,
                         Diskspace & diskspace,
                         int cdCapacity,
-                        const std::string & tarExecutable,
+                        Encrypter::Format format,
                         const std::string & bzip2Executable,
-                        const std::string & gpgExecutable,
-                        const std::string & mkisofsExecutable)
+                        const std::string & mkisofsExecutable,
+                        ChunkIndex * chunkIndex = 0)
             throw(Image::Exception, IoPump::Exception,
                   Pipe::Exception, Childprocess::Exception);
 
@@ -272,42 +288,35 @@ namespace KryptoCD {
             throw (IoPump::Exception);
 
         /**
-         * checkArchive gets the list of dumped files from the ArchiveLister
-         * object. This list is then compared to the list of files that tar
-         * should have included in the archive.
-         * It is assumed that files missing in the middle of the created
-         * archive have not been included by tar, either because they do not
-         * exist, or because of insufficient reading permissions. These
-         * filenames are then removed from the "files" list and appended to the
-         * "rejectedForbiddenFiles" list.
+         * checkArchive learns from the ArchiveCreator which files it has
+         * stored, and from the ArchiveLister how many of them made it into
+         * the archive before it was cut at the cd capacity. A deduplicated
+         * archive is not listed, the ArchiveCreator tells how much of the
+         * tar stream the cut chunk stream holds.
+         * Files missing in between have not been stored, either because
+         * they do not exist, or because of insufficient reading
+         * permissions. These filenames are then removed from the "files"
+         * list and appended to the "rejectedForbiddenFiles" list.
+         * The files are stored in the order we requested them, so one pass
+         * over both lists matches them up.
          * Called from createTestArchiveAndExamineResult
          *
+         * After the check, the first thisTimeFileCount entries of "files"
+         * are the files contained in the archive.
+         * If the tar archive is truncated at some point, then the file with
+         * the last of these names will usually not be contained completely
+         * in the archive.
+         *
+         * @param archiveCreator the stopped ArchiveCreator
          * @param archiveLister  a pointer to the ArchiveLister object. The
-         *                       list of files contained in the archive is
-         *                       copied from here.
-         * @return               The list of filenames contained in the
-         *                       archive, as returned by tar, but preceeded
-         *                       with a "/" (which is removed from absolute
-         *                       filenames by GNU tar).
-         *                       If the tar archive is truncated at some point,
-         *                       then the file with the last name in this list
-         *                       will usually not be contained completely in
-         *                       the archive.
-         * @exception Image::Exception
-         *                       the Exception's data member "reason" is set
-         *                       to Image::Exception::BAD_FILENAME. The
-         *                       image object should remove bad filenames
-         *                       containing "funny" characters from the
-         *                       "files" list before creating an archive
-         *                       (it moves these filenames to the
-         *                       "rejectedBadNamedFiles" list). However, if
-         *                       it left a bad filename in the list (because
-         *                       it did not know better), and tar sees and
-         *                       mangles that name, then this Exception will
-         *                       be thrown.
+         *                       number of files contained in the archive is
+         *                       read from here. 0 for a deduplicated
+         *                       archive.
+         * @param archiveFileSize the number of bytes stored
          */
-        std::list<std::string> checkArchive(ArchiveLister * archiveLister)
-            throw (Image::Exception);
+        void checkArchive(const ArchiveCreator & archiveCreator,
+                          ArchiveLister * archiveLister,
+                          long long archiveFileSize);
 
         /**
          * reduceFileset is called when all files together do not fit on one
@@ -329,14 +338,21 @@ namespace KryptoCD {
         void reduceFileset(void);
 
         /**
-         * This is the list of files to be stored on this cd. It is derived
-         * from the "files" list.
+         * deletes the archive files of a trial that is not used, and
+         * removes its chunks from the chunk index
+         */
+        void discardArchive(void);
+
+        /**
+         * The files to be stored on this cd are the first thisTimeFileCount
+         * entries of the "files" list.
          */
-        std::list<std::string> thisTimeFileList;
+        size_t thisTimeFileCount;
 
         /**
          * An upper limit estimation for the size (in bytes) of an encrypted
-         * file containing all names of files stored on this cd.
+         * file containing all names of files stored on this cd, and of its
+         * ImageIndex.
          *
          * if "int" is 32 bits wide, then the max possible
          * estimatedIndexFileSize is 2 Gigabyte -- probably enough
@@ -364,6 +380,22 @@ namespace KryptoCD {
          */
         long long archiveFileMaxSize;
 
+        /**
+         * the tar members of the archive that went onto the image, in the
+         * order of the files, for the image's ImageIndex
+         */
+        std::vector<TarWriter::Member> storedMembers;
+
+        /**
+         * where the compressed segments of that archive start
+         */
+        std::vector<SegmentedBzip2::Segment> storedSegments;
+
+        /**
+         * the chunks stored so far, or 0 if the archive is not deduplicated
+         */
+        ChunkIndex * chunkIndex;
+
         /**
          * method assembleImageData() will at first try to put all files into
          * a single archive. If that does not work, because all files together
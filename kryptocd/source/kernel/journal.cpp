@@ -0,0 +1,464 @@
+/*
+ * journal.cpp: class Journal implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "journal.hh"
+#include "content_hasher.hh"
+#include "varint.hh"
+#include "xxh64.hh"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+using KryptoCD::Journal;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::ContentHasher;
+using KryptoCD::Xxh64;
+using KryptoCD::putNumber;
+using KryptoCD::getNumber;
+using std::string;
+using std::vector;
+using std::map;
+
+static const string JOURNAL_MAGIC("KryptoCD journal 1\n");
+
+namespace {
+    /**
+     * reads a record payload for getNumber()
+     */
+    class StringInput {
+    public:
+        StringInput(const string & s_) : s(s_), position(0) {}
+        int get(void) {
+            if (position == s.length()) {
+                return EOF;
+            }
+            return static_cast<unsigned char>(s[position++]);
+        }
+        bool read(string & out, size_t length) {
+            if (s.length() - position < length) {
+                return false;
+            }
+            out.assign(s, position, length);
+            position += length;
+            return true;
+        }
+        size_t tell(void) const {return position;}
+    private:
+        const string & s;
+        size_t position;
+    };
+
+    bool spoolFileLess(const Journal::SpoolFile & a,
+                       const Journal::SpoolFile & b) {
+        return a.name < b.name;
+    }
+}
+
+/**
+ * the checksum following each record: the XXH64 of its payload, little
+ * endian
+ */
+static void putChecksum(string & out, const string & payload) {
+    unsigned long long checksum = Xxh64::hash(payload.data(),
+                                              payload.length());
+    for (int i = 0; i < 8; ++i) {
+        out += char(checksum >> (8 * i));
+    }
+}
+
+/**
+ * reads a list of names written by Journal::putFiles()
+ */
+static bool getFiles(StringInput & input, PathStore & paths,
+                     PathList & files) {
+    unsigned long long count;
+    if (!getNumber(input, count)) {
+        return false;
+    }
+    files.clear();
+    string name;
+    string suffix;
+    for (; count > 0; --count) {
+        unsigned long long prefix, length;
+        if (!getNumber(input, prefix) || (prefix > name.length())
+            || !getNumber(input, length) || !input.read(suffix, length)) {
+            return false;
+        }
+        name.erase(prefix);
+        name += suffix;
+        files.push_back(paths.intern(name));
+    }
+    return true;
+}
+
+Journal::Journal(const string & filename_)
+    : filename(filename_),
+      fd(-1),
+      paths(0),
+      planRecorded(false),
+      mutex(new pthread_mutex_t)
+{
+    pthread_mutex_init(mutex, 0);
+}
+
+Journal::~Journal() {
+    if (fd >= 0) {
+        close(fd);
+    }
+    int destroyVal = pthread_mutex_destroy(mutex);
+    assert(destroyVal == 0);
+    delete mutex;
+}
+
+void Journal::open(PathStore & paths_) throw(Journal::Exception) {
+    assert(fd < 0);
+    paths = &paths_;
+    fd = ::open(filename.c_str(), O_RDWR|O_CREAT, 0600);
+    if (fd < 0) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+
+    string contents;
+    char buffer[65536];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        contents.append(buffer, length);
+    }
+    if (length < 0) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+
+    if (contents.empty()) {
+        if ((write(fd, JOURNAL_MAGIC.data(), JOURNAL_MAGIC.length())
+             != ssize_t(JOURNAL_MAGIC.length()))
+            || (fsync(fd) != 0)) {
+            throw Exception(Exception::UNABLE_TO_WRITE);
+        }
+        return;
+    }
+    if (contents.substr(0, JOURNAL_MAGIC.length()) != JOURNAL_MAGIC) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+
+    /*
+     * Apply the records up to the first one that is incomplete or fails
+     * its checksum, and cut that one off, so new records follow the last
+     * good one.
+     */
+    size_t good = JOURNAL_MAGIC.length();
+    StringInput input(contents);
+    string payload;
+    input.read(payload, good);
+    for (;;) {
+        int type = input.get();
+        unsigned long long payloadLength;
+        string checksum;
+        if ((type == EOF) || !getNumber(input, payloadLength)
+            || !input.read(payload, payloadLength)
+            || !input.read(checksum, 8)) {
+            break;
+        }
+        string expected;
+        putChecksum(expected, payload);
+        if ((checksum != expected)
+            || !apply(RecordType(type), payload, paths_)) {
+            break;
+        }
+        good = input.tell();
+    }
+    if ((good < contents.length())
+        && ((ftruncate(fd, good) != 0) || (fsync(fd) != 0))) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    if (lseek(fd, good, SEEK_SET) != off_t(good)) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+}
+
+bool Journal::apply(RecordType type, const string & payload,
+                    PathStore & paths_) {
+    StringInput input(payload);
+
+    switch (type) {
+    case PLAN: {
+        unsigned long long discs;
+        if (!getNumber(input, discs)) {
+            return false;
+        }
+        vector<PathList> newPlan(discs);
+        for (size_t disc = 0; disc < newPlan.size(); ++disc) {
+            if (!getFiles(input, paths_, newPlan[disc])) {
+                return false;
+            }
+        }
+        plan.swap(newPlan);
+        planRecorded = true;
+        return true;
+    }
+    case IMAGE: {
+        unsigned long long length;
+        string imageId;
+        ImageRecord record;
+        unsigned long long count;
+        if (!getNumber(input, length) || !input.read(imageId, length)
+            || !getNumber(input, record.inputHash)
+            || !getFiles(input, paths_, record.storedFiles)
+            || !getFiles(input, paths_, record.rejectedBigFiles)
+            || !getFiles(input, paths_, record.rejectedForbiddenFiles)
+            || !getFiles(input, paths_, record.rejectedBadNamedFiles)
+            || !getFiles(input, paths_, record.leftOverFiles)
+            || !getNumber(input, count)) {
+            return false;
+        }
+        record.spoolFiles.resize(count);
+        for (size_t i = 0; i < record.spoolFiles.size(); ++i) {
+            SpoolFile & file = record.spoolFiles[i];
+            unsigned long long size;
+            if (!getNumber(input, length) || !input.read(file.name, length)
+                || !getNumber(input, size) || !getNumber(input, file.hash)) {
+                return false;
+            }
+            file.size = size;
+        }
+        record.burned = false;
+        images[imageId] = record;
+        return true;
+    }
+    case BURNED: {
+        map<string, ImageRecord>::iterator found = images.find(payload);
+        if (found != images.end()) {
+            found->second.burned = true;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+void Journal::putFiles(string & out, const PathList & files) const {
+    putNumber(out, files.size());
+    string previous;
+    string name;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        name.erase();
+        paths->appendPath(*iter, name);
+        size_t prefix = 0;
+        while ((prefix < previous.length()) && (prefix < name.length())
+               && (previous[prefix] == name[prefix])) {
+            ++prefix;
+        }
+        putNumber(out, prefix);
+        putNumber(out, name.length() - prefix);
+        out.append(name, prefix, string::npos);
+        previous.swap(name);
+    }
+}
+
+void Journal::append(RecordType type, const string & payload)
+    throw(Journal::Exception) {
+    assert(fd >= 0);
+    string record;
+    record += char(type);
+    putNumber(record, payload.length());
+    record += payload;
+    putChecksum(record, payload);
+
+    const char * data = record.data();
+    size_t remaining = record.length();
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written <= 0) {
+            throw Exception(Exception::UNABLE_TO_WRITE);
+        }
+        data += written;
+        remaining -= written;
+    }
+    if (fsync(fd) != 0) {
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+}
+
+bool Journal::hasPlan(void) const {
+    return planRecorded;
+}
+
+const vector<PathList> & Journal::getPlan(void) const {
+    return plan;
+}
+
+void Journal::recordPlan(const vector<PathList> & discs)
+    throw(Journal::Exception) {
+    string payload;
+    putNumber(payload, discs.size());
+    for (vector<PathList>::const_iterator iter = discs.begin();
+         iter != discs.end();
+         ++iter) {
+        putFiles(payload, *iter);
+    }
+
+    pthread_mutex_lock(mutex);
+    try {
+        append(PLAN, payload);
+    } catch (...) {
+        pthread_mutex_unlock(mutex);
+        throw;
+    }
+    plan = discs;
+    planRecorded = true;
+    pthread_mutex_unlock(mutex);
+}
+
+bool Journal::findImage(const string & imageId,
+                        ImageRecord & record) const {
+    pthread_mutex_lock(mutex);
+    map<string, ImageRecord>::const_iterator found = images.find(imageId);
+    bool success = (found != images.end());
+    if (success) {
+        record = found->second;
+    }
+    pthread_mutex_unlock(mutex);
+    return success;
+}
+
+void Journal::recordImage(const string & imageId,
+                          const ImageRecord & record)
+    throw(Journal::Exception) {
+    string payload;
+    putNumber(payload, imageId.length());
+    payload += imageId;
+    putNumber(payload, record.inputHash);
+    putFiles(payload, record.storedFiles);
+    putFiles(payload, record.rejectedBigFiles);
+    putFiles(payload, record.rejectedForbiddenFiles);
+    putFiles(payload, record.rejectedBadNamedFiles);
+    putFiles(payload, record.leftOverFiles);
+    putNumber(payload, record.spoolFiles.size());
+    for (vector<SpoolFile>::const_iterator iter = record.spoolFiles.begin();
+         iter != record.spoolFiles.end();
+         ++iter) {
+        putNumber(payload, iter->name.length());
+        payload += iter->name;
+        putNumber(payload, iter->size);
+        putNumber(payload, iter->hash);
+    }
+
+    pthread_mutex_lock(mutex);
+    try {
+        append(IMAGE, payload);
+    } catch (...) {
+        pthread_mutex_unlock(mutex);
+        throw;
+    }
+    images[imageId] = record;
+    images[imageId].burned = false;
+    pthread_mutex_unlock(mutex);
+}
+
+void Journal::recordBurned(const string & imageId)
+    throw(Journal::Exception) {
+    pthread_mutex_lock(mutex);
+    try {
+        append(BURNED, imageId);
+    } catch (...) {
+        pthread_mutex_unlock(mutex);
+        throw;
+    }
+    map<string, ImageRecord>::iterator found = images.find(imageId);
+    if (found != images.end()) {
+        found->second.burned = true;
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+unsigned long long Journal::hashFiles(const PathStore & paths,
+                                      const PathList & files) {
+    Xxh64 hasher;
+    string name;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        name.erase();
+        paths.appendPath(*iter, name);
+        hasher.update(name.c_str(), name.length() + 1);
+    }
+    return hasher.digest();
+}
+
+bool Journal::listDirectory(const string & directory,
+                            vector<SpoolFile> & files) {
+    files.clear();
+    DIR * dp = opendir(directory.c_str());
+    if (dp == 0) {
+        return false;
+    }
+    struct dirent * ep;
+    while ((ep = readdir(dp)) != 0) {
+        if ((strcmp(ep->d_name, ".") != 0)
+            && (strcmp(ep->d_name, "..") != 0)) {
+            files.push_back(SpoolFile());
+            files.back().name = ep->d_name;
+        }
+    }
+    closedir(dp);
+    std::sort(files.begin(), files.end(), spoolFileLess);
+
+    vector<char> buffer;
+    for (vector<SpoolFile>::iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        string name = directory + "/" + iter->name;
+        struct stat st;
+        if ((stat(name.c_str(), &st) != 0)
+            || !ContentHasher::hashFile(name.c_str(), iter->hash, buffer)) {
+            return false;
+        }
+        iter->size = st.st_size;
+    }
+    return true;
+}
+
+bool Journal::verifyDirectory(const string & directory,
+                              const vector<SpoolFile> & files) {
+    vector<SpoolFile> found;
+    if (!listDirectory(directory, found) || (found.size() != files.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+        if ((found[i].name != files[i].name)
+            || (found[i].size != files[i].size)
+            || (found[i].hash != files[i].hash)) {
+            return false;
+        }
+    }
+    return true;
+}
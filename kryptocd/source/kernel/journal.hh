@@ -0,0 +1,228 @@
+/*
+ * journal.hh: class Journal header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef JOURNAL_HH
+#define JOURNAL_HH
+
+#include "path_store.hh"
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+
+namespace KryptoCD {
+    /**
+     * Class Journal lets an interrupted backup resume where it stopped. It
+     * records the plan of the backup, and for each finished image the files
+     * it contains, the files that were rejected or left over for a later
+     * cd, and the names, sizes and content hashes of the files in the
+     * image's directory. A restarted ImageScheduler takes finished images
+     * whose directory is still intact from the journal instead of
+     * compressing and encrypting them again, and skips images that have
+     * been burned.
+     * <p>
+     * The journal is a file of records that are only ever appended, each
+     * followed by its XXH64 checksum and written with fsync(). A record
+     * that was cut off by a crash fails its checksum and is dropped when
+     * the journal is opened again.
+     * <p>
+     * All methods may be called by several threads at once.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Journal {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                UNABLE_TO_OPEN,
+                UNABLE_TO_WRITE,
+                BAD_FORMAT,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * a file in the directory of an image
+         */
+        struct SpoolFile {
+            std::string name;
+            long long size;
+            unsigned long long hash;
+        };
+
+        /**
+         * what became of the files of one image
+         */
+        struct ImageRecord {
+            /**
+             * hashFiles() of the files the image was built from. A record
+             * is only used for an image built from the same files.
+             */
+            unsigned long long inputHash;
+
+            PathList storedFiles;
+            PathList rejectedBigFiles;
+            PathList rejectedForbiddenFiles;
+            PathList rejectedBadNamedFiles;
+
+            /**
+             * the files that did not fit and go onto a later cd
+             */
+            PathList leftOverFiles;
+
+            std::vector<SpoolFile> spoolFiles;
+
+            /**
+             * set by recordBurned()
+             */
+            bool burned;
+        };
+
+        /**
+         * @param filename the journal file. It is created by open() if it
+         *                 does not exist.
+         */
+        Journal(const std::string & filename);
+
+        ~Journal();
+
+        /**
+         * reads the records of an earlier run, and prepares for appending
+         * new ones
+         *
+         * @param paths the names in the journal are interned here. New
+         *              records may only contain names of this store.
+         * @exception Journal::Exception
+         *              UNABLE_TO_OPEN, or BAD_FORMAT if the file is not a
+         *              journal
+         */
+        void open(PathStore & paths) throw(Exception);
+
+        /**
+         * @return true if a plan has been recorded
+         */
+        bool hasPlan(void) const;
+
+        /**
+         * @return the files of each cd of the recorded plan
+         */
+        const std::vector<PathList> & getPlan(void) const;
+
+        /**
+         * records the plan of the backup: the files of each cd
+         */
+        void recordPlan(const std::vector<PathList> & discs)
+            throw(Exception);
+
+        /**
+         * looks up a finished image
+         *
+         * @param record receives the record of the image
+         * @return       false if the image has not been recorded
+         */
+        bool findImage(const std::string & imageId,
+                       ImageRecord & record) const;
+
+        /**
+         * records a finished image. An earlier record of the same image is
+         * replaced.
+         */
+        void recordImage(const std::string & imageId,
+                         const ImageRecord & record)
+            throw(Exception);
+
+        /**
+         * records that an image has been burned, so that its directory may
+         * be deleted, and a resumed backup does not burn it again
+         */
+        void recordBurned(const std::string & imageId) throw(Exception);
+
+        /**
+         * @return a hash of the names of a list of files, in order
+         */
+        static unsigned long long hashFiles(const PathStore & paths,
+                                            const PathList & files);
+
+        /**
+         * lists the files of a directory, with their sizes and content
+         * hashes, sorted by name
+         *
+         * @return false if the directory or one of its files could not be
+         *         read
+         */
+        static bool listDirectory(const std::string & directory,
+                                  std::vector<SpoolFile> & files);
+
+        /**
+         * @return true if the directory contains exactly the given files
+         *         with the given contents
+         */
+        static bool verifyDirectory(const std::string & directory,
+                                    const std::vector<SpoolFile> & files);
+
+    private:
+        enum RecordType {
+            PLAN = 'P',
+            IMAGE = 'I',
+            BURNED = 'B',
+        };
+
+        /**
+         * appends a record to the file. Called with the mutex held.
+         */
+        void append(RecordType type, const std::string & payload)
+            throw(Exception);
+
+        /**
+         * applies a record read by open()
+         *
+         * @param paths the names of the record are interned here
+         * @return      false if the payload is malformed
+         */
+        bool apply(RecordType type, const std::string & payload,
+                   PathStore & paths);
+
+        void putFiles(std::string & out, const PathList & files) const;
+
+        std::string filename;
+
+        /**
+         * the file descriptor records are appended to, or -1 before open()
+         */
+        int fd;
+
+        const PathStore * paths;
+
+        std::vector<PathList> plan;
+        bool planRecorded;
+
+        std::map<std::string, ImageRecord> images;
+
+        pthread_mutex_t * mutex;
+    };
+}
+#endif
@@ -0,0 +1,211 @@
+/*
+ * key_cache.cpp: class KeyCache implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "key_cache.hh"
+#include "sha1.hh"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+using KryptoCD::KeyCache;
+using KryptoCD::Sha1;
+using std::string;
+using std::vector;
+
+/**
+ * The OpenPGP algorithm numbers of the S2K function
+ */
+static const unsigned char HASH_SHA1 = 2;
+
+class KeyCache::Registry {
+public:
+    pthread_mutex_t mutex;
+    vector<KeyCache *> caches;
+
+    Registry() {
+        pthread_mutex_init(&mutex, 0);
+    }
+
+    /* the keys are wiped when the process exits */
+    ~Registry() {
+        for (vector<KeyCache *>::iterator iter = caches.begin();
+             iter != caches.end();
+             ++iter) {
+            delete *iter;
+        }
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+const KeyCache & KeyCache::get(const string & password) throw(Exception) {
+    static Registry registry;
+
+    pthread_mutex_lock(&registry.mutex);
+    for (vector<KeyCache *>::const_iterator iter = registry.caches.begin();
+         iter != registry.caches.end();
+         ++iter) {
+        if ((*iter)->password == password) {
+            pthread_mutex_unlock(&registry.mutex);
+            return **iter;
+        }
+    }
+    KeyCache * cache;
+    try {
+        cache = new KeyCache(password);
+    } catch (Exception & e) {
+        pthread_mutex_unlock(&registry.mutex);
+        throw;
+    }
+    registry.caches.push_back(cache);
+    pthread_mutex_unlock(&registry.mutex);
+    return *cache;
+}
+
+KeyCache::KeyCache(const string & password_) throw(Exception)
+    : password(password_),
+      locked(false)
+{
+    secretsSize = sysconf(_SC_PAGESIZE);
+    if (secretsSize < sizeof(Secrets)) {
+        secretsSize = sizeof(Secrets);
+    }
+    void * page = mmap(0, secretsSize, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        throw Exception(Exception::NO_MEMORY);
+    }
+    locked = (mlock(page, secretsSize) == 0);
+#ifdef MADV_DONTDUMP
+    /* keep the key out of core dumps, too */
+    madvise(page, secretsSize, MADV_DONTDUMP);
+#endif
+    secrets = static_cast<Secrets *>(page);
+
+    if (!readRandom(secrets->salt, SALT_LENGTH)) {
+        munmap(page, secretsSize);
+        throw Exception(Exception::NO_RANDOM);
+    }
+    deriveKey(password, secrets->salt, S2K_COUNT,
+              secrets->key, KEY_LENGTH);
+}
+
+KeyCache::~KeyCache() {
+    wipe(secrets, secretsSize);
+    if (locked) {
+        munlock(secrets, secretsSize);
+    }
+    munmap(secrets, secretsSize);
+    wipe(&password[0], password.size());
+}
+
+const unsigned char * KeyCache::getSalt(void) const {
+    return secrets->salt;
+}
+
+const unsigned char * KeyCache::getKey(void) const {
+    return secrets->key;
+}
+
+bool KeyCache::isLocked(void) const {
+    return locked;
+}
+
+void KeyCache::deriveKey(const string & password,
+                         const unsigned char * salt,
+                         unsigned char coded,
+                         unsigned char * key, size_t keyLength) {
+    size_t count = (16 + (coded & 15)) << ((coded >> 4) + 6);
+    string material(reinterpret_cast<const char *>(salt), SALT_LENGTH);
+    material += password;
+    if (count < material.size()) {
+        count = material.size();
+    }
+
+    /* hash the repeated salt and passphrase in large pieces */
+    string repeated;
+    while (repeated.size() < 4096) {
+        repeated += material;
+    }
+
+    /*
+     * each hash gives DIGEST_LENGTH bytes of the key. The n-th hash is
+     * preloaded with n zero bytes.
+     */
+    for (size_t done = 0, preload = 0; done < keyLength; ++preload) {
+        Sha1 hash;
+        for (size_t i = 0; i < preload; ++i) {
+            hash.update("", 1);
+        }
+        size_t remaining = count;
+        while (remaining >= repeated.size()) {
+            hash.update(repeated.data(), repeated.size());
+            remaining -= repeated.size();
+        }
+        hash.update(repeated.data(), remaining);
+
+        unsigned char digest[Sha1::DIGEST_LENGTH];
+        hash.digest(digest);
+        size_t length = keyLength - done;
+        if (length > Sha1::DIGEST_LENGTH) {
+            length = Sha1::DIGEST_LENGTH;
+        }
+        memcpy(key + done, digest, length);
+        done += length;
+        wipe(digest, sizeof(digest));
+    }
+    wipe(&material[0], material.size());
+    wipe(&repeated[0], repeated.size());
+}
+
+bool KeyCache::readRandom(unsigned char * data, size_t length) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    while (length > 0) {
+        ssize_t count = read(fd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += count;
+        length -= count;
+    }
+    close(fd);
+    return length == 0;
+}
+
+void KeyCache::wipe(void * data, size_t length) {
+    volatile unsigned char * bytes = static_cast<volatile unsigned char *>(data);
+    while (length-- > 0) {
+        *bytes++ = 0;
+    }
+}
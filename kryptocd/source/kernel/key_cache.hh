@@ -0,0 +1,149 @@
+/*
+ * key_cache.hh: class KeyCache header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef KEY_CACHE_HH
+#define KEY_CACHE_HH
+
+#include <string>
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * Class KeyCache turns a passphrase into an AES-256 key once per run.
+     * The OpenPGP S2K function makes that expensive on purpose, and every
+     * archive, listing and info file of a backup is encrypted with the
+     * same passphrase.
+     * <p>
+     * There is one KeyCache per passphrase in the process, see get(). It
+     * chooses a random salt when it is created, and derives the key with
+     * the iterated and salted SHA-1 S2K function. Salt and key are kept in
+     * a page of memory that is locked with mlock(), so the key never goes
+     * to swap space, and that is overwritten when the process exits. If
+     * the page cannot be locked, e.g. because of RLIMIT_MEMLOCK, the cache
+     * works anyway.
+     * <p>
+     * PgpEncrypter does not encrypt with this key directly: every stream
+     * gets a random session key, which is encrypted with the cached key
+     * and stored together with salt and S2K parameters, so gpg can derive
+     * the same key from the passphrase again. PgpDecrypter uses the cached
+     * key for streams with the cache's salt.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class KeyCache {
+    public:
+        class Exception {
+        public:
+            enum Reason {
+                NO_RANDOM,
+                NO_MEMORY,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        static const size_t KEY_LENGTH = 32;
+        static const size_t SALT_LENGTH = 8;
+
+        /**
+         * the coded S2K count: (16 + (c & 15)) << ((c >> 4) + 6) bytes
+         * of salt and passphrase are hashed to get the key, here 8 MB
+         */
+        static const unsigned char S2K_COUNT = 0xd0;
+
+        /**
+         * @return the cache for a passphrase. The first call for a
+         *         passphrase derives the key, the others wait for that
+         *         and return the same object. Thread safe.
+         * @exception KeyCache::Exception
+         *         if no random salt or no memory could be got
+         */
+        static const KeyCache & get(const std::string & password)
+            throw(Exception);
+
+        /**
+         * @return the salt, SALT_LENGTH bytes
+         */
+        const unsigned char * getSalt(void) const;
+
+        /**
+         * @return the key, KEY_LENGTH bytes
+         */
+        const unsigned char * getKey(void) const;
+
+        /**
+         * @return true if the key is kept in locked memory
+         */
+        bool isLocked(void) const;
+
+        /**
+         * turns a passphrase into a key with the iterated and salted SHA-1
+         * S2K function of RFC 4880
+         *
+         * @param count  the coded S2K count
+         */
+        static void deriveKey(const std::string & password,
+                              const unsigned char * salt,
+                              unsigned char count,
+                              unsigned char * key, size_t keyLength);
+
+        /**
+         * fills a buffer from /dev/urandom
+         *
+         * @return false if that fails
+         */
+        static bool readRandom(unsigned char * data, size_t length);
+
+        /**
+         * overwrites secret data
+         */
+        static void wipe(void * data, size_t length);
+
+    private:
+        KeyCache(const std::string & password) throw(Exception);
+
+        /**
+         * wipes and unlocks the secrets
+         */
+        ~KeyCache();
+
+        /**
+         * the caches of the process
+         */
+        class Registry;
+        friend class Registry;
+
+        struct Secrets {
+            unsigned char salt[SALT_LENGTH];
+            unsigned char key[KEY_LENGTH];
+        };
+
+        std::string password;
+        Secrets * secrets;
+        size_t secretsSize;
+        bool locked;
+    };
+}
+#endif
@@ -0,0 +1,222 @@
+/*
+ * layout_order.cpp: class LayoutOrder implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "layout_order.hh"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+using KryptoCD::LayoutOrder;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using std::string;
+using std::vector;
+
+/**
+ * the number of files a worker takes at once, see metadata_scanner.cpp
+ */
+static const size_t BATCH_SIZE = 64;
+
+LayoutOrder::LayoutOrder(const PathStore & paths_,
+                         const MetadataScanner & metadata_,
+                         Method method_,
+                         int threads_)
+    : paths(paths_),
+      metadata(metadata_),
+      method(method_),
+      threads(threads_)
+{
+    assert(threads > 0);
+}
+
+bool LayoutOrder::firstExtent(const char * name,
+                              unsigned long long & physical) {
+#ifdef FS_IOC_FIEMAP
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    /* room for the request and one extent, aligned for both */
+    long long buffer[(sizeof(struct fiemap) + sizeof(struct fiemap_extent))
+                     / sizeof(long long) + 1];
+    memset(buffer, 0, sizeof(buffer));
+    struct fiemap * request = reinterpret_cast<struct fiemap *>(buffer);
+    request->fm_start = 0;
+    request->fm_length = ~0ULL;
+    request->fm_extent_count = 1;
+
+    int result = ioctl(fd, FS_IOC_FIEMAP, request);
+    close(fd);
+    if ((result != 0) || (request->fm_mapped_extents == 0)) {
+        return false;
+    }
+
+    /*
+     * Data not yet allocated, or stored in the inode, has no address of
+     * its own.
+     */
+    const struct fiemap_extent & extent = request->fm_extents[0];
+    if (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN
+                           | FIEMAP_EXTENT_DATA_INLINE)) {
+        return false;
+    }
+    physical = extent.fe_physical;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LayoutOrder::positionLess(const Position & a, const Position & b) {
+    if (a.device != b.device) {
+        return a.device < b.device;
+    }
+    if (a.kind != b.kind) {
+        return a.kind < b.kind;
+    }
+    if (a.address != b.address) {
+        return a.address < b.address;
+    }
+    return a.index < b.index;
+}
+
+void LayoutOrder::sort(PathList & files) const {
+    PathList directories;
+    vector<Position> positions;
+    positions.reserve(files.size());
+    Lookup lookup;
+    lookup.files = &files;
+    lookup.positions = &positions;
+    lookup.nextPending = 0;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (paths.isDirectory(files[i])) {
+            directories.push_back(files[i]);
+            continue;
+        }
+        Position position;
+        position.index = i;
+        const FileMetadata * st = metadata.get(files[i]);
+        if (st == 0) {
+            position.device = 0;
+            position.kind = 2;
+            position.address = 0;
+        } else {
+            position.device = st->device;
+            position.kind = 1;
+            position.address = st->inode;
+            if ((method == EXTENT) && S_ISREG(st->mode) && (st->size > 0)) {
+                lookup.pending.push_back(positions.size());
+            }
+        }
+        positions.push_back(position);
+    }
+
+    if (!lookup.pending.empty()) {
+        /* not more threads than batches: */
+        size_t threadCount = (lookup.pending.size() + BATCH_SIZE - 1)
+            / BATCH_SIZE;
+        if (threadCount > size_t(threads)) {
+            threadCount = threads;
+        }
+        lookup.mutex = new pthread_mutex_t;
+        pthread_mutex_init(lookup.mutex, 0);
+        vector<Worker *> workers;
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.push_back(new Worker(*this, lookup));
+            int success = workers.back()->start();
+            assert(success == 0);
+        }
+
+        /* the Worker destructor joins the thread */
+        for (vector<Worker *>::iterator iter = workers.begin();
+             iter != workers.end();
+             ++iter) {
+            delete *iter;
+        }
+        int destroyVal = pthread_mutex_destroy(lookup.mutex);
+        assert(destroyVal == 0);
+        delete lookup.mutex;
+    }
+
+    std::sort(positions.begin(), positions.end(), positionLess);
+
+    PathList sorted;
+    sorted.reserve(files.size());
+    sorted.insert(sorted.end(), directories.begin(), directories.end());
+    for (vector<Position>::const_iterator iter = positions.begin();
+         iter != positions.end();
+         ++iter) {
+        sorted.push_back(files[iter->index]);
+    }
+    files.swap(sorted);
+}
+
+void * LayoutOrder::Worker::run(void) {
+    order.work(lookup);
+    return this;
+}
+
+void LayoutOrder::work(Lookup & lookup) const {
+    string name;
+
+    for (;;) {
+        pthread_mutex_lock(lookup.mutex);
+        size_t first = lookup.nextPending;
+        size_t last = first + BATCH_SIZE;
+        if (last > lookup.pending.size()) {
+            last = lookup.pending.size();
+        }
+        lookup.nextPending = last;
+        pthread_mutex_unlock(lookup.mutex);
+
+        if (first == last) {
+            break;
+        }
+        for (size_t i = first; i < last; ++i) {
+            Position & position = (*lookup.positions)[lookup.pending[i]];
+            name.erase();
+            paths.appendPath((*lookup.files)[position.index], name);
+            unsigned long long physical;
+            if (firstExtent(name.c_str(), physical)) {
+                position.kind = 0;
+                position.address = physical;
+            }
+        }
+    }
+}
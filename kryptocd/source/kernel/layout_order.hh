@@ -0,0 +1,155 @@
+/*
+ * layout_order.hh: class LayoutOrder header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef LAYOUT_ORDER_HH
+#define LAYOUT_ORDER_HH
+
+#include "path_store.hh"
+#include "metadata_scanner.hh"
+#include "thread.hh"
+#include <vector>
+#include <pthread.h>
+
+namespace KryptoCD {
+    /**
+     * Class LayoutOrder sorts the files of an image by where they are on
+     * the disk, so that tar reads them with few seeks. Read in the order
+     * of the directory tree, files scattered over a spinning disk or a
+     * fragmented filesystem are read at a few MB/s.
+     * <p>
+     * The position of a file is the physical address of its first extent,
+     * as told by the FIEMAP ioctl on Linux. Files without one, on
+     * filesystems that do not support FIEMAP, and empty files are placed
+     * by their inode number instead, which most filesystems allocate near
+     * the data. Files on different devices are not interleaved.
+     * <p>
+     * Directories keep their relative order and go before all other
+     * files, so a restore creates each directory before its contents.
+     * Only the order within one image changes, never which image a file
+     * goes to. Finding the extents needs an open() per file, which is
+     * spread over a number of threads like in MetadataScanner.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class LayoutOrder {
+    public:
+        enum Method {
+            /**
+             * sort by inode number only. Needs no system calls.
+             */
+            INODE,
+
+            /**
+             * sort by the first physical extent where available
+             */
+            EXTENT,
+        };
+
+        /**
+         * @param paths    the store containing the file names
+         * @param metadata the results of stat()ing the files. Files not
+         *                 scanned are sorted to the end.
+         * @param method   how to find the position of a file
+         * @param threads  the number of threads looking up extents
+         */
+        LayoutOrder(const PathStore & paths,
+                    const MetadataScanner & metadata,
+                    Method method,
+                    int threads);
+
+        /**
+         * sorts a list of files by their positions on disk. May be called
+         * by several threads at once.
+         */
+        void sort(PathList & files) const;
+
+        /**
+         * finds the physical address of the first extent of a file
+         *
+         * @param physical receives the address in bytes
+         * @return         false if the file could not be opened, has no
+         *                 extents, or FIEMAP is not supported
+         */
+        static bool firstExtent(const char * name,
+                                unsigned long long & physical);
+
+    private:
+        /**
+         * where a file is on the disk
+         */
+        struct Position {
+            unsigned long long device;
+
+            /**
+             * 0 if "address" is a physical address, 1 if it is an inode
+             * number, 2 if the file has not been scanned
+             */
+            int kind;
+
+            unsigned long long address;
+            size_t index;
+        };
+
+        /**
+         * a sort() call whose extents are looked up by the workers
+         */
+        struct Lookup {
+            const PathList * files;
+            std::vector<Position> * positions;
+            std::vector<size_t> pending;
+            size_t nextPending;
+            pthread_mutex_t * mutex;
+        };
+
+        /**
+         * the work of one thread: look up the extents of pending files
+         * until there are none left
+         */
+        void work(Lookup & lookup) const;
+
+        /**
+         * a thread calling work()
+         */
+        class Worker : public Thread {
+            const LayoutOrder & order;
+            Lookup & lookup;
+        public:
+            Worker(const LayoutOrder & o, Lookup & l) : order(o), lookup(l) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        static bool positionLess(const Position & a, const Position & b);
+
+        const PathStore & paths;
+        const MetadataScanner & metadata;
+        Method method;
+        int threads;
+    };
+}
+#endif
@@ -0,0 +1,163 @@
+/*
+ * metadata_scanner.cpp: class MetadataScanner implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "metadata_scanner.hh"
+#include <sys/stat.h>
+#include <assert.h>
+
+using KryptoCD::MetadataScanner;
+using KryptoCD::FileMetadata;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using std::string;
+using std::vector;
+
+/**
+ * the number of files a thread takes at once. Large enough to keep the
+ * mutex cold, small enough to keep all threads busy until the end.
+ */
+static const size_t BATCH_SIZE = 64;
+
+MetadataScanner::MetadataScanner(const PathStore & paths_, int threads_)
+    : paths(paths_),
+      threads(threads_),
+      nextPending(0),
+      mutex(new pthread_mutex_t)
+{
+    assert(threads > 0);
+    pthread_mutex_init(mutex, 0);
+}
+
+MetadataScanner::~MetadataScanner() {
+    int destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+}
+
+bool MetadataScanner::statFile(const char * name, FileMetadata & metadata) {
+    struct stat st;
+
+    if (lstat(name, &st) != 0) {
+        metadata.size = 0;
+        metadata.inode = 0;
+        metadata.mtime = 0;
+        metadata.ctime = 0;
+        metadata.device = 0;
+        metadata.mode = 0;
+        metadata.uid = 0;
+        metadata.gid = 0;
+        return false;
+    }
+    metadata.size = st.st_size;
+    metadata.inode = st.st_ino;
+    metadata.mtime = st.st_mtime;
+    metadata.ctime = st.st_ctime;
+    metadata.device = st.st_dev;
+    metadata.mode = st.st_mode;
+    metadata.uid = st.st_uid;
+    metadata.gid = st.st_gid;
+    return true;
+}
+
+void MetadataScanner::scan(const PathList & files) {
+    if (slotOf.size() < paths.size()) {
+        slotOf.resize(paths.size(), 0);
+    }
+
+    /* assign slots to all files we have not seen yet: */
+    pendingFiles.clear();
+    pendingSlots.clear();
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        if (slotOf[*iter] == 0) {
+            pendingFiles.push_back(*iter);
+            pendingSlots.push_back(entries.size() + pendingSlots.size());
+            slotOf[*iter] = pendingSlots.back() + 1;
+        }
+    }
+    if (pendingFiles.empty()) {
+        return;
+    }
+    entries.resize(entries.size() + pendingFiles.size());
+    nextPending = 0;
+
+    /* not more threads than batches: */
+    size_t threadCount = (pendingFiles.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+    if (threadCount > size_t(threads)) {
+        threadCount = threads;
+    }
+    vector<Worker *> workers;
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+    pendingFiles.clear();
+    pendingSlots.clear();
+}
+
+void * MetadataScanner::Worker::run(void) {
+    scanner.work();
+    return this;
+}
+
+void MetadataScanner::work(void) {
+    string name;
+
+    for (;;) {
+        pthread_mutex_lock(mutex);
+        size_t first = nextPending;
+        size_t last = first + BATCH_SIZE;
+        if (last > pendingFiles.size()) {
+            last = pendingFiles.size();
+        }
+        nextPending = last;
+        pthread_mutex_unlock(mutex);
+
+        if (first == last) {
+            break;
+        }
+        for (size_t i = first; i < last; ++i) {
+            name.erase();
+            paths.appendPath(pendingFiles[i], name);
+            statFile(name.c_str(), entries[pendingSlots[i]]);
+        }
+    }
+}
+
+const FileMetadata * MetadataScanner::get(PathId file) const {
+    if ((file >= slotOf.size()) || (slotOf[file] == 0)) {
+        return 0;
+    }
+    return &entries[slotOf[file] - 1];
+}
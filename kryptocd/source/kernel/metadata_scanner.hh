@@ -0,0 +1,167 @@
+/*
+ * metadata_scanner.hh: class MetadataScanner header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef METADATA_SCANNER_HH
+#define METADATA_SCANNER_HH
+
+#include "path_store.hh"
+#include "thread.hh"
+#include <sys/types.h>
+#include <time.h>
+
+namespace KryptoCD {
+    /**
+     * what stat() told us about a file
+     */
+    struct FileMetadata {
+        long long size;
+        long long inode;
+        time_t    mtime;
+        time_t    ctime;
+        dev_t     device;
+
+        /**
+         * st_mode, or 0 if the file could not be stat()ed
+         */
+        mode_t    mode;
+
+        uid_t     uid;
+        gid_t     gid;
+    };
+
+    /**
+     * Class MetadataScanner stat()s all files of a backup once, and keeps
+     * the results for everybody who needs them later: Image checks the
+     * files' existence and types, the planner needs their sizes, change
+     * detection needs their times and inode numbers.
+     * <p>
+     * Symbolic links are not followed (lstat()), because the TarWriter
+     * archives the link itself: a link to a directory is a link, not a
+     * directory, and a dangling link exists.
+     * <p>
+     * The stat() calls are spread over a number of threads. On NFS and on
+     * cold disks, stat() spends nearly all its time waiting, so many more
+     * threads than processors make sense here. Each thread takes the next
+     * batch of unscanned files from a shared position; the results are
+     * written to slots that were assigned before the threads started, so
+     * the order of the results does not depend on the threads.
+     * <p>
+     * scan() must not run concurrently with any other method, but after it
+     * has returned, any number of threads may call get().
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class MetadataScanner {
+    public:
+        /**
+         * @param paths   the store containing the names of the files to
+         *                scan. It has to outlive the scanner.
+         * @param threads the number of threads calling stat() at the same
+         *                time
+         */
+        MetadataScanner(const PathStore & paths, int threads);
+
+        ~MetadataScanner();
+
+        /**
+         * stat()s all files in the list that have not been scanned before,
+         * and returns when all results are available.
+         *
+         * @param files names of files in the store passed to the
+         *              constructor
+         */
+        void scan(const PathList & files);
+
+        /**
+         * @param file a file name from the store passed to the constructor
+         * @return     the metadata found by scan(), or 0 if the file has
+         *             not been scanned. The pointer is valid until the next
+         *             call to scan().
+         */
+        const FileMetadata * get(PathId file) const;
+
+        /**
+         * stat()s a single file on the calling thread
+         *
+         * @param name     the name of the file
+         * @param metadata receives the result of lstat(). If it fails,
+         *                 the mode is set to 0.
+         * @return         true if stat() succeeded
+         */
+        static bool statFile(const char * name, FileMetadata & metadata);
+
+    private:
+        /**
+         * the work of one thread: stat() batches of pending files until
+         * there are none left
+         */
+        void work(void);
+
+        /**
+         * a thread calling work()
+         */
+        class Worker : public Thread {
+            MetadataScanner & scanner;
+        public:
+            Worker(MetadataScanner & s) : scanner(s) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        const PathStore & paths;
+        int threads;
+
+        /**
+         * slotOf[id] is the index in "entries" of the metadata of the file
+         * with PathId id, plus one. 0 for files not scanned.
+         */
+        std::vector<unsigned> slotOf;
+
+        /**
+         * the metadata of all scanned files
+         */
+        std::vector<FileMetadata> entries;
+
+        /**
+         * the files that the current scan() has to stat(), and their slots
+         */
+        std::vector<PathId>   pendingFiles;
+        std::vector<unsigned> pendingSlots;
+
+        /**
+         * the index in pendingFiles of the next file to be taken by a
+         * thread
+         */
+        size_t nextPending;
+
+        /**
+         * protects nextPending
+         */
+        pthread_mutex_t * mutex;
+    };
+}
+#endif
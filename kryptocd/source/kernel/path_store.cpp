@@ -0,0 +1,214 @@
+/*
+ * path_store.cpp: class PathStore implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "path_store.hh"
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+using KryptoCD::PathStore;
+using KryptoCD::PathSlice;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using std::string;
+using std::vector;
+
+/**
+ * the initial number of hash slots, must be a power of two
+ */
+static const size_t INITIAL_SLOTS = 64;
+
+/**
+ * the length of the first component of a path name: up to and including
+ * the first '/', or the whole rest if there is no '/'
+ */
+static size_t componentLength(const char * path, size_t length) {
+    const void * slash = memchr(path, '/', length);
+    return slash ? (static_cast<const char *>(slash) - path + 1) : length;
+}
+
+PathSlice::PathSlice(const PathList & list, size_t first_, size_t count_)
+    : first(list.empty() ? 0 : &list[0] + first_),
+      count(count_)
+{
+    assert(first_ + count_ <= list.size());
+}
+
+PathSlice::PathSlice(const PathList & list)
+    : first(list.empty() ? 0 : &list[0]),
+      count(list.size())
+{}
+
+PathStore::PathStore()
+    : slots(INITIAL_SLOTS, 0)
+{
+    nameOffsets.push_back(0);
+}
+
+unsigned PathStore::hash(PathId parent, const char * name, size_t length) {
+    unsigned h = 2166136261U ^ parent;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+size_t PathStore::getNameLength(PathId id) const {
+    return nameOffsets[id + 1] - nameOffsets[id] - 1;
+}
+
+void PathStore::rehash(size_t slotCount) {
+    slots.assign(slotCount, 0);
+    for (PathId id = 0; id < parents.size(); ++id) {
+        size_t slot = hash(parents[id], &buffer[nameOffsets[id]],
+                           getNameLength(id))
+            & (slots.size() - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slots.size() - 1);
+        }
+        slots[slot] = id + 1;
+    }
+}
+
+PathId PathStore::findComponent(PathId parent,
+                                const char * name, size_t length) const {
+    size_t slot = hash(parent, name, length) & (slots.size() - 1);
+
+    while (slots[slot] != 0) {
+        PathId id = slots[slot] - 1;
+        if ((parents[id] == parent)
+            && (getNameLength(id) == length)
+            && (memcmp(&buffer[nameOffsets[id]], name, length) == 0)) {
+            return id;
+        }
+        slot = (slot + 1) & (slots.size() - 1);
+    }
+    return KryptoCD::NO_PATH;
+}
+
+PathId PathStore::internComponent(PathId parent,
+                                  const char * name, size_t length) {
+    PathId id = findComponent(parent, name, length);
+    if (id != KryptoCD::NO_PATH) {
+        return id;
+    }
+
+    id = parents.size();
+    assert(id != KryptoCD::NO_PATH);
+    /* the offsets into the buffer are unsigned */
+    assert(length < UINT_MAX - buffer.size());
+    buffer.insert(buffer.end(), name, name + length);
+    buffer.push_back('\0');
+    nameOffsets.push_back(buffer.size());
+    parents.push_back(parent);
+    if (3 * parents.size() > 2 * slots.size()) {
+        rehash(slots.size() * 2);
+    } else {
+        size_t slot = hash(parent, name, length) & (slots.size() - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slots.size() - 1);
+        }
+        slots[slot] = id + 1;
+    }
+    return id;
+}
+
+PathId PathStore::intern(const char * path, size_t length) {
+    PathId id = KryptoCD::NO_PATH;
+    do {
+        size_t component = componentLength(path, length);
+        id = internComponent(id, path, component);
+        path += component;
+        length -= component;
+    } while (length > 0);
+    return id;
+}
+
+PathId PathStore::intern(const string & path) {
+    return intern(path.data(), path.length());
+}
+
+PathId PathStore::internChild(PathId parent,
+                              const char * name, size_t length) {
+    assert((parent == KryptoCD::NO_PATH) || isDirectory(parent));
+    assert(componentLength(name, length) == length);
+    return internComponent(parent, name, length);
+}
+
+PathId PathStore::find(const char * path, size_t length) const {
+    PathId id = KryptoCD::NO_PATH;
+    do {
+        size_t component = componentLength(path, length);
+        id = findComponent(id, path, component);
+        if (id == KryptoCD::NO_PATH) {
+            break;
+        }
+        path += component;
+        length -= component;
+    } while (length > 0);
+    return id;
+}
+
+PathId PathStore::find(const string & path) const {
+    return find(path.data(), path.length());
+}
+
+void PathStore::appendPath(PathId id, string & out) const {
+    assert(id < parents.size());
+    if (parents[id] != KryptoCD::NO_PATH) {
+        appendPath(parents[id], out);
+    }
+    out.append(&buffer[nameOffsets[id]], getNameLength(id));
+}
+
+string PathStore::getPath(PathId id) const {
+    string path;
+    path.reserve(getLength(id));
+    appendPath(id, path);
+    return path;
+}
+
+size_t PathStore::getLength(PathId id) const {
+    size_t length = 0;
+    for (; id != KryptoCD::NO_PATH; id = parents[id]) {
+        length += getNameLength(id);
+    }
+    return length;
+}
+
+PathId PathStore::getParent(PathId id) const {
+    assert(id < parents.size());
+    return parents[id];
+}
+
+bool PathStore::isDirectory(PathId id) const {
+    assert(id < parents.size());
+    return (getNameLength(id) > 0)
+        && (buffer[nameOffsets[id + 1] - 2] == '/');
+}
+
+unsigned PathStore::size(void) const {
+    return parents.size();
+}
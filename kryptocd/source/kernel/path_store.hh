@@ -0,0 +1,240 @@
+/*
+ * path_store.hh: class PathStore header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PATH_STORE_HH
+#define PATH_STORE_HH
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * a 32 bit number identifying a path name inside a PathStore
+     */
+    typedef unsigned int PathId;
+
+    /**
+     * a PathId that does not identify any path name
+     */
+    const PathId NO_PATH (~0U);
+
+    /**
+     * a list of path names. All PathIds in a list refer to the same
+     * PathStore. At 4 bytes per entry, lists are cheap to copy.
+     */
+    typedef std::vector<PathId> PathList;
+
+    /**
+     * Class PathSlice refers to a consecutive part of a PathList without
+     * copying it, e.g. to the files going into one image. The PathList must
+     * not change while the slice is in use.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class PathSlice {
+    public:
+        /**
+         * @param list  the list containing the PathIds
+         * @param first the position in list of the first PathId
+         * @param count the number of PathIds
+         */
+        PathSlice(const PathList & list, size_t first, size_t count);
+
+        /**
+         * a slice referring to a whole list
+         */
+        PathSlice(const PathList & list);
+
+        const PathId * begin(void) const {return first;}
+        const PathId * end(void) const {return first + count;}
+        size_t size(void) const {return count;}
+        bool empty(void) const {return count == 0;}
+
+    private:
+        const PathId * first;
+        size_t count;
+    };
+
+    /**
+     * Class PathStore is the one place where the kernel keeps path names.
+     * Every distinct path name gets a PathId, counting from 0 in the order
+     * of interning. PathIds never change while the store exists.
+     * <p>
+     * Path names are split into components, each component including its
+     * trailing '/': "/home/tp/file" consists of "/", "home/", "tp/" and
+     * "file". A path name is stored as its last component plus the PathId
+     * of the path name without it, so all files in a directory share the
+     * directory's prefix, and interning a path name also interns all its
+     * prefixes. The components are stored NUL separated in one contiguous
+     * buffer, and are found through an open addressing hash table on
+     * (parent PathId, component). Each distinct path name costs about 16
+     * bytes plus the length of its last component.
+     * <p>
+     * The component split reproduces every string exactly, so bad
+     * filenames (relative ones, or ones containing "//") can be stored and
+     * checked like any others.
+     * <p>
+     * A PathStore is not thread safe. Any number of threads may read it
+     * concurrently as long as nobody interns new path names.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class PathStore {
+    public:
+        PathStore();
+
+        /**
+         * adds a path name to the store, unless it is already there
+         *
+         * @param path   the path name, need not be NUL terminated
+         * @param length the length of the path name
+         * @return       the PathId of the path name
+         */
+        PathId intern(const char * path, size_t length);
+        PathId intern(const std::string & path);
+
+        /**
+         * adds a path name given as an already stored path name plus one
+         * more component. Faster than intern() when walking a directory
+         * tree.
+         *
+         * @param parent the PathId of a directory name (ending with '/'),
+         *               or NO_PATH
+         * @param name   the component; it must not contain '/', except as
+         *               its last character for directories
+         * @param length the length of the component
+         * @return       the PathId of the complete path name
+         */
+        PathId internChild(PathId parent, const char * name, size_t length);
+
+        /**
+         * looks up a path name. Allocates no memory.
+         *
+         * @param path   the path name, need not be NUL terminated
+         * @param length the length of the path name
+         * @return       the PathId of the path name, or NO_PATH if it has
+         *               never been interned
+         */
+        PathId find(const char * path, size_t length) const;
+        PathId find(const std::string & path) const;
+
+        /**
+         * appends a path name to a string. Reusing the same string for many
+         * path names avoids allocating memory for each of them.
+         *
+         * @param id  a PathId of this store
+         * @param out the path name is appended here
+         */
+        void appendPath(PathId id, std::string & out) const;
+
+        /**
+         * @param id a PathId of this store
+         * @return   the path name
+         */
+        std::string getPath(PathId id) const;
+
+        /**
+         * @param id a PathId of this store
+         * @return   the length of the path name
+         */
+        size_t getLength(PathId id) const;
+
+        /**
+         * @param id a PathId of this store
+         * @return   the PathId of the path name without its last component,
+         *           or NO_PATH if it consists of just one component
+         */
+        PathId getParent(PathId id) const;
+
+        /**
+         * @param id a PathId of this store
+         * @return   true if the path name ends with '/'
+         */
+        bool isDirectory(PathId id) const;
+
+        /**
+         * @return the number of distinct path names, including prefixes,
+         *         in this store
+         */
+        unsigned size(void) const;
+
+    private:
+        /**
+         * hash of a (parent, component) pair
+         */
+        static unsigned hash(PathId parent, const char * name, size_t length);
+
+        /**
+         * @return the PathId of the (parent, component) pair, or NO_PATH
+         */
+        PathId findComponent(PathId parent,
+                             const char * name, size_t length) const;
+
+        /**
+         * @return the PathId of the (parent, component) pair, which is
+         *         added if necessary
+         */
+        PathId internComponent(PathId parent,
+                               const char * name, size_t length);
+
+        /**
+         * the length of a component
+         */
+        size_t getNameLength(PathId id) const;
+
+        /**
+         * changes the number of hash slots and reinserts all entries
+         *
+         * @param slotCount the new number of slots, a power of two
+         */
+        void rehash(size_t slotCount);
+
+        /**
+         * all components, each followed by a NUL character
+         */
+        std::vector<char> buffer;
+
+        /**
+         * nameOffsets[i] is the start of the last component of path i in
+         * buffer. There is one additional element, the end of the buffer.
+         */
+        std::vector<unsigned> nameOffsets;
+
+        /**
+         * parents[i] is the PathId of path i without its last component
+         */
+        std::vector<PathId> parents;
+
+        /**
+         * the hash table. Each slot contains a PathId plus one, or 0 if it
+         * is empty. The number of slots is a power of two, and at most
+         * two thirds of them are used.
+         */
+        std::vector<unsigned> slots;
+    };
+}
+#endif
@@ -0,0 +1,440 @@
+/*
+ * pgp_decrypter.cpp: class PgpDecrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "pgp_decrypter.hh"
+#include "pgp_encrypter.hh"
+#include "aes.hh"
+#include "key_cache.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::PgpDecrypter;
+using KryptoCD::PgpEncrypter;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using KryptoCD::Aes;
+using KryptoCD::Sha1;
+using KryptoCD::KeyCache;
+using std::string;
+using std::vector;
+
+/**
+ * the OpenPGP packet tags
+ */
+static const unsigned TAG_SKESK   = 3;
+static const unsigned TAG_LITERAL = 11;
+static const unsigned TAG_SEIPD   = 18;
+static const unsigned TAG_MDC     = 19;
+
+/**
+ * the OpenPGP algorithm numbers
+ */
+static const unsigned char CIPHER_AES128 = 7;
+static const unsigned char CIPHER_AES256 = 9;
+static const unsigned char HASH_SHA1 = 2;
+static const unsigned char S2K_ITERATED_SALTED = 3;
+
+/**
+ * the longest session key packet: the parameters, and an encrypted
+ * algorithm number and AES-256 key
+ */
+static const size_t MAX_SKESK_LENGTH = 13 + 1 + KeyCache::KEY_LENGTH;
+
+/**
+ * @return the key length of an AES cipher algorithm number, or 0
+ */
+static size_t keyLength(unsigned char algorithm) {
+    if ((algorithm < CIPHER_AES128) || (algorithm > CIPHER_AES256)) {
+        return 0;
+    }
+    return 16 + 8 * (algorithm - CIPHER_AES128);
+}
+
+PgpDecrypter::PgpDecrypter(const string & password_,
+                           Source & source,
+                           Sink & sink,
+                           long long plainStart,
+                           long long plainEnd)
+    : Decrypter(plainStart, plainEnd),
+      password(password_),
+      position(0),
+      aes(0),
+      hashing(true),
+      feedbackPosition(Aes::BLOCK_SIZE),
+      input(PgpEncrypter::PARTIAL_LENGTH),
+      inputPosition(0),
+      inputLength(0)
+{
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    sinkFd = dup(sink.getSinkFd());
+    sink.closeSink();
+
+    int success = start();
+    assert(success == 0);
+}
+
+PgpDecrypter::~PgpDecrypter() {
+    join();
+    delete aes;
+    KeyCache::wipe(&password[0], password.size());
+}
+
+void * PgpDecrypter::run(void) {
+    /*
+     * if the reader of the plain data has exited, write() has to fail
+     * with EPIPE instead of the whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    bool success = true;
+    unsigned tag;
+
+    /* the session key packet comes first, other packets are skipped */
+    Body packet;
+    packet.inner = false;
+    while (success && (aes == 0)) {
+        success = readHeader(packet, tag);
+        if (!success) {
+            break;
+        }
+        if (tag == TAG_SKESK) {
+            success = readSessionKey(packet);
+        } else if ((tag == TAG_SEIPD) || packet.partial) {
+            success = false;
+        } else {
+            unsigned char skipped[256];
+            while (success && (packet.remaining > 0)) {
+                size_t count = packet.remaining;
+                if (count > sizeof(skipped)) {
+                    count = sizeof(skipped);
+                }
+                success = readBody(packet, skipped, count);
+            }
+        }
+    }
+
+    /* the encrypted packet, and its version */
+    encrypted.inner = false;
+    unsigned char version;
+    success = success
+        && readHeader(encrypted, tag) && (tag == TAG_SEIPD)
+        && readBody(encrypted, &version, 1) && (version == 1);
+
+    /*
+     * the random prefix, whose last two bytes are repeated. If they
+     * differ, the passphrase is wrong.
+     */
+    unsigned char prefix[Aes::BLOCK_SIZE + 2];
+    memset(feedback, 0, sizeof(feedback));
+    success = success
+        && decrypt(prefix, sizeof(prefix))
+        && (prefix[Aes::BLOCK_SIZE] == prefix[Aes::BLOCK_SIZE - 2])
+        && (prefix[Aes::BLOCK_SIZE + 1] == prefix[Aes::BLOCK_SIZE - 1]);
+
+    success = success && readLiteral();
+
+    /*
+     * the modification detection code covers everything before its own
+     * value, including the header of its packet
+     */
+    unsigned char mdcHeader[2];
+    success = success
+        && decrypt(mdcHeader, sizeof(mdcHeader))
+        && (mdcHeader[0] == (0xc0 | TAG_MDC))
+        && (mdcHeader[1] == Sha1::DIGEST_LENGTH);
+    if (success) {
+        unsigned char expected[Sha1::DIGEST_LENGTH];
+        unsigned char digest[Sha1::DIGEST_LENGTH];
+        mdc.digest(expected);
+        hashing = false;
+        success = decrypt(digest, sizeof(digest))
+            && (memcmp(digest, expected, sizeof(digest)) == 0)
+            && (encrypted.remaining == 0) && !encrypted.partial;
+    }
+
+    if (!success) {
+        failed = true;
+    }
+    close(sourceFd);
+    if (sinkFd >= 0) {
+        close(sinkFd);
+    }
+    return this;
+}
+
+bool PgpDecrypter::readHeader(Body & body, unsigned & tag) {
+    unsigned char header;
+    if (!read(body.inner, &header, 1) || ((header & 0x80) == 0)) {
+        return false;
+    }
+    body.partial = false;
+    if (header & 0x40) {
+        /* new format */
+        tag = header & 0x3f;
+        return readLength(body);
+    }
+
+    /* old format: the length of the length is in the header */
+    tag = (header >> 2) & 0xf;
+    size_t lengthLength = 1 << (header & 3);
+    if (lengthLength > 4) {
+        /* indeterminate length */
+        return false;
+    }
+    unsigned char length[4];
+    if (!read(body.inner, length, lengthLength)) {
+        return false;
+    }
+    body.remaining = 0;
+    for (size_t i = 0; i < lengthLength; ++i) {
+        body.remaining = (body.remaining << 8) | length[i];
+    }
+    return true;
+}
+
+bool PgpDecrypter::readLength(Body & body) {
+    unsigned char length[4];
+    if (!read(body.inner, length, 1)) {
+        return false;
+    }
+    body.partial = false;
+    if (length[0] < 192) {
+        body.remaining = length[0];
+    } else if (length[0] < 224) {
+        if (!read(body.inner, length + 1, 1)) {
+            return false;
+        }
+        body.remaining = ((length[0] - 192) << 8) + length[1] + 192;
+    } else if (length[0] < 255) {
+        body.remaining = size_t(1) << (length[0] & 0x1f);
+        body.partial = true;
+    } else {
+        if (!read(body.inner, length, 4)) {
+            return false;
+        }
+        body.remaining = (size_t(length[0]) << 24) | (length[1] << 16)
+            | (length[2] << 8) | length[3];
+    }
+    return true;
+}
+
+bool PgpDecrypter::readBody(Body & body,
+                            unsigned char * data, size_t length) {
+    while (length > 0) {
+        if (body.remaining == 0) {
+            if (!body.partial || !readLength(body)) {
+                return false;
+            }
+            continue;
+        }
+        size_t count = body.remaining;
+        if (count > length) {
+            count = length;
+        }
+        if (!read(body.inner, data, count)) {
+            return false;
+        }
+        body.remaining -= count;
+        data += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool PgpDecrypter::read(bool inner, unsigned char * data, size_t length) {
+    return inner ? decrypt(data, length) : readInput(data, length);
+}
+
+bool PgpDecrypter::readSessionKey(Body & packet) {
+    unsigned char skesk[MAX_SKESK_LENGTH];
+    size_t length = packet.remaining;
+    if (packet.partial || (length < 13) || (length > sizeof(skesk))
+        || !readBody(packet, skesk, length)) {
+        return false;
+    }
+    size_t s2kKeyLength = keyLength(skesk[1]);
+    if ((skesk[0] != 4) || (s2kKeyLength == 0)
+        || (skesk[2] != S2K_ITERATED_SALTED) || (skesk[3] != HASH_SHA1)) {
+        return false;
+    }
+    const unsigned char * salt = skesk + 4;
+    unsigned char count = skesk[4 + KeyCache::SALT_LENGTH];
+
+    /*
+     * shorter S2K keys are the beginning of longer ones, so the cached
+     * key serves all AES key lengths
+     */
+    unsigned char key[1 + KeyCache::KEY_LENGTH];
+    try {
+        const KeyCache & cache = KeyCache::get(password);
+        if ((count == KeyCache::S2K_COUNT)
+            && (memcmp(salt, cache.getSalt(), KeyCache::SALT_LENGTH) == 0)) {
+            memcpy(key, cache.getKey(), s2kKeyLength);
+        } else {
+            KeyCache::deriveKey(password, salt, count, key, s2kKeyLength);
+        }
+    } catch (KeyCache::Exception &) {
+        return false;
+    }
+
+    size_t sessionKeyLength = s2kKeyLength;
+    if (length > 13) {
+        /* an encrypted session key, preceded by its algorithm number */
+        size_t encryptedLength = length - 13;
+        Aes(key, s2kKeyLength).cfbDecrypt(skesk + 13, encryptedLength);
+        sessionKeyLength = keyLength(skesk[13]);
+        if (sessionKeyLength != encryptedLength - 1) {
+            KeyCache::wipe(key, sizeof(key));
+            KeyCache::wipe(skesk, sizeof(skesk));
+            return false;
+        }
+        memcpy(key, skesk + 14, sessionKeyLength);
+    }
+    aes = new Aes(key, sessionKeyLength);
+    KeyCache::wipe(key, sizeof(key));
+    KeyCache::wipe(skesk, sizeof(skesk));
+    return true;
+}
+
+bool PgpDecrypter::decrypt(unsigned char * data, size_t length) {
+    if (!readBody(encrypted, data, length)) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (feedbackPosition == Aes::BLOCK_SIZE) {
+            aes->encryptBlock(feedback, keyStream);
+            feedbackPosition = 0;
+        }
+        feedback[feedbackPosition] = data[i];
+        data[i] ^= keyStream[feedbackPosition++];
+    }
+    if (hashing) {
+        mdc.update(data, length);
+    }
+    return true;
+}
+
+bool PgpDecrypter::readLiteral(void) {
+    Body literal;
+    literal.inner = true;
+    unsigned tag;
+    unsigned char header[2];
+    if (!readHeader(literal, tag) || (tag != TAG_LITERAL)
+        || !readBody(literal, header, sizeof(header))) {
+        return false;
+    }
+
+    /* the format, the file name, and the date are not used */
+    unsigned char skipped[255 + 4];
+    if (!readBody(literal, skipped, header[1] + 4)) {
+        return false;
+    }
+
+    vector<unsigned char> data(PgpEncrypter::PARTIAL_LENGTH);
+    while (true) {
+        if (literal.remaining == 0) {
+            if (!literal.partial) {
+                return true;
+            }
+            if (!readLength(literal)) {
+                return false;
+            }
+            continue;
+        }
+        size_t count = literal.remaining;
+        if (count > data.size()) {
+            count = data.size();
+        }
+        if (!readBody(literal, &data[0], count)
+            || !writeOutput(&data[0], count)) {
+            return false;
+        }
+    }
+}
+
+bool PgpDecrypter::readInput(unsigned char * data, size_t length) {
+    while (length > 0) {
+        if (inputPosition == inputLength) {
+            ssize_t count = ::read(sourceFd, &input[0], input.size());
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (count == 0) {
+                return false;
+            }
+            inputPosition = 0;
+            inputLength = count;
+        }
+        size_t count = inputLength - inputPosition;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(data, &input[inputPosition], count);
+        inputPosition += count;
+        data += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool PgpDecrypter::writeOutput(const unsigned char * data, size_t length) {
+    if (sinkFd < 0) {
+        /* after the range */
+        position += length;
+        return true;
+    }
+    size_t skip;
+    size_t count = clip(position, length, skip);
+    position += length;
+    data += skip;
+    while (count > 0) {
+        ssize_t written = write(sinkFd, data, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        count -= written;
+    }
+    if ((rangeEnd >= 0) && (position >= (unsigned long long) rangeEnd)) {
+        close(sinkFd);
+        sinkFd = -1;
+    }
+    return true;
+}
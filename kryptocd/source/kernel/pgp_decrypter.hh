@@ -0,0 +1,199 @@
+/*
+ * pgp_decrypter.hh: class PgpDecrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef PGP_DECRYPTER_HH
+#define PGP_DECRYPTER_HH
+
+#include "decrypter.hh"
+#include "sha1.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+    class Aes;
+
+    /**
+     * Class PgpDecrypter decrypts what PgpEncrypter encrypted, in a thread
+     * instead of a "gpg --decrypt" child process. It reads the OpenPGP
+     * packets of RFC 4880 that PgpEncrypter writes: a symmetric-key
+     * encrypted session key packet with AES and the iterated and salted
+     * SHA-1 S2K function, and a symmetrically encrypted integrity
+     * protected data packet containing a literal data packet and a
+     * modification detection code packet. Compressed packets, as gpg
+     * writes them by default, are not understood.
+     * <p>
+     * If the salt and count of the stream are those of the passphrase's
+     * KeyCache, the cached key is used, so listing the archives of this
+     * backup does not run the S2K function again.
+     * <p>
+     * The plain data is written to the Sink while it is decrypted, before
+     * the modification detection code at the end of the stream has been
+     * checked. exitedAbnormally() tells whether it matched.
+     * <p>
+     * For a range of the plain data, the stream is still decrypted from
+     * its beginning, because CFB mode and the modification detection code
+     * are sequential, but only the range is written. The Sink is closed
+     * at the end of the range, so its reader need not wait for the
+     * remaining stream to be checked.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class PgpDecrypter : public Decrypter {
+    public:
+        /**
+         * starts the decrypting thread. Like a ChildFilter, the object
+         * takes over the file descriptors of source and sink, and closes
+         * them in the caller's view.
+         *
+         * @param password the passphrase
+         * @param source   the encrypted data are read from here
+         * @param sink     the plain data are written here
+         * @param start    the offset of the first plain byte to write
+         * @param end      the offset after the last plain byte to write,
+         *                 or -1 for the end of the stream
+         */
+        PgpDecrypter(const std::string & password,
+                     Source & source,
+                     Sink & sink,
+                     long long start = 0,
+                     long long end = -1);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~PgpDecrypter();
+
+    protected:
+        /**
+         * reads, decrypts and writes the stream
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * the body of a packet whose length is known chunk by chunk
+         */
+        struct Body {
+            /**
+             * true for packets inside the encrypted packet
+             */
+            bool inner;
+            size_t remaining;
+            bool partial;
+        };
+
+        /**
+         * reads a packet header, and the length of its first chunk
+         *
+         * @return false at the end of the input, or if the header is
+         *         broken
+         */
+        bool readHeader(Body & body, unsigned & tag);
+
+        /**
+         * reads the length of the next chunk of a packet, in the new format
+         */
+        bool readLength(Body & body);
+
+        /**
+         * reads from a packet's body
+         *
+         * @return false if the packet ends before length bytes have been
+         *         read
+         */
+        bool readBody(Body & body, unsigned char * data, size_t length);
+
+        /**
+         * reads from the input, or from the decrypted data
+         */
+        bool read(bool inner, unsigned char * data, size_t length);
+
+        /**
+         * reads the session key packet, and prepares the cipher
+         */
+        bool readSessionKey(Body & packet);
+
+        /**
+         * reads and decrypts the next bytes of the encrypted packet, and
+         * adds them to the modification detection code if hashing is set
+         */
+        bool decrypt(unsigned char * data, size_t length);
+
+        /**
+         * reads the literal packet inside the encrypted packet, and
+         * writes its contents
+         */
+        bool readLiteral(void);
+
+        /**
+         * reads exactly length bytes from the input file descriptor
+         */
+        bool readInput(unsigned char * data, size_t length);
+
+        /**
+         * writes the part of the plain data that is in the range to the
+         * output file descriptor, and closes it after the range
+         */
+        bool writeOutput(const unsigned char * data, size_t length);
+
+        std::string password;
+        int sourceFd;
+
+        /**
+         * -1 after the end of the range
+         */
+        int sinkFd;
+
+        /**
+         * the number of plain bytes decrypted
+         */
+        unsigned long long position;
+
+        Aes * aes;
+        Sha1 mdc;
+        bool hashing;
+
+        /**
+         * the encrypted packet
+         */
+        Body encrypted;
+
+        /**
+         * the CFB feedback register: the last ciphertext block, and the
+         * key stream computed from it
+         */
+        unsigned char feedback[16];
+        unsigned char keyStream[16];
+        unsigned feedbackPosition;
+
+        std::vector<unsigned char> input;
+        size_t inputPosition;
+        size_t inputLength;
+    };
+}
+#endif
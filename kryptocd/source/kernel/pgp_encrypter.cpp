@@ -0,0 +1,322 @@
+/*
+ * pgp_encrypter.cpp: class PgpEncrypter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "pgp_encrypter.hh"
+#include "aes.hh"
+#include "key_cache.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::PgpEncrypter;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using KryptoCD::Aes;
+using KryptoCD::Sha1;
+using KryptoCD::KeyCache;
+using std::string;
+using std::vector;
+
+/**
+ * the OpenPGP packet tags, in the new packet format
+ */
+static const unsigned char TAG_SKESK   = 0xc0 | 3;
+static const unsigned char TAG_LITERAL = 0xc0 | 11;
+static const unsigned char TAG_SEIPD   = 0xc0 | 18;
+static const unsigned char TAG_MDC     = 0xc0 | 19;
+
+/**
+ * the length octet of a partial body chunk of PARTIAL_LENGTH bytes
+ */
+static const unsigned char PARTIAL_CHUNK = 0xe0 | 16;
+
+/**
+ * the OpenPGP algorithm numbers
+ */
+static const unsigned char CIPHER_AES256 = 9;
+static const unsigned char HASH_SHA1 = 2;
+static const unsigned char S2K_ITERATED_SALTED = 3;
+
+
+/**
+ * writes a packet body length in the new format
+ *
+ * @return the number of length octets, at most 5
+ */
+static size_t encodeLength(size_t length, unsigned char * out) {
+    if (length < 192) {
+        out[0] = length;
+        return 1;
+    }
+    if (length < 8384) {
+        out[0] = ((length - 192) >> 8) + 192;
+        out[1] = (length - 192) & 0xff;
+        return 2;
+    }
+    out[0] = 0xff;
+    out[1] = length >> 24;
+    out[2] = length >> 16;
+    out[3] = length >> 8;
+    out[4] = length;
+    return 5;
+}
+
+/**
+ * @return the number of octets encodeLength() writes for a length
+ */
+static long long lengthOctets(long long length) {
+    return (length < 192) ? 1 : ((length < 8384) ? 2 : 5);
+}
+
+long long PgpEncrypter::encryptedSize(long long plainSize) {
+    /*
+     * the literal packet: its tag, then the body of 6 header bytes and
+     * the data in full chunks, and a last chunk, which is empty if the
+     * body fills the full chunks exactly
+     */
+    long long literalBody = 6 + plainSize;
+    long long literalRest = literalBody % PARTIAL_LENGTH;
+    long long literal = 1 + (literalBody / PARTIAL_LENGTH)
+        * (1 + PARTIAL_LENGTH) + lengthOctets(literalRest) + literalRest;
+
+    /*
+     * the encrypted packet's body: the version, the prefix, the literal
+     * packet and the MDC packet. A full chunk is only written when more
+     * bytes follow, so the last chunk is never empty.
+     */
+    long long body = 1 + (Aes::BLOCK_SIZE + 2) + literal
+        + (2 + Sha1::DIGEST_LENGTH);
+    long long fullChunks = (body - 1) / PARTIAL_LENGTH;
+    long long bodyRest = body - fullChunks * PARTIAL_LENGTH;
+
+    /*
+     * the SKESK: tag, length, version, cipher, S2K type and hash, salt,
+     * count, and the encrypted session key. Then the encrypted packet's
+     * tag.
+     */
+    return (6 + KeyCache::SALT_LENGTH + 1 + 1 + KeyCache::KEY_LENGTH) + 1
+        + fullChunks * (1 + PARTIAL_LENGTH) + lengthOctets(bodyRest)
+        + bodyRest;
+}
+
+PgpEncrypter::PgpEncrypter(const string & password_,
+                           Source & source,
+                           Sink & sink)
+    : password(password_),
+      aes(0),
+      feedbackPosition(Aes::BLOCK_SIZE),
+      body(PARTIAL_LENGTH),
+      bodyLength(0)
+{
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    sinkFd = dup(sink.getSinkFd());
+    sink.closeSink();
+
+    int success = start();
+    assert(success == 0);
+}
+
+PgpEncrypter::~PgpEncrypter() {
+    join();
+    delete aes;
+    KeyCache::wipe(&password[0], password.size());
+}
+
+void * PgpEncrypter::run(void) {
+    /*
+     * if the reader of the encrypted data has exited, write() has to fail
+     * with EPIPE instead of the whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    const KeyCache * cache = 0;
+    try {
+        cache = &KeyCache::get(password);
+    } catch (KeyCache::Exception &) {
+        failed = true;
+    }
+
+    /*
+     * the session key, preceded by its algorithm number, is encrypted
+     * with the cached key. Each stream gets a fresh one.
+     */
+    unsigned char sessionKey[1 + KeyCache::KEY_LENGTH];
+    unsigned char prefix[Aes::BLOCK_SIZE + 2];
+    sessionKey[0] = CIPHER_AES256;
+    if ((cache == 0)
+        || !KeyCache::readRandom(sessionKey + 1, KeyCache::KEY_LENGTH)
+        || !KeyCache::readRandom(prefix, Aes::BLOCK_SIZE)) {
+        failed = true;
+    } else {
+        aes = new Aes(sessionKey + 1, KeyCache::KEY_LENGTH);
+
+        unsigned char skesk[] = {TAG_SKESK, 13 + sizeof(sessionKey), 4,
+                                 CIPHER_AES256,
+                                 S2K_ITERATED_SALTED, HASH_SHA1,
+                                 0, 0, 0, 0, 0, 0, 0, 0,
+                                 KeyCache::S2K_COUNT};
+        memcpy(skesk + 6, cache->getSalt(), KeyCache::SALT_LENGTH);
+        Aes(cache->getKey(), KeyCache::KEY_LENGTH)
+            .cfbEncrypt(sessionKey, sizeof(sessionKey));
+
+        /*
+         * the encrypted packet's version, and the random prefix with its
+         * last two bytes repeated, which is encrypted with an IV of zeros
+         */
+        body[bodyLength++] = 1;
+        memset(feedback, 0, sizeof(feedback));
+        prefix[Aes::BLOCK_SIZE] = prefix[Aes::BLOCK_SIZE - 2];
+        prefix[Aes::BLOCK_SIZE + 1] = prefix[Aes::BLOCK_SIZE - 1];
+
+        /* the literal packet: binary, no file name, no date */
+        unsigned char literalHeader[] = {TAG_LITERAL};
+        vector<unsigned char> literal(PARTIAL_LENGTH);
+        size_t literalLength = 0;
+        literal[literalLength++] = 'b';
+        literal[literalLength++] = 0;
+        literal[literalLength++] = 0;
+        literal[literalLength++] = 0;
+        literal[literalLength++] = 0;
+        literal[literalLength++] = 0;
+
+        bool success = writeOutput(skesk, sizeof(skesk))
+            && writeOutput(sessionKey, sizeof(sessionKey))
+            && writeOutput(&TAG_SEIPD, 1)
+            && encrypt(prefix, sizeof(prefix))
+            && encrypt(literalHeader, sizeof(literalHeader));
+        while (success) {
+            if (literalLength == PARTIAL_LENGTH) {
+                success = encrypt(&PARTIAL_CHUNK, 1)
+                    && encrypt(&literal[0], literalLength);
+                literalLength = 0;
+                continue;
+            }
+            ssize_t count = read(sourceFd, &literal[literalLength],
+                                 PARTIAL_LENGTH - literalLength);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                failed = true;
+                success = false;
+            } else if (count == 0) {
+                break;
+            } else {
+                literalLength += count;
+            }
+        }
+
+        if (success) {
+            unsigned char length[5];
+            unsigned char mdcHeader[] = {TAG_MDC, Sha1::DIGEST_LENGTH};
+            unsigned char digest[Sha1::DIGEST_LENGTH];
+            success = encrypt(length, encodeLength(literalLength, length))
+                && encrypt(&literal[0], literalLength)
+                && encrypt(mdcHeader, sizeof(mdcHeader));
+            if (success) {
+                mdc.digest(digest);
+                success = cipher(digest, sizeof(digest))
+                    && writeLastChunk();
+            }
+        }
+        KeyCache::wipe(&literal[0], literal.size());
+    }
+    close(sourceFd);
+    close(sinkFd);
+    return this;
+}
+
+bool PgpEncrypter::encrypt(const unsigned char * data, size_t length) {
+    mdc.update(data, length);
+    return cipher(data, length);
+}
+
+bool PgpEncrypter::cipher(const unsigned char * data, size_t length) {
+    while (length > 0) {
+        if ((bodyLength == PARTIAL_LENGTH) && !writeChunk()) {
+            return false;
+        }
+        if (feedbackPosition == Aes::BLOCK_SIZE) {
+            aes->encryptBlock(feedback, keyStream);
+            feedbackPosition = 0;
+        }
+        size_t count = Aes::BLOCK_SIZE - feedbackPosition;
+        if (count > length) {
+            count = length;
+        }
+        if (count > PARTIAL_LENGTH - bodyLength) {
+            count = PARTIAL_LENGTH - bodyLength;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char c = data[i] ^ keyStream[feedbackPosition + i];
+            feedback[feedbackPosition + i] = c;
+            body[bodyLength + i] = c;
+        }
+        feedbackPosition += count;
+        bodyLength += count;
+        data += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool PgpEncrypter::writeChunk(void) {
+    bool success = writeOutput(&PARTIAL_CHUNK, 1)
+        && writeOutput(&body[0], bodyLength);
+    bodyLength = 0;
+    return success;
+}
+
+bool PgpEncrypter::writeLastChunk(void) {
+    unsigned char length[5];
+    bool success = writeOutput(length, encodeLength(bodyLength, length))
+        && writeOutput(&body[0], bodyLength);
+    bodyLength = 0;
+    return success;
+}
+
+bool PgpEncrypter::writeOutput(const unsigned char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(sinkFd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
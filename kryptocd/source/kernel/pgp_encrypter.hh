@@ -0,0 +1,153 @@
+/*
+ * pgp_encrypter.hh: class PgpEncrypter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef PGP_ENCRYPTER_HH
+#define PGP_ENCRYPTER_HH
+
+#include "encrypter.hh"
+#include "sha1.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+    class Aes;
+
+    /**
+     * Class PgpEncrypter encrypts a stream with a passphrase, in the
+     * OpenPGP format of RFC 4880 that "gpg --decrypt" reads. It replaces
+     * a "gpg --symmetric" child process: a thread reads the plain data
+     * from a Source and writes the encrypted data to a Sink, so no
+     * process is started, and the passphrase does not travel through a
+     * pipe.
+     * <p>
+     * The output consists of a symmetric-key encrypted session key packet
+     * and a symmetrically encrypted integrity protected data packet. The
+     * first holds the salt and count of the passphrase's key in the
+     * KeyCache, and a random AES-256 session key for this stream,
+     * encrypted with the cached key. The data is encrypted with the
+     * session key, so the expensive S2K function runs once per backup,
+     * but no two streams share a key. Inside the
+     * encryption, there are a literal data packet with the plain data, and
+     * a modification detection code packet with the SHA-1 hash of
+     * everything before it. Both streams are of unknown length, so they
+     * are split into partial body chunks of PARTIAL_LENGTH bytes.
+     * <p>
+     * Unlike gpg, the data is not compressed, since it has been compressed
+     * by bzip2 already.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class PgpEncrypter : public Encrypter {
+    public:
+        /**
+         * the length of a partial body chunk, a power of two
+         */
+        static const unsigned PARTIAL_LENGTH = 64 * 1024;
+
+        /**
+         * starts the encrypting thread. Like a ChildFilter, the object
+         * takes over the file descriptors of source and sink, and closes
+         * them in the caller's view.
+         *
+         * @param password the passphrase
+         * @param source   the plain data are read from here
+         * @param sink     the encrypted data are written here
+         */
+        PgpEncrypter(const std::string & password,
+                     Source & source,
+                     Sink & sink);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~PgpEncrypter();
+
+        /**
+         * @return the number of bytes written for plainSize plain bytes,
+         *         see Encrypter::encryptedSize()
+         */
+        static long long encryptedSize(long long plainSize);
+
+    protected:
+        /**
+         * reads, encrypts and writes the stream
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * hashes and encrypts the next plain bytes of the encrypted packet
+         *
+         * @return false if the output could not be written
+         */
+        bool encrypt(const unsigned char * data, size_t length);
+
+        /**
+         * encrypts the next bytes in CFB mode, without hashing them, and
+         * appends them to the encrypted packet's body, writing each full
+         * chunk
+         *
+         * @return false if the output could not be written
+         */
+        bool cipher(const unsigned char * data, size_t length);
+
+        /**
+         * writes a full chunk of the encrypted packet's body
+         */
+        bool writeChunk(void);
+
+        /**
+         * writes the last chunk of the encrypted packet's body
+         */
+        bool writeLastChunk(void);
+
+        /**
+         * writes to the output file descriptor
+         */
+        bool writeOutput(const unsigned char * data, size_t length);
+
+        std::string password;
+        int sourceFd;
+        int sinkFd;
+
+        Aes * aes;
+        Sha1 mdc;
+
+        /**
+         * the CFB feedback register: the last ciphertext block, and the
+         * key stream computed from it
+         */
+        unsigned char feedback[16];
+        unsigned char keyStream[16];
+        unsigned feedbackPosition;
+
+        std::vector<unsigned char> body;
+        size_t bodyLength;
+    };
+}
+#endif
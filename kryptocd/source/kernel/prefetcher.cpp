@@ -0,0 +1,223 @@
+/*
+ * prefetcher.cpp: class Prefetcher implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "prefetcher.hh"
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <algorithm>
+
+using KryptoCD::Prefetcher;
+using KryptoCD::PathStore;
+using KryptoCD::PathSlice;
+using KryptoCD::PathId;
+using std::string;
+using std::vector;
+
+const long long Prefetcher::DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+/**
+ * how often the reader's progress is checked, in milliseconds
+ */
+static const int POLL_INTERVAL = 20;
+
+/**
+ * reads a number following a label like "rchar: " in a /proc file
+ *
+ * @return -1 if the file or the label is not there
+ */
+static long long readProcNumber(const char * filename, const char * label) {
+    FILE * file = fopen(filename, "r");
+    if (file == 0) {
+        return -1;
+    }
+    long long result = -1;
+    char line[256];
+    size_t labelLength = strlen(label);
+    while (fgets(line, sizeof(line), file) != 0) {
+        if (strncmp(line, label, labelLength) == 0) {
+            long long value;
+            if (sscanf(line + labelLength, "%lld", &value) == 1) {
+                result = value;
+            }
+            break;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+Prefetcher::Prefetcher(const PathStore & paths_,
+                       const PathSlice & files_,
+                       pid_t reader_,
+                       int maxFiles_,
+                       long long maxBytes_)
+    : paths(paths_),
+      files(files_),
+      reader(reader_),
+      maxFiles(maxFiles_),
+      maxBytes(maxBytes_),
+      stopping(false),
+      wakeup(new pthread_cond_t),
+      readerPosition(0)
+{
+    assert(maxFiles > 0);
+    pthread_cond_init(wakeup, 0);
+    int success = start();
+    assert(success == 0);
+}
+
+Prefetcher::~Prefetcher() {
+    pthread_mutex_lock(mutex);
+    stopping = true;
+    pthread_cond_signal(wakeup);
+    pthread_mutex_unlock(mutex);
+    join();
+    int destroyVal = pthread_cond_destroy(wakeup);
+    assert(destroyVal == 0);
+    delete wakeup;
+}
+
+void Prefetcher::readerAt(size_t position) {
+    pthread_mutex_lock(mutex);
+    readerPosition = position;
+    pthread_cond_signal(wakeup);
+    pthread_mutex_unlock(mutex);
+}
+
+long long Prefetcher::getReaderBytes(void) const {
+    char filename[64];
+    sprintf(filename, "/proc/%ld/io", static_cast<long>(reader));
+    return readProcNumber(filename, "rchar:");
+}
+
+long long Prefetcher::getWindowBytes(void) const {
+    /*
+     * Leave at least half of the memory that is available for the page
+     * cache to others.
+     */
+    long long available = readProcNumber("/proc/meminfo", "MemAvailable:");
+    if (available >= 0) {
+        available *= 1024;
+    } else {
+        available = static_cast<long long>(sysconf(_SC_AVPHYS_PAGES))
+            * sysconf(_SC_PAGESIZE);
+    }
+    if (available / 2 < maxBytes) {
+        return available / 2;
+    }
+    return maxBytes;
+}
+
+long long Prefetcher::prefetch(PathId file, long long length) const {
+    if (paths.isDirectory(file)) {
+        return 0;
+    }
+    string name = paths.getPath(file);
+    int fd = open(name.c_str(), O_RDONLY|O_NONBLOCK);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    long long size = 0;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+        size = st.st_size;
+        if (length > size) {
+            length = size;
+        }
+        if (length > 0) {
+            posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+        }
+    }
+    close(fd);
+    return size;
+}
+
+void * Prefetcher::run(void) {
+    /* ends[i] is the number of bytes in files 0 to i */
+    vector<long long> ends;
+    long long requested = 0;
+    bool progressKnown = true;
+
+    pthread_mutex_lock(mutex);
+    while (!stopping && (ends.size() < files.size())) {
+        size_t position = readerPosition;
+        pthread_mutex_unlock(mutex);
+
+        long long done = 0;
+        if (reader != 0) {
+            done = getReaderBytes();
+            if (done < 0) {
+                if (!ends.empty()) {
+                    /* the reader has exited, or never told us anything */
+                    pthread_mutex_lock(mutex);
+                    break;
+                }
+                progressKnown = false;
+                done = 0;
+            }
+            /* the reader is at the first file it has not read completely */
+            position = std::upper_bound(ends.begin(), ends.end(), done)
+                - ends.begin();
+        } else {
+            /* skip the files the reader has passed already */
+            while (ends.size() < position) {
+                ends.push_back(requested);
+            }
+            if (position > 0) {
+                done = ends[position - 1];
+            }
+        }
+        long long window = getWindowBytes();
+        while ((ends.size() < files.size())
+               && (ends.size() < position + maxFiles)
+               && (requested - done < window)) {
+            requested += prefetch(files.begin()[ends.size()],
+                                  window - (requested - done));
+            ends.push_back(requested);
+        }
+
+        pthread_mutex_lock(mutex);
+        if (!progressKnown) {
+            break;
+        }
+        if (!stopping) {
+            struct timeval now;
+            gettimeofday(&now, 0);
+            struct timespec timeout;
+            long microseconds = now.tv_usec + POLL_INTERVAL * 1000;
+            timeout.tv_sec = now.tv_sec + microseconds / 1000000;
+            timeout.tv_nsec = (microseconds % 1000000) * 1000;
+            pthread_cond_timedwait(wakeup, mutex, &timeout);
+        }
+    }
+    pthread_mutex_unlock(mutex);
+    return this;
+}
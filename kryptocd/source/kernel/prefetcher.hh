@@ -0,0 +1,142 @@
+/*
+ * prefetcher.hh: class Prefetcher header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef PREFETCHER_HH
+#define PREFETCHER_HH
+
+#include "thread.hh"
+#include "path_store.hh"
+#include <sys/types.h>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class Prefetcher reads ahead of tar. tar reads one file after the
+     * other, and each new file starts with a wait for the disk, while the
+     * compressor after tar waits for data. A Prefetcher thread asks the
+     * kernel with posix_fadvise(POSIX_FADV_WILLNEED) to read the next files
+     * of tar's list into the page cache in the background, so the disk is
+     * kept busy while tar works on the current file.
+     * <p>
+     * How far tar has come is taken from the number of bytes it has read,
+     * as reported in /proc/pid/io on Linux, and the sizes of the files in
+     * its list. At most maxFiles files and maxBytes bytes ahead of tar are
+     * requested. The byte window shrinks when the memory available for
+     * the page cache gets short, so the prefetched data is not evicted
+     * before tar reads it. When tar stalls, because the compressor waits
+     * for Diskspace, or the disk is full, the window does not move and
+     * nothing more is read.
+     * <p>
+     * Without /proc/pid/io, only the first window is requested.
+     * <p>
+     * A reader in this process, like TarWriter, tells the Prefetcher which
+     * file it is reading with readerAt() instead.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Prefetcher : public Thread {
+    public:
+        /**
+         * the default maximum number of files requested ahead of the reader
+         */
+        static const int DEFAULT_MAX_FILES = 64;
+
+        /**
+         * the default maximum number of bytes requested ahead of the reader
+         */
+        static const long long DEFAULT_MAX_BYTES;
+
+        /**
+         * starts the prefetching thread
+         *
+         * @param paths    the store containing the file names
+         * @param files    the files, in the order the reader reads them.
+         *                 Store and list must not change while this object
+         *                 exists.
+         * @param reader   the process reading the files, or 0 if the
+         *                 reader calls readerAt()
+         * @param maxFiles the maximum number of files requested ahead
+         * @param maxBytes the maximum number of bytes requested ahead
+         */
+        Prefetcher(const PathStore & paths,
+                   const PathSlice & files,
+                   pid_t reader,
+                   int maxFiles = DEFAULT_MAX_FILES,
+                   long long maxBytes = DEFAULT_MAX_BYTES);
+
+        /**
+         * stops the thread
+         */
+        virtual ~Prefetcher();
+
+        /**
+         * tells the thread that the reader has started to read a file
+         *
+         * @param position the position of the file in the list
+         */
+        void readerAt(size_t position);
+
+    protected:
+        virtual void * run(void);
+
+    private:
+        /**
+         * @return the number of bytes the reader has read so far, or -1 if
+         *         that is unknown, e.g. because it has exited
+         */
+        long long getReaderBytes(void) const;
+
+        /**
+         * @return maxBytes, or less if memory is short
+         */
+        long long getWindowBytes(void) const;
+
+        /**
+         * requests the start of a file from the kernel
+         *
+         * @return the size of the file, 0 if it cannot be read
+         */
+        long long prefetch(PathId file, long long maxBytes) const;
+
+        const PathStore & paths;
+        PathSlice files;
+        pid_t reader;
+        int maxFiles;
+        long long maxBytes;
+
+        /**
+         * set by the destructor, signalled through "wakeup"
+         */
+        bool stopping;
+        pthread_cond_t * wakeup;
+
+        /**
+         * the position passed to readerAt()
+         */
+        size_t readerPosition;
+    };
+}
+#endif
@@ -0,0 +1,268 @@
+/*
+ * segmented_bzip2.cpp: class SegmentedBzip2 implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "segmented_bzip2.hh"
+#include "bzip2.hh"
+#include "pipe.hh"
+#include "source.hh"
+#include "sink.hh"
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+
+using KryptoCD::SegmentedBzip2;
+using KryptoCD::Bzip2;
+using KryptoCD::Pipe;
+using KryptoCD::Source;
+using KryptoCD::Sink;
+using std::string;
+using std::vector;
+
+/**
+ * the size of the pieces the input is read and the output copied in
+ */
+static const size_t READ_SIZE = 64 * 1024;
+
+/**
+ * writes to a file descriptor
+ */
+static bool writeAll(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * if a reader has exited, write() has to fail with EPIPE instead of the
+ * whole process being killed by SIGPIPE
+ */
+static void blockPipeSignal(void) {
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+}
+
+SegmentedBzip2::SegmentedBzip2(const string & bzip2Executable_,
+                               int compression_,
+                               Source & source,
+                               Sink & sink,
+                               unsigned segmentSize_)
+    : bzip2Executable(bzip2Executable_),
+      compression(compression_),
+      segmentSize(segmentSize_),
+      failed(false),
+      bzip2(0),
+      stopping(false)
+{
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    sinkFd = dup(sink.getSinkFd());
+    sink.closeSink();
+
+    int success = start();
+    assert(success == 0);
+}
+
+SegmentedBzip2::~SegmentedBzip2() {
+    join();
+}
+
+void SegmentedBzip2::wait(void) {
+    join();
+}
+
+void SegmentedBzip2::stop(void) {
+    pthread_mutex_lock(mutex);
+    stopping = true;
+    if ((bzip2 != 0) && bzip2->isRunning()) {
+        bzip2->sendSignal(SIGTERM);
+    }
+    pthread_mutex_unlock(mutex);
+    join();
+}
+
+bool SegmentedBzip2::exitedAbnormally(void) const {
+    return failed;
+}
+
+const vector<SegmentedBzip2::Segment> &
+SegmentedBzip2::getSegments(void) const {
+    return segments;
+}
+
+void * SegmentedBzip2::run(void) {
+    blockPipeSignal();
+
+    vector<char> buffer(READ_SIZE);
+    long long plainOffset = 0;
+    long long compressedOffset = 0;
+    bool more = true;
+    while (more && !failed) {
+        /*
+         * read before starting bzip2, so that input that ends at a
+         * segment's end is not followed by an empty stream
+         */
+        ssize_t buffered = readInput(&buffer[0], buffer.size());
+        if (buffered < 0) {
+            failed = true;
+            break;
+        }
+        if ((buffered == 0) && !segments.empty()) {
+            break;
+        }
+
+        Segment segment;
+        segment.plainOffset = plainOffset;
+        segment.compressedOffset = compressedOffset;
+        long long length = 0;
+        long long compressed = 0;
+        if (!compressSegment(buffer, buffered, length, compressed, more)) {
+            failed = true;
+        }
+        segments.push_back(segment);
+        plainOffset += length;
+        compressedOffset += compressed;
+    }
+    close(sourceFd);
+    close(sinkFd);
+    return this;
+}
+
+bool SegmentedBzip2::compressSegment(vector<char> & buffer, size_t buffered,
+                                     long long & length,
+                                     long long & compressed,
+                                     bool & more) {
+    bool success = true;
+    try {
+        Pipe toBzip2;
+        Pipe fromBzip2;
+        pthread_mutex_lock(mutex);
+        if (stopping) {
+            pthread_mutex_unlock(mutex);
+            return false;
+        }
+        bzip2 = new Bzip2(bzip2Executable, compression, toBzip2, fromBzip2);
+        pthread_mutex_unlock(mutex);
+
+        Collector collector(fromBzip2.getSourceFd(), sinkFd);
+        fromBzip2.closeSource();
+
+        length = buffered;
+        more = (buffered > 0);
+        success = writeAll(toBzip2.getSinkFd(), &buffer[0], buffered);
+        while (success && more && (length < segmentSize)) {
+            size_t count = buffer.size();
+            size_t left = size_t(segmentSize - length);
+            if (count > left) {
+                count = left;
+            }
+            ssize_t got = readInput(&buffer[0], count);
+            if (got <= 0) {
+                success = (got == 0);
+                more = false;
+                break;
+            }
+            success = writeAll(toBzip2.getSinkFd(), &buffer[0], got);
+            length += got;
+        }
+        toBzip2.closeSink();
+
+        collector.join();
+        compressed = collector.count;
+        pthread_mutex_lock(mutex);
+        bzip2->wait();
+        success = success && !collector.failed && !bzip2->exitedAbnormally();
+        delete bzip2;
+        bzip2 = 0;
+        pthread_mutex_unlock(mutex);
+    } catch (Pipe::Exception) {
+        success = false;
+    } catch (Bzip2::Exception) {
+        pthread_mutex_unlock(mutex);
+        success = false;
+    }
+    return success;
+}
+
+ssize_t SegmentedBzip2::readInput(char * data, size_t length) {
+    for (;;) {
+        ssize_t got = read(sourceFd, data, length);
+        if ((got >= 0) || (errno != EINTR)) {
+            return got;
+        }
+    }
+}
+
+SegmentedBzip2::Collector::Collector(int from_, int to_)
+    : count(0),
+      failed(false),
+      from(dup(from_)),
+      to(to_)
+{
+    int success = start();
+    assert(success == 0);
+}
+
+SegmentedBzip2::Collector::~Collector() {
+    join();
+}
+
+void * SegmentedBzip2::Collector::run(void) {
+    blockPipeSignal();
+
+    char buffer[READ_SIZE];
+    for (;;) {
+        ssize_t got = read(from, buffer, sizeof(buffer));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            break;
+        }
+        if (got == 0) {
+            break;
+        }
+        if (!writeAll(to, buffer, got)) {
+            /* closing the pipe stops bzip2 */
+            failed = true;
+            break;
+        }
+        count += got;
+    }
+    close(from);
+    return this;
+}
@@ -0,0 +1,189 @@
+/*
+ * segmented_bzip2.hh: class SegmentedBzip2 header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef SEGMENTED_BZIP2_HH
+#define SEGMENTED_BZIP2_HH
+
+#include "thread.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    class Source;
+    class Sink;
+    class Bzip2;
+
+    /**
+     * Class SegmentedBzip2 compresses a stream like Bzip2, but as a
+     * series of independent bzip2 streams, one for every SEGMENT_SIZE
+     * bytes of input, or as many as the constructor is told. bzip2
+     * --decompress, and therefore ArchiveLister, read the concatenation
+     * like a single stream.
+     * <p>
+     * Where each segment starts, in the input and in the output, is
+     * recorded. Any segment can then be decompressed on its own, so
+     * restoring a single file from a large archive means decompressing
+     * the segments that contain it, not everything before it. bzip2
+     * compresses blocks of at most 900 kB independently anyway, so
+     * starting a new stream now and then costs a few bytes, and the start
+     * of a bzip2 process.
+     * <p>
+     * A thread reads the input, and feeds it to one bzip2 process per
+     * segment. A second thread copies each process's output to the sink
+     * and counts it.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class SegmentedBzip2 : public Thread {
+    public:
+        /**
+         * the number of input bytes compressed into one bzip2 stream: 9
+         * blocks of bzip2 -9
+         */
+        static const unsigned SEGMENT_SIZE = 9 * 900 * 1000;
+
+        /**
+         * where a segment starts
+         */
+        struct Segment {
+            long long plainOffset;
+            long long compressedOffset;
+        };
+
+        /**
+         * starts the thread. Like a ChildFilter, the object takes over the
+         * file descriptors of source and sink, and closes them in the
+         * caller's view.
+         *
+         * @param bzip2Executable the full path to the bzip2 executable file
+         * @param compression     the level of compression, 1,2,...,9
+         * @param source          the data to compress are read from here
+         * @param sink            the compressed data are written here
+         * @param segmentSize     the number of input bytes per segment
+         */
+        SegmentedBzip2(const std::string & bzip2Executable,
+                       int compression,
+                       Source & source,
+                       Sink & sink,
+                       unsigned segmentSize = SEGMENT_SIZE);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~SegmentedBzip2();
+
+        /**
+         * waits until all input has been compressed, or compression failed
+         */
+        void wait(void);
+
+        /**
+         * terminates the running bzip2 process, and waits for the thread
+         */
+        void stop(void);
+
+        /**
+         * @return true if the input could not be read, a bzip2 process
+         *         could not be started or failed, or the output could not
+         *         be written. Only meaningful after wait().
+         */
+        bool exitedAbnormally(void) const;
+
+        /**
+         * @return the segments, in stream order. Only valid after wait().
+         */
+        const std::vector<Segment> & getSegments(void) const;
+
+    protected:
+        /**
+         * reads the input, and compresses it segment by segment
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * compresses one segment, beginning with the bytes in "buffer"
+         *
+         * @param length receives the number of input bytes compressed
+         * @param more   set to false at the end of the input
+         * @return       false if compression failed
+         */
+        bool compressSegment(std::vector<char> & buffer, size_t buffered,
+                             long long & length, long long & compressed,
+                             bool & more);
+
+        /**
+         * reads from the input, up to "length" bytes
+         *
+         * @return the number of bytes read, 0 at the end of the input, or
+         *         -1 if reading failed
+         */
+        ssize_t readInput(char * data, size_t length);
+
+        /**
+         * copies a bzip2 process's output to the sink
+         */
+        class Collector : public Thread {
+        public:
+            /**
+             * starts the thread
+             *
+             * @param from the output of the bzip2 process. The Collector
+             *             closes it.
+             */
+            Collector(int from, int to);
+            virtual ~Collector();
+
+            /**
+             * the number of bytes copied, and whether the sink refused
+             * them. Only valid after join().
+             */
+            long long count;
+            bool failed;
+        protected:
+            virtual void * run(void);
+        private:
+            int from;
+            int to;
+        };
+
+        std::string bzip2Executable;
+        int compression;
+        unsigned segmentSize;
+        int sourceFd;
+        int sinkFd;
+        std::vector<Segment> segments;
+        bool failed;
+
+        /**
+         * the bzip2 process of the current segment, and whether stop()
+         * has been called, protected by Thread's mutex
+         */
+        Bzip2 * bzip2;
+        bool stopping;
+    };
+}
+#endif
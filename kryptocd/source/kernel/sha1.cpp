@@ -0,0 +1,149 @@
+/*
+ * sha1.cpp: class Sha1 implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "sha1.hh"
+#include <string.h>
+
+using KryptoCD::Sha1;
+
+/**
+ * the rounds work on 32 bit words
+ */
+typedef unsigned int Word;
+
+static inline Word rotl(Word x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+Sha1::Sha1()
+    : total(0),
+      blockLength(0)
+{
+    state[0] = 0x67452301UL;
+    state[1] = 0xefcdab89UL;
+    state[2] = 0x98badcfeUL;
+    state[3] = 0x10325476UL;
+    state[4] = 0xc3d2e1f0UL;
+}
+
+void Sha1::compress(const unsigned char * data) {
+    Word w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (static_cast<Word>(data[4 * i]) << 24)
+            | (static_cast<Word>(data[4 * i + 1]) << 16)
+            | (static_cast<Word>(data[4 * i + 2]) << 8)
+            | static_cast<Word>(data[4 * i + 3]);
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    Word a = state[0];
+    Word b = state[1];
+    Word c = state[2];
+    Word d = state[3];
+    Word e = state[4];
+
+    /* the four groups of 20 rounds differ in the function of b, c, d */
+#define SHA1_ROUND(f, k, i) { \
+        Word t = rotl(a, 5) + (f) + e + (k) + w[i]; \
+        e = d; \
+        d = c; \
+        c = rotl(b, 30); \
+        b = a; \
+        a = t; \
+    }
+    int i = 0;
+    for (; i < 20; ++i) {
+        SHA1_ROUND((b & c) | (~b & d), 0x5a827999U, i);
+    }
+    for (; i < 40; ++i) {
+        SHA1_ROUND(b ^ c ^ d, 0x6ed9eba1U, i);
+    }
+    for (; i < 60; ++i) {
+        SHA1_ROUND((b & c) | (b & d) | (c & d), 0x8f1bbcdcU, i);
+    }
+    for (; i < 80; ++i) {
+        SHA1_ROUND(b ^ c ^ d, 0xca62c1d6U, i);
+    }
+#undef SHA1_ROUND
+
+    state[0] = (state[0] + a) & 0xffffffffUL;
+    state[1] = (state[1] + b) & 0xffffffffUL;
+    state[2] = (state[2] + c) & 0xffffffffUL;
+    state[3] = (state[3] + d) & 0xffffffffUL;
+    state[4] = (state[4] + e) & 0xffffffffUL;
+}
+
+void Sha1::update(const void * data, size_t length) {
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+
+    total += length;
+    if (blockLength > 0) {
+        size_t fill = 64 - blockLength;
+        if (fill > length) {
+            fill = length;
+        }
+        memcpy(block + blockLength, p, fill);
+        blockLength += fill;
+        p += fill;
+        length -= fill;
+        if (blockLength < 64) {
+            return;
+        }
+        compress(block);
+        blockLength = 0;
+    }
+    while (length >= 64) {
+        compress(p);
+        p += 64;
+        length -= 64;
+    }
+    memcpy(block, p, length);
+    blockLength = length;
+}
+
+void Sha1::digest(unsigned char result[DIGEST_LENGTH]) {
+    unsigned long long bits = total * 8;
+
+    /* a 1 bit, zeros up to 8 bytes before a block end, and the length */
+    unsigned char padding[72];
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    size_t padLength = (blockLength < 56) ? (56 - blockLength)
+                                          : (120 - blockLength);
+    for (int i = 0; i < 8; ++i) {
+        padding[padLength + i] =
+            static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    update(padding, padLength + 8);
+
+    for (int i = 0; i < 5; ++i) {
+        result[4 * i]     = static_cast<unsigned char>(state[i] >> 24);
+        result[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        result[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        result[4 * i + 3] = static_cast<unsigned char>(state[i]);
+    }
+}
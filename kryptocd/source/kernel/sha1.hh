@@ -0,0 +1,77 @@
+/*
+ * sha1.hh: class Sha1 header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef SHA1_HH
+#define SHA1_HH
+
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * Class Sha1 computes the SHA-1 hash of a byte stream, as defined in
+     * FIPS 180-1. OpenPGP needs it for the modification detection code of
+     * encrypted data and for turning passphrases into keys, see
+     * PgpEncrypter.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Sha1 {
+    public:
+        /**
+         * the length of a hash in bytes
+         */
+        static const unsigned DIGEST_LENGTH = 20;
+
+        Sha1();
+
+        /**
+         * hashes the next part of the stream
+         */
+        void update(const void * data, size_t length);
+
+        /**
+         * stores the hash of all bytes passed to update() so far. The
+         * object cannot be updated afterwards.
+         */
+        void digest(unsigned char result[DIGEST_LENGTH]);
+
+    private:
+        /**
+         * processes one 64 byte block
+         */
+        void compress(const unsigned char * block);
+
+        unsigned long state[5];
+        unsigned long long total;
+
+        /**
+         * bytes of an incomplete block
+         */
+        unsigned char block[64];
+        size_t blockLength;
+    };
+}
+#endif
@@ -0,0 +1,261 @@
+/*
+ * snapshot.cpp: class Snapshot implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "snapshot.hh"
+#include "varint.hh"
+#include <algorithm>
+#include <unistd.h>
+
+using KryptoCD::Snapshot;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using KryptoCD::FileMetadata;
+using KryptoCD::MetadataScanner;
+using std::string;
+using std::vector;
+
+/**
+ * the first line of every snapshot file, without the version number
+ */
+static const string SNAPSHOT_MAGIC("KryptoCD snapshot ");
+
+/**
+ * the version written by save()
+ */
+static const int SNAPSHOT_VERSION = 3;
+
+namespace {
+    /**
+     * orders records by the names of their files. Keeps two buffers, so
+     * that comparing does not allocate memory.
+     */
+    template <class Record>
+    class ByName {
+        const PathStore & paths;
+        string * a;
+        string * b;
+    public:
+        ByName(const PathStore & p, string & bufferA, string & bufferB)
+            : paths(p), a(&bufferA), b(&bufferB) {}
+        bool operator()(const Record & x, const Record & y) const {
+            a->erase();
+            b->erase();
+            paths.appendPath(x.file, *a);
+            paths.appendPath(y.file, *b);
+            return *a < *b;
+        }
+    };
+}
+
+Snapshot::Snapshot(const PathStore & paths_)
+    : paths(paths_)
+{}
+
+void Snapshot::add(PathId file, const FileMetadata & metadata,
+                   unsigned long long hash) {
+    Record record;
+    record.file = file;
+    record.metadata = metadata;
+    record.hash = hash;
+    records.push_back(record);
+}
+
+void Snapshot::addFiles(const PathList & files,
+                        const MetadataScanner & metadata) {
+    records.reserve(records.size() + files.size());
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        const FileMetadata * st = metadata.get(*iter);
+        if ((st != 0) && (st->mode != 0)) {
+            add(*iter, *st);
+        }
+    }
+}
+
+void Snapshot::addHashes(ContentHasher & hasher) {
+    for (vector<Record>::iterator iter = records.begin();
+         iter != records.end();
+         ++iter) {
+        if (!hasher.get(iter->file, iter->hash)) {
+            iter->hash = 0;
+        }
+    }
+}
+
+bool Snapshot::isSorted(void) const {
+    string previous;
+    string current;
+
+    for (vector<Record>::const_iterator iter = records.begin();
+         iter != records.end();
+         ++iter) {
+        current.erase();
+        paths.appendPath(iter->file, current);
+        if ((iter != records.begin()) && !(previous < current)) {
+            return false;
+        }
+        previous.swap(current);
+    }
+    return true;
+}
+
+void Snapshot::sort(void) {
+    if (!isSorted()) {
+        string a, b;
+        std::sort(records.begin(), records.end(),
+                  ByName<Record>(paths, a, b));
+    }
+}
+
+const vector<Snapshot::Record> & Snapshot::getRecords(void) const {
+    return records;
+}
+
+const PathStore & Snapshot::getPathStore(void) const {
+    return paths;
+}
+
+void Snapshot::save(const string & filename) const
+    throw(Snapshot::Exception) {
+    string temporary = filename + ".new";
+    std::ofstream output(temporary.c_str());
+    if (!output) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+
+    string buffer = SNAPSHOT_MAGIC;
+    buffer += char('0' + SNAPSHOT_VERSION);
+    buffer += '\n';
+    putNumber(buffer, records.size());
+    output.write(buffer.data(), buffer.length());
+
+    string previous;
+    string current;
+    for (vector<Record>::const_iterator iter = records.begin();
+         iter != records.end();
+         ++iter) {
+        current.erase();
+        paths.appendPath(iter->file, current);
+
+        size_t shared = 0;
+        while ((shared < previous.length()) && (shared < current.length())
+               && (previous[shared] == current[shared])) {
+            ++shared;
+        }
+        buffer.erase();
+        putNumber(buffer, shared);
+        putNumber(buffer, current.length() - shared);
+        buffer.append(current, shared, string::npos);
+        putNumber(buffer, iter->metadata.device);
+        putNumber(buffer, iter->metadata.inode);
+        putNumber(buffer, iter->metadata.size);
+        putNumber(buffer, iter->metadata.mode);
+        putNumber(buffer, iter->metadata.uid);
+        putNumber(buffer, iter->metadata.gid);
+        putSignedNumber(buffer, iter->metadata.mtime);
+        putSignedNumber(buffer, iter->metadata.ctime);
+        putNumber(buffer, iter->hash);
+        output.write(buffer.data(), buffer.length());
+
+        previous.swap(current);
+    }
+    output.flush();
+    if (!output) {
+        output.close();
+        unlink(temporary.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+    output.close();
+    if (rename(temporary.c_str(), filename.c_str()) != 0) {
+        unlink(temporary.c_str());
+        throw Exception(Exception::UNABLE_TO_WRITE);
+    }
+}
+
+Snapshot::Reader::Reader(const string & filename)
+    throw(Snapshot::Exception)
+    : input(filename.c_str()),
+      version(0),
+      remaining(0),
+      hash(0)
+{
+    if (!input) {
+        throw Exception(Exception::UNABLE_TO_OPEN);
+    }
+    string magic(SNAPSHOT_MAGIC.length() + 2, '\0');
+    input.read(&magic[0], magic.length());
+    if (!input
+        || (magic.substr(0, SNAPSHOT_MAGIC.length()) != SNAPSHOT_MAGIC)
+        || (magic[magic.length() - 1] != '\n')) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    version = magic[magic.length() - 2] - '0';
+    if ((version < 1) || (version > SNAPSHOT_VERSION)
+        || !getNumber(input, remaining)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+}
+
+bool Snapshot::Reader::next(void) throw(Snapshot::Exception) {
+    if (remaining == 0) {
+        return false;
+    }
+    --remaining;
+
+    unsigned long long shared, suffix;
+    unsigned long long device, inode, size, mode;
+    unsigned long long uid = 0, gid = 0;
+    long long mtime, ctime;
+    if (!getNumber(input, shared) || !getNumber(input, suffix)
+        || (shared > name.length())) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    name.resize(shared + suffix);
+    if (suffix > 0) {
+        input.read(&name[shared], suffix);
+    }
+    if (!input
+        || !getNumber(input, device) || !getNumber(input, inode)
+        || !getNumber(input, size) || !getNumber(input, mode)
+        || ((version >= 3)
+            && (!getNumber(input, uid) || !getNumber(input, gid)))
+        || !getSignedNumber(input, mtime) || !getSignedNumber(input, ctime)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    hash = 0;
+    if ((version >= 2) && !getNumber(input, hash)) {
+        throw Exception(Exception::BAD_FORMAT);
+    }
+    metadata.device = device;
+    metadata.inode = inode;
+    metadata.size = size;
+    metadata.mode = mode;
+    metadata.uid = uid;
+    metadata.gid = gid;
+    metadata.mtime = mtime;
+    metadata.ctime = ctime;
+    return true;
+}
@@ -0,0 +1,210 @@
+/*
+ * snapshot.hh: class Snapshot header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SNAPSHOT_HH
+#define SNAPSHOT_HH
+
+#include "path_store.hh"
+#include "metadata_scanner.hh"
+#include "content_hasher.hh"
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace KryptoCD {
+    /**
+     * Class Snapshot records the state of all files of a backup: name,
+     * device, inode, size, mode, owner, group, mtime, ctime and optionally
+     * a hash of the contents, sorted by name. A later
+     * backup compares the current state of the files with a saved snapshot
+     * to find out what has changed, see SnapshotDatabase.
+     * <p>
+     * The file format is sorted by name, so two snapshots can be compared
+     * by reading both once, side by side. Each name is stored as the length
+     * of the prefix it shares with the previous name plus the rest, and
+     * all numbers are stored as variable length integers. Neighbouring
+     * names share most of their directory prefix, so a record typically
+     * takes 20-30 bytes.
+     * <pre>
+     *   "KryptoCD snapshot 3\n"
+     *   number of records
+     *   records: shared prefix length, suffix length, suffix,
+     *            device, inode, size, mode, uid, gid, mtime, ctime,
+     *            content hash
+     * </pre>
+     * Files of version 2 have no uid and gid, those of version 1 no
+     * content hash either. They are still read.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Snapshot {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                UNABLE_TO_OPEN,
+                UNABLE_TO_WRITE,
+                BAD_FORMAT,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * the state of one file
+         */
+        struct Record {
+            PathId             file;
+            FileMetadata       metadata;
+
+            /**
+             * the XXH64 hash of the contents, or 0 if unknown
+             */
+            unsigned long long hash;
+        };
+
+        /**
+         * creates an empty snapshot
+         *
+         * @param paths the store containing the names of the files
+         */
+        Snapshot(const PathStore & paths);
+
+        /**
+         * adds the state of a file
+         *
+         * @param file     a name from the store
+         * @param metadata what stat() told about the file
+         * @param hash     the content hash, or 0 if unknown
+         */
+        void add(PathId file, const FileMetadata & metadata,
+                 unsigned long long hash = 0);
+
+        /**
+         * adds the state of all files in a list. Files that have not been
+         * scanned, or could not be stat()ed, are left out.
+         *
+         * @param files    names from the store
+         * @param metadata a scanner that has scanned the files
+         */
+        void addFiles(const PathList & files, const MetadataScanner & metadata);
+
+        /**
+         * sets the content hashes of all records, waiting for the hasher
+         * where necessary
+         *
+         * @param hasher a hasher that has been started with the files
+         */
+        void addHashes(ContentHasher & hasher);
+
+        /**
+         * sorts the records by name. Lists produced by TreeWalker are
+         * already sorted, which is detected in linear time.
+         */
+        void sort(void);
+
+        /**
+         * @return the records, sorted by name after sort() has been called
+         */
+        const std::vector<Record> & getRecords(void) const;
+
+        /**
+         * @return the store containing the names of the files
+         */
+        const PathStore & getPathStore(void) const;
+
+        /**
+         * saves the sorted snapshot to a file. The file is written under a
+         * temporary name and then renamed, so an existing snapshot is never
+         * left half overwritten.
+         *
+         * @param filename the name of the file
+         * @exception Snapshot::Exception
+         *                 UNABLE_TO_OPEN or UNABLE_TO_WRITE
+         */
+        void save(const std::string & filename) const throw(Exception);
+
+        /**
+         * Class Reader reads a saved snapshot record by record, in the
+         * sorted order, without keeping more than one record in memory.
+         */
+        class Reader {
+        public:
+            /**
+             * @param filename the name of a file written by save()
+             * @exception Snapshot::Exception
+             *                 UNABLE_TO_OPEN or BAD_FORMAT
+             */
+            Reader(const std::string & filename) throw(Exception);
+
+            /**
+             * reads the next record
+             *
+             * @return false if there are no more records
+             * @exception Snapshot::Exception
+             *                 BAD_FORMAT if the file is truncated
+             */
+            bool next(void) throw(Exception);
+
+            /**
+             * @return the name of the file of the current record
+             */
+            const std::string & getName(void) const {return name;}
+
+            /**
+             * @return the state of the file of the current record
+             */
+            const FileMetadata & getMetadata(void) const {return metadata;}
+
+            /**
+             * @return the content hash of the current record, or 0
+             */
+            unsigned long long getHash(void) const {return hash;}
+
+            /**
+             * @return false if the file is too old to record uid and gid.
+             *         getMetadata() then returns 0 for both.
+             */
+            bool hasOwner(void) const {return version >= 3;}
+
+        private:
+            std::ifstream input;
+            int version;
+            unsigned long long remaining;
+            std::string name;
+            FileMetadata metadata;
+            unsigned long long hash;
+        };
+
+    private:
+        /**
+         * checks if the records are sorted by name
+         */
+        bool isSorted(void) const;
+
+        const PathStore & paths;
+        std::vector<Record> records;
+    };
+}
+#endif
@@ -0,0 +1,182 @@
+/*
+ * snapshot_database.cpp: class SnapshotDatabase implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "snapshot_database.hh"
+#include <sys/stat.h>
+#include <unistd.h>
+
+using KryptoCD::SnapshotDatabase;
+using KryptoCD::Snapshot;
+using KryptoCD::PathList;
+using KryptoCD::FileMetadata;
+using std::string;
+using std::vector;
+
+/**
+ * checks if the permissions or the owner of a file have changed. Then it
+ * has to be saved again, whatever its contents.
+ *
+ * @param owner false if the snapshot did not record the owner
+ */
+static bool hasNewAttributes(const FileMetadata & now,
+                             const FileMetadata & then,
+                             bool owner) {
+    return (now.mode != then.mode)
+        || (owner && ((now.uid != then.uid) || (now.gid != then.gid)));
+}
+
+/**
+ * checks if the contents of a file may have changed
+ */
+static bool hasChanged(const FileMetadata & now, const FileMetadata & then) {
+    return (now.size != then.size)
+        || (now.mtime != then.mtime)
+        || (now.ctime != then.ctime)
+        || (now.inode != then.inode)
+        || (now.device != then.device);
+}
+
+SnapshotDatabase::SnapshotDatabase(const string & directory_)
+    : directory(directory_)
+{
+    if (directory.empty() || (directory[directory.length() - 1] != '/')) {
+        directory += '/';
+    }
+}
+
+string SnapshotDatabase::getFilename(const string & profile, int level) const
+    throw(SnapshotDatabase::Exception) {
+    if (profile.empty()
+        || (profile.find('/') != string::npos)
+        || (profile[0] == '.')) {
+        throw Exception(Exception::BAD_PROFILE_NAME);
+    }
+    if ((level < 0) || (level > MAX_LEVEL)) {
+        throw Exception(Exception::BAD_LEVEL);
+    }
+    return directory + profile + "." + char('0' + level) + ".snapshot";
+}
+
+int SnapshotDatabase::findBaseLevel(const string & profile, int level) const
+    throw(SnapshotDatabase::Exception) {
+    getFilename(profile, level);
+
+    struct stat st;
+    for (int base = level - 1; base >= 0; --base) {
+        if (stat(getFilename(profile, base).c_str(), &st) == 0) {
+            return base;
+        }
+    }
+    return -1;
+}
+
+void SnapshotDatabase::diff(const string & profile, int level,
+                            const Snapshot & current,
+                            PathList & changed,
+                            vector<string> & deleted,
+                            ContentHasher * hasher) const
+    throw(SnapshotDatabase::Exception, Snapshot::Exception) {
+    const vector<Snapshot::Record> & records = current.getRecords();
+    int base = findBaseLevel(profile, level);
+
+    if (base < 0) {
+        changed.reserve(changed.size() + records.size());
+        for (vector<Snapshot::Record>::const_iterator iter = records.begin();
+             iter != records.end();
+             ++iter) {
+            changed.push_back(iter->file);
+        }
+        return;
+    }
+
+    /* merge join: both sides are sorted by name */
+    const PathStore & paths = current.getPathStore();
+    Snapshot::Reader reader(getFilename(profile, base));
+    bool haveOld = reader.next();
+    string name;
+    for (vector<Snapshot::Record>::const_iterator iter = records.begin();
+         iter != records.end();
+         ++iter) {
+        name.erase();
+        paths.appendPath(iter->file, name);
+
+        while (haveOld && (reader.getName() < name)) {
+            deleted.push_back(reader.getName());
+            haveOld = reader.next();
+        }
+        if (!haveOld || (reader.getName() != name)) {
+            changed.push_back(iter->file);
+            continue;
+        }
+        if (S_ISDIR(iter->metadata.mode)
+            || hasNewAttributes(iter->metadata, reader.getMetadata(),
+                                reader.hasOwner())) {
+            changed.push_back(iter->file);
+        } else if (hasChanged(iter->metadata, reader.getMetadata())) {
+            /*
+             * the hash only vouches for the contents. A snapshot without
+             * owners cannot tell whether a chown changed the ctime.
+             */
+            unsigned long long hash;
+            if ((hasher == 0) || !reader.hasOwner() || (reader.getHash() == 0)
+                || !hasher->get(iter->file, hash)
+                || (hash != reader.getHash())) {
+                changed.push_back(iter->file);
+            }
+        }
+        haveOld = reader.next();
+    }
+    while (haveOld) {
+        deleted.push_back(reader.getName());
+        haveOld = reader.next();
+    }
+}
+
+void SnapshotDatabase::store(const string & profile, int level,
+                             const Snapshot & snapshot)
+    throw(SnapshotDatabase::Exception, Snapshot::Exception) {
+    snapshot.save(getFilename(profile, level));
+    for (int higher = level + 1; higher <= MAX_LEVEL; ++higher) {
+        unlink(getFilename(profile, higher).c_str());
+    }
+}
+
+void SnapshotDatabase::loadHashIndex(const string & profile,
+                                     HashIndex & index) const
+    throw(SnapshotDatabase::Exception, Snapshot::Exception) {
+    struct stat st;
+    for (int level = 0; level <= MAX_LEVEL; ++level) {
+        string filename = getFilename(profile, level);
+        if (stat(filename.c_str(), &st) != 0) {
+            continue;
+        }
+        Snapshot::Reader reader(filename);
+        while (reader.next()) {
+            if (reader.getHash() != 0) {
+                index.insert(reader.getMetadata(), reader.getHash());
+            }
+        }
+    }
+    index.sort();
+}
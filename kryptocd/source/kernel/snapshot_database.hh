@@ -0,0 +1,169 @@
+/*
+ * snapshot_database.hh: class SnapshotDatabase header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SNAPSHOT_DATABASE_HH
+#define SNAPSHOT_DATABASE_HH
+
+#include "snapshot.hh"
+#include "hash_index.hh"
+#include "content_hasher.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class SnapshotDatabase keeps the snapshots of the backup profiles
+     * described in use_cases.txt, one per profile and backup level, and
+     * decides which files an incremental backup has to save.
+     * <p>
+     * Backup levels work like those of dump: a level 0 backup saves all
+     * files, a backup of level n saves the files that have changed since
+     * the last backup of a lower level. Storing the snapshot of a backup
+     * of level n invalidates the snapshots of all higher levels.
+     * <p>
+     * Each snapshot is a file "profile.level.snapshot" in the database
+     * directory. Because both the current snapshot and the saved one are
+     * sorted by name, diff() compares them in a single pass over both,
+     * reading the saved one sequentially from disk.
+     * <p>
+     * Optionally, diff() also compares content hashes: a file whose
+     * size, times or inode changed, but whose contents are still the same,
+     * e.g. after a restore or a "touch", is then not saved again. Changed
+     * permissions or ownership are always saved.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class SnapshotDatabase {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                BAD_PROFILE_NAME,
+                BAD_LEVEL,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * the highest backup level
+         */
+        static const int MAX_LEVEL = 9;
+
+        /**
+         * @param directory the directory containing the snapshot files. It
+         *                  has to exist.
+         */
+        SnapshotDatabase(const std::string & directory);
+
+        /**
+         * finds the snapshot that a backup of some level is relative to
+         *
+         * @param profile the name of the backup profile
+         * @param level   the level of the planned backup
+         * @return        the highest level below "level" for which a
+         *                snapshot exists, or -1 if there is none
+         * @exception SnapshotDatabase::Exception
+         *                BAD_PROFILE_NAME or BAD_LEVEL
+         */
+        int findBaseLevel(const std::string & profile, int level) const
+            throw(Exception);
+
+        /**
+         * compares the current state of the files with the snapshot that a
+         * backup of some level is relative to. If there is no such
+         * snapshot, all files count as changed.
+         *
+         * @param profile the name of the backup profile
+         * @param level   the level of the planned backup
+         * @param current the current state of the files, sorted
+         * @param changed files that are new, or whose size, times, inode,
+         *                device, mode, owner or group differ from the
+         *                snapshot, are appended to this list.
+         *                Directories are always appended, so that a
+         *                restore can recreate them with their permissions.
+         * @param deleted the names of files that are in the snapshot but
+         *                not in "current" are appended to this list
+         * @param hasher  if not 0, a hasher started with the files of
+         *                "current". A file whose size, times, inode or
+         *                device changed is then only reported if its
+         *                contents changed, too. The
+         *                hasher is only waited for when such a file is
+         *                encountered.
+         * @exception SnapshotDatabase::Exception
+         *                BAD_PROFILE_NAME or BAD_LEVEL
+         * @exception Snapshot::Exception
+         *                if the snapshot file cannot be read
+         */
+        void diff(const std::string & profile, int level,
+                  const Snapshot & current,
+                  PathList & changed,
+                  std::vector<std::string> & deleted,
+                  ContentHasher * hasher = 0) const
+            throw(Exception, Snapshot::Exception);
+
+        /**
+         * stores the snapshot of a finished backup, and removes the
+         * snapshots of all higher levels
+         *
+         * @param profile  the name of the backup profile
+         * @param level    the level of the finished backup
+         * @param snapshot the state of the files when they were saved,
+         *                 sorted
+         * @exception SnapshotDatabase::Exception
+         *                BAD_PROFILE_NAME or BAD_LEVEL
+         * @exception Snapshot::Exception
+         *                if the snapshot file cannot be written
+         */
+        void store(const std::string & profile, int level,
+                   const Snapshot & snapshot)
+            throw(Exception, Snapshot::Exception);
+
+        /**
+         * inserts the content hashes from all snapshots of a profile into
+         * an index, and sorts it
+         *
+         * @param profile the name of the backup profile
+         * @param index   the index to fill
+         * @exception SnapshotDatabase::Exception
+         *                BAD_PROFILE_NAME
+         * @exception Snapshot::Exception
+         *                if a snapshot file cannot be read
+         */
+        void loadHashIndex(const std::string & profile, HashIndex & index)
+            const throw(Exception, Snapshot::Exception);
+
+    private:
+        /**
+         * @return the name of the snapshot file of a profile and level
+         * @exception SnapshotDatabase::Exception
+         *                BAD_PROFILE_NAME or BAD_LEVEL
+         */
+        std::string getFilename(const std::string & profile, int level) const
+            throw(Exception);
+
+        std::string directory;
+    };
+}
+#endif
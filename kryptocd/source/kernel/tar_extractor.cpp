@@ -0,0 +1,722 @@
+/*
+ * tar_extractor.cpp: class TarExtractor implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "tar_extractor.hh"
+#include "tar_parser.hh"
+#include "source.hh"
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <assert.h>
+
+using KryptoCD::TarExtractor;
+using KryptoCD::TarParser;
+using KryptoCD::Source;
+using std::string;
+using std::vector;
+using std::map;
+
+/**
+ * compared with the pages of a file, to find those that can be left out
+ */
+static const char zeroPage[TarExtractor::SPARSE_PAGE_SIZE] = {0};
+
+/**
+ * writes a whole buffer to a file descriptor at an offset
+ *
+ * @return false if writing failed
+ */
+static bool writeAt(int fd, const char * data, size_t length,
+                    long long offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+/**
+ * deallocates the zeros between two offsets of a preallocated file. If
+ * the file system cannot punch holes, they stay allocated, and still read
+ * as zeros.
+ */
+static void punchHole(int fd, long long start, long long end) {
+    fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              start, end - start);
+}
+
+/**
+ * splits a cleaned name into the name of its directory, empty for the top
+ * directory, and its last component
+ */
+static void splitName(const string & name, string & parent, string & leaf) {
+    size_t slash = name.rfind('/');
+    if (slash == string::npos) {
+        parent.erase();
+        leaf = name;
+    } else {
+        parent.assign(name, 0, slash);
+        leaf.assign(name, slash + 1, string::npos);
+    }
+}
+
+/**
+ * fills in the times for utimensat() and futimens(): the access time is
+ * now, as with tar, the modification time is the archived one
+ */
+static void setTimes(struct timespec times[2], time_t mtime) {
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_NOW;
+    times[1].tv_sec = mtime;
+    times[1].tv_nsec = 0;
+}
+
+TarExtractor::TarExtractor(Source & source, const string & directory_,
+                           int threads_, const vector<string> * selection_)
+    : directory(directory_),
+      rootFd(-1),
+      threads(threads_),
+      selective(selection_ != 0),
+      restoreOwners(geteuid() == 0),
+      lastParentFd(-1),
+      readFailed(false),
+      extractedCount(0),
+      queuedBytes(0),
+      busyWriters(0),
+      closed(false),
+      queued(new pthread_cond_t),
+      written(new pthread_cond_t)
+{
+    assert(threads > 0);
+    while ((directory.size() > 1)
+           && (directory[directory.size() - 1] == '/')) {
+        directory.erase(directory.size() - 1);
+    }
+    if (selective) {
+        string clean;
+        for (vector<string>::const_iterator iter = selection_->begin();
+             iter != selection_->end();
+             ++iter) {
+            if (cleanName(*iter, clean)) {
+                selection.insert(clean);
+            }
+        }
+    }
+    umaskBits = umask(0);
+    umask(umaskBits);
+
+    pthread_cond_init(queued, 0);
+    pthread_cond_init(written, 0);
+
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
+    int success = start();
+    assert(success == 0);
+}
+
+TarExtractor::~TarExtractor() {
+    join();
+    int destroyVal = pthread_cond_destroy(written);
+    assert (destroyVal == 0);
+    destroyVal = pthread_cond_destroy(queued);
+    assert (destroyVal == 0);
+    delete written;
+    delete queued;
+}
+
+void TarExtractor::wait(void) {
+    join();
+}
+
+bool TarExtractor::archiveFailed(void) const {
+    return readFailed;
+}
+
+const vector<string> & TarExtractor::getFailedFiles(void) const {
+    return failedFiles;
+}
+
+size_t TarExtractor::getExtractedCount(void) const {
+    return extractedCount;
+}
+
+void * TarExtractor::run(void) {
+    /* if this fails, creating the members fails, too */
+    rootFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+
+    vector<Worker *> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+
+    TarParser parser(sourceFd);
+    TarParser::Entry entry;
+    string name;
+    string leaf;
+    string target;
+    try {
+        while (parser.next(entry)) {
+            if (!cleanName(entry.name, name)) {
+                report(entry.name, false);
+                continue;
+            }
+            if (name.empty() || (selective && !isSelected(name))) {
+                continue;
+            }
+            if (!symlinks.empty()) {
+                /* a later member replaces the link */
+                symlinks.erase(name);
+            }
+            Metadata metadata;
+            metadata.mode = entry.mode & 07777;
+            metadata.uid = entry.uid;
+            metadata.gid = entry.gid;
+            metadata.mtime = entry.mtime;
+
+            switch (entry.type) {
+            case '5': {
+                /* writable until finishDirectories() */
+                int fd = openDirectory(name, true, S_IRWXU);
+                if (fd >= 0) {
+                    close(fd);
+                    directories.push_back(Directory());
+                    directories.back().name = entry.name;
+                    directories.back().path = name;
+                    directories.back().metadata = metadata;
+                } else {
+                    report(entry.name, false);
+                }
+                break;
+            }
+            case '1':
+                if (!cleanName(entry.linkName, target) || target.empty()) {
+                    report(entry.name, false);
+                    break;
+                }
+                links.push_back(Link());
+                links.back().name = entry.name;
+                links.back().path = name;
+                links.back().target = target;
+                break;
+            case '2': {
+                Link & link = symlinks[name];
+                link.name = entry.name;
+                link.path = name;
+                link.target = entry.linkName;
+                link.metadata = metadata;
+                break;
+            }
+            case '3':
+            case '4':
+            case '6': {
+                int parentFd = openParent(name, leaf);
+                report(entry.name,
+                       makeSpecial(entry.type, parentFd, leaf, entry.linkName,
+                                   entry.devMajor, entry.devMinor, metadata));
+                break;
+            }
+            default: {
+                /* like tar, treat unknown types as regular files */
+                int parentFd = openParent(name, leaf);
+                if (!extractedFiles.insert(name).second) {
+                    /* a writer might still be writing the earlier one */
+                    drain();
+                }
+                if (entry.size > MAX_BUFFERED_SIZE) {
+                    writeLargeFile(parser, entry.name, parentFd, leaf,
+                                   entry.size, metadata);
+                    break;
+                }
+                Job * job = new Job;
+                job->name = entry.name;
+                job->parentFd = (parentFd >= 0) ? dup(parentFd) : -1;
+                job->leaf = leaf;
+                job->metadata = metadata;
+                job->data.reserve(entry.size);
+                const char * data;
+                size_t length;
+                while ((length = parser.getData(data)) > 0) {
+                    job->data.insert(job->data.end(), data, data + length);
+                }
+                if ((long long)job->data.size() < entry.size) {
+                    /* write what there is, but do not count it */
+                    report(entry.name, false);
+                    job->name.erase();
+                }
+                queue(job);
+                break;
+            }
+            }
+        }
+        if (parser.isTruncated()) {
+            readFailed = true;
+        }
+    } catch (TarParser::Exception) {
+        readFailed = true;
+    }
+
+    pthread_mutex_lock(mutex);
+    closed = true;
+    pthread_cond_broadcast(queued);
+    pthread_mutex_unlock(mutex);
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+
+    /* now that all files are complete, their hard links can be made: */
+    for (vector<Link>::const_iterator iter = links.begin();
+         iter != links.end();
+         ++iter) {
+        int parentFd = openParent(iter->path, leaf);
+        report(iter->name, makeSpecial('1', parentFd, leaf, iter->target,
+                                       0, 0, Metadata()));
+    }
+    /* and no more members are created below the symbolic links: */
+    for (map<string, Link>::const_iterator iter = symlinks.begin();
+         iter != symlinks.end();
+         ++iter) {
+        int parentFd = openParent(iter->second.path, leaf);
+        report(iter->second.name,
+               makeSpecial('2', parentFd, leaf, iter->second.target,
+                           0, 0, iter->second.metadata));
+    }
+    if (lastParentFd >= 0) {
+        close(lastParentFd);
+    }
+    finishDirectories();
+    if (rootFd >= 0) {
+        close(rootFd);
+    }
+
+    /* tar, too, reads the archive to its end */
+    char rest[TarParser::BLOCK_SIZE * 16];
+    ssize_t count;
+    while (((count = read(sourceFd, rest, sizeof(rest))) > 0)
+           || ((count < 0) && (errno == EINTR))) {
+    }
+    close(sourceFd);
+    return this;
+}
+
+bool TarExtractor::cleanName(const string & name, string & clean) {
+    clean.erase();
+    size_t position = 0;
+    while (position < name.size()) {
+        size_t next = name.find('/', position);
+        if (next == string::npos) {
+            next = name.size();
+        }
+        size_t length = next - position;
+        if ((length == 2) && (name.compare(position, 2, "..") == 0)) {
+            return false;
+        }
+        if ((length > 1) || ((length == 1) && (name[position] != '.'))) {
+            if (!clean.empty()) {
+                clean += '/';
+            }
+            clean.append(name, position, length);
+        }
+        position = next + 1;
+    }
+    return true;
+}
+
+bool TarExtractor::isSelected(const string & name) const {
+    if (selection.count(name) != 0) {
+        return true;
+    }
+    for (size_t slash = name.find('/');
+         slash != string::npos;
+         slash = name.find('/', slash + 1)) {
+        if (selection.count(name.substr(0, slash)) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TarExtractor::openDirectory(const string & path, bool create,
+                                mode_t mode) const {
+    if (path.empty()) {
+        return dup(rootFd);
+    }
+    int fd = rootFd;
+    size_t position = 0;
+    while ((fd >= 0) && (position < path.size())) {
+        size_t next = path.find('/', position);
+        if (next == string::npos) {
+            next = path.size();
+        }
+        string component(path, position, next - position);
+        int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW;
+        int child = openat(fd, component.c_str(), flags);
+        if ((child < 0) && create) {
+            if ((errno == ENOTDIR) || (errno == ELOOP)) {
+                /* a file or link of the same name is replaced */
+                unlinkat(fd, component.c_str(), 0);
+            }
+            mode_t componentMode = (next == path.size())
+                ? mode : (S_IRWXU | S_IRWXG | S_IRWXO);
+            if ((mkdirat(fd, component.c_str(), componentMode) == 0)
+                || (errno == EEXIST)) {
+                child = openat(fd, component.c_str(), flags);
+            }
+        }
+        if (fd != rootFd) {
+            close(fd);
+        }
+        fd = child;
+        position = next + 1;
+    }
+    return fd;
+}
+
+int TarExtractor::openParent(const string & path, string & leaf) {
+    string parent;
+    splitName(path, parent, leaf);
+    if ((lastParentFd < 0) || (parent != lastParent)) {
+        if (lastParentFd >= 0) {
+            close(lastParentFd);
+        }
+        lastParentFd = openDirectory(parent, true,
+                                     S_IRWXU | S_IRWXG | S_IRWXO);
+        lastParent = parent;
+    }
+    return lastParentFd;
+}
+
+int TarExtractor::createFile(int parentFd, const string & leaf,
+                             mode_t mode) {
+    int flags = O_WRONLY | O_CREAT | O_EXCL;
+    int fd = openat(parentFd, leaf.c_str(), flags, mode);
+    if ((fd < 0) && (errno == EEXIST)) {
+        /* never write through an existing link */
+        if (unlinkat(parentFd, leaf.c_str(), 0) == 0) {
+            fd = openat(parentFd, leaf.c_str(), flags, mode);
+        }
+    }
+    return fd;
+}
+
+bool TarExtractor::writeSparse(int fd, long long offset, const char * data,
+                               size_t length, bool preallocated,
+                               long long & end) {
+    const char * stop = data + length;
+    while (data < stop) {
+        /* a run of pages that are all zeros, or all not: */
+        const char * runStart = data;
+        long long runOffset = offset;
+        bool zeros = false;
+        while (data < stop) {
+            size_t pageLength = SPARSE_PAGE_SIZE - offset % SPARSE_PAGE_SIZE;
+            if (pageLength > size_t(stop - data)) {
+                pageLength = stop - data;
+            }
+            bool pageIsZero = (memcmp(data, zeroPage, pageLength) == 0);
+            if ((data != runStart) && (pageIsZero != zeros)) {
+                break;
+            }
+            zeros = pageIsZero;
+            data += pageLength;
+            offset += pageLength;
+        }
+        if (zeros) {
+            continue;
+        }
+
+        /*
+         * the zeros since the last write may have begun in an earlier
+         * piece. Only a hole over all of them frees whole pages.
+         */
+        if (preallocated && (runOffset > end)) {
+            punchHole(fd, end, runOffset);
+        }
+        if (!writeAt(fd, runStart, data - runStart, runOffset)) {
+            return false;
+        }
+        end = offset;
+    }
+    return true;
+}
+
+bool TarExtractor::finishFile(int fd, long long size, long long written,
+                              bool preallocated,
+                              const Metadata & metadata) const {
+    bool success = true;
+    /* the file may end with left out zeros */
+    if (preallocated) {
+        if (written < size) {
+            punchHole(fd, written, size);
+        }
+    } else if (written < size) {
+        success = (ftruncate(fd, size) == 0);
+    }
+    if (restoreOwners) {
+        success = (fchown(fd, metadata.uid, metadata.gid) == 0) && success;
+    }
+    /*
+     * open() has set the permissions already, unless the umask removed
+     * some, or fchown() removed the set-id bits
+     */
+    if (((metadata.mode & umaskBits) != 0)
+        || (restoreOwners && ((metadata.mode & (S_ISUID | S_ISGID)) != 0))) {
+        success = (fchmod(fd, metadata.mode) == 0) && success;
+    }
+    struct timespec times[2];
+    setTimes(times, metadata.mtime);
+    success = (futimens(fd, times) == 0) && success;
+    return (close(fd) == 0) && success;
+}
+
+void TarExtractor::writeLargeFile(TarParser & parser, const string & name,
+                                  int parentFd, const string & leaf,
+                                  long long size, const Metadata & metadata) {
+    int fd = createFile(parentFd, leaf, metadata.mode);
+    if (fd < 0) {
+        /* the parser skips the data */
+        report(name, false);
+        return;
+    }
+    bool preallocated = (fallocate(fd, 0, 0, size) == 0);
+    bool success = true;
+    long long offset = 0;
+    long long written = 0;
+    const char * data;
+    size_t length;
+    try {
+        while ((length = parser.getData(data)) > 0) {
+            success = success
+                && writeSparse(fd, offset, data, length, preallocated,
+                               written);
+            offset += length;
+        }
+    } catch (TarParser::Exception) {
+        close(fd);
+        report(name, false);
+        throw;
+    }
+    success = finishFile(fd, size, written, preallocated, metadata)
+        && success && (offset == size);
+    report(name, success);
+}
+
+void TarExtractor::writeJob(const Job & job) {
+    int fd = createFile(job.parentFd, job.leaf, job.metadata.mode);
+    if (job.parentFd >= 0) {
+        close(job.parentFd);
+    }
+    if (fd < 0) {
+        report(job.name, false);
+        return;
+    }
+    long long size = job.data.size();
+    bool preallocated = (size >= PREALLOCATE_SIZE)
+        && (fallocate(fd, 0, 0, size) == 0);
+    long long written = 0;
+    bool success = (size == 0)
+        || writeSparse(fd, 0, &job.data[0], size, preallocated, written);
+    success = finishFile(fd, size, written, preallocated, job.metadata)
+        && success;
+    if (!job.name.empty()) {
+        report(job.name, success);
+    }
+}
+
+bool TarExtractor::makeSpecial(char type, int parentFd, const string & leaf,
+                               const string & target,
+                               unsigned devMajor, unsigned devMinor,
+                               const Metadata & metadata) const {
+    /* the target of a hard link is looked up like the members */
+    int targetFd = -1;
+    string targetLeaf;
+    if (type == '1') {
+        string targetParent;
+        splitName(target, targetParent, targetLeaf);
+        targetFd = openDirectory(targetParent, false, 0);
+        if (targetFd < 0) {
+            return false;
+        }
+    }
+    const char * name = leaf.c_str();
+    bool created = false;
+    for (int attempt = 0; ; ++attempt) {
+        int result;
+        switch (type) {
+        case '1':
+            /* a symbolic link as target is linked itself */
+            result = linkat(targetFd, targetLeaf.c_str(), parentFd, name, 0);
+            break;
+        case '2':
+            result = symlinkat(target.c_str(), parentFd, name);
+            break;
+        case '3':
+            result = mknodat(parentFd, name, S_IFCHR | metadata.mode,
+                             makedev(devMajor, devMinor));
+            break;
+        case '4':
+            result = mknodat(parentFd, name, S_IFBLK | metadata.mode,
+                             makedev(devMajor, devMinor));
+            break;
+        default:
+            result = mkfifoat(parentFd, name, metadata.mode);
+            break;
+        }
+        if (result == 0) {
+            created = true;
+            break;
+        }
+        if ((attempt > 0) || (errno != EEXIST)
+            || (unlinkat(parentFd, name, 0) != 0)) {
+            break;
+        }
+    }
+    if (type == '1') {
+        close(targetFd);
+        /* a hard link shares its target's metadata */
+        return created;
+    }
+    if (!created) {
+        return false;
+    }
+
+    bool success = true;
+    if (restoreOwners) {
+        success = (fchownat(parentFd, name, metadata.uid, metadata.gid,
+                            AT_SYMLINK_NOFOLLOW) == 0);
+    }
+    if ((type != '2')
+        && (((metadata.mode & umaskBits) != 0) || restoreOwners)) {
+        success = (fchmodat(parentFd, name, metadata.mode, 0) == 0)
+            && success;
+    }
+    struct timespec times[2];
+    setTimes(times, metadata.mtime);
+    return (utimensat(parentFd, name, times, AT_SYMLINK_NOFOLLOW) == 0)
+        && success;
+}
+
+void TarExtractor::finishDirectories(void) {
+    /* children sort after their parents */
+    std::sort(directories.begin(), directories.end());
+    struct timespec times[2];
+    for (vector<Directory>::reverse_iterator iter = directories.rbegin();
+         iter != directories.rend();
+         ++iter) {
+        int fd = openDirectory(iter->path, false, 0);
+        if (fd < 0) {
+            report(iter->name, false);
+            continue;
+        }
+        bool success = true;
+        if (restoreOwners) {
+            success = (fchown(fd, iter->metadata.uid,
+                              iter->metadata.gid) == 0);
+        }
+        success = (fchmod(fd, iter->metadata.mode) == 0) && success;
+        setTimes(times, iter->metadata.mtime);
+        success = (futimens(fd, times) == 0) && success;
+        report(iter->name, (close(fd) == 0) && success);
+    }
+}
+
+void TarExtractor::queue(Job * job) {
+    size_t bytes = job->data.size() + TarParser::BLOCK_SIZE;
+    pthread_mutex_lock(mutex);
+    while ((queuedBytes > 0) && (queuedBytes + bytes > MAX_QUEUED_BYTES)) {
+        pthread_cond_wait(written, mutex);
+    }
+    jobs.push_back(job);
+    queuedBytes += bytes;
+    pthread_cond_signal(queued);
+    pthread_mutex_unlock(mutex);
+}
+
+void TarExtractor::drain(void) {
+    pthread_mutex_lock(mutex);
+    while (!jobs.empty() || (busyWriters > 0)) {
+        pthread_cond_wait(written, mutex);
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+void * TarExtractor::Worker::run(void) {
+    extractor.work();
+    return this;
+}
+
+void TarExtractor::work(void) {
+    for (;;) {
+        pthread_mutex_lock(mutex);
+        while (jobs.empty() && !closed) {
+            pthread_cond_wait(queued, mutex);
+        }
+        if (jobs.empty()) {
+            pthread_mutex_unlock(mutex);
+            break;
+        }
+        Job * job = jobs.front();
+        jobs.pop_front();
+        ++busyWriters;
+        pthread_mutex_unlock(mutex);
+
+        writeJob(*job);
+        size_t bytes = job->data.size() + TarParser::BLOCK_SIZE;
+        delete job;
+
+        pthread_mutex_lock(mutex);
+        --busyWriters;
+        queuedBytes -= bytes;
+        pthread_cond_broadcast(written);
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+void TarExtractor::report(const string & name, bool success) {
+    pthread_mutex_lock(mutex);
+    if (success) {
+        ++extractedCount;
+    } else {
+        failedFiles.push_back(name);
+    }
+    pthread_mutex_unlock(mutex);
+}
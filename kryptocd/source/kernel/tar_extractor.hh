@@ -0,0 +1,423 @@
+/*
+ * tar_extractor.hh: class TarExtractor header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef TAR_EXTRACTOR_HH
+#define TAR_EXTRACTOR_HH
+
+#include "thread.hh"
+#include <sys/types.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+
+namespace KryptoCD {
+    class Source;
+    class TarParser;
+
+    /**
+     * Class TarExtractor restores the members of a tar archive below a
+     * directory, without a tar process. A thread reads the archive with a
+     * TarParser and creates directories, links and special files itself.
+     * <p>
+     * Regular files up to MAX_BUFFERED_SIZE are copied out of the parser's
+     * buffer and handed to a pool of writer threads, which create, write
+     * and close them. When millions of small files are restored, the time
+     * goes into open(), close() and the metadata updates of the file
+     * system, not into copying data, and several threads keep several of
+     * these calls in flight. Larger files are written by the reading
+     * thread while the writers go on with the small ones.
+     * <p>
+     * Files of at least PREALLOCATE_SIZE are preallocated with fallocate(),
+     * so that the file system can give them contiguous space at once.
+     * Pages of zeros are not written: in a preallocated file, holes are
+     * punched for them, otherwise they are just skipped. Sparse files
+     * therefore stay sparse, although the archive does not record their
+     * holes.
+     * <p>
+     * Ownership, permissions and times of files are set through the open
+     * descriptor before it is closed. Those of directories are set in one
+     * batch after all members have been written, deepest directories
+     * first, because creating files in a directory changes its mtime, and
+     * its permissions might not allow it.
+     * <p>
+     * No member is created outside the directory: members are created
+     * through a descriptor of their parent directory, which is opened
+     * component by component from the directory without following
+     * symbolic links. Symbolic links of the archive are created after all
+     * other members, as GNU tar does, so that no later member is written
+     * through them.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class TarExtractor : public Thread {
+    public:
+        /**
+         * regular files up to this size are written by the writer threads
+         */
+        static const unsigned MAX_BUFFERED_SIZE = 1024 * 1024;
+
+        /**
+         * the writer threads hold at most this many bytes of file data
+         */
+        static const unsigned MAX_QUEUED_BYTES = 32 * 1024 * 1024;
+
+        /**
+         * smaller files are not preallocated, because the extra system
+         * call costs more than it saves
+         */
+        static const unsigned PREALLOCATE_SIZE = 64 * 1024;
+
+        /**
+         * the size of the pages of zeros that become holes
+         */
+        static const unsigned SPARSE_PAGE_SIZE = 4096;
+
+        /**
+         * starts the thread that reads the archive and extracts it.
+         *
+         * @param source    The source of the tar archive data. The
+         *                  TarExtractor takes it over, and *will* *close* it.
+         * @param directory the directory to extract into. It must exist.
+         *                  Leading slashes are removed from the members'
+         *                  names, and members with ".." in their names are
+         *                  not extracted.
+         * @param threads   the number of writer threads
+         * @param selection if not 0, only the members with these names,
+         *                  and those below directories with these names,
+         *                  are extracted. Names are given as in the
+         *                  archive, without leading and trailing slashes.
+         */
+        TarExtractor(Source & source, const std::string & directory,
+                     int threads,
+                     const std::vector<std::string> * selection = 0);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~TarExtractor();
+
+        /**
+         * waits until all members have been extracted, and the metadata of
+         * the directories has been set
+         */
+        void wait(void);
+
+        /**
+         * @return true if the archive could not be read, had a damaged
+         *         header, or ended prematurely. Only valid after wait().
+         */
+        bool archiveFailed(void) const;
+
+        /**
+         * @return the names of the members that could not be extracted
+         *         completely, as in the archive. Only valid after wait().
+         */
+        const std::vector<std::string> & getFailedFiles(void) const;
+
+        /**
+         * @return the number of members extracted. Only valid after
+         *         wait().
+         */
+        size_t getExtractedCount(void) const;
+
+    protected:
+        /**
+         * Method run() is executed by the new thread. It starts the
+         * writers, parses the archive, and reads the input to its end, so
+         * that the writer of the archive does not get SIGPIPE.
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * the ownership, permissions and time of a member
+         */
+        struct Metadata {
+            mode_t mode;
+            uid_t uid;
+            gid_t gid;
+            time_t mtime;
+        };
+
+        /**
+         * a regular file for the writer threads
+         */
+        struct Job {
+            /**
+             * the name in the archive, a descriptor of the directory to
+             * create the file in, which the writer closes, and the name
+             * to create there
+             */
+            std::string name;
+            int parentFd;
+            std::string leaf;
+            Metadata metadata;
+            std::vector<char> data;
+        };
+
+        /**
+         * a directory whose metadata is set at the end
+         */
+        struct Directory {
+            /**
+             * the name in the archive, and the cleaned name
+             */
+            std::string name;
+            std::string path;
+            Metadata metadata;
+            bool operator<(const Directory & other) const {
+                return path < other.path;
+            }
+        };
+
+        /**
+         * a hard link, created at the end, when its target is surely
+         * complete, or a symbolic link, created after it
+         */
+        struct Link {
+            /**
+             * the name in the archive, the cleaned name, and the cleaned
+             * name of a hard link's target, or a symbolic link's contents
+             */
+            std::string name;
+            std::string path;
+            std::string target;
+            Metadata metadata;
+        };
+
+        /**
+         * removes leading and trailing slashes, empty components and "."
+         * from a member's name
+         *
+         * @param name  a name as in the archive
+         * @param clean receives the cleaned name, empty for the top
+         *              directory
+         * @return      false if the name contains "..", so that the member
+         *              would be created outside the directory
+         */
+        static bool cleanName(const std::string & name, std::string & clean);
+
+        /**
+         * @param name a cleaned name
+         * @return     true if the name, or one of the directories above it,
+         *             was selected in the constructor
+         */
+        bool isSelected(const std::string & name) const;
+
+        /**
+         * opens a directory below the directory passed to the
+         * constructor, without following symbolic links
+         *
+         * @param path   a cleaned name, empty for the directory itself
+         * @param create if true, missing directories are created, and
+         *               other files in their way are replaced
+         * @param mode   the permissions of the directory itself, if it is
+         *               created
+         * @return       a descriptor of the directory, or -1
+         */
+        int openDirectory(const std::string & path, bool create,
+                          mode_t mode) const;
+
+        /**
+         * opens the directory containing a member, creating it and its
+         * parents as far as they do not exist. The last one is kept open
+         * for the next member, and closed by the next call or by run().
+         *
+         * @param path a cleaned name
+         * @param leaf receives the last component of the name
+         * @return     a descriptor of the directory, or -1
+         */
+        int openParent(const std::string & path, std::string & leaf);
+
+        /**
+         * reads a regular file's data from the parser and writes it, on
+         * the reading thread
+         */
+        void writeLargeFile(TarParser & parser,
+                            const std::string & name,
+                            int parentFd, const std::string & leaf,
+                            long long size, const Metadata & metadata);
+
+        /**
+         * writes a buffered regular file, on a writer thread
+         */
+        void writeJob(const Job & job);
+
+        /**
+         * creates "leaf" in a directory as a new regular file, replacing
+         * what was there
+         *
+         * @return a descriptor open for writing, or -1
+         */
+        static int createFile(int parentFd, const std::string & leaf,
+                              mode_t mode);
+
+        /**
+         * writes a piece of a file's data, leaving out pages of zeros
+         *
+         * @param offset       the position of the piece in the file
+         * @param preallocated true if holes have to be punched for the
+         *                     pages of zeros
+         * @param end          the end of the last byte written, before
+         *                     and after the call. The zeros after it are
+         *                     punched out when the next data is written.
+         * @return             false if writing fails
+         */
+        static bool writeSparse(int fd, long long offset, const char * data,
+                                size_t length, bool preallocated,
+                                long long & end);
+
+        /**
+         * sets a file's size, ownership, permissions and times, and
+         * closes it
+         *
+         * @param written      the end of the last byte written
+         * @param preallocated true if the file was preallocated
+         * @return             false if any of this fails
+         */
+        bool finishFile(int fd, long long size, long long written,
+                        bool preallocated, const Metadata & metadata) const;
+
+        /**
+         * creates a symbolic link, hard link, fifo or device as "leaf" in
+         * a directory
+         *
+         * @param target the contents of a symbolic link, or the cleaned
+         *               name of a hard link's target
+         */
+        bool makeSpecial(char type, int parentFd, const std::string & leaf,
+                         const std::string & target,
+                         unsigned devMajor, unsigned devMinor,
+                         const Metadata & metadata) const;
+
+        /**
+         * sets the metadata of all directories
+         */
+        void finishDirectories(void);
+
+        /**
+         * queues a job for the writers, waiting while they hold too much
+         * data
+         */
+        void queue(Job * job);
+
+        /**
+         * waits until the writers have written all queued files
+         */
+        void drain(void);
+
+        /**
+         * the work of one writer thread: write queued files until the
+         * queue is closed and empty
+         */
+        void work(void);
+
+        /**
+         * counts a member as extracted, or adds it to the failed files.
+         * Called from all threads.
+         */
+        void report(const std::string & name, bool success);
+
+        /**
+         * a thread calling work()
+         */
+        class Worker : public Thread {
+            TarExtractor & extractor;
+        public:
+            Worker(TarExtractor & e) : extractor(e) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        int sourceFd;
+        std::string directory;
+
+        /**
+         * a descriptor of the directory, open while run() extracts
+         */
+        int rootFd;
+        int threads;
+        bool selective;
+        std::set<std::string> selection;
+
+        /**
+         * the permission bits that the umask would remove, and whether
+         * we may give files away
+         */
+        mode_t umaskBits;
+        bool restoreOwners;
+
+        /**
+         * the last directory opened by openParent(), so that the files in
+         * a directory do not all open it again
+         */
+        std::string lastParent;
+        int lastParentFd;
+
+        /**
+         * the regular files extracted so far, to notice members that
+         * replace earlier ones
+         */
+        std::set<std::string> extractedFiles;
+
+        std::vector<Directory> directories;
+        std::vector<Link> links;
+
+        /**
+         * the symbolic links, by cleaned name, so that a later member of
+         * the same name replaces one
+         */
+        std::map<std::string, Link> symlinks;
+
+        bool readFailed;
+        size_t extractedCount;
+        std::vector<std::string> failedFiles;
+
+        /**
+         * the writers' queue, the bytes of data in it and in the jobs
+         * being written, the number of jobs being written, and whether
+         * more jobs will come
+         */
+        std::deque<Job *> jobs;
+        size_t queuedBytes;
+        int busyWriters;
+        bool closed;
+
+        /**
+         * Thread's mutex protects the queue, extractedCount and
+         * failedFiles. "queued" is signalled when a job is queued or the
+         * queue is closed, "written" when a job is done.
+         */
+        pthread_cond_t  * queued;
+        pthread_cond_t  * written;
+    };
+}
+#endif
@@ -23,76 +23,76 @@
  */
 
 #include "tar_lister.hh"
-#include "pipe.hh"
-#include <fstream>
+#include "tar_parser.hh"
+#include "source.hh"
 #include <unistd.h>
+#include <errno.h>
+#include <assert.h>
 
 using KryptoCD::TarLister;
-using KryptoCD::Pipe;
-using KryptoCD::ChildFilter;
-using std::string;
-using std::list;
+using KryptoCD::TarParser;
+using KryptoCD::Source;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
 using std::vector;
 
-TarLister::TarLister(const string & tarExecutable,
-                     Source & source, Pipe * pipe = 0)
-    : ChildFilter(tarExecutable,
-                  TarLister::argumentList(tarExecutable),
-                  source, *(pipe = new Pipe)),
-    threadFinished(false)
+TarLister::TarLister(Source & source)
+    : readFailed(false)
 {
-    listPipe = pipe;
+    sourceFd = dup(source.getSourceFd());
+    source.closeSource();
     int success = start();
     assert(success == 0);
 }
-  
-vector<string> TarLister::argumentList(const string & tarExecutable) {
-    vector<string> argumentList;
 
-    argumentList.push_back(tarExecutable);
-    argumentList.push_back("--list");
-    argumentList.push_back("--file=-");
-    return argumentList;
+TarLister::~TarLister() {
+    join();
 }
 
 void * TarLister::run(void) {
-    pthread_mutex_lock(mutex);
-    {
-        ifstream tarStdout(listPipe->getSourceFd());
-        string filename;
-        while (getline(tarStdout, filename)) {
-            files.push_back(filename);
+    TarParser parser(sourceFd);
+    TarParser::Entry entry;
+    try {
+        while (parser.next(entry)) {
+            files.push_back(paths.intern(entry.name));
+            members.push_back(Member());
+            members.back().file = files.back();
+            members.back().offset = entry.offset;
+            members.back().dataOffset = entry.dataOffset;
+            members.back().size = entry.size;
+            members.back().mtime = entry.mtime;
         }
+    } catch (TarParser::Exception) {
+        readFailed = true;
     }
-    listPipe->closeSource();
-    delete listPipe;
-    listPipe = 0;
-    threadFinished=true;
-    pthread_mutex_unlock(mutex);
+
+    /* tar, too, reads the archive to its end */
+    char rest[TarParser::BLOCK_SIZE * 16];
+    ssize_t count;
+    while (((count = read(sourceFd, rest, sizeof(rest))) > 0)
+           || ((count < 0) && (errno == EINTR))) {
+    }
+    close(sourceFd);
     return this;
 }
 
-const list<string> & TarLister::getFileList() {
-    bool threadStillReading;
-    
-    wait();
-    /* Make sure the thread has done its job */
-    do {
-        pthread_mutex_lock(mutex);
-        /*
-          Mutex aquiration may also succeed before the thread reaches its
-          own mutex_lock call. So make sure it has read the file names before
-          going on:
-        */
-        threadStillReading = !threadFinished;
-        pthread_mutex_unlock(mutex);
-    } while (threadStillReading);
-
+const PathList & TarLister::getFileList() {
     /*
-     * Ok, the thread finished. Now it is safe to return a const reference to
-     * "files", because it will not change any more.
+     * Once the thread has finished, it is safe to return a const reference
+     * to "files", because it will not change any more.
      */
+    join();
     return files;
 }
 
-    
+const vector<TarLister::Member> & TarLister::getMembers() const {
+    return members;
+}
+
+const PathStore & TarLister::getPathStore() const {
+    return paths;
+}
+
+bool TarLister::failed() const {
+    return readFailed;
+}
@@ -25,97 +25,105 @@
 #ifndef TAR_LISTER_HH
 #define TAR_LISTER_HH
 
-#include "child_filter.hh"
 #include "thread.hh"
-#include <list>
+#include "path_store.hh"
+#include <vector>
 
 namespace KryptoCD {
     class Source;
-    class Pipe;
 
     /**
-     * Class tarLister examines what files are present in a tar archive.
-     * It works only if all file and path names in the archive do not
-     * contain newlines, backslashes and perhaps other funny characters (but
-     * latin 1 characters 128-255 ?should? work).
-     * 
-     * The List is received from tar's stdout.
+     * Class TarLister examines what files are present in a tar archive.
+     * A thread reads the archive with a TarParser, so the names arrive
+     * exactly as they are stored, whatever characters they contain, and
+     * without a tar process.
      *
      * @author Tobias Peters
      * @version $Revision: 1.2 $ $Date: 2001/05/19 21:56:19 $
      */
-    class TarLister : public ChildFilter, public Thread {
+    class TarLister : public Thread {
+    public:
         /**
-         * Here we store the names of the listed files.
+         * where a listed file is stored in the archive
          */
-        std::list<std::string> files;
-        Pipe * listPipe;
+        struct Member {
+            PathId file;
+
+            /**
+             * the offsets of the member's first header and of its data
+             */
+            long long offset;
+            long long dataOffset;
+
+            /**
+             * the number of data bytes
+             */
+            long long size;
+
+            time_t mtime;
+        };
 
-    public:
         /**
-         * Instanciation of an object of class TarLister causes
-         * <ul>
-         *   <li> the spawning of a child process (tar) with the following
-         *        command line:
-         *   <ver>
-         *   <tar executable> --list --file=-
-         *   </ver>
-         *   <li> the spawning of a thread whose single task is to read the
-         *     stdout of the tar process and store the recognized file names
-         *     in the list "files". After tar closes its stdout, the thread
-         *     exits.
-         * </ul>
-         * The tar process will then create a tar archive containing the
-         * given files.
-         * <P>
-         * tar receives the archive data through its stdin.
-         * The last argument to the constructor is unimportatnt to clients,
-         * and only needed internally.
+         * starts the thread that reads the archive and stores the names
+         * of its members in the list "files" and the store "paths".
          *
-         * @param tarExecutable  A string containing the filesystem location of
-         *                       the GNU tar executable.
-         * @param source         The source of the tar archive data.
-         *                       The TarLister object will hand it over to the
-         *                       childprocess'es stdin *and* *will* *close* it
-         *                       inside this process.
+         * @param source The source of the tar archive data. The TarLister
+         *               takes it over, and *will* *close* it.
          */
-        TarLister(const std::string & tarExecutable, Source & source,
-                  Pipe * = 0);
+        TarLister(Source & source);
 
         /**
-         * getFileList waits for the tar process and the reading thread to
-         * finish, then return the list of filenames we got from tar.
+         * waits for the thread
+         */
+        virtual ~TarLister();
+
+        /**
+         * getFileList waits for the reading thread to finish, then returns
+         * the list of filenames in the archive.
          *
          * @return the list of file names mentioned in the tar archive.
          *         Note: if the tar archive ends prematurely, then file with
          *         the last filename in the list will not be contained
          *         completely inside the archive.
          */
-        const std::list<std::string> & getFileList();
+        const PathList & getFileList();
+
+        /**
+         * @return the members, in the order of getFileList(). Only valid
+         *         after getFileList() has returned.
+         */
+        const std::vector<Member> & getMembers() const;
+
+        /**
+         * @return the store containing the names in getFileList(). Only
+         *         valid after getFileList() has returned.
+         */
+        const PathStore & getPathStore() const;
+
+        /**
+         * @return true if the archive could not be read, or had a damaged
+         *         header. Only valid after getFileList() has returned.
+         */
+        bool failed() const;
 
     protected:
         /**
-         * Method run() is executed by the new thread. It reads newline
-         * separated filenames from tar's stdout and stores them in the list
-         * "files".
+         * Method run() is executed by the new thread. It parses the
+         * archive, and reads the input to its end, so that the writer
+         * does not get SIGPIPE.
          */
         virtual void * run(void);
 
     private:
         /**
-         * argumentList is called during the construction to build
-         * a vector of command line arguments. These arguments are needed
-         * to initialize the parent class of TarLister, ChildFilter
-         *
-         * @param tarExecutable  The location of the "tar" executable file.
-         * @return               a vector of strings, the command line
-         *                       arguments to execute tar
+         * Here we store the names of the listed files, in archive order.
+         * The names are kept in a store of their own.
          */
-        static std::vector<std::string>
-        argumentList(const std::string & tarExecutable);
-
-
-        bool threadFinished;
+        PathStore paths;
+        PathList files;
+        std::vector<Member> members;
+        int sourceFd;
+        bool readFailed;
     };
 }
 
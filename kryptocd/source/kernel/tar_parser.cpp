@@ -0,0 +1,425 @@
+/*
+ * tar_parser.cpp: class TarParser implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tar_parser.hh"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+using KryptoCD::TarParser;
+using std::string;
+
+/**
+ * the positions and lengths of the ustar header fields, see TarWriter
+ */
+enum {
+    NAME = 0,       NAME_LENGTH = 100,
+    MODE = 100,     MODE_LENGTH = 8,
+    UID = 108,      UID_LENGTH = 8,
+    GID = 116,      GID_LENGTH = 8,
+    SIZE = 124,     SIZE_LENGTH = 12,
+    MTIME = 136,    MTIME_LENGTH = 12,
+    CHECKSUM = 148, CHECKSUM_LENGTH = 8,
+    TYPE = 156,
+    LINKNAME = 157, LINKNAME_LENGTH = 100,
+    MAGIC = 257,
+    VERSION = 263,
+    DEVMAJOR = 329, DEVMAJOR_LENGTH = 8,
+    DEVMINOR = 337, DEVMINOR_LENGTH = 8,
+    PREFIX = 345,   PREFIX_LENGTH = 155
+};
+
+/**
+ * the largest extended header that is read, a guard against damaged
+ * archives
+ */
+static const long long MAX_EXTENSION_SIZE = 16 * 1024 * 1024;
+
+/**
+ * reads a number field: octal digits, or GNU tar's base-256 format for
+ * numbers that do not fit, marked by the high bit of the first byte
+ *
+ * @return false if the field is neither
+ */
+static bool getNumberField(const char * field, size_t length, long long & value) {
+    const unsigned char * bytes =
+        reinterpret_cast<const unsigned char *>(field);
+    if (bytes[0] & 0x80) {
+        /* two's complement, the marker bit belongs to the sign */
+        unsigned long long number = (bytes[0] == 0xff) ? ~0ULL
+                                                       : (bytes[0] & 0x7f);
+        for (size_t i = 1; i < length; ++i) {
+            number = (number << 8) | bytes[i];
+        }
+        value = static_cast<long long>(number);
+        return true;
+    }
+    size_t i = 0;
+    while ((i < length) && (field[i] == ' ')) {
+        ++i;
+    }
+    unsigned long long number = 0;
+    for (; (i < length) && (field[i] >= '0') && (field[i] <= '7'); ++i) {
+        number = (number << 3) | (field[i] - '0');
+    }
+    if ((i < length) && (field[i] != ' ') && (field[i] != '\0')) {
+        return false;
+    }
+    value = static_cast<long long>(number);
+    return true;
+}
+
+/**
+ * @return a string field, which is NUL terminated unless it fills the
+ *         whole field
+ */
+static string getString(const char * field, size_t length) {
+    const void * nul = memchr(field, '\0', length);
+    return string(field, (nul == 0) ? length
+                                    : static_cast<const char *>(nul) - field);
+}
+
+/**
+ * @return true if the header's checksum is right. Some old tars summed
+ *         the bytes as signed chars.
+ */
+static bool checksumIsRight(const char * header) {
+    long long stored;
+    if (!getNumberField(header + CHECKSUM, CHECKSUM_LENGTH, stored)) {
+        return false;
+    }
+    long long unsignedSum = 0;
+    long long signedSum = 0;
+    for (unsigned i = 0; i < TarParser::BLOCK_SIZE; ++i) {
+        char c = ((i >= CHECKSUM) && (i < CHECKSUM + CHECKSUM_LENGTH))
+            ? ' ' : header[i];
+        unsignedSum += static_cast<unsigned char>(c);
+        signedSum += static_cast<signed char>(c);
+    }
+    return (stored == unsignedSum) || (stored == signedSum);
+}
+
+static bool isZero(const char * block) {
+    for (unsigned i = 0; i < TarParser::BLOCK_SIZE; ++i) {
+        if (block[i] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * the values of a pax extended header that TarParser uses
+ */
+struct PaxValues {
+    bool hasPath, hasLinkPath, hasSize, hasMtime, hasUid, hasGid;
+    string path, linkPath;
+    long long size, mtime, uid, gid;
+
+    PaxValues()
+        : hasPath(false), hasLinkPath(false), hasSize(false),
+          hasMtime(false), hasUid(false), hasGid(false) {}
+};
+
+/**
+ * parses the records "<length> <key>=<value>\n" of a pax extended header
+ *
+ * @return false if they are malformed
+ */
+static bool parsePax(const string & data, PaxValues & values) {
+    size_t position = 0;
+    while (position < data.size()) {
+        char * digitsEnd;
+        unsigned long length = strtoul(data.c_str() + position, &digitsEnd,
+                                       10);
+        size_t space = digitsEnd - data.c_str();
+        if ((space == position) || (*digitsEnd != ' ') || (length == 0)
+            || (length > data.size() - position)
+            || (data[position + length - 1] != '\n')) {
+            return false;
+        }
+        size_t equals = data.find('=', space + 1);
+        if ((equals == string::npos) || (equals >= position + length)) {
+            return false;
+        }
+        string key = data.substr(space + 1, equals - space - 1);
+        string value = data.substr(equals + 1,
+                                   position + length - 1 - equals - 1);
+        long long number = strtoll(value.c_str(), 0, 10);
+        if (key == "path") {
+            values.hasPath = true;
+            values.path = value;
+        } else if (key == "linkpath") {
+            values.hasLinkPath = true;
+            values.linkPath = value;
+        } else if (key == "size") {
+            values.hasSize = true;
+            values.size = number;
+        } else if (key == "mtime") {
+            values.hasMtime = true;
+            values.mtime = number;
+        } else if (key == "uid") {
+            values.hasUid = true;
+            values.uid = number;
+        } else if (key == "gid") {
+            values.hasGid = true;
+            values.gid = number;
+        }
+        position += length;
+    }
+    return true;
+}
+
+TarParser::TarParser(int fd_)
+    : fd(fd_),
+      seekable(false),
+      buffer(BUFFER_SIZE),
+      start(0),
+      end(0),
+      position(0),
+      remaining(0),
+      padding(0),
+      truncated(false)
+{
+    struct stat st;
+    seekable = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode)
+        && (lseek(fd, 0, SEEK_CUR) != -1);
+}
+
+size_t TarParser::fill(size_t needed) throw(TarParser::Exception) {
+    if (end - start >= needed) {
+        return end - start;
+    }
+    if (start > 0) {
+        memmove(&buffer[0], &buffer[start], end - start);
+        end -= start;
+        start = 0;
+    }
+    while (end < needed) {
+        ssize_t count = read(fd, &buffer[end], buffer.size() - end);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Exception(Exception::UNABLE_TO_READ);
+        }
+        if (count == 0) {
+            break;
+        }
+        end += count;
+    }
+    return end;
+}
+
+bool TarParser::skip(long long length) throw(TarParser::Exception) {
+    if (length <= static_cast<long long>(end - start)) {
+        start += length;
+        position += length;
+        return true;
+    }
+    length -= end - start;
+    position += end - start;
+    start = end = 0;
+
+    if (seekable) {
+        off_t here = lseek(fd, length, SEEK_CUR);
+        struct stat st;
+        if ((here == -1) || (fstat(fd, &st) != 0)) {
+            throw Exception(Exception::UNABLE_TO_READ);
+        }
+        position += length;
+        return here <= st.st_size;
+    }
+    while (length > 0) {
+        size_t wanted = (length < static_cast<long long>(buffer.size()))
+            ? static_cast<size_t>(length) : buffer.size();
+        ssize_t count = read(fd, &buffer[0], wanted);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Exception(Exception::UNABLE_TO_READ);
+        }
+        if (count == 0) {
+            return false;
+        }
+        length -= count;
+        position += count;
+    }
+    return true;
+}
+
+bool TarParser::readExtension(long long size, string & data)
+    throw(TarParser::Exception) {
+    if ((size < 0) || (size > MAX_EXTENSION_SIZE)) {
+        throw Exception(Exception::BAD_HEADER);
+    }
+    data.erase();
+    long long left = size;
+    while (left > 0) {
+        size_t available = fill(1);
+        if (available == 0) {
+            return false;
+        }
+        size_t count = (static_cast<long long>(available) < left)
+            ? available : static_cast<size_t>(left);
+        data.append(&buffer[start], count);
+        start += count;
+        position += count;
+        left -= count;
+    }
+    return skip((BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE);
+}
+
+bool TarParser::next(Entry & entry) throw(TarParser::Exception) {
+    if (truncated) {
+        return false;
+    }
+    if (!skip(remaining + padding)) {
+        truncated = true;
+        remaining = padding = 0;
+        return false;
+    }
+    remaining = padding = 0;
+
+    long long offset = position;
+    PaxValues pax;
+    string longName, longLinkName;
+    for (;;) {
+        if (fill(BLOCK_SIZE) < BLOCK_SIZE) {
+            truncated = true;
+            return false;
+        }
+        const char * header = &buffer[start];
+        if (isZero(header)) {
+            /* the end of the archive */
+            return false;
+        }
+        long long size;
+        if (!checksumIsRight(header)
+            || !getNumberField(header + SIZE, SIZE_LENGTH, size) || (size < 0)) {
+            throw Exception(Exception::BAD_HEADER);
+        }
+        char type = header[TYPE];
+
+        if ((type == 'x') || (type == 'g') || (type == 'L')
+            || (type == 'K')) {
+            /* an extension for the following header */
+            start += BLOCK_SIZE;
+            position += BLOCK_SIZE;
+            string data;
+            if (!readExtension(size, data)) {
+                truncated = true;
+                return false;
+            }
+            if ((type == 'x') && !parsePax(data, pax)) {
+                throw Exception(Exception::BAD_HEADER);
+            } else if (type == 'L') {
+                longName = getString(data.data(), data.size());
+            } else if (type == 'K') {
+                longLinkName = getString(data.data(), data.size());
+            }
+            continue;
+        }
+
+        /* the prefix field only exists in POSIX ustar headers */
+        string prefix;
+        if (memcmp(header + MAGIC, "ustar\0", 6) == 0) {
+            prefix = getString(header + PREFIX, PREFIX_LENGTH);
+        }
+        if (pax.hasPath) {
+            entry.name = pax.path;
+        } else if (!longName.empty()) {
+            entry.name = longName;
+        } else if (!prefix.empty()) {
+            entry.name = prefix + '/' + getString(header + NAME, NAME_LENGTH);
+        } else {
+            entry.name = getString(header + NAME, NAME_LENGTH);
+        }
+        if (pax.hasLinkPath) {
+            entry.linkName = pax.linkPath;
+        } else if (!longLinkName.empty()) {
+            entry.linkName = longLinkName;
+        } else {
+            entry.linkName = getString(header + LINKNAME, LINKNAME_LENGTH);
+        }
+
+        long long mode, uid, gid, mtime, devMajor, devMinor;
+        if (!getNumberField(header + MODE, MODE_LENGTH, mode)
+            || !getNumberField(header + UID, UID_LENGTH, uid)
+            || !getNumberField(header + GID, GID_LENGTH, gid)
+            || !getNumberField(header + MTIME, MTIME_LENGTH, mtime)) {
+            throw Exception(Exception::BAD_HEADER);
+        }
+        if (!getNumberField(header + DEVMAJOR, DEVMAJOR_LENGTH, devMajor)
+            || !getNumberField(header + DEVMINOR, DEVMINOR_LENGTH, devMinor)) {
+            devMajor = devMinor = 0;
+        }
+        entry.type = ((type == '\0') || (type == '7')) ? '0' : type;
+        entry.mode = mode & 07777;
+        entry.uid = pax.hasUid ? pax.uid : uid;
+        entry.gid = pax.hasGid ? pax.gid : gid;
+        entry.mtime = pax.hasMtime ? pax.mtime : mtime;
+        entry.devMajor = devMajor;
+        entry.devMinor = devMinor;
+        entry.size = pax.hasSize ? pax.size : size;
+        if ((entry.type == '1') || (entry.type == '2') || (entry.type == '3')
+            || (entry.type == '4') || (entry.type == '6')) {
+            /* like GNU tar, links and special files have no data */
+            entry.size = 0;
+        }
+        start += BLOCK_SIZE;
+        position += BLOCK_SIZE;
+        entry.offset = offset;
+        entry.dataOffset = position;
+        remaining = entry.size;
+        padding = (BLOCK_SIZE - entry.size % BLOCK_SIZE) % BLOCK_SIZE;
+        return true;
+    }
+}
+
+size_t TarParser::getData(const char * & data) throw(TarParser::Exception) {
+    if (remaining == 0) {
+        return 0;
+    }
+    size_t available = fill(1);
+    if (available == 0) {
+        truncated = true;
+        remaining = padding = 0;
+        return 0;
+    }
+    size_t count = (static_cast<long long>(available) < remaining)
+        ? available : static_cast<size_t>(remaining);
+    data = &buffer[start];
+    start += count;
+    position += count;
+    remaining -= count;
+    return count;
+}
+
+bool TarParser::isTruncated(void) const {
+    return truncated;
+}
@@ -0,0 +1,200 @@
+/*
+ * tar_parser.hh: class TarParser header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef TAR_PARSER_HH
+#define TAR_PARSER_HH
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class TarParser reads the members of a tar archive from a file
+     * descriptor, without a tar process. It understands ustar headers,
+     * the pax extended headers that TarWriter writes for long names and
+     * large numbers, GNU tar's long name headers and its base-256
+     * numbers.
+     * <p>
+     * Headers are parsed where they lie in the input buffer. The data of
+     * a member is skipped unless it is asked for, by seeking if the
+     * input is a file, otherwise by reading it into the buffer without
+     * looking at it. getData() hands out the data where it lies in the
+     * buffer, too.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class TarParser {
+    public:
+        class Exception {
+        public:
+            enum Reason {
+                UNABLE_TO_READ,
+                BAD_HEADER,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * the size of a tar header or data block
+         */
+        static const unsigned BLOCK_SIZE = 512;
+
+        /**
+         * the size of the input buffer
+         */
+        static const unsigned BUFFER_SIZE = 1024 * 1024;
+
+        /**
+         * a member of the archive
+         */
+        struct Entry {
+            /**
+             * the name as stored, from the pax or GNU long name header if
+             * there is one. Directories end with '/'.
+             */
+            std::string name;
+
+            /**
+             * the target of a hard or symbolic link
+             */
+            std::string linkName;
+
+            /**
+             * the ustar type flag, '0' for regular files
+             */
+            char type;
+
+            mode_t mode;
+            uid_t uid;
+            gid_t gid;
+            time_t mtime;
+            unsigned devMajor;
+            unsigned devMinor;
+
+            /**
+             * the number of data bytes
+             */
+            long long size;
+
+            /**
+             * the offset of the member's first header in the archive, as
+             * in TarWriter::Member
+             */
+            long long offset;
+
+            /**
+             * the offset of the member's data in the archive
+             */
+            long long dataOffset;
+        };
+
+        /**
+         * @param fd the archive. It is read from its current position, and
+         *           not closed.
+         */
+        TarParser(int fd);
+
+        /**
+         * reads the next member's headers, skipping what is left of the
+         * previous member's data
+         *
+         * @param entry receives the member
+         * @return      false at the end of the archive, or if the input
+         *              ends before, see isTruncated()
+         * @exception TarParser::Exception
+         *              UNABLE_TO_READ if reading fails, or BAD_HEADER if
+         *              a header's checksum is wrong
+         */
+        bool next(Entry & entry) throw(Exception);
+
+        /**
+         * hands out the next piece of the current member's data, in place
+         *
+         * @param data receives a pointer into the input buffer, valid up
+         *             to the next call of a method of this object
+         * @return     the number of bytes at data, 0 at the end of the
+         *             member's data
+         * @exception TarParser::Exception UNABLE_TO_READ
+         */
+        size_t getData(const char * & data) throw(Exception);
+
+        /**
+         * @return true if the input has ended before the end of the
+         *         archive. The last entry returned by next() may then lack
+         *         some of its data.
+         */
+        bool isTruncated(void) const;
+
+    private:
+        /**
+         * makes at least "needed" bytes available at "start", if there
+         * are as many before the end of the input
+         *
+         * @return the number of bytes available, at most BUFFER_SIZE
+         */
+        size_t fill(size_t needed) throw(Exception);
+
+        /**
+         * skips input bytes
+         *
+         * @return false if the input ends before
+         */
+        bool skip(long long length) throw(Exception);
+
+        /**
+         * reads the data of an extended header member into a string
+         *
+         * @return false if the input ends before
+         */
+        bool readExtension(long long size, std::string & data)
+            throw(Exception);
+
+        int fd;
+        bool seekable;
+        std::vector<char> buffer;
+
+        /**
+         * the unread bytes are buffer[start] to buffer[end - 1]
+         */
+        size_t start;
+        size_t end;
+
+        /**
+         * the offset in the archive of buffer[start]
+         */
+        long long position;
+
+        /**
+         * the data bytes of the current member not yet handed out, and
+         * the padding after them
+         */
+        long long remaining;
+        long long padding;
+
+        bool truncated;
+    };
+}
+#endif
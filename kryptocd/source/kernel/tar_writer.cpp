@@ -0,0 +1,510 @@
+/*
+ * tar_writer.cpp: class TarWriter implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "tar_writer.hh"
+#include "prefetcher.hh"
+#include "sink.hh"
+#include "xxh64.hh"
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+using KryptoCD::TarWriter;
+using KryptoCD::Xxh64;
+using KryptoCD::PathStore;
+using KryptoCD::PathSlice;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using KryptoCD::Sink;
+using KryptoCD::Prefetcher;
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+/**
+ * the positions and lengths of the ustar header fields
+ */
+enum {
+    NAME = 0,       NAME_LENGTH = 100,
+    MODE = 100,     MODE_LENGTH = 8,
+    UID = 108,      UID_LENGTH = 8,
+    GID = 116,      GID_LENGTH = 8,
+    SIZE = 124,     SIZE_LENGTH = 12,
+    MTIME = 136,    MTIME_LENGTH = 12,
+    CHECKSUM = 148, CHECKSUM_LENGTH = 8,
+    TYPE = 156,
+    LINKNAME = 157, LINKNAME_LENGTH = 100,
+    MAGIC = 257,
+    VERSION = 263,
+    DEVMAJOR = 329, DEVMAJOR_LENGTH = 8,
+    DEVMINOR = 337, DEVMINOR_LENGTH = 8,
+    PREFIX = 345,   PREFIX_LENGTH = 155
+};
+
+static const char ZEROS[TarWriter::BLOCK_SIZE] = {0};
+
+/**
+ * writes a number as octal digits, terminated by NUL, into a header field
+ *
+ * @return false if the number does not fit
+ */
+static bool putOctal(char * field, size_t length,
+                     unsigned long long value) {
+    field[--length] = '\0';
+    while (length > 0) {
+        field[--length] = '0' + (value & 7);
+        value >>= 3;
+    }
+    return value == 0;
+}
+
+static string decimal(long long value) {
+    char text[32];
+    sprintf(text, "%lld", value);
+    return text;
+}
+
+/**
+ * appends a pax extended header record "<length> <key>=<value>\n". The
+ * length includes its own digits.
+ */
+static void addPaxRecord(string & records,
+                         const string & key, const string & value) {
+    size_t length = key.size() + value.size() + 3;
+    size_t digits = decimal(length).size();
+    while (decimal(length + digits).size() != digits) {
+        ++digits;
+    }
+    records += decimal(length + digits);
+    records += ' ';
+    records += key;
+    records += '=';
+    records += value;
+    records += '\n';
+}
+
+/**
+ * splits a name into the ustar prefix and name fields at a slash
+ *
+ * @return false if that is not possible
+ */
+static bool splitName(const string & name, string & prefix, string & base) {
+    if (name.size() <= NAME_LENGTH) {
+        prefix.erase();
+        base = name;
+        return true;
+    }
+    string::size_type slash =
+        name.find('/', name.size() - NAME_LENGTH - 1);
+    if ((slash == string::npos) || (slash > PREFIX_LENGTH)
+        || (slash + 1 >= name.size())) {
+        return false;
+    }
+    prefix = name.substr(0, slash);
+    base = name.substr(slash + 1);
+    return true;
+}
+
+/**
+ * writes the ustar checksum, the sum of all header bytes with the
+ * checksum field counted as spaces
+ */
+static void putChecksum(char * header) {
+    memset(header + CHECKSUM, ' ', CHECKSUM_LENGTH);
+    unsigned long sum = 0;
+    for (unsigned i = 0; i < TarWriter::BLOCK_SIZE; ++i) {
+        sum += static_cast<unsigned char>(header[i]);
+    }
+    putOctal(header + CHECKSUM, CHECKSUM_LENGTH - 1, sum);
+}
+
+/**
+ * writes a whole buffer to a file descriptor
+ *
+ * @return false if writing failed
+ */
+static bool writeAll(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+TarWriter::TarWriter(const PathStore & paths_,
+                     const PathSlice & files_,
+                     Sink & output_)
+    : paths(paths_),
+      files(files_),
+      output(output_),
+      prefetcher(new Prefetcher(paths_, files_, 0)),
+      buffer(BUFFER_SIZE),
+      filled(0),
+      position(0),
+      writeFailed(false)
+{
+    int success = start();
+    assert(success == 0);
+}
+
+TarWriter::~TarWriter() {
+    join();
+    delete prefetcher;
+}
+
+void TarWriter::wait(void) {
+    join();
+}
+
+bool TarWriter::filesFailed(void) const {
+    return !leftOut.empty() || !changed.empty();
+}
+
+bool TarWriter::exitedAbnormally(void) const {
+    return writeFailed;
+}
+
+const vector<TarWriter::Member> & TarWriter::getMembers(void) const {
+    return members;
+}
+
+const PathList & TarWriter::getLeftOut(void) const {
+    return leftOut;
+}
+
+const PathList & TarWriter::getChanged(void) const {
+    return changed;
+}
+
+long long TarWriter::getTotalBytes(void) const {
+    return position;
+}
+
+void * TarWriter::run(void) {
+    /*
+     * if bzip2 is killed, write() has to fail with EPIPE instead of the
+     * whole process being killed by SIGPIPE
+     */
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, 0);
+
+    bool success = true;
+    for (size_t i = 0; success && (i < files.size()); ++i) {
+        prefetcher->readerAt(i);
+        success = writeMember(files.begin()[i]);
+    }
+    prefetcher->readerAt(files.size());
+
+    /* the end of the archive is marked by two zero blocks */
+    if (success) {
+        success = append(ZEROS, BLOCK_SIZE)
+            && append(ZEROS, BLOCK_SIZE)
+            && pad(RECORD_SIZE)
+            && flush();
+    }
+    output.closeSink();
+    return this;
+}
+
+bool TarWriter::writeMember(PathId file) {
+    string name = paths.getPath(file);
+    struct stat st;
+    if (lstat(name.c_str(), &st) != 0) {
+        leftOut.push_back(file);
+        return true;
+    }
+
+    /* like GNU tar, store names relative to the root */
+    string::size_type start = name.find_first_not_of('/');
+    string archiveName = (start == string::npos) ? string(".")
+                                                 : name.substr(start);
+    long long offset = position;
+    long long dataSize = 0;
+    unsigned long long hash = Xxh64::hash(0, 0);
+    bool success;
+
+    if (S_ISREG(st.st_mode)) {
+        pair<dev_t, ino_t> inode = make_pair(st.st_dev, st.st_ino);
+        std::map<pair<dev_t, ino_t>, string>::const_iterator link =
+            links.end();
+        if (st.st_nlink > 1) {
+            link = links.find(inode);
+        }
+        if (link != links.end()) {
+            success = writeHeaders(archiveName, st, '1', link->second, 0);
+        } else {
+            int fd = open(name.c_str(), O_RDONLY);
+            if (fd < 0) {
+                leftOut.push_back(file);
+                return true;
+            }
+            if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+                /* replaced since the lstat() */
+                close(fd);
+                leftOut.push_back(file);
+                return true;
+            }
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            dataSize = st.st_size;
+            success = writeHeaders(archiveName, st, '0', "", st.st_size)
+                && writeData(fd, st.st_size, file, hash);
+            close(fd);
+            if (st.st_nlink > 1) {
+                links[inode] = archiveName;
+            }
+        }
+    } else if (S_ISDIR(st.st_mode)) {
+        /* tar marks directories with a trailing slash */
+        if (archiveName[archiveName.size() - 1] != '/') {
+            archiveName += '/';
+        }
+        success = writeHeaders(archiveName, st, '5', "", 0);
+    } else if (S_ISLNK(st.st_mode)) {
+        vector<char> target(st.st_size + 1);
+        ssize_t length;
+        while ((length = readlink(name.c_str(), &target[0], target.size()))
+               >= static_cast<ssize_t>(target.size())) {
+            /* the link has grown since the lstat() */
+            target.resize(target.size() * 2);
+        }
+        if (length < 0) {
+            leftOut.push_back(file);
+            return true;
+        }
+        success = writeHeaders(archiveName, st, '2',
+                               string(&target[0], length), 0);
+    } else if (S_ISCHR(st.st_mode)) {
+        success = writeHeaders(archiveName, st, '3', "", 0);
+    } else if (S_ISBLK(st.st_mode)) {
+        success = writeHeaders(archiveName, st, '4', "", 0);
+    } else if (S_ISFIFO(st.st_mode)) {
+        success = writeHeaders(archiveName, st, '6', "", 0);
+    } else {
+        /* sockets cannot be archived */
+        leftOut.push_back(file);
+        return true;
+    }
+    members.push_back(Member());
+    members.back().file = file;
+    members.back().offset = offset;
+    members.back().size = position - offset;
+    members.back().dataSize = dataSize;
+    members.back().mtime = st.st_mtime;
+    members.back().hash = hash;
+    return success;
+}
+
+bool TarWriter::writeHeaders(const string & name,
+                             const struct stat & st,
+                             char type,
+                             const string & linkName,
+                             long long size) {
+    char header[BLOCK_SIZE];
+    memset(header, 0, BLOCK_SIZE);
+    string paxRecords;
+
+    string prefix, base;
+    if (splitName(name, prefix, base)) {
+        memcpy(header + NAME, base.data(), base.size());
+        memcpy(header + PREFIX, prefix.data(), prefix.size());
+    } else {
+        addPaxRecord(paxRecords, "path", name);
+        memcpy(header + NAME, name.data(), NAME_LENGTH);
+    }
+    if (linkName.size() <= LINKNAME_LENGTH) {
+        memcpy(header + LINKNAME, linkName.data(), linkName.size());
+    } else {
+        addPaxRecord(paxRecords, "linkpath", linkName);
+        memcpy(header + LINKNAME, linkName.data(), LINKNAME_LENGTH);
+    }
+    putOctal(header + MODE, MODE_LENGTH, st.st_mode & 07777);
+    if (!putOctal(header + UID, UID_LENGTH, st.st_uid)) {
+        addPaxRecord(paxRecords, "uid", decimal(st.st_uid));
+        putOctal(header + UID, UID_LENGTH, 0);
+    }
+    if (!putOctal(header + GID, GID_LENGTH, st.st_gid)) {
+        addPaxRecord(paxRecords, "gid", decimal(st.st_gid));
+        putOctal(header + GID, GID_LENGTH, 0);
+    }
+    if (!putOctal(header + SIZE, SIZE_LENGTH, size)) {
+        addPaxRecord(paxRecords, "size", decimal(size));
+        putOctal(header + SIZE, SIZE_LENGTH, 0);
+    }
+    if ((st.st_mtime < 0)
+        || !putOctal(header + MTIME, MTIME_LENGTH, st.st_mtime)) {
+        addPaxRecord(paxRecords, "mtime", decimal(st.st_mtime));
+        putOctal(header + MTIME, MTIME_LENGTH, 0);
+    }
+    header[TYPE] = type;
+    memcpy(header + MAGIC, "ustar", 6);
+    memcpy(header + VERSION, "00", 2);
+    if ((type == '3') || (type == '4')) {
+        putOctal(header + DEVMAJOR, DEVMAJOR_LENGTH, major(st.st_rdev));
+        putOctal(header + DEVMINOR, DEVMINOR_LENGTH, minor(st.st_rdev));
+    }
+    putChecksum(header);
+
+    if (!paxRecords.empty()) {
+        char paxHeader[BLOCK_SIZE];
+        memset(paxHeader, 0, BLOCK_SIZE);
+        string paxName = "PaxHeaders/" + name.substr(name.rfind('/',
+                                                         name.size() - 2)
+                                                     + 1);
+        if (paxName.size() > NAME_LENGTH) {
+            paxName.resize(NAME_LENGTH);
+        }
+        memcpy(paxHeader + NAME, paxName.data(), paxName.size());
+        putOctal(paxHeader + MODE, MODE_LENGTH, 0644);
+        putOctal(paxHeader + UID, UID_LENGTH, 0);
+        putOctal(paxHeader + GID, GID_LENGTH, 0);
+        putOctal(paxHeader + SIZE, SIZE_LENGTH, paxRecords.size());
+        memcpy(paxHeader + MTIME, header + MTIME, MTIME_LENGTH);
+        paxHeader[TYPE] = 'x';
+        memcpy(paxHeader + MAGIC, "ustar", 6);
+        memcpy(paxHeader + VERSION, "00", 2);
+        putChecksum(paxHeader);
+        if (!append(paxHeader, BLOCK_SIZE)
+            || !append(paxRecords.data(), paxRecords.size())
+            || !pad(BLOCK_SIZE)) {
+            return false;
+        }
+    }
+    return append(header, BLOCK_SIZE);
+}
+
+bool TarWriter::writeData(int fd, long long size, PathId file,
+                          unsigned long long & hash) {
+    Xxh64 hasher;
+    long long remaining = size;
+    while (remaining > 0) {
+        if ((filled == buffer.size()) && !flush()) {
+            return false;
+        }
+        size_t wanted = buffer.size() - filled;
+        if (static_cast<long long>(wanted) > remaining) {
+            wanted = remaining;
+        }
+        ssize_t count = read(fd, &buffer[filled], wanted);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+        hasher.update(&buffer[filled], count);
+        filled += count;
+        position += count;
+        remaining -= count;
+    }
+
+    if (remaining > 0) {
+        /*
+         * the file has shrunk, or could not be read to its end. The size
+         * in the header is fixed, so fill the member up with zeros, as
+         * GNU tar does.
+         */
+        changed.push_back(file);
+        while (remaining > 0) {
+            size_t length = BLOCK_SIZE;
+            if (remaining < BLOCK_SIZE) {
+                length = remaining;
+            }
+            if (!append(ZEROS, length)) {
+                return false;
+            }
+            hasher.update(ZEROS, length);
+            remaining -= length;
+        }
+    } else {
+        char probe;
+        if (read(fd, &probe, 1) > 0) {
+            /* the file has grown, the rest is not stored */
+            changed.push_back(file);
+        }
+    }
+    hash = hasher.digest();
+    return pad(BLOCK_SIZE);
+}
+
+bool TarWriter::append(const char * data, size_t length) {
+    while (length > 0) {
+        if ((filled == buffer.size()) && !flush()) {
+            return false;
+        }
+        size_t count = buffer.size() - filled;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(&buffer[filled], data, count);
+        filled += count;
+        position += count;
+        data += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool TarWriter::pad(unsigned size) {
+    unsigned rest = position % size;
+    if (rest == 0) {
+        return true;
+    }
+    rest = size - rest;
+    while (rest > 0) {
+        unsigned length = (rest < BLOCK_SIZE) ? rest : BLOCK_SIZE;
+        if (!append(ZEROS, length)) {
+            return false;
+        }
+        rest -= length;
+    }
+    return true;
+}
+
+bool TarWriter::flush(void) {
+    if (!writeAll(output.getSinkFd(), &buffer[0], filled)) {
+        writeFailed = true;
+        return false;
+    }
+    filled = 0;
+    return true;
+}
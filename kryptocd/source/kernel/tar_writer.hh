@@ -0,0 +1,267 @@
+/*
+ * tar_writer.hh: class TarWriter header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef TAR_WRITER_HH
+#define TAR_WRITER_HH
+
+#include "thread.hh"
+#include "path_store.hh"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace KryptoCD {
+    class Sink;
+    class Prefetcher;
+
+    /**
+     * Class TarWriter writes a ustar archive of a list of files without a
+     * tar child process: a thread reads the files itself, with large reads
+     * straight into its output buffer, and writes the archive to a Sink.
+     * <p>
+     * As it writes the archive, it records where each member starts and
+     * how long it is, and which files could not be stored. So the caller
+     * learns exactly what went into the archive without listing it again.
+     * <p>
+     * The archive format is POSIX ustar, which GNU tar extracts. Names are
+     * stored relative to the root, like GNU tar does, and with numeric
+     * owners only. Names and link targets that do not fit into the ustar
+     * header, and sizes, ids and times that do not fit into its octal
+     * fields, are stored in a pax extended header before the member. Hard
+     * links between files of the same archive are stored as links. Sockets
+     * cannot be stored, and are left out like unreadable files.
+     * <p>
+     * A Prefetcher reads the next files of the list ahead of the writer.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class TarWriter : public Thread {
+    public:
+        /**
+         * the size of a tar header or data block
+         */
+        static const unsigned BLOCK_SIZE = 512;
+
+        /**
+         * the archive is padded to a multiple of this size, GNU tar's
+         * default record size
+         */
+        static const unsigned RECORD_SIZE = 20 * BLOCK_SIZE;
+
+        /**
+         * the size of the output buffer, and of the reads from the files
+         */
+        static const unsigned BUFFER_SIZE = 1024 * 1024;
+
+        /**
+         * where a file has been stored in the archive
+         */
+        struct Member {
+            PathId file;
+
+            /**
+             * the offset of the member's first header in the archive
+             */
+            long long offset;
+
+            /**
+             * the number of bytes of the member in the archive, headers and
+             * padding included
+             */
+            long long size;
+
+            /**
+             * the number of data bytes stored, 0 but for regular files
+             * that are not stored as hard links
+             */
+            long long dataSize;
+
+            /**
+             * the modification time recorded in the header
+             */
+            time_t mtime;
+
+            /**
+             * the Xxh64 hash of the stored data
+             */
+            unsigned long long hash;
+        };
+
+        /**
+         * starts the writing thread
+         *
+         * @param paths   the store containing the file names
+         * @param files   the files that should go into the archive, in this
+         *                order. Store and list must not change while this
+         *                object exists.
+         * @param output  the archive is written to this sink. The thread
+         *                closes it when the archive is complete. The caller
+         *                keeps it until this object is destroyed.
+         */
+        TarWriter(const PathStore & paths,
+                  const PathSlice & files,
+                  Sink & output);
+
+        /**
+         * waits for the thread
+         */
+        virtual ~TarWriter();
+
+        /**
+         * waits until the archive is written, or writing it failed
+         */
+        void wait(void);
+
+        /**
+         * @return true if a file could not be stored, or has changed while
+         *         it was read. Only meaningful after wait().
+         */
+        bool filesFailed(void) const;
+
+        /**
+         * @return true if the archive could not be written completely,
+         *         e.g. because its reader has exited. Only meaningful
+         *         after wait().
+         */
+        bool exitedAbnormally(void) const;
+
+        /**
+         * @return the stored files in archive order. Only meaningful after
+         *         wait().
+         */
+        const std::vector<Member> & getMembers(void) const;
+
+        /**
+         * @return the files that could not be stored, because they could
+         *         not be read, have vanished, or are sockets. Only
+         *         meaningful after wait().
+         */
+        const PathList & getLeftOut(void) const;
+
+        /**
+         * @return the files whose size changed while they were read. They
+         *         are in the archive, but their contents may be
+         *         inconsistent. Only meaningful after wait().
+         */
+        const PathList & getChanged(void) const;
+
+        /**
+         * @return the length of the archive in bytes. Only meaningful after
+         *         wait().
+         */
+        long long getTotalBytes(void) const;
+
+    protected:
+        /**
+         * writes the archive
+         */
+        virtual void * run(void);
+
+    private:
+        /**
+         * writes one file to the archive
+         *
+         * @return false if the archive could not be written
+         */
+        bool writeMember(PathId file);
+
+        /**
+         * writes the headers of a member, preceeded by a pax extended
+         * header if necessary
+         *
+         * @param name     the name in the archive
+         * @param st       the file's status
+         * @param type     the ustar type flag
+         * @param linkName the link target of symbolic and hard links
+         * @param size     the number of data bytes following the header
+         * @return false if the archive could not be written
+         */
+        bool writeHeaders(const std::string & name,
+                          const struct stat & st,
+                          char type,
+                          const std::string & linkName,
+                          long long size);
+
+        /**
+         * copies a file's contents into the archive, padded with zeros to
+         * the given size and to a whole block
+         *
+         * @param fd     the open file
+         * @param size   the size recorded in the header
+         * @param file   the file, added to "changed" if it has not got
+         *               the given size
+         * @param hash   the Xxh64 hash of the stored data is returned here
+         * @return false if the archive could not be written
+         */
+        bool writeData(int fd, long long size, PathId file,
+                       unsigned long long & hash);
+
+        /**
+         * appends data to the output buffer, writing the buffer when it is
+         * full
+         *
+         * @return false if the archive could not be written
+         */
+        bool append(const char * data, size_t length);
+
+        /**
+         * appends zeros up to the next multiple of the given size
+         */
+        bool pad(unsigned size);
+
+        /**
+         * writes the output buffer to the sink
+         */
+        bool flush(void);
+
+        const PathStore & paths;
+        PathSlice files;
+        Sink & output;
+        Prefetcher * prefetcher;
+
+        std::vector<char> buffer;
+        size_t filled;
+
+        /**
+         * the number of bytes of the archive appended to the buffer so far
+         */
+        long long position;
+
+        /**
+         * the archive names of files with more than one link, so that
+         * further links are stored as hard links
+         */
+        std::map<std::pair<dev_t, ino_t>, std::string> links;
+
+        std::vector<Member> members;
+        PathList leftOut;
+        PathList changed;
+        bool writeFailed;
+    };
+}
+#endif
@@ -0,0 +1,183 @@
+/*
+ * test_catalog.cpp: test program for class Catalog
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "catalog.hh"
+#include "tree_walker.hh"
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+
+using KryptoCD::Catalog;
+using KryptoCD::ImageInfo;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::PathSlice;
+using std::string;
+using std::vector;
+using std::list;
+
+static const char CATALOG_DIRECTORY[] = "/tmp/kryptocd_catalog";
+
+/**
+ * the number of runs added, more than Catalog::MAX_SEGMENTS so that the
+ * segments are merged
+ */
+static const unsigned long RUNS = Catalog::MAX_SEGMENTS + 2;
+
+/**
+ * the number of cds of each run
+ */
+static const size_t CDS = 3;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * @return the cd a file of a run went to
+ */
+static string getImageId(unsigned long run, size_t position, size_t count) {
+    size_t cd = 0;
+    while ((cd + 1) * count / CDS <= position) {
+        ++cd;
+    }
+    char id[64];
+    sprintf(id, "run%lu_cd%lu", run, static_cast<unsigned long>(cd));
+    return id;
+}
+
+/**
+ * This is a test program for class Catalog. It walks the directories given
+ * as command line arguments, and adds their files to a new catalog in
+ * /tmp/kryptocd_catalog RUNS times, each time spread over CDS cds. Then it
+ * looks up every file, and checks that it is found once per run, on the
+ * right cd. Every run, files with a name ending in "1" are left out.
+ * If the first argument is "-s pattern", it prints the files matching
+ * the pattern, see Catalog::search().
+ */
+int main(int argc, char ** argv) {
+    string pattern;
+    int first = 1;
+    if ((argc > 2) && (string(argv[1]) == "-s")) {
+        pattern = argv[2];
+        first = 3;
+    }
+    if (argc <= first) {
+        cerr << "usage: test_catalog [-s pattern] directory..." << endl;
+        return 1;
+    }
+
+    PathStore paths;
+    PathList files;
+    PathList unreadable;
+    KryptoCD::TreeWalker walker(paths, 16);
+    for (int i = first; i < argc; ++i) {
+        walker.walk(argv[i], files, unreadable);
+    }
+    PathList saved;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        string name = paths.getPath(*iter);
+        if (name[name.length() - 1] != '1') {
+            saved.push_back(*iter);
+        }
+    }
+
+    system((string("rm -rf ") + CATALOG_DIRECTORY).c_str());
+    mkdir(CATALOG_DIRECTORY, 0700);
+    double start = now();
+    for (unsigned long run = 1; run <= RUNS; ++run) {
+        list<ImageInfo> infos;
+        for (size_t cd = 0; cd < CDS; ++cd) {
+            size_t begin = cd * saved.size() / CDS;
+            size_t end = (cd + 1) * saved.size() / CDS;
+            infos.push_back(ImageInfo(getImageId(run, begin, saved.size()),
+                                      paths,
+                                      PathSlice(saved, begin, end - begin)));
+        }
+        /* a new Catalog each time, like a new backup run */
+        Catalog catalog(CATALOG_DIRECTORY);
+        if (catalog.add(infos) != run) {
+            cerr << "wrong run number" << endl;
+            return 1;
+        }
+    }
+    cout << RUNS << " runs of " << saved.size() << " files added in "
+         << now() - start << " s" << endl;
+
+    Catalog catalog(CATALOG_DIRECTORY);
+    size_t wrong = 0;
+    vector<Catalog::Hit> hits;
+    start = now();
+    for (size_t position = 0; position < saved.size(); ++position) {
+        string name = paths.getPath(saved[position]);
+        hits.clear();
+        catalog.find(name, hits);
+        bool right = (hits.size() == RUNS);
+        for (size_t i = 0; right && (i < hits.size()); ++i) {
+            right = (hits[i].name == name) && (hits[i].run == i + 1)
+                && (hits[i].imageId
+                    == getImageId(i + 1, position, saved.size()));
+        }
+        if (!right) {
+            cout << "wrong: " << name << endl;
+            ++wrong;
+        }
+    }
+    double elapsed = now() - start;
+    for (PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        string name = paths.getPath(*iter);
+        hits.clear();
+        catalog.find(name, hits);
+        if ((name[name.length() - 1] == '1') && !hits.empty()) {
+            cout << "found a file that was left out: " << name << endl;
+            ++wrong;
+        }
+    }
+    cout << saved.size() << " files looked up in " << elapsed << " s, "
+         << catalog.getCount() << " entries, " << wrong << " wrong" << endl;
+
+    if (!pattern.empty()) {
+        hits.clear();
+        start = now();
+        catalog.search(pattern, hits);
+        elapsed = now() - start;
+        for (vector<Catalog::Hit>::const_iterator iter = hits.begin();
+             iter != hits.end();
+             ++iter) {
+            cout << iter->name << "  run " << iter->run << ", "
+                 << iter->imageId << endl;
+        }
+        cout << hits.size() << " hits in " << elapsed << " s" << endl;
+    }
+    return (wrong == 0) ? 0 : 1;
+}
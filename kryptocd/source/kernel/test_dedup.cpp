@@ -0,0 +1,386 @@
+/*
+ * test_dedup.cpp: test program for deduplicated images
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include "image_scheduler.hh"
+#include "image_planner.hh"
+#include "chunk_index.hh"
+#include "dedup_filter.hh"
+#include "dedup_replayer.hh"
+#include "decrypter.hh"
+#include "bzip2.hh"
+#include "tar_extractor.hh"
+#include "tree_walker.hh"
+#include "metadata_scanner.hh"
+#include "fsource.hh"
+#include "fsink.hh"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <map>
+
+using KryptoCD::ImageScheduler;
+using KryptoCD::ImagePlanner;
+using KryptoCD::ChunkIndex;
+using KryptoCD::DedupFilter;
+using KryptoCD::DedupReplayer;
+using KryptoCD::Decrypter;
+using KryptoCD::Bzip2;
+using KryptoCD::TarExtractor;
+using KryptoCD::Image;
+using KryptoCD::ImageInfo;
+using KryptoCD::Encrypter;
+using KryptoCD::Diskspace;
+using KryptoCD::TreeWalker;
+using KryptoCD::MetadataScanner;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::Pipe;
+using KryptoCD::FSource;
+using KryptoCD::FSink;
+using std::string;
+using std::list;
+using std::vector;
+using std::map;
+
+static const char WORK_DIRECTORY[] = "/tmp/kryptocd_dedup";
+static const char PASSWORD[] = "some_password";
+
+static int failures = 0;
+
+static void check(bool condition, const char * what) {
+    if (!condition) {
+        cout << "FAILED: " << what << endl;
+        ++failures;
+    }
+}
+
+static off_t fileSize(const string & filename) {
+    struct stat st;
+    return (stat(filename.c_str(), &st) == 0) ? st.st_size : -1;
+}
+
+/**
+ * writes a file of pseudo random bytes, which bzip2 cannot compress
+ */
+static void writeRandomFile(const string & filename, size_t length,
+                            unsigned seed) {
+    std::ofstream file(filename.c_str());
+    for (size_t i = 0; i < length; ++i) {
+        seed = seed * 1103515245 + 12345;
+        file.put(char(seed >> 23));
+    }
+}
+
+static string readFile(const string & filename) {
+    std::ifstream file(filename.c_str());
+    string contents;
+    char c;
+    while (file.get(c)) {
+        contents += c;
+    }
+    return contents;
+}
+
+/**
+ * decrypts a file, and decompresses it if bzip2Executable is not empty
+ *
+ * @return true on success
+ */
+static bool decryptFile(const string & bzip2Executable,
+                        const string & input, const string & output) {
+    FSource source(input);
+    FSink sink(output);
+    Decrypter * decrypter;
+    Bzip2 * bzip2Inflator = 0;
+    if (bzip2Executable.empty()) {
+        decrypter = Decrypter::create(Encrypter::CHUNKED, PASSWORD,
+                                      source, sink);
+    } else {
+        Pipe decrypterToBzip2;
+        decrypter = Decrypter::create(Encrypter::CHUNKED, PASSWORD,
+                                      source, decrypterToBzip2);
+        bzip2Inflator = new Bzip2(bzip2Executable, -1, // -1 == decompress
+                                  decrypterToBzip2, sink);
+        bzip2Inflator->wait();
+    }
+    decrypter->wait();
+    bool success = !decrypter->exitedAbnormally()
+        && ((bzip2Inflator == 0) || !bzip2Inflator->exitedAbnormally());
+    delete bzip2Inflator;
+    delete decrypter;
+    return success;
+}
+
+/**
+ * backs up the files in a directory with deduplicated images, which are
+ * kept in the work directory
+ *
+ * @param ratio the compression that the planner expects
+ * @return      the ids of the images
+ */
+static vector<string> backup(const string & bzip2Executable,
+                             const string & source, int capacity,
+                             double ratio, const string & imageIdPrefix,
+                             ChunkIndex & index, vector<string> & stored) {
+    PathStore paths;
+    PathList files, unreadable;
+    TreeWalker walker(paths, 16);
+    walker.walk(source, files, unreadable);
+    MetadataScanner metadata(paths, 16);
+    metadata.scan(files);
+    Diskspace diskspace(WORK_DIRECTORY, 100);
+
+    ImagePlanner planner(paths, capacity, Encrypter::CHUNKED, diskspace);
+    planner.addFiles(files, metadata, ratio);
+    planner.plan();
+
+    PathList rejected;
+    list<ImageInfo> imageInfos;
+    vector<string> imageIds;
+    ImageScheduler scheduler(paths, metadata, planner, imageIdPrefix,
+                             PASSWORD, 6, diskspace, capacity,
+                             Image::SINGLE_FILE, Encrypter::CHUNKED,
+                             bzip2Executable, "/usr/bin/mkisofs", 2, 0, 0, &index);
+    Image * image;
+    while ((image = scheduler.nextImage(rejected, rejected, rejected,
+                                        imageInfos)) != 0) {
+        imageIds.push_back(image->getImageId());
+        image->keepData();
+        delete image;
+    }
+    check(rejected.empty(), "no file rejected");
+    for (list<ImageInfo>::const_iterator iter = imageInfos.begin();
+         iter != imageInfos.end();
+         ++iter) {
+        for (PathList::const_iterator file = iter->files.begin();
+             file != iter->files.end();
+             ++file) {
+            stored.push_back(paths.getPath(*file));
+        }
+    }
+    return imageIds;
+}
+
+/**
+ * rebuilds the tar stream of an image from its recipe and the chunk
+ * streams of all images, and extracts it
+ *
+ * @return the number of extracted members
+ */
+static size_t restore(const map<string, string> & chunkFiles,
+                      const string & imageId, const string & directory) {
+    string recipe = string(WORK_DIRECTORY) + "/recipe";
+    string tar = string(WORK_DIRECTORY) + "/tar";
+    check(decryptFile("", string(WORK_DIRECTORY) + "/" + imageId
+                      + DedupFilter::RECIPE_FILENAME, recipe),
+          "recipe decrypted");
+    try {
+        DedupReplayer replayer(chunkFiles);
+        FSource recipeSource(recipe);
+        FSink tarSink(tar);
+        replayer.replay(recipeSource, tarSink);
+    } catch (DedupReplayer::Exception & e) {
+        cout << "replaying " << imageId << ": reason " << e.reason
+             << " " << e.imageId << endl;
+        check(false, "recipe replayed");
+        return 0;
+    }
+    FSource tarSource(tar);
+    TarExtractor extractor(tarSource, directory, 1);
+    extractor.wait();
+    check(!extractor.archiveFailed() && extractor.getFailedFiles().empty(),
+          "tar stream extracted");
+    return extractor.getExtractedCount();
+}
+
+/**
+ * This is a test program for deduplicated images. It expects the location
+ * of the bzip2 executable as command line argument.
+ * <p>
+ * It backs up a directory of random files twice, with one ChunkIndex, on
+ * cds that are too small for the planner's expectations, so that trial
+ * archives are discarded. Between the backups, a byte in the middle of a
+ * large file is changed, and a file is added. The second backup has to
+ * store only the chunks around the changes. The tar stream of every image
+ * of the second backup is then rebuilt by a DedupReplayer from its recipe
+ * and the chunk streams of both backups, extracted, and compared with the
+ * files. Chunks of a discarded trial that stayed in the index would be
+ * missing from the chunk streams. A backup that reuses the image ids of
+ * the first one must be refused.
+ * <p>
+ * Finally, files much larger than the buffers between the tar writer and
+ * the cd are backed up, and every cd but the last has to be nearly full.
+ * Everything is kept in /tmp/kryptocd_dedup.
+ */
+int main(int argc, char ** argv) {
+    if (argc != 2) {
+        cerr << "usage: test_dedup bzip2" << endl;
+        return 1;
+    }
+    string bzip2Executable(argv[1]);
+    string work(WORK_DIRECTORY);
+    string source = work + "/src";
+    string indexFile = work + "/chunks";
+    const int capacity = 400;
+
+    /*
+     * the planner expects twice the compression that the random data
+     * get, so the trial archives do not fit, and are discarded
+     */
+    const double ratio = 0.5;
+
+    system((string("rm -rf ") + WORK_DIRECTORY).c_str());
+    mkdir(work.c_str(), 0700);
+    mkdir(source.c_str(), 0700);
+    writeRandomFile(source + "/big1", 300000, 1);
+    writeRandomFile(source + "/big2", 300000, 2);
+    for (unsigned i = 0; i < 60; ++i) {
+        char name[32];
+        sprintf(name, "/small%u", i);
+        writeRandomFile(source + name, 8000, 100 + i);
+    }
+
+    /* the first backup, with a new index */
+    vector<string> firstIds;
+    {
+        ChunkIndex index;
+        vector<string> stored;
+        firstIds = backup(bzip2Executable, source, capacity, ratio, "dedup_a",
+                          index, stored);
+        index.save(indexFile);
+    }
+    check(firstIds.size() >= 2, "the first backup needs several cds");
+
+    /* a change in the middle of a file, and a new file */
+    {
+        std::fstream file((source + "/big1").c_str(),
+                          std::ios::in | std::ios::out);
+        file.seekp(150000);
+        file.put('X');
+    }
+    writeRandomFile(source + "/new", 5000, 3);
+
+    vector<string> stored;
+    vector<string> secondIds;
+    {
+        ChunkIndex index;
+        index.load(indexFile);
+        secondIds = backup(bzip2Executable, source, capacity, ratio, "dedup_b",
+                           index, stored);
+    }
+
+    /* the ids of the first backup are taken */
+    {
+        ChunkIndex index;
+        index.load(indexFile);
+        size_t known = index.size();
+        bool refused = false;
+        try {
+            vector<string> none;
+            backup(bzip2Executable, source, capacity, ratio, "dedup_a",
+                   index, none);
+        } catch (Image::Exception & e) {
+            refused = (e.reason == Image::Exception::BAD_IMAGE_ID);
+        }
+        check(refused, "the image ids of the first backup are refused");
+        check(index.size() == known, "the refused backup added no chunks");
+    }
+
+    long long firstBytes = 0;
+    long long secondBytes = 0;
+    map<string, string> chunkFiles;
+    vector<string> allIds(firstIds);
+    allIds.insert(allIds.end(), secondIds.begin(), secondIds.end());
+    for (size_t i = 0; i < allIds.size(); ++i) {
+        string chunks = work + "/" + allIds[i] + DedupFilter::CHUNKS_FILENAME;
+        if (i < firstIds.size()) {
+            firstBytes += fileSize(chunks);
+        } else {
+            secondBytes += fileSize(chunks);
+        }
+        string plain = work + "/" + allIds[i] + ".chunks";
+        check(decryptFile(bzip2Executable, chunks, plain),
+              "chunk stream decrypted");
+        chunkFiles[allIds[i]] = plain;
+    }
+    check(secondBytes * 10 < firstBytes,
+          "the second backup stores only the changed chunks");
+
+    string restored = work + "/restored";
+    mkdir(restored.c_str(), 0700);
+    size_t extracted = 0;
+    for (size_t i = 0; i < secondIds.size(); ++i) {
+        extracted += restore(chunkFiles, secondIds[i], restored);
+    }
+    check(extracted == stored.size(), "every stored file restored");
+    for (size_t i = 0; i < stored.size(); ++i) {
+        /* the tar stream holds the names relative to the root */
+        check(readFile(restored + stored[i]) == readFile(stored[i]),
+              "restored file equals the original");
+    }
+
+    /*
+     * Only the files that reached the cd count when a trial is cut. The
+     * planner expects so much compression that it plans a single cd, so
+     * every cd but the last is cut.
+     */
+    const int fillCapacity = 6000;
+    string fillSource = work + "/fill";
+    mkdir(fillSource.c_str(), 0700);
+    for (unsigned i = 0; i < 40; ++i) {
+        char name[32];
+        sprintf(name, "/file%u", i);
+        writeRandomFile(fillSource + name, 750000, 200 + i);
+    }
+    vector<string> fillIds;
+    {
+        ChunkIndex index;
+        vector<string> fillStored;
+        fillIds = backup(bzip2Executable, fillSource, fillCapacity, 0.05,
+                         "fill_", index, fillStored);
+        /* the files and their directory */
+        check(fillStored.size() == 41, "every file stored");
+    }
+    check(fillIds.size() == 3, "the files fill three cds");
+    for (size_t i = 0; i + 1 < fillIds.size(); ++i) {
+        off_t bytes = fileSize(work + "/" + fillIds[i]
+                               + DedupFilter::CHUNKS_FILENAME);
+        check(bytes * 10 > fillCapacity * 2048LL * 8,
+              "the cd is more than 80% full");
+    }
+
+    cout << firstIds.size() << " + " << secondIds.size() << " cds, "
+         << firstBytes << " + " << secondBytes << " bytes of chunks, "
+         << fillIds.size() << " cds of large files" << endl;
+    if (failures == 0) {
+        cout << "OK" << endl;
+    }
+    return (failures == 0) ? 0 : 1;
+}
@@ -38,16 +38,17 @@ int main(int argc, char ** argv)
     KryptoCD::FSink output("/tmp/kryptocd_test.tar.bz2.gpg");
 
     /* a list of files to put into the archive */
-    std::list<std::string> files;
+    KryptoCD::PathStore paths;
+    KryptoCD::PathList files;
     
     for (int i = 1; i < argc; ++i) {
-        files.push_back(argv[i]);
+        files.push_back(paths.intern(argv[i]));
     }
 
     KryptoCD::ArchiveCreator * ac =
-        new KryptoCD::ArchiveCreator("/bin/tar", "/usr/bin/bzip2",
-                                     "/usr/bin/gpg", files, 6, "some_password",
-                                     output);
+        new KryptoCD::ArchiveCreator("/usr/bin/bzip2", paths, files,
+                                     6, "some_password",
+                                     KryptoCD::Encrypter::OPENPGP, output);
     ac->wait();
     delete ac;
 }
@@ -0,0 +1,255 @@
+/*
+ * test_gcm.cpp: test program for class Gcm
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "gcm.hh"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using KryptoCD::Gcm;
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+static void check(bool condition, const string & what) {
+    if (!condition) {
+        cout << "FAILED: " << what << endl;
+        ++failures;
+    }
+}
+
+/**
+ * @return the bytes written in hexadecimal digits
+ */
+static vector<unsigned char> bytes(const char * hex) {
+    vector<unsigned char> result;
+    for (size_t i = 0; hex[i] != '\0'; i += 2) {
+        result.push_back(strtol(string(hex + i, 2).c_str(), 0, 16));
+    }
+    return result;
+}
+
+/**
+ * a test case from the GCM specification of McGrew and Viega
+ */
+struct TestVector {
+    int number;
+    const char * key;
+    const char * nonce;
+    const char * plain;
+    const char * aad;
+    const char * cipher;
+    const char * tag;
+};
+
+static const char KEY_3[] = "feffe9928665731c6d6a8f9467308308";
+static const char NONCE_3[] = "cafebabefacedbaddecaf888";
+static const char PLAIN_3[] =
+    "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+    "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255";
+static const char PLAIN_4[] =
+    "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+    "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+static const char AAD_4[] = "feedfacedeadbeeffeedfacedeadbeefabaddad2";
+static const char ZEROS_12[] = "000000000000000000000000";
+static const char ZEROS_16[] = "00000000000000000000000000000000";
+
+static const TestVector VECTORS[] = {
+    {1, ZEROS_16, ZEROS_12, "", "", "",
+     "58e2fccefa7e3061367f1d57a4e7455a"},
+    {2, ZEROS_16, ZEROS_12, ZEROS_16, "",
+     "0388dace60b6a392f328c2b971b2fe78",
+     "ab6e47d42cec13bdf53a67b21257bddf"},
+    {3, KEY_3, NONCE_3, PLAIN_3, "",
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+     "4d5c2af327cd64a62cf35abd2ba6fab4"},
+    {4, KEY_3, NONCE_3, PLAIN_4, AAD_4,
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+     "5bc94fbc3221a5db94fae95ae7121a47"},
+    {7, "000000000000000000000000000000000000000000000000", ZEROS_12,
+     "", "", "", "cd33b28ac773f74ba00ed1f312572435"},
+    {8, "000000000000000000000000000000000000000000000000", ZEROS_12,
+     ZEROS_16, "", "98e7247c07f0fe411c267e4384b0f600",
+     "2ff58d80033927ab8ef4d4587514f0fb"},
+    {13, "0000000000000000000000000000000000000000000000000000000000000000",
+     ZEROS_12, "", "", "", "530f8afbc74536b9a963b4f1c4cb738b"},
+    {14, "0000000000000000000000000000000000000000000000000000000000000000",
+     ZEROS_12, ZEROS_16, "", "cea7403d4d606b6e074ec5d3baf39d18",
+     "d0d1c8a799996bf0265b98b5d48ab919"},
+    {15, "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+     NONCE_3, PLAIN_3, "",
+     "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+     "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad",
+     "b094dac5d93471bdec1a502270e3cc6c"},
+    {16, "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+     NONCE_3, PLAIN_4, AAD_4,
+     "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+     "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+     "76fc6ece0f4e1768cddf8853bb2d551b"}
+};
+
+/**
+ * encrypts and decrypts a test case with a kernel, and checks the
+ * ciphertext, the tag, and that a wrong tag is rejected
+ */
+static void checkVector(Gcm::Kernel kernel, const TestVector & testCase) {
+    string what = string(Gcm::getName(kernel)) + ", test case ";
+    what += char('0' + testCase.number / 10);
+    what += char('0' + testCase.number % 10);
+
+    vector<unsigned char> key = bytes(testCase.key);
+    vector<unsigned char> nonce = bytes(testCase.nonce);
+    vector<unsigned char> plain = bytes(testCase.plain);
+    vector<unsigned char> aad = bytes(testCase.aad);
+    vector<unsigned char> cipher = bytes(testCase.cipher);
+    vector<unsigned char> tag = bytes(testCase.tag);
+    /* one spare byte, so that empty data has an address */
+    plain.push_back(0);
+    aad.push_back(0);
+
+    Gcm gcm(&key[0], key.size(), kernel);
+    vector<unsigned char> data = plain;
+    unsigned char computedTag[Gcm::TAG_LENGTH];
+    gcm.encrypt(&nonce[0], &aad[0], aad.size() - 1,
+                &data[0], data.size() - 1, computedTag);
+    check(memcmp(&data[0], &cipher[0], cipher.size()) == 0,
+          what + ": ciphertext");
+    check(memcmp(computedTag, &tag[0], Gcm::TAG_LENGTH) == 0,
+          what + ": tag");
+
+    check(gcm.decrypt(&nonce[0], &aad[0], aad.size() - 1,
+                      &data[0], data.size() - 1, &tag[0]),
+          what + ": tag accepted");
+    check(data == plain, what + ": decryption");
+
+    tag[Gcm::TAG_LENGTH - 1] ^= 1;
+    check(!gcm.decrypt(&nonce[0], &aad[0], aad.size() - 1,
+                       &data[0], data.size() - 1, &tag[0]),
+          what + ": wrong tag rejected");
+    check(data == plain, what + ": data unchanged after rejection");
+}
+
+/**
+ * encrypts random data of a length with a kernel and with the portable
+ * kernel, checks that both give the same result, and that the kernel
+ * decrypts it again and rejects a changed ciphertext
+ */
+static void crossCheck(Gcm::Kernel kernel,
+                       const unsigned char * key, size_t keyLength,
+                       size_t aadLength, size_t length) {
+    string what = string(Gcm::getName(kernel)) + ", cross check";
+
+    unsigned char nonce[Gcm::NONCE_LENGTH];
+    for (unsigned i = 0; i < Gcm::NONCE_LENGTH; ++i) {
+        nonce[i] = rand();
+    }
+    vector<unsigned char> aad(aadLength + 1);
+    vector<unsigned char> plain(length + 1);
+    for (size_t i = 0; i < aadLength; ++i) {
+        aad[i] = rand();
+    }
+    for (size_t i = 0; i < length; ++i) {
+        plain[i] = rand();
+    }
+
+    Gcm portable(key, keyLength, Gcm::PORTABLE);
+    Gcm gcm(key, keyLength, kernel);
+    vector<unsigned char> expected = plain;
+    vector<unsigned char> data = plain;
+    unsigned char expectedTag[Gcm::TAG_LENGTH];
+    unsigned char tag[Gcm::TAG_LENGTH];
+    portable.encrypt(nonce, &aad[0], aadLength,
+                     &expected[0], length, expectedTag);
+    gcm.encrypt(nonce, &aad[0], aadLength, &data[0], length, tag);
+    if ((data != expected)
+        || (memcmp(tag, expectedTag, Gcm::TAG_LENGTH) != 0)) {
+        cout << "FAILED: " << what << ": " << length << " bytes, "
+             << aadLength << " bytes of additional data" << endl;
+        ++failures;
+        return;
+    }
+
+    if (length > 0) {
+        data[length / 2] ^= 0x80;
+        check(!gcm.decrypt(nonce, &aad[0], aadLength, &data[0], length, tag),
+              what + ": changed ciphertext rejected");
+        data[length / 2] ^= 0x80;
+    }
+    check(gcm.decrypt(nonce, &aad[0], aadLength, &data[0], length, tag)
+          && (data == plain),
+          what + ": decryption");
+}
+
+/**
+ * This is a test program for class Gcm. Every kernel that this processor
+ * supports must give the results of the test cases in the GCM
+ * specification, and the same results as the portable kernel on random
+ * data of many lengths, around the 16 block steps of the vector kernels
+ * and the 16 kB pieces of encrypt(). Kernels this processor does not
+ * support are reported and skipped.
+ */
+int main() {
+    unsigned char key[32];
+    for (unsigned i = 0; i < sizeof(key); ++i) {
+        key[i] = rand();
+    }
+    size_t aadLengths[] = {0, 1, 13, 16, 17, 64, 100, 255};
+    vector<size_t> lengths;
+    for (size_t length = 0; length < 300; ++length) {
+        lengths.push_back(length);
+    }
+    for (size_t length = 16 * 1024 - 17; length < 16 * 1024 + 17; ++length) {
+        lengths.push_back(length);
+    }
+    lengths.push_back(100000 + 7);
+
+    for (int k = Gcm::PORTABLE; k <= Gcm::VAES; ++k) {
+        Gcm::Kernel kernel = static_cast<Gcm::Kernel>(k);
+        if (!Gcm::isSupported(kernel)) {
+            cout << Gcm::getName(kernel) << ": not supported" << endl;
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(VECTORS) / sizeof(*VECTORS); ++i) {
+            checkVector(kernel, VECTORS[i]);
+        }
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            size_t aadLength =
+                aadLengths[i % (sizeof(aadLengths) / sizeof(*aadLengths))];
+            crossCheck(kernel, key, ((i % 3) + 2) * 8, aadLength,
+                       lengths[i]);
+        }
+        cout << Gcm::getName(kernel) << ": checked" << endl;
+    }
+
+    if (failures == 0) {
+        cout << "OK" << endl;
+    }
+    return (failures == 0) ? 0 : 1;
+}
@@ -24,21 +24,51 @@
 #include <iostream>
 #include <fcntl.h>
 #include "image.hh"
+#include "image_planner.hh"
+#include "image_scheduler.hh"
+#include "path_store.hh"
+#include "metadata_scanner.hh"
+#include "tree_walker.hh"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
 
 /**
- * return a string representation of an unsigned integer:
+ * the directory with symbolic links for the "-l" test
  */
-static string unsignedToString(unsigned i) {
-    string s;
-    
-    if (i == 0) {
-        return "0";
-    }
-    while (i > 0) {
-        s.insert(s.begin(), char('0' + i % 10));
-        i /= 10;
+static const char LINK_DIRECTORY[] = "/tmp/kryptocd_links";
+
+/**
+ * print all file names of a list
+ */
+static void printFiles(const KryptoCD::PathStore & paths,
+                       const KryptoCD::PathList & files) {
+    for (KryptoCD::PathList::const_iterator iter = files.begin();
+         iter != files.end();
+         ++iter) {
+        cout << paths.getPath(*iter) << "  \\  ";
     }
-    return s;
+}
+
+/**
+ * creates a directory with a file, a link to a subdirectory and a dangling
+ * link, and lists them all
+ */
+static void makeLinks(KryptoCD::PathStore & paths,
+                      KryptoCD::PathList & files) {
+    std::string directory(LINK_DIRECTORY);
+    system(("rm -rf " + directory).c_str());
+    mkdir(directory.c_str(), 0700);
+    mkdir((directory + "/dir").c_str(), 0700);
+    close(open((directory + "/dir/file").c_str(), O_WRONLY | O_CREAT, 0600));
+    symlink("dir", (directory + "/dl").c_str());
+    symlink("nowhere", (directory + "/dangling").c_str());
+
+    files.push_back(paths.intern(directory + "/"));
+    files.push_back(paths.intern(directory + "/dir/"));
+    files.push_back(paths.intern(directory + "/dir/file"));
+    files.push_back(paths.intern(directory + "/dl"));
+    files.push_back(paths.intern(directory + "/dangling"));
 }
 
 /**
@@ -47,9 +77,18 @@ static string unsignedToString(unsigned i) {
  * "cdrecord -atip" in the line starting with "  ATIP start of lead out".
  * A block on a cd contains 2048 bytes of data. As the remaining command line
  * arguments, this programm expects absolute filenames from which to create an
- * archive.
+ * archive. If the second argument is "-r", the remaining arguments are
+ * directories, which are walked recursively by a TreeWalker. If it is
+ * "-l", a directory with symbolic links is created in /tmp/kryptocd_links
+ * and backed up, and the program checks that the links are stored as
+ * links: a link to a directory is no bad named directory, and a dangling
+ * link is no missing file.
  * These files will then go into the archive. Depending on the
- * space available on cd, they will be distributed over several cd's.
+ * space available on cd, they will be distributed over several cd's. Before
+ * any archive is created, a MetadataScanner stat()s all files, and an
+ * ImagePlanner decides which file goes on which
+ * cd, assuming the files do not compress at all. The images are then built
+ * in parallel by an ImageScheduler.
  * The parts of the new archive are encrypted with the password
  * "some_password" and stored in /tmp/imageId[1-9]/kryptocd_test.tar.bz2.gpg
  * 
@@ -69,19 +108,34 @@ int main(int argc, char ** argv) {
     int capacity = atoi(argv[1]);
 
     /* a list of files to put into the archive */
-    std::list<std::string> files, rejectedBigFiles;
-    std::list<std::string> rejectedForbiddenFiles, rejectedBadNamedFiles;
+    KryptoCD::PathStore paths;
+    KryptoCD::PathList files, rejectedBigFiles;
+    KryptoCD::PathList rejectedForbiddenFiles, rejectedBadNamedFiles;
 
-    if (argc > 2) {
+    bool linkTest = (argc == 3) && (std::string(argv[2]) == "-l");
+    if (linkTest) {
+        makeLinks(paths, files);
+    } else if ((argc > 3) && (std::string(argv[2]) == "-r")) {
+        KryptoCD::TreeWalker walker(paths, 16);
+        KryptoCD::PathList unreadable;
+        for (int i = 3; i < argc; ++i) {
+            walker.walk(argv[i], files, unreadable);
+        }
+        if (!unreadable.empty()) {
+            cout << "These directories could not be read: ";
+            printFiles(paths, unreadable);
+            cout << endl;
+        }
+    } else if (argc > 2) {
         for (int i = 2; i < argc; ++i) {
-            files.push_back(argv[i]);
+            files.push_back(paths.intern(argv[i]));
         }
     } else {
         /* read filenames from stdin */
         std::string filename;
         getline(cin,password);
         while (getline(cin, filename)) {
-            files.push_back(filename);
+            files.push_back(paths.intern(filename));
         }
     }
 
@@ -89,27 +143,43 @@ int main(int argc, char ** argv) {
     std::list<KryptoCD::ImageInfo> imageInfos;
     KryptoCD::Diskspace ds("/tmp", 700);
 
-    unsigned i = 0;
+    /* stat all files once, with many requests in flight */
+    KryptoCD::MetadataScanner metadata(paths, 16);
+    metadata.scan(files);
+    size_t fileCount = files.size();
+
+    /* plan the distribution of the files over the cds */
+    KryptoCD::ImagePlanner planner(paths, capacity,
+                                   KryptoCD::Encrypter::OPENPGP, ds);
+    planner.addFiles(files, metadata, 1.0);
+    planner.plan();
+    files.clear();
+
+    /* build the images on as many threads as there are processors */
+    int processors = sysconf(_SC_NPROCESSORS_ONLN);
     list<KryptoCD::Image*> images;
-    while (!files.empty()) {
-        ++i;
-        images.push_back(KryptoCD::Image::create
-                                             ("image_id" + unsignedToString(i),
-                                              password,
-                                              6, // compression level
-                                              files,
-                                              rejectedBigFiles,
-                                              rejectedForbiddenFiles,
-                                              rejectedBadNamedFiles,
-                                              imageInfos,
-                                              ds,
-                                              capacity,
-                                              KryptoCD::Image::SINGLE_FILE,
-                                              "/bin/tar",
-                                              "/usr/bin/bzip2",
-                                              "/usr/bin/gpg",
-                                              "/usr/bin/mkisofs"
-                                              ));
+    {
+        KryptoCD::ImageScheduler scheduler(paths,
+                                           metadata,
+                                           planner,
+                                           "image_id",
+                                           password,
+                                           6, // compression level
+                                           ds,
+                                           capacity,
+                                           KryptoCD::Image::SINGLE_FILE,
+                                           KryptoCD::Encrypter::OPENPGP,
+                                           "/usr/bin/bzip2",
+                                           "/usr/bin/mkisofs",
+                                           (processors > 0) ? processors : 1);
+        KryptoCD::Image * image;
+        while ((image = scheduler.nextImage(rejectedBigFiles,
+                                            rejectedForbiddenFiles,
+                                            rejectedBadNamedFiles,
+                                            imageInfos))
+               != 0) {
+            images.push_back(image);
+        }
     }
     /* Create a report */
     if (rejectedBigFiles.empty()) {
@@ -117,12 +187,7 @@ int main(int argc, char ** argv) {
              << endl;
     } else {
         cout << "These files have been too big to be saved: ";
-        for (std::list<std::string>::const_iterator iter =
-                 rejectedBigFiles.begin();
-             iter != rejectedBigFiles.end();
-             ++iter) {
-            cout << *iter << "  \\  ";
-        }
+        printFiles(paths, rejectedBigFiles);
         cout << endl;
     }
     if (rejectedForbiddenFiles.empty()) {
@@ -130,12 +195,7 @@ int main(int argc, char ** argv) {
              << endl;
     } else {
         cout << "These files have been left out due to their permissions: ";
-        for (std::list<std::string>::const_iterator iter =
-                 rejectedForbiddenFiles.begin();
-             iter != rejectedForbiddenFiles.end();
-             ++iter) {
-            cout << *iter << "  \\  ";
-        }
+        printFiles(paths, rejectedForbiddenFiles);
         cout << endl;
     }
     if (rejectedBadNamedFiles.empty()) {
@@ -143,12 +203,7 @@ int main(int argc, char ** argv) {
              << endl;
     } else {
         cout << "These files have been left out because of their names: ";
-        for (std::list<std::string>::const_iterator iter =
-                 rejectedBadNamedFiles.begin();
-             iter != rejectedBadNamedFiles.end();
-             ++iter) {
-            cout << *iter << "  \\  ";
-        }
+        printFiles(paths, rejectedBadNamedFiles);
         cout << endl;
     }
     if (imageInfos.empty()) {
@@ -162,12 +217,7 @@ int main(int argc, char ** argv) {
              infoIterator != imageInfos.end();
              ++i, ++infoIterator) {
             cout << "####### On cd number " << i << ": ";
-            for (std::list<std::string>::const_iterator iter =
-                     infoIterator->files.begin();
-                 iter != infoIterator->files.end();
-                 ++iter) {
-                cout << *iter << "  \\  ";
-            }
+            printFiles(paths, infoIterator->files);
             cout << endl;
         }
     }
@@ -175,12 +225,29 @@ int main(int argc, char ** argv) {
         cout << "No files have been queued for a next cd." << endl;
     } else {
         cout << "These files have been queued for a next cd: ";
-        for (std::list<std::string>::const_iterator iter = files.begin();
-             iter != files.end();
+        printFiles(paths, files);
+        cout << endl;
+    }
+    if (linkTest) {
+        size_t stored = 0;
+        for (std::list<KryptoCD::ImageInfo>::iterator iter =
+                 imageInfos.begin();
+             iter != imageInfos.end();
              ++iter) {
-            cout << *iter << "  \\  ";
+            stored += iter->files.size();
         }
-        cout << endl;
+        const KryptoCD::FileMetadata * link =
+            metadata.get(paths.intern(std::string(LINK_DIRECTORY) + "/dl"));
+        bool success = (link != 0) && S_ISLNK(link->mode)
+            && (stored == fileCount) && rejectedForbiddenFiles.empty()
+            && rejectedBadNamedFiles.empty();
+        cout << (success ? "OK" : "FAILED: the links were not stored")
+             << endl;
+        while(!images.empty()) {
+            delete images.front();
+            images.pop_front();
+        }
+        return success ? 0 : 1;
     }
     cout << "You may now now examine the created images (they are in /tmp)."
          << endl
@@ -0,0 +1,203 @@
+/*
+ * test_journal.cpp: test program for class Journal
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "journal.hh"
+#include "image_scheduler.hh"
+#include "image_planner.hh"
+#include "image_resumed.hh"
+#include "tree_walker.hh"
+#include "metadata_scanner.hh"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <algorithm>
+
+using KryptoCD::Journal;
+using KryptoCD::ImageScheduler;
+using KryptoCD::ImagePlanner;
+using KryptoCD::ImageResumed;
+using KryptoCD::Image;
+using KryptoCD::ImageInfo;
+using KryptoCD::Encrypter;
+using KryptoCD::Diskspace;
+using KryptoCD::TreeWalker;
+using KryptoCD::MetadataScanner;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using std::string;
+using std::list;
+
+static const char SPOOL_DIRECTORY[] = "/tmp/kryptocd_journal";
+static const char IMAGE_ID_PREFIX[] = "journal_test";
+
+static int failures = 0;
+
+static void check(bool condition, const char * what) {
+    if (!condition) {
+        cout << "FAILED: " << what << endl;
+        ++failures;
+    }
+}
+
+static off_t fileSize(const string & filename) {
+    struct stat st;
+    return (stat(filename.c_str(), &st) == 0) ? st.st_size : -1;
+}
+
+/**
+ * This is a test program for class Journal and for resuming a backup with
+ * an ImageScheduler. It expects the location of the bzip2 executable, the
+ * number of blocks on a cd, and directories to back up as command line
+ * arguments. The cd has to be small enough for at least three cds.
+ * <p>
+ * The first run takes image 1 from the scheduler, reports it burned, and
+ * is interrupted by destroying the scheduler while image 2 is being
+ * built. A torn record is appended to the journal, as if the machine had
+ * crashed while writing it. The second run has to drop that record, skip
+ * image 1, adopt image 2 with its harddisk space allocated in full, and
+ * build the rest, so that the two runs store every file exactly once.
+ * The images are kept in /tmp/kryptocd_journal.
+ */
+int main(int argc, char ** argv) {
+    if (argc < 4) {
+        cerr << "usage: test_journal bzip2 capacity directories..." << endl;
+        return 1;
+    }
+    string bzip2Executable(argv[1]);
+    int capacity = atoi(argv[2]);
+
+    mkdir(SPOOL_DIRECTORY, 0700);
+    string journalFile = string(SPOOL_DIRECTORY) + "/journal";
+    unlink(journalFile.c_str());
+    for (int i = 1; i <= 100; ++i) {
+        char id[64];
+        sprintf(id, "%s/%s%d", SPOOL_DIRECTORY, IMAGE_ID_PREFIX, i);
+        Image::removeDirectory(id);
+    }
+
+    PathStore paths;
+    PathList files, unreadable;
+    TreeWalker walker(paths, 16);
+    for (int i = 3; i < argc; ++i) {
+        walker.walk(argv[i], files, unreadable);
+    }
+    MetadataScanner metadata(paths, 16);
+    metadata.scan(files);
+    Diskspace diskspace(SPOOL_DIRECTORY, 700);
+    ImagePlanner planner(paths, capacity, Encrypter::CHUNKED, diskspace);
+    planner.addFiles(files, metadata, 1.0);
+    planner.plan();
+    check(planner.getDiscCount() >= 3, "at least three cds planned");
+
+    PathList rejected;
+    list<ImageInfo> imageInfos;
+
+    /* the first run, interrupted after image 1 */
+    string firstImageId;
+    {
+        Journal journal(journalFile);
+        journal.open(paths);
+        ImageScheduler scheduler(paths, metadata, planner, IMAGE_ID_PREFIX,
+                                 "some_password", 6, diskspace, capacity,
+                                 Image::SINGLE_FILE, Encrypter::CHUNKED,
+                                 bzip2Executable, "/usr/bin/mkisofs", 1, &journal);
+        Image * image = scheduler.nextImage(rejected, rejected, rejected,
+                                            imageInfos);
+        check(image != 0, "image 1 built");
+        if (image == 0) {
+            return 1;
+        }
+        firstImageId = image->getImageId();
+        scheduler.imageBurned(*image);
+        delete image;
+    }
+    check(diskspace.getFreeMegabytes() == diskspace.getUsableMegabytes(),
+          "all harddisk space released after the interruption");
+
+    /* a record cut off by a crash */
+    off_t goodSize = fileSize(journalFile);
+    int fd = open(journalFile.c_str(), O_WRONLY | O_APPEND);
+    write(fd, "I\x7f" "cut off", 9);
+    close(fd);
+
+    /* the resumed run */
+    imageInfos.clear();
+    rejected.clear();
+    int resumed = 0;
+    {
+        Journal journal(journalFile);
+        journal.open(paths);
+        check(fileSize(journalFile) == goodSize, "torn record dropped");
+        Journal::ImageRecord record;
+        check(journal.findImage(firstImageId, record) && record.burned,
+              "image 1 recorded as burned");
+
+        ImageScheduler scheduler(paths, metadata, planner, IMAGE_ID_PREFIX,
+                                 "some_password", 6, diskspace, capacity,
+                                 Image::SINGLE_FILE, Encrypter::CHUNKED,
+                                 bzip2Executable, "/usr/bin/mkisofs", 1, &journal);
+        list<Image *> images;
+        int dataMegabytes = 0;
+        Image * image;
+        while ((image = scheduler.nextImage(rejected, rejected, rejected,
+                                            imageInfos)) != 0) {
+            check(image->getImageId() != firstImageId,
+                  "the burned image is not handed out again");
+            if (dynamic_cast<ImageResumed *>(image) != 0) {
+                ++resumed;
+            }
+            dataMegabytes += Image::getDirectoryMegabytes(
+                string(SPOOL_DIRECTORY) + "/" + image->getImageId());
+            images.push_back(image);
+        }
+        check(diskspace.getUsableMegabytes() - diskspace.getFreeMegabytes()
+              >= dataMegabytes, "the images' data is allocated");
+        while (!images.empty()) {
+            delete images.front();
+            images.pop_front();
+        }
+    }
+    check(resumed > 0, "image 2 adopted");
+
+    /* every file is stored or rejected exactly once */
+    PathList stored(rejected);
+    for (list<ImageInfo>::const_iterator iter = imageInfos.begin();
+         iter != imageInfos.end();
+         ++iter) {
+        stored.insert(stored.end(), iter->files.begin(), iter->files.end());
+    }
+    std::sort(stored.begin(), stored.end());
+    std::sort(files.begin(), files.end());
+    check(stored == files, "all files stored once");
+
+    cout << imageInfos.size() << " cds, " << resumed << " resumed" << endl;
+    if (failures == 0) {
+        cout << "OK" << endl;
+    }
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * test_size_model.cpp: test program for Encrypter::encryptedSize()
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "encrypter.hh"
+#include "pgp_encrypter.hh"
+#include "chunked_encrypter.hh"
+#include "fsource.hh"
+#include "fsink.hh"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using KryptoCD::Encrypter;
+using KryptoCD::PgpEncrypter;
+using KryptoCD::ChunkedEncrypter;
+using std::vector;
+
+static const char PLAIN_FILE[] = "/tmp/kryptocd_size_model.plain";
+static const char ENCRYPTED_FILE[] = "/tmp/kryptocd_size_model.encrypted";
+
+/**
+ * encrypts size random bytes, and compares the size of the output with
+ * the prediction
+ *
+ * @return true if they are equal
+ */
+static bool check(Encrypter::Format format, long long size) {
+    vector<char> plain(size);
+    for (long long i = 0; i < size; ++i) {
+        plain[i] = rand();
+    }
+    int fd = open(PLAIN_FILE, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if ((fd < 0) || ((size > 0) && (write(fd, &plain[0], size) != size))) {
+        cerr << "cannot write " << PLAIN_FILE << endl;
+        exit(1);
+    }
+    close(fd);
+
+    {
+        KryptoCD::FSource source(PLAIN_FILE);
+        KryptoCD::FSink sink(ENCRYPTED_FILE);
+        Encrypter * encrypter =
+            Encrypter::create(format, "some_password", source, sink);
+        encrypter->wait();
+        if (encrypter->exitedAbnormally()) {
+            cerr << "encryption failed" << endl;
+            exit(1);
+        }
+        delete encrypter;
+    }
+
+    struct stat st;
+    stat(ENCRYPTED_FILE, &st);
+    long long predicted = Encrypter::encryptedSize(format, size);
+    if (st.st_size != predicted) {
+        cout << ((format == Encrypter::OPENPGP) ? "OpenPGP" : "chunked")
+             << ": " << size << " plain bytes, predicted " << predicted
+             << ", written " << st.st_size << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * This is a test program for Encrypter::encryptedSize(). It encrypts
+ * random data of many sizes in both formats, especially around the
+ * boundaries of OpenPGP's partial body chunks and length encodings, and
+ * of the chunked format's chunks, and checks that the encrypted files
+ * are exactly as big as predicted.
+ */
+int main() {
+    const long long partial = PgpEncrypter::PARTIAL_LENGTH;
+    const long long chunk = ChunkedEncrypter::CHUNK_SIZE;
+    vector<long long> sizes;
+    for (long long size = 0; size < 400; ++size) {
+        sizes.push_back(size);
+    }
+    for (long long size = 8300; size < 8400; ++size) {
+        sizes.push_back(size);
+    }
+    for (int chunks = 1; chunks <= 3; ++chunks) {
+        for (long long size = chunks * partial - 80;
+             size < chunks * partial + 10;
+             ++size) {
+            sizes.push_back(size);
+        }
+    }
+
+    int failures = 0;
+    for (vector<long long>::const_iterator iter = sizes.begin();
+         iter != sizes.end();
+         ++iter) {
+        failures += !check(Encrypter::OPENPGP, *iter);
+    }
+    long long chunkedSizes[] = {0, 1, chunk - 1, chunk, chunk + 1,
+                                2 * chunk, 2 * chunk + 12345};
+    for (size_t i = 0; i < sizeof(chunkedSizes) / sizeof(*chunkedSizes); ++i) {
+        failures += !check(Encrypter::CHUNKED, chunkedSizes[i]);
+    }
+
+    unlink(PLAIN_FILE);
+    unlink(ENCRYPTED_FILE);
+    cout << sizes.size() + sizeof(chunkedSizes) / sizeof(*chunkedSizes)
+         << " sizes checked, " << failures << " wrong" << endl;
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/*
+ * test_tar_extractor.cpp: test program for class TarExtractor
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "tar_extractor.hh"
+#include "fsource.hh"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+using std::string;
+
+/**
+ * appends a ustar member to an archive in memory
+ */
+static void addMember(string & archive, const string & name, char type,
+                      const string & linkName, const string & data) {
+    char header[512];
+    memset(header, 0, sizeof(header));
+    strncpy(header, name.c_str(), 100);
+    sprintf(header + 100, "%07o", (type == '5') ? 0755 : 0644);
+    sprintf(header + 108, "%07o", 0);
+    sprintf(header + 116, "%07o", 0);
+    sprintf(header + 124, "%011o", unsigned(data.size()));
+    sprintf(header + 136, "%011o", 0);
+    header[156] = type;
+    strncpy(header + 157, linkName.c_str(), 100);
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        sum += (unsigned char)header[i];
+    }
+    sprintf(header + 148, "%06o", sum);
+    header[155] = ' ';
+    archive.append(header, sizeof(header));
+    archive += data;
+    archive.append((512 - data.size() % 512) % 512, '\0');
+}
+
+/**
+ * extracts an archive with a symbolic link that points outside the
+ * directory, followed by members below the link, once into an empty
+ * directory and once into one that has such a link already.
+ *
+ * @return true if nothing has been written outside
+ */
+static bool testEscape(const string & directory) {
+    string outside = directory + "/outside";
+    system(("rm -rf " + directory).c_str());
+    mkdir(directory.c_str(), 0700);
+    mkdir(outside.c_str(), 0700);
+
+    string archive;
+    addMember(archive, "s", '2', outside, "");
+    addMember(archive, "s/sub/", '5', "", "");
+    addMember(archive, "s/sub/x", '0', "", "escaped\n");
+    archive.append(1024, '\0');
+    string archiveFile = directory + "/escape.tar";
+    int fd = open(archiveFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    write(fd, archive.data(), archive.size());
+    close(fd);
+
+    string targets[2] = {directory + "/new", directory + "/linked"};
+    mkdir(targets[0].c_str(), 0700);
+    mkdir(targets[1].c_str(), 0700);
+    symlink(outside.c_str(), (targets[1] + "/s").c_str());
+
+    bool success = true;
+    for (int i = 0; i < 2; ++i) {
+        KryptoCD::FSource source(archiveFile);
+        KryptoCD::TarExtractor extractor(source, targets[i], 8);
+        extractor.wait();
+        struct stat st;
+        if (lstat((outside + "/sub").c_str(), &st) == 0) {
+            cout << "Written outside " << targets[i] << endl;
+            success = false;
+        }
+        if ((lstat((targets[i] + "/s/sub/x").c_str(), &st) != 0)
+            || !S_ISREG(st.st_mode)) {
+            cout << "Not extracted into " << targets[i] << ": s/sub/x"
+                 << endl;
+            success = false;
+        }
+    }
+    if (success) {
+        cout << "Nothing written outside" << endl;
+    }
+    return success;
+}
+
+/**
+ * This is a test program for class TarExtractor. It expects the filename of
+ * a tar archive and a directory as its first command line arguments, and
+ * extracts the archive into the directory with 8 writer threads. Further
+ * arguments select the members to extract.
+ * <p>
+ * With only a directory as argument, it checks that an archive cannot
+ * write outside the directory it is extracted into, see testEscape(). The
+ * directory is removed first.
+ */
+int main(int argc, char ** argv) {
+    if (argc == 2) {
+        return testEscape(argv[1]) ? 0 : 1;
+    }
+    if (argc < 3) {
+        return 1;
+    }
+
+    KryptoCD::FSource source(argv[1]);
+    std::vector<std::string> selection(argv + 3, argv + argc);
+
+    KryptoCD::TarExtractor * extractor =
+        new KryptoCD::TarExtractor(source, argv[2], 8,
+                                   (argc > 3) ? &selection : 0);
+    extractor->wait();
+
+    cout << extractor->getExtractedCount() << " members extracted" << endl;
+    const std::vector<std::string> & failed = extractor->getFailedFiles();
+    for (size_t i = 0; i < failed.size(); ++i) {
+        cout << "Could not extract: " << failed[i] << endl;
+    }
+    if (extractor->archiveFailed()) {
+        cout << "The archive is damaged." << endl;
+    }
+    int result = (failed.empty() && !extractor->archiveFailed()) ? 0 : 1;
+    delete extractor;
+    return result;
+}
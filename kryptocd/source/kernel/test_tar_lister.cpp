@@ -41,12 +41,19 @@ int main(int argc, char**argv) {
 
     KryptoCD::FSource source(argv[1]);
 
-    KryptoCD::TarLister * tar = new KryptoCD::TarLister("/bin/tar", source);
+    KryptoCD::TarLister * tar = new KryptoCD::TarLister(source);
 
-    std::list<std::string> fileList = tar->getFileList();
+    const KryptoCD::PathList & fileList = tar->getFileList();
+    const KryptoCD::PathStore & paths = tar->getPathStore();
+    const vector<KryptoCD::TarLister::Member> & members = tar->getMembers();
 
-    for (std::list<std::string>::const_iterator i=fileList.begin();
-         i != fileList.end(); ++i) {
-        cout << "Found tar member: "<< *i << endl;
+    for (size_t i = 0; i < fileList.size(); ++i) {
+        cout << "Found tar member: "<< paths.getPath(fileList[i])
+             << "  offset " << members[i].offset
+             << ", " << members[i].size << " bytes" << endl;
     }
+    if (tar->failed()) {
+        cout << "The archive is damaged." << endl;
+    }
+    delete tar;
 }
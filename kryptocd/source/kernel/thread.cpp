@@ -28,7 +28,8 @@
 using KryptoCD::Thread;
 
 Thread::Thread()
-    : threadStarted(false)
+    : threadStarted(false),
+      threadJoined(false)
 {
     mutex = new pthread_mutex_t;
 
@@ -40,7 +41,7 @@ Thread::~Thread() {
     /** the return value of a pthread_mutex_destroy call */
     int mutexDestroyVal;
 
-    pthread_join(thread, 0);
+    join();
     mutexDestroyVal = pthread_mutex_destroy(mutex);
     assert (mutexDestroyVal == 0);
     delete (mutex);
@@ -55,6 +56,13 @@ bool Thread::isStarted(void) const {
     return returnValue;
 }
 
+void Thread::join(void) {
+    if (threadStarted && !threadJoined) {
+        pthread_join(thread, 0);
+        threadJoined = true;
+    }
+}
+
 int Thread::start() {
     int success = pthread_mutex_trylock(mutex);
 
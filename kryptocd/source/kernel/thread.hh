@@ -73,6 +73,15 @@ namespace KryptoCD {
          */
         bool isStarted(void) const;
 
+        /**
+         * waits until the thread has exited. The destructor of Thread does
+         * this too, but then the derived object is already destroyed, and a
+         * thread that has not yet reached run() would call a pure virtual
+         * method. Derived classes should therefore call join() in their own
+         * destructor. Calling it more than once is harmless.
+         */
+        void join(void);
+
     protected:
         /**
          * Overwrite the run method, it will be executed by the new thread.
@@ -100,6 +109,11 @@ namespace KryptoCD {
          * will be set to true by method start
          */
         bool              threadStarted;
+
+        /**
+         * will be set to true by method join
+         */
+        bool              threadJoined;
     };
 }
 
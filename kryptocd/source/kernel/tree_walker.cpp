@@ -0,0 +1,345 @@
+/*
+ * tree_walker.cpp: class TreeWalker implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tree_walker.hh"
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <assert.h>
+
+using KryptoCD::TreeWalker;
+using KryptoCD::PathStore;
+using KryptoCD::PathList;
+using KryptoCD::PathId;
+using std::string;
+using std::vector;
+
+/**
+ * the size of the buffer for getdents64. Big directories on network file
+ * systems are read with fewer round trips this way.
+ */
+static const size_t GETDENTS_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * the number of directory file descriptors that queued directories may
+ * hold at the same time. Directories beyond this limit are opened by name.
+ */
+static const int MAX_OPEN_DESCRIPTORS = 256;
+
+/**
+ * the records returned by the getdents64 system call
+ */
+struct LinuxDirent64 {
+    unsigned long long d_ino;
+    long long          d_off;
+    unsigned short     d_reclen;
+    unsigned char      d_type;
+    char               d_name[1];
+};
+
+namespace {
+    /**
+     * orders the entries of a directory by name
+     */
+    template <class Entry>
+    class ByName {
+        const vector<char> & names;
+    public:
+        ByName(const vector<char> & n) : names(n) {}
+        bool operator()(const Entry & a, const Entry & b) const {
+            return strcmp(&names[a.nameOffset], &names[b.nameOffset]) < 0;
+        }
+    };
+}
+
+TreeWalker::TreeWalker(PathStore & paths_, int threads_)
+    : paths(paths_),
+      threads(threads_),
+      openDescriptors(0),
+      finished(false),
+      mutex(new pthread_mutex_t),
+      queued(new pthread_cond_t),
+      completed(new pthread_cond_t)
+{
+    assert(threads > 0);
+    pthread_mutex_init(mutex, 0);
+    pthread_cond_init(queued, 0);
+    pthread_cond_init(completed, 0);
+}
+
+TreeWalker::~TreeWalker() {
+    int destroyVal = pthread_mutex_destroy(mutex);
+    assert (destroyVal == 0);
+    delete mutex;
+    destroyVal = pthread_cond_destroy(queued);
+    assert (destroyVal == 0);
+    delete queued;
+    destroyVal = pthread_cond_destroy(completed);
+    assert (destroyVal == 0);
+    delete completed;
+}
+
+void TreeWalker::walk(const string & root,
+                      PathList & files,
+                      PathList & unreadable)
+    throw(TreeWalker::Exception) {
+    if (root.empty() || (root[0] != '/')) {
+        throw Exception(Exception::ROOT_NOT_ABSOLUTE);
+    }
+    string rootPath = root;
+    if (rootPath[rootPath.length() - 1] != '/') {
+        rootPath += '/';
+    }
+    int fd = open(rootPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw Exception(Exception::UNABLE_TO_OPEN_ROOT);
+    }
+
+    Directory * rootDirectory = new Directory(rootPath, fd);
+    openDescriptors = 1;
+    finished = false;
+    queue.push_back(rootDirectory);
+
+    vector<Worker *> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(new Worker(*this));
+        int success = workers.back()->start();
+        assert(success == 0);
+    }
+
+    PathId rootId = paths.intern(rootPath);
+    files.push_back(rootId);
+    consume(rootDirectory, rootId, files, unreadable);
+
+    /* every directory has been consumed, so the queue is empty: */
+    pthread_mutex_lock(mutex);
+    assert(queue.empty());
+    finished = true;
+    pthread_cond_broadcast(queued);
+    pthread_mutex_unlock(mutex);
+
+    /* the Worker destructor joins the thread */
+    for (vector<Worker *>::iterator iter = workers.begin();
+         iter != workers.end();
+         ++iter) {
+        delete *iter;
+    }
+    assert(openDescriptors == 0);
+}
+
+void * TreeWalker::Worker::run(void) {
+    walker.work();
+    return this;
+}
+
+void TreeWalker::work(void) {
+    vector<char> buffer(GETDENTS_BUFFER_SIZE);
+
+    pthread_mutex_lock(mutex);
+    for (;;) {
+        while (queue.empty() && !finished) {
+            pthread_cond_wait(queued, mutex);
+        }
+        if (finished) {
+            break;
+        }
+        Directory * directory = queue.back();
+        queue.pop_back();
+        pthread_mutex_unlock(mutex);
+
+        /*
+         * read the directory without holding the mutex. Only descriptors
+         * opened while queueing are counted, the ones opened by name here
+         * are never more than one per thread.
+         */
+        bool counted = (directory->fd >= 0);
+        readDirectory(*directory, buffer);
+        if (directory->fd >= 0) {
+            openSubdirectories(*directory);
+            close(directory->fd);
+            directory->fd = -1;
+        }
+
+        pthread_mutex_lock(mutex);
+        if (counted) {
+            --openDescriptors;
+        }
+        /* queue the subdirectories so that the first one is taken first */
+        for (vector<Directory::Entry>::reverse_iterator iter =
+                 directory->entries.rbegin();
+             iter != directory->entries.rend();
+             ++iter) {
+            if (iter->subdirectory != 0) {
+                queue.push_back(iter->subdirectory);
+            }
+        }
+        directory->done = true;
+        pthread_cond_broadcast(queued);
+        pthread_cond_broadcast(completed);
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+void TreeWalker::readDirectory(Directory & directory, vector<char> & buffer) {
+    if (directory.fd < 0) {
+        directory.fd = open(directory.path.c_str(),
+                            O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (directory.fd < 0) {
+            directory.failed = true;
+            return;
+        }
+    }
+
+    for (;;) {
+        long bytes = syscall(SYS_getdents64, directory.fd,
+                             &buffer[0], buffer.size());
+        if (bytes <= 0) {
+            directory.failed = (bytes < 0);
+            break;
+        }
+        for (long position = 0; position < bytes; ) {
+            const LinuxDirent64 * record =
+                reinterpret_cast<const LinuxDirent64 *>(&buffer[position]);
+            position += record->d_reclen;
+
+            const char * name = record->d_name;
+            if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0)) {
+                continue;
+            }
+
+            bool isDirectory;
+            if (record->d_type == DT_UNKNOWN) {
+                /* some file systems do not tell the type */
+                struct stat st;
+                isDirectory = (fstatat(directory.fd, name, &st,
+                                       AT_SYMLINK_NOFOLLOW) == 0)
+                    && S_ISDIR(st.st_mode);
+            } else {
+                isDirectory = (record->d_type == DT_DIR);
+            }
+
+            Directory::Entry entry;
+            size_t length = strlen(name);
+            entry.nameOffset = directory.names.size();
+            entry.nameLength = length + (isDirectory ? 1 : 0);
+            directory.names.insert(directory.names.end(),
+                                   name, name + length);
+            if (isDirectory) {
+                directory.names.push_back('/');
+            }
+            directory.names.push_back('\0');
+            entry.subdirectory = 0;
+            directory.entries.push_back(entry);
+        }
+    }
+
+    std::sort(directory.entries.begin(), directory.entries.end(),
+              ByName<Directory::Entry>(directory.names));
+
+    for (vector<Directory::Entry>::iterator iter = directory.entries.begin();
+         iter != directory.entries.end();
+         ++iter) {
+        if (directory.names[iter->nameOffset + iter->nameLength - 1] == '/') {
+            iter->subdirectory =
+                new Directory(directory.path
+                              + &directory.names[iter->nameOffset], -1);
+        }
+    }
+}
+
+void TreeWalker::openSubdirectories(Directory & directory) {
+    int subdirectories = 0;
+    for (vector<Directory::Entry>::const_iterator iter =
+             directory.entries.begin();
+         iter != directory.entries.end();
+         ++iter) {
+        if (iter->subdirectory != 0) {
+            ++subdirectories;
+        }
+    }
+
+    /* reserve descriptors for as many subdirectories as permitted: */
+    pthread_mutex_lock(mutex);
+    int granted = MAX_OPEN_DESCRIPTORS - openDescriptors;
+    if (granted > subdirectories) {
+        granted = subdirectories;
+    }
+    if (granted < 0) {
+        granted = 0;
+    }
+    openDescriptors += granted;
+    pthread_mutex_unlock(mutex);
+
+    /* the first subdirectories will be read first, they get them: */
+    int used = 0;
+    for (vector<Directory::Entry>::iterator iter = directory.entries.begin();
+         (iter != directory.entries.end()) && (used < granted);
+         ++iter) {
+        if (iter->subdirectory != 0) {
+            iter->subdirectory->fd =
+                openat(directory.fd, &directory.names[iter->nameOffset],
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            if (iter->subdirectory->fd >= 0) {
+                ++used;
+            }
+            /* else the worker retries by name, and reports the failure */
+        }
+    }
+
+    /* give back what we did not use: */
+    pthread_mutex_lock(mutex);
+    openDescriptors -= granted - used;
+    pthread_mutex_unlock(mutex);
+}
+
+void TreeWalker::consume(Directory * directory, PathId directoryId,
+                         PathList & files, PathList & unreadable) {
+    pthread_mutex_lock(mutex);
+    while (!directory->done) {
+        pthread_cond_wait(completed, mutex);
+    }
+    pthread_mutex_unlock(mutex);
+
+    if (directory->failed) {
+        unreadable.push_back(directoryId);
+    }
+    for (vector<Directory::Entry>::const_iterator iter =
+             directory->entries.begin();
+         iter != directory->entries.end();
+         ++iter) {
+        PathId id = paths.internChild(directoryId,
+                                      &directory->names[iter->nameOffset],
+                                      iter->nameLength);
+        files.push_back(id);
+        if (iter->subdirectory != 0) {
+            consume(iter->subdirectory, id, files, unreadable);
+        }
+    }
+    delete directory;
+}
@@ -0,0 +1,222 @@
+/*
+ * tree_walker.hh: class TreeWalker header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef TREE_WALKER_HH
+#define TREE_WALKER_HH
+
+#include "path_store.hh"
+#include "thread.hh"
+#include <string>
+#include <vector>
+
+namespace KryptoCD {
+    /**
+     * Class TreeWalker expands a directory into the complete list of files
+     * that Image::create() expects: every file and directory below it, with
+     * directory names ending in '/', each directory preceeding its contents.
+     * <p>
+     * Several threads read directories at the same time, with the
+     * getdents64 system call and with openat() relative to the already open
+     * parent directory, so no path name is resolved twice by the kernel.
+     * The calling thread meanwhile consumes the finished directories in
+     * depth first order, sorting each directory's entries by name, and
+     * appends them to the file list. The result therefore does not depend
+     * on the number of threads or on their timing, and the first entries
+     * are available while the rest of the tree is still being read.
+     * <p>
+     * Symbolic links are listed, but not followed. Directories that cannot
+     * be read are listed without their contents.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class TreeWalker {
+    public:
+        class Exception{
+        public:
+            enum Reason {
+                ROOT_NOT_ABSOLUTE,
+                UNABLE_TO_OPEN_ROOT,
+            } reason;
+            Exception(Reason r) : reason(r) {}
+        };
+
+        /**
+         * @param paths   the store where the file names are interned
+         * @param threads the number of threads reading directories
+         */
+        TreeWalker(PathStore & paths, int threads);
+
+        ~TreeWalker();
+
+        /**
+         * lists a directory tree. The store must not be used by other
+         * threads while walk() runs.
+         *
+         * @param root       the absolute name of the directory to walk. A
+         *                   missing trailing '/' is added.
+         * @param files      the root and everything below it are appended
+         *                   to this list
+         * @param unreadable directories that could not be opened or read
+         *                   are appended to this list. They are still
+         *                   contained in "files".
+         * @exception TreeWalker::Exception
+         *                   ROOT_NOT_ABSOLUTE if root does not start with
+         *                   '/', UNABLE_TO_OPEN_ROOT if root cannot be opened
+         *                   as a directory
+         */
+        void walk(const std::string & root,
+                  PathList & files,
+                  PathList & unreadable)
+            throw(Exception);
+
+    private:
+        /**
+         * a directory that has been found, and whose entries are read by a
+         * worker thread
+         */
+        struct Directory {
+            /**
+             * the complete name, ending with '/'
+             */
+            std::string path;
+
+            /**
+             * an open file descriptor of the directory, or -1 if the worker
+             * has to open it by name
+             */
+            int fd;
+
+            /**
+             * set by the worker when the entries are complete
+             */
+            bool done;
+
+            /**
+             * set by the worker if the directory could not be read
+             */
+            bool failed;
+
+            /**
+             * the names of all entries, NUL separated. Names of
+             * subdirectories include their trailing '/'.
+             */
+            std::vector<char> names;
+
+            /**
+             * one entry in the directory, sorted by name once done
+             */
+            struct Entry {
+                unsigned    nameOffset;
+                unsigned    nameLength;
+                Directory * subdirectory;
+            };
+            std::vector<Entry> entries;
+
+            Directory(const std::string & p, int f)
+                : path(p), fd(f), done(false), failed(false) {}
+        };
+
+        /**
+         * a worker thread
+         */
+        class Worker : public Thread {
+            TreeWalker & walker;
+        public:
+            Worker(TreeWalker & w) : walker(w) {}
+            virtual ~Worker() {join();}
+        protected:
+            virtual void * run(void);
+        };
+        friend class Worker;
+
+        /**
+         * the work of one worker thread: read queued directories until
+         * walk() is finished
+         */
+        void work(void);
+
+        /**
+         * reads all entries of one directory, sorts them, and creates the
+         * Directory objects of its subdirectories. Called by a worker
+         * without holding the mutex.
+         *
+         * @param directory the directory to read
+         * @param buffer    a buffer for getdents64
+         */
+        void readDirectory(Directory & directory, std::vector<char> & buffer);
+
+        /**
+         * opens the subdirectories of a directory relative to it, as far as
+         * the limit on open file descriptors permits
+         *
+         * @param directory a directory that has been read, with its
+         *                  descriptor still open
+         */
+        void openSubdirectories(Directory & directory);
+
+        /**
+         * appends the entries of a directory and of all its subdirectories
+         * to the file list, waiting for the workers where necessary, and
+         * deletes the Directory objects. Called by walk().
+         *
+         * @param directory   the directory, already in the file list
+         * @param directoryId its PathId
+         * @param files       the file list
+         * @param unreadable  the list of unreadable directories
+         */
+        void consume(Directory * directory, PathId directoryId,
+                     PathList & files, PathList & unreadable);
+
+        PathStore & paths;
+        int threads;
+
+        /**
+         * directories waiting for a worker. Workers take from the back, so
+         * the tree is read roughly in the order walk() consumes it.
+         */
+        std::vector<Directory *> queue;
+
+        /**
+         * the number of file descriptors opened with openat() for queued
+         * directories and not yet closed
+         */
+        int openDescriptors;
+
+        /**
+         * set by walk() when all directories have been consumed
+         */
+        bool finished;
+
+        /**
+         * protects all of the above and the "done" flags of the
+         * directories. "queued" is signalled when the queue grows or walk()
+         * is finished, "completed" when a directory is done.
+         */
+        pthread_mutex_t * mutex;
+        pthread_cond_t  * queued;
+        pthread_cond_t  * completed;
+    };
+}
+#endif
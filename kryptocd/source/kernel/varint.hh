@@ -0,0 +1,92 @@
+/*
+ * varint.hh: variable length integer encoding
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef VARINT_HH
+#define VARINT_HH
+
+#include <string>
+#include <stdio.h>
+
+namespace KryptoCD {
+    /**
+     * appends an unsigned number as a variable length integer: 7 bits per
+     * byte, least significant first, the high bit set on all but the last
+     * byte. Used by the file formats of Snapshot, ChunkIndex and
+     * DedupFilter.
+     */
+    inline void putNumber(std::string & out, unsigned long long n) {
+        while (n >= 0x80) {
+            out += char((n & 0x7f) | 0x80);
+            n >>= 7;
+        }
+        out += char(n);
+    }
+
+    /**
+     * appends a signed number, zigzag encoded so that small negative
+     * numbers stay short
+     */
+    inline void putSignedNumber(std::string & out, long long n) {
+        putNumber(out, (static_cast<unsigned long long>(n) << 1)
+                       ^ static_cast<unsigned long long>(n >> 63));
+    }
+
+    /**
+     * reads a number written by putNumber
+     *
+     * @param in anything with a method get() that returns the next byte,
+     *           or EOF, like an istream
+     * @return   false on end of file or if the number is too long
+     */
+    template <class Input>
+    bool getNumber(Input & in, unsigned long long & n) {
+        n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = in.get();
+            if (c == EOF) {
+                return false;
+            }
+            n |= static_cast<unsigned long long>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * reads a number written by putSignedNumber
+     */
+    template <class Input>
+    bool getSignedNumber(Input & in, long long & n) {
+        unsigned long long u;
+        if (!getNumber(in, u)) {
+            return false;
+        }
+        n = static_cast<long long>(u >> 1) ^ -static_cast<long long>(u & 1);
+        return true;
+    }
+}
+#endif
@@ -0,0 +1,160 @@
+/*
+ * xxh64.cpp: class Xxh64 implementation
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "xxh64.hh"
+#include <string.h>
+
+using KryptoCD::Xxh64;
+
+static const unsigned long long PRIME1 = 11400714785074694791ULL;
+static const unsigned long long PRIME2 = 14029467366897019727ULL;
+static const unsigned long long PRIME3 =  1609587929392839161ULL;
+static const unsigned long long PRIME4 =  9650029242287828579ULL;
+static const unsigned long long PRIME5 =  2870177450012600261ULL;
+
+static inline unsigned long long rotl(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * reads little endian numbers independent of the host byte order
+ */
+static inline unsigned long long read64(const unsigned char * p) {
+    return static_cast<unsigned long long>(p[0])
+        | (static_cast<unsigned long long>(p[1]) << 8)
+        | (static_cast<unsigned long long>(p[2]) << 16)
+        | (static_cast<unsigned long long>(p[3]) << 24)
+        | (static_cast<unsigned long long>(p[4]) << 32)
+        | (static_cast<unsigned long long>(p[5]) << 40)
+        | (static_cast<unsigned long long>(p[6]) << 48)
+        | (static_cast<unsigned long long>(p[7]) << 56);
+}
+
+static inline unsigned long long read32(const unsigned char * p) {
+    return static_cast<unsigned long long>(p[0])
+        | (static_cast<unsigned long long>(p[1]) << 8)
+        | (static_cast<unsigned long long>(p[2]) << 16)
+        | (static_cast<unsigned long long>(p[3]) << 24);
+}
+
+static inline unsigned long long stripeRound(unsigned long long acc,
+                                             unsigned long long input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline unsigned long long mergeRound(unsigned long long acc,
+                                            unsigned long long value) {
+    acc ^= stripeRound(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+Xxh64::Xxh64(unsigned long long seed_)
+    : seed(seed_),
+      total(0),
+      v1(seed_ + PRIME1 + PRIME2),
+      v2(seed_ + PRIME2),
+      v3(seed_),
+      v4(seed_ - PRIME1),
+      stripeLength(0)
+{}
+
+void Xxh64::update(const void * data, size_t length) {
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    const unsigned char * end = p + length;
+
+    total += length;
+    if (stripeLength + length < 32) {
+        memcpy(stripe + stripeLength, p, length);
+        stripeLength += length;
+        return;
+    }
+    if (stripeLength > 0) {
+        size_t fill = 32 - stripeLength;
+        memcpy(stripe + stripeLength, p, fill);
+        p += fill;
+        v1 = stripeRound(v1, read64(stripe));
+        v2 = stripeRound(v2, read64(stripe + 8));
+        v3 = stripeRound(v3, read64(stripe + 16));
+        v4 = stripeRound(v4, read64(stripe + 24));
+        stripeLength = 0;
+    }
+    while (end - p >= 32) {
+        v1 = stripeRound(v1, read64(p));
+        v2 = stripeRound(v2, read64(p + 8));
+        v3 = stripeRound(v3, read64(p + 16));
+        v4 = stripeRound(v4, read64(p + 24));
+        p += 32;
+    }
+    stripeLength = end - p;
+    memcpy(stripe, p, stripeLength);
+}
+
+unsigned long long Xxh64::digest(void) const {
+    unsigned long long h;
+
+    if (total >= 32) {
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += total;
+
+    const unsigned char * p = stripe;
+    const unsigned char * end = stripe + stripeLength;
+    while (end - p >= 8) {
+        h ^= stripeRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+unsigned long long Xxh64::hash(const void * data, size_t length,
+                               unsigned long long seed) {
+    Xxh64 hasher(seed);
+    hasher.update(data, length);
+    return hasher.digest();
+}
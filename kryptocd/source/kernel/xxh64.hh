@@ -0,0 +1,76 @@
+/*
+ * xxh64.hh: class Xxh64 header file
+ *
+ * $Id$
+ *
+ * This file is part of KryptoCD
+ * (c) 2001 Tobias Peters
+ * see file COPYING for the copyright terms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef XXH64_HH
+#define XXH64_HH
+
+#include <stddef.h>
+
+namespace KryptoCD {
+    /**
+     * Class Xxh64 computes the 64 bit XXH64 hash of a byte stream, as
+     * defined by Yann Collet's xxHash. It is not a cryptographic hash, but
+     * it processes several bytes per clock cycle with four independent
+     * accumulators, so fingerprinting file contents costs little more than
+     * reading them.
+     *
+     * @author  Tobias Peters
+     * @version $Revision$ $Date$
+     */
+    class Xxh64 {
+    public:
+        /**
+         * @param seed a value that changes all hashes
+         */
+        Xxh64(unsigned long long seed = 0);
+
+        /**
+         * hashes the next part of the stream
+         */
+        void update(const void * data, size_t length);
+
+        /**
+         * @return the hash of all bytes passed to update() so far
+         */
+        unsigned long long digest(void) const;
+
+        /**
+         * hashes a single buffer
+         */
+        static unsigned long long hash(const void * data, size_t length,
+                                       unsigned long long seed = 0);
+
+    private:
+        unsigned long long seed;
+        unsigned long long total;
+        unsigned long long v1, v2, v3, v4;
+
+        /**
+         * bytes of an incomplete 32 byte stripe
+         */
+        unsigned char stripe[32];
+        size_t stripeLength;
+    };
+}
+#endif